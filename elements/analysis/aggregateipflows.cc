@@ -583,10 +583,113 @@ AggregateIPFlows::pull(int)
     return 0;
 }
 
-enum { H_CLEAR };
+void
+AggregateIPFlows::unparse_flow_state(StringAccum &sa, const Map &m, int ip_p, uint32_t &count) const
+{
+    for (Map::const_iterator iter = m.begin(); iter.live(); iter++)
+	for (FlowInfo *f = iter.value()._flows; f; f = f->_next) {
+	    FlowStateRecord r;
+	    memset(&r, 0, sizeof(r));
+	    r.a = iter.key().a;
+	    r.b = iter.key().b;
+	    r.ports = f->_ports;
+	    r.aggregate = htonl(f->_aggregate);
+	    r.last_sec = htonl(f->_last_timestamp.sec());
+	    r.last_usec = htonl(f->_last_timestamp.usec());
+	    r.ip_p = ip_p;
+	    r.flow_over = f->_flow_over;
+	    r.reverse = f->_reverse;
+	    sa.append(reinterpret_cast<const char *>(&r), sizeof(r));
+	    count++;
+	}
+}
+
+int
+AggregateIPFlows::parse_flow_state(const String &str, ErrorHandler *errh)
+{
+    FlowStateHeader h;
+    if (str.length() < (int) sizeof(h))
+	return errh->error("flow state too short");
+    memcpy(&h, str.data(), sizeof(h));
+    uint32_t count = ntohl(h.count);
+    if (memcmp(h.magic, "AGGFLOWS", sizeof(h.magic)) != 0
+	|| ntohl(h.version) != 1)
+	return errh->error("bad flow state header");
+    if ((str.length() - sizeof(h)) / sizeof(FlowStateRecord) < count)
+	return errh->error("flow state truncated");
+
+    const char *x = str.data() + sizeof(h);
+    for (uint32_t i = 0; i < count; i++, x += sizeof(FlowStateRecord)) {
+	FlowStateRecord r;
+	memcpy(&r, x, sizeof(r));
+	if (r.ip_p != IP_PROTO_TCP && r.ip_p != IP_PROTO_UDP)
+	    continue;
+	Map &m = (r.ip_p == IP_PROTO_TCP ? _tcp_map : _udp_map);
+	HostPairInfo *hpinfo = &m[HostPair(r.a, r.b)];
+	FlowInfo *finfo;
+	for (finfo = hpinfo->_flows; finfo; finfo = finfo->_next)
+	    if (finfo->_ports == r.ports)
+		break;
+	if (finfo)
+	    continue;
+
+	uint32_t agg = ntohl(r.aggregate);
+#if CLICK_USERLEVEL
+	if (stats()) {
+	    StatFlowInfo *sinfo = new StatFlowInfo(r.ports, hpinfo->_flows, agg);
+	    sinfo->_first_timestamp = Timestamp::make_usec(ntohl(r.last_sec), ntohl(r.last_usec));
+	    sinfo->_filepos = 0;
+	    finfo = sinfo;
+	} else
+#endif
+	    finfo = new FlowInfo(r.ports, hpinfo->_flows, agg);
+	finfo->_last_timestamp = Timestamp::make_usec(ntohl(r.last_sec), ntohl(r.last_usec));
+	finfo->_flow_over = r.flow_over & 3;
+	finfo->_reverse = r.reverse;
+	hpinfo->_flows = finfo;
+	notify(agg, AggregateListener::NEW_AGG, 0);
+    }
+
+    // circular comparisons, as elsewhere
+    uint32_t next = ntohl(h.next), active_sec = ntohl(h.active_sec);
+    if ((int32_t) (next - _next) > 0)
+	_next = next;
+    if (SEC_OLDER(_active_sec, active_sec))
+	_active_sec = active_sec;
+    return 0;
+}
+
+enum { H_CLEAR, H_FLOW_STATE };
+
+String
+AggregateIPFlows::read_handler(Element *e, void *thunk)
+{
+    AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
+    switch ((intptr_t)thunk) {
+      case H_FLOW_STATE: {
+	  StringAccum sa;
+	  FlowStateHeader h;
+	  sa.append(reinterpret_cast<const char *>(&h), sizeof(h));
+	  uint32_t count = 0;
+	  af->unparse_flow_state(sa, af->_tcp_map, IP_PROTO_TCP, count);
+	  af->unparse_flow_state(sa, af->_udp_map, IP_PROTO_UDP, count);
+	  if (sa.out_of_memory())
+	      return String::make_out_of_memory();
+	  memcpy(h.magic, "AGGFLOWS", sizeof(h.magic));
+	  h.version = htonl(1);
+	  h.next = htonl(af->_next);
+	  h.active_sec = htonl(af->_active_sec);
+	  h.count = htonl(count);
+	  memcpy(sa.data(), &h, sizeof(h));
+	  return sa.take_string();
+      }
+      default:
+	return String();
+    }
+}
 
 int
-AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
+AggregateIPFlows::write_handler(const String &str, Element *e, void *thunk, ErrorHandler *errh)
 {
     AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
     switch ((intptr_t)thunk) {
@@ -597,6 +700,8 @@ AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHa
 	  af->_active_sec = active_sec, af->_gc_sec = gc_sec;
 	  return 0;
       }
+      case H_FLOW_STATE:
+	return af->parse_flow_state(str, errh);
       default:
 	return -1;
     }
@@ -606,6 +711,8 @@ void
 AggregateIPFlows::add_handlers()
 {
     add_write_handler("clear", write_handler, (void *)H_CLEAR);
+    add_read_handler("flow_state", read_handler, (void *)H_FLOW_STATE, Handler::RAW);
+    add_write_handler("flow_state", write_handler, (void *)H_FLOW_STATE, Handler::RAW);
 }
 
 ELEMENT_REQUIRES(AggregateNotifier)
@@ -120,6 +120,17 @@ notifications when new aggregates are created and old ones are deleted.
 Clears all flow information. Future packets will get new aggregate annotation
 values. This may cause packets to be emitted if FRAGMENTS is true.
 
+=h flow_state read/write
+
+Returns a binary snapshot of the current flows: their addresses, ports,
+aggregate numbers, directions, and last packet times, along with the next
+aggregate number. Writing a snapshot adds its flows, so an AggregateIPFlows in
+a restarted router continues the numbering instead of starting new
+aggregates for established flows. Flows already present are left alone.
+Write the snapshot before packets arrive; otherwise the restored aggregate
+numbers may repeat ones this element has already assigned. Fragments held
+by the element are not saved.
+
 =e
 
 This configuration counts the number of packets in each flow in a trace, using
@@ -257,6 +268,32 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
     int handle_fragment(Packet *, HostPairInfo *);
     int handle_packet(Packet *);
 
+    // flow_state snapshots: a FlowStateHeader, then 'count' FlowStateRecords.
+    // Integers are in network byte order; addresses and ports are as in
+    // HostPair and FlowInfo.
+    struct FlowStateHeader {
+	char magic[8];			// "AGGFLOWS"
+	uint32_t version;
+	uint32_t next;
+	uint32_t active_sec;
+	uint32_t count;
+    };
+    struct FlowStateRecord {
+	uint32_t a;
+	uint32_t b;
+	uint32_t ports;
+	uint32_t aggregate;
+	uint32_t last_sec;
+	uint32_t last_usec;
+	uint8_t ip_p;
+	uint8_t flow_over;
+	uint8_t reverse;
+	uint8_t pad;
+    };
+    void unparse_flow_state(StringAccum &, const Map &, int ip_p, uint32_t &count) const;
+    int parse_flow_state(const String &, ErrorHandler *);
+
+    static String read_handler(Element *, void *);
     static int write_handler(const String &, Element *, void *, ErrorHandler *);
 
 };
@@ -72,6 +72,26 @@ EtherEncap::pull(int)
 	return 0;
 }
 
+void
+EtherEncap::push_batch(int, PacketBatch &batch)
+{
+    PacketBatch out;
+    while (Packet *p = batch.pop_front())
+	if (Packet *q = smaction(p))
+	    out.push_back(q);
+    output(0).push_batch(out);
+}
+
+PacketBatch
+EtherEncap::pull_batch(int, unsigned max)
+{
+    PacketBatch in = input(0).pull_batch(max), out;
+    while (Packet *p = in.pop_front())
+	if (Packet *q = smaction(p))
+	    out.push_back(q);
+    return out;
+}
+
 void
 EtherEncap::add_handlers()
 {
@@ -225,6 +225,18 @@ CheckIPHeader::simple_action(Packet *p)
   return(p);
 }
 
+void
+CheckIPHeader::push_batch(int port, PacketBatch &batch)
+{
+    simple_push_batch<CheckIPHeader>(port, batch);
+}
+
+PacketBatch
+CheckIPHeader::pull_batch(int port, unsigned max)
+{
+    return simple_pull_batch<CheckIPHeader>(port, max);
+}
+
 String
 CheckIPHeader::read_handler(Element *e, void *)
 {
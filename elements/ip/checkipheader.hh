@@ -118,6 +118,8 @@ class CheckIPHeader : public Element { public:
   void add_handlers();
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, PacketBatch &batch);
+  PacketBatch pull_batch(int port, unsigned max);
 
   struct OldBadSrcArg {
       static bool parse(const String &str, Vector<IPAddress> &result,
@@ -23,6 +23,7 @@
 #include <click/ipaddress.hh>
 #include <click/straccum.hh>
 #include <click/router.hh>
+#include <click/master.hh>
 #include <click/error.hh>
 CLICK_DECLS
 
@@ -41,7 +42,41 @@ DirectIPLookup::Table::initialize()
     _tbl_24_31_capacity = 4096;
     _vport_capacity = 1024;
     _rtable_capacity = 2048;
+    return allocate();
+}
+
+/** @brief Initialize this table as a copy of @a x. */
+int
+DirectIPLookup::Table::copy(const Table &x)
+{
+    assert(!_tbl_0_23 && !_tbl_24_31 && !_vport && !_rtable && !_rt_hashtbl
+	   && !_tbl_0_23_plen && !_tbl_24_31_plen);
+    _tbl_24_31_capacity = x._tbl_24_31_capacity;
+    _vport_capacity = x._vport_capacity;
+    _rtable_capacity = x._rtable_capacity;
+    if (allocate() < 0)
+	return -ENOMEM;
 
+    memcpy(_tbl_0_23, x._tbl_0_23, (sizeof(uint16_t) + sizeof(uint8_t)) * (1 << 24));
+    memcpy(_tbl_24_31, x._tbl_24_31, sizeof(uint16_t) * _tbl_24_31_capacity);
+    memcpy(_tbl_24_31_plen, x._tbl_24_31_plen, sizeof(uint8_t) * _tbl_24_31_capacity);
+    memcpy(_vport, x._vport, sizeof(VirtualPort) * _vport_capacity);
+    memcpy(_rtable, x._rtable, sizeof(CleartextEntry) * _rtable_capacity);
+    memcpy(_rt_hashtbl, x._rt_hashtbl, sizeof(int) * PREF_HASHSIZE);
+
+    _rtable_size = x._rtable_size;
+    _tbl_24_31_size = x._tbl_24_31_size;
+    _vport_size = x._vport_size;
+    _rt_empty_head = x._rt_empty_head;
+    _tbl_24_31_empty_head = x._tbl_24_31_empty_head;
+    _vport_head = x._vport_head;
+    _vport_empty_head = x._vport_empty_head;
+    return 0;
+}
+
+int
+DirectIPLookup::Table::allocate()
+{
     if ((_tbl_0_23 = (uint16_t *) CLICK_LALLOC((sizeof(uint16_t) + sizeof(uint8_t)) * (1 << 24)))
 	&& (_tbl_24_31 = (uint16_t *) CLICK_LALLOC((sizeof(uint16_t) + sizeof(uint8_t)) * _tbl_24_31_capacity))
 	&& (_vport = (VirtualPort *) CLICK_LALLOC(sizeof(VirtualPort) * _vport_capacity))
@@ -488,6 +523,7 @@ DirectIPLookup::Table::remove_route(const IPRoute& route, IPRoute* old_route, Er
 // DIRECTIPLOOKUP
 
 DirectIPLookup::DirectIPLookup()
+    : _live(&_t[0]), _writer(&_t[0])
 {
 }
 
@@ -499,16 +535,48 @@ int
 DirectIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     int r;
-    if ((r = _t.initialize()) < 0)
+    if ((r = _t[0].initialize()) < 0)
 	return r;
-    _t.flush();
+    _t[0].flush();
     return IPRouteTable::configure(conf, errh);
 }
 
+int
+DirectIPLookup::initialize(ErrorHandler *errh)
+{
+    // Other threads may look up routes while a handler changes them, so
+    // keep a spare copy of the table for update_routes().
+    if (master()->nthreads() > 1 && _t[1].copy(_t[0]) < 0) {
+	_t[1].cleanup();
+	return errh->error("out of memory");
+    }
+    return 0;
+}
+
 void
 DirectIPLookup::cleanup(CleanupStage)
 {
-    _t.cleanup();
+    _t[0].cleanup();
+    _t[1].cleanup();
+}
+
+bool
+DirectIPLookup::use_spare_table(bool spare)
+{
+    if (!_t[1]._tbl_0_23)
+	return false;
+    Table *live = _live;
+    _writer = (spare ? &_t[live == &_t[0]] : live);
+    return true;
+}
+
+void
+DirectIPLookup::swap_tables()
+{
+    Table *old = _live;
+    click_fence();
+    _live = _writer;
+    _writer = old;
 }
 
 void
@@ -528,26 +596,41 @@ DirectIPLookup::push(int, Packet *p)
 int
 DirectIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
 {
+    const Table *t = _live;
     uint32_t ip_addr = ntohl(dest.addr());
-    uint16_t vport_i = _t._tbl_0_23[ip_addr >> 8];
+    uint16_t vport_i = t->_tbl_0_23[ip_addr >> 8];
 
     if (vport_i & 0x8000)
-        vport_i = _t._tbl_24_31[((vport_i & 0x7fff) << 8) | (ip_addr & 0xff)];
+        vport_i = t->_tbl_24_31[((vport_i & 0x7fff) << 8) | (ip_addr & 0xff)];
 
-    gw = _t._vport[vport_i].gw;
-    return _t._vport[vport_i].port;
+    gw = t->_vport[vport_i].gw;
+    return t->_vport[vport_i].port;
 }
 
 int
 DirectIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
-    return _t.add_route(route, allow_replace, old_route, errh);
+    int r;
+    if (_t[1]._tbl_0_23) {
+	IPRoute command = route;
+	command.extra = (allow_replace ? CMD_SET : CMD_ADD);
+	if (forward_update(command, old_route, errh, r))
+	    return r;
+    }
+    return _writer->add_route(route, allow_replace, old_route, errh);
 }
 
 int
 DirectIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler *errh)
 {
-    return _t.remove_route(route, old_route, errh);
+    int r;
+    if (_t[1]._tbl_0_23) {
+	IPRoute command = route;
+	command.extra = CMD_REMOVE;
+	if (forward_update(command, old_route, errh, r))
+	    return r;
+    }
+    return _writer->remove_route(route, old_route, errh);
 }
 
 int
@@ -555,14 +638,24 @@ DirectIPLookup::flush_handler(const String &, Element *e, void *,
 				ErrorHandler *)
 {
     DirectIPLookup *t = static_cast<DirectIPLookup *>(e);
-    t->_t.flush();
+    t->lock_updates();
+    if (!t->use_spare_table(true))
+	t->_writer->flush();
+    else {
+	t->_writer->flush();
+	t->swap_tables();
+	t->master()->wait_grace_period();
+	t->_writer->flush();
+	t->use_spare_table(false);
+    }
+    t->unlock_updates();
     return 0;
 }
 
 String
 DirectIPLookup::dump_routes()
 {
-    return _t.dump();
+    return _writer->dump();
 }
 
 void
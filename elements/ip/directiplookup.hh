@@ -70,6 +70,11 @@ Clears the entire routing table in a single atomic operation.
 See IPRouteTable for a performance comparison of the various IP routing
 elements.
 
+In a multithreaded router, DirectIPLookup keeps a second copy of its table,
+which doubles its memory use. Handler updates change that copy and then
+publish it, so lookups on other threads never see a partly applied update and
+never wait for one.
+
 DirectIPLookup's data structures are inherently limited: at most 2^16 /24
 networks can contain routes for /25-or-smaller subnetworks, no matter how much
 memory you have.  If you need more than this, try RangeIPLookup.
@@ -94,6 +99,7 @@ class DirectIPLookup : public IPRouteTable { public:
     const char *processing() const	{ return PUSH; }
 
     int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
     void cleanup(CleanupStage stage);
     void add_handlers();
 
@@ -165,6 +171,7 @@ class DirectIPLookup : public IPRouteTable { public:
 	}
 
 	int initialize();
+	int copy(const Table &x);
 	void cleanup();
 
 	static inline uint32_t prefix_hash(uint32_t, uint32_t);
@@ -179,11 +186,20 @@ class DirectIPLookup : public IPRouteTable { public:
 	int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
 	void flush();
 
+      private:
+
+	int allocate();
+
     };
 
   protected:
 
-    Table _t;
+    bool use_spare_table(bool spare);
+    void swap_tables();
+
+    Table _t[2];
+    Table * volatile _live;	// used by lookups
+    Table *_writer;		// changed by add_route and remove_route
 
     friend class RangeIPLookup;
 
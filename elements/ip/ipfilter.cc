@@ -1286,6 +1286,8 @@ IPFilter::configure(Vector<String> &conf, ErrorHandler *errh)
     parse_program(zprog, conf, noutputs(), this, errh);
     if (!errh->nerrors()) {
 	_zprog = zprog;
+	static const int base_offsets[] = { offset_mac, offset_net, offset_transp };
+	_sprog.compile(_zprog, base_offsets, 3);
 	return 0;
     } else
 	return -1;
@@ -1377,7 +1379,23 @@ IPFilter::length_checked_match(const IPFilterProgram &zprog, const Packet *p,
 void
 IPFilter::push(int, Packet *p)
 {
-    checked_output_push(match(_zprog, p), p);
+    checked_output_push(match(p), p);
+}
+
+void
+IPFilter::push_batch(int, PacketBatch &batch)
+{
+    // See Classifier::push_batch().
+    PacketBatch run;
+    int run_port = -1;
+    while (Packet *p = batch.pop_front()) {
+	int port = match(p);
+	if (port != run_port)
+	    checked_output_push_batch(run_port, run);
+	run_port = port;
+	run.push_back(p);
+    }
+    checked_output_push_batch(run_port, run);
 }
 
 CLICK_ENDDECLS
@@ -107,6 +107,13 @@ is using to classify packets. At each step in the program, four bytes
 of packet data are ANDed with a mask and compared against four bytes of
 classifier pattern.
 
+IPFilter runs a specialized form of this program, with fixed-size steps that
+read their header word directly, for packets long enough to need no length
+checks; shorter packets fall back to interpreting the program above.
+Consecutive steps that test the same header word, as in large ACLs with one
+rule per host or port, become a single lookup in a sorted table, so such
+rule sets cost a binary search rather than a walk down the rule list.
+
 =a
 
 IPClassifier, Classifier, CheckIPHeader, MarkIPHeader, CheckIPHeader2,
@@ -131,6 +138,7 @@ class IPFilter : public Element { public:
     void add_handlers();
 
     void push(int port, Packet *);
+    void push_batch(int port, PacketBatch &batch);
 
     typedef Classification::Wordwise::CompressedProgram IPFilterProgram;
     static void parse_program(IPFilterProgram &zprog,
@@ -138,6 +146,9 @@ class IPFilter : public Element { public:
 			      const Element *context, ErrorHandler *errh);
     static inline int match(const IPFilterProgram &zprog, const Packet *p);
 
+    inline int match(const Packet *p) const;
+    int match_interpreted(const Packet *p) const { return match(_zprog, p); }
+
     enum {
 	TYPE_NONE	= 0,		// data types
 	TYPE_TYPE	= 1,
@@ -258,6 +269,7 @@ class IPFilter : public Element { public:
   protected:
 
     IPFilterProgram _zprog;
+    Classification::Wordwise::SpecializedProgram _sprog;
 
   private:
 
@@ -298,6 +310,7 @@ class IPFilter : public Element { public:
 	int parse_test(int pos, bool negated);
     };
 
+    static inline int match_length(const Packet *p);
     static int length_checked_match(const IPFilterProgram &zprog,
 				    const Packet *p, int packet_length);
 
@@ -323,15 +336,22 @@ IPFilter::Primitive::negation_is_simple() const
 	return _type == TYPE_HOST || (_type & TYPE_FIELD) || _type == TYPE_IPFRAG;
 }
 
+/** @brief Return @a p's length in the program's offset space. */
 inline int
-IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
+IPFilter::match_length(const Packet *p)
 {
     int packet_length = p->network_length(),
 	network_header_length = p->network_header_length();
     if (packet_length > network_header_length)
-	packet_length += offset_transp - network_header_length;
+	return packet_length + offset_transp - network_header_length;
     else
-	packet_length += offset_net;
+	return packet_length + offset_net;
+}
+
+inline int
+IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
+{
+    int packet_length = match_length(p);
 
     if (zprog.output_everything() >= 0)
 	return zprog.output_everything();
@@ -383,5 +403,19 @@ IPFilter::match(const IPFilterProgram &zprog, const Packet *p)
     }
 }
 
+inline int
+IPFilter::match(const Packet *p) const
+{
+    if (_sprog.empty())
+	return match(_zprog, p);
+    int packet_length = match_length(p);
+    if (packet_length < (int) _sprog.safe_length())
+	return length_checked_match(_zprog, p, packet_length);
+    const unsigned char *base[3] = {
+	p->mac_header() - 2, p->network_header(), p->transport_header()
+    };
+    return _sprog.match(base);
+}
+
 CLICK_ENDDECLS
 #endif
@@ -33,6 +33,7 @@
 #include <click/error.hh>
 #include <click/algorithm.hh>
 #include <click/heap.hh>
+#include <click/master.hh>
 
 #ifdef CLICK_LINUXMODULE
 #include <click/cxxprotect.h>
@@ -63,12 +64,154 @@ IPMapper::rewrite_flowid(IPRewriterInput *, const IPFlowID &, IPFlowID &,
     return IPRewriterBase::rw_drop;
 }
 
+//
+// IPRewriterHeap
+//
+
+IPRewriterHeap::IPRewriterHeap()
+    : _capacity(0x7FFFFFFF), _use_count(1)
+{
+    click_jiffies_t now_j = click_jiffies();
+    for (int which = 0; which < 2; ++which) {
+	_wheel[which] = new IPRewriterFlow *[wheel_slots];
+	memset(_wheel[which], 0, sizeof(IPRewriterFlow *) * wheel_slots);
+	_wheel_now[which] = now_j;
+	_wheel_now_j[which] = now_j;
+	_wheel_count[which] = 0;
+    }
+}
+
+IPRewriterHeap::~IPRewriterHeap()
+{
+    assert(size() == 0);
+    delete[] _wheel[0];
+    delete[] _wheel[1];
+}
+
+/** @brief Move @a flow after a change to its expiry or guarantee. */
+void
+IPRewriterHeap::refile(IPRewriterFlow *flow, bool guaranteed)
+{
+    remove(flow);
+    flow->_guaranteed = guaranteed;
+    restart(flow);
+    file(flow);
+}
+
+/** @brief Return the flow in a class that expires first, or null.
+ * @param guaranteed true for the guaranteed class */
+IPRewriterFlow *
+IPRewriterHeap::earliest(bool guaranteed)
+{
+    Vector<IPRewriterFlow *> &h = _heaps[guaranteed];
+    while (h.size() || wheel_refill(guaranteed)) {
+	IPRewriterFlow *flow = h[0];
+	if (flow->_filed_j == flow->_expiry_j)
+	    return flow;
+	// The flow's expiry moved later since it was filed.
+	pop_heap(h.begin(), h.end(),
+		 IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+	h.pop_back();
+	file(flow);
+    }
+    return 0;
+}
+
+/** @brief Append every flow to @a v. */
+void
+IPRewriterHeap::flows(Vector<IPRewriterFlow *> &v) const
+{
+    for (int which = 0; which < 2; ++which) {
+	for (int i = 0; i < _heaps[which].size(); ++i)
+	    v.push_back(_heaps[which][i]);
+	for (int i = 0; i < wheel_slots; ++i)
+	    for (IPRewriterFlow *f = _wheel[which][i]; f; f = f->_wheel_next)
+		v.push_back(f);
+    }
+}
+
+void
+IPRewriterHeap::wheel_requeue(int which, IPRewriterFlow **slot)
+{
+    IPRewriterFlow *flow = *slot;
+    *slot = 0;
+    while (flow) {
+	IPRewriterFlow *next = flow->_wheel_next;
+	--_wheel_count[which];
+	file(flow);
+	flow = next;
+    }
+}
+
+void
+IPRewriterHeap::wheel_advance(int which, uint64_t now)
+{
+    // Flows before the new _wheel_now move to the heap; flows in a slot
+    // that now matches _wheel_now cascade to lower levels.
+    uint64_t old_now = _wheel_now[which];
+    _wheel_now_j[which] += (click_jiffies_t) (now - old_now);
+    _wheel_now[which] = now;
+    for (int level = 0; level < wheel_levels; ++level) {
+	int shift = level * wheel_bits;
+	unsigned first = (old_now >> shift) & wheel_mask, last;
+	if ((old_now >> (shift + wheel_bits)) != (now >> (shift + wheel_bits)))
+	    last = wheel_mask;
+	else
+	    last = (now >> shift) & wheel_mask;
+	IPRewriterFlow **slot = _wheel[which] + level * wheel_size;
+	for (unsigned i = first; i <= last; ++i)
+	    if (slot[i])
+		wheel_requeue(which, &slot[i]);
+    }
+    if ((old_now >> (wheel_levels * wheel_bits))
+	!= (now >> (wheel_levels * wheel_bits)))
+	wheel_requeue(which, _wheel[which] + wheel_levels * wheel_size);
+}
+
+bool
+IPRewriterHeap::wheel_refill(int which)
+{
+    // Advance the wheel to its earliest nonempty slot until some flows
+    // reach the heap.
+    uint64_t now = _wheel_now[which];
+    while (_heaps[which].empty() && _wheel_count[which]) {
+	uint64_t next = 0;
+	bool found = false;
+	for (int level = 0; level < wheel_levels && !found; ++level) {
+	    int shift = level * wheel_bits;
+	    IPRewriterFlow **slot = _wheel[which] + level * wheel_size;
+	    for (unsigned i = (now >> shift) & wheel_mask; i < wheel_size; ++i)
+		if (slot[i]) {
+		    next = ((now >> (shift + wheel_bits)) << (shift + wheel_bits))
+			| ((uint64_t) i << shift);
+		    // a level-0 slot holds a single tick; move past it
+		    if (level == 0)
+			++next;
+		    found = true;
+		    break;
+		}
+	}
+	if (!found) {
+	    IPRewriterFlow *f = _wheel[which][wheel_levels * wheel_size];
+	    next = tick(which, f->_filed_j);
+	    for (f = f->_wheel_next; f; f = f->_wheel_next)
+		if (tick(which, f->_filed_j) < next)
+		    next = tick(which, f->_filed_j);
+	}
+	wheel_advance(which, next);
+	now = next;
+    }
+    return !_heaps[which].empty();
+}
+
 //
 // IPRewriterBase
 //
 
 IPRewriterBase::IPRewriterBase()
-    : _map(0), _heap(new IPRewriterHeap), _gc_timer(gc_timer_hook, this)
+    : _map(0), _heap(new IPRewriterHeap), _shards(0), _nshards(1),
+      _index(0), _index_shift(0), _restoring(-1),
+      _gc_timer(gc_timer_hook, this)
 {
     _timeouts[0] = default_timeout;
     _timeouts[1] = default_guarantee;
@@ -79,6 +222,15 @@ IPRewriterBase::~IPRewriterBase()
 {
     if (_heap)
 	_heap->unuse();
+    for (int s = 1; s < _nshards; ++s) {
+	for (int i = 0; i < 2; ++i) {
+	    delete _shards[s].maps[i];
+	    delete _shards[s].allocators[i];
+	}
+	_shards[s].heap->unuse();
+    }
+    delete[] _shards;
+    delete[] _index;
 }
 
 
@@ -189,9 +341,70 @@ IPRewriterBase::configure(Vector<String> &conf, ErrorHandler *errh)
     return _input_specs.size() == ninputs() ? 0 : -1;
 }
 
+/** @brief Create one shard per router thread.
+ *
+ * Called by subclasses that support the SHARDED keyword, after
+ * IPRewriterBase::configure().  Makes the shards' heaps and default maps
+ * and divides the mapping capacity among them; the subclass then fills in
+ * the shards' allocators and other maps.  Does nothing unless the driver
+ * runs more than one thread. */
+int
+IPRewriterBase::make_shards(ErrorHandler *errh)
+{
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+    int n = master()->nthreads();
+    if (n < 2)
+	return 0;
+    else if (n > 256)
+	return errh->error("SHARDED supports at most 256 threads");
+    else if (_heap->_use_count > 1)
+	return errh->error("SHARDED rewriters cannot share MAPPING_CAPACITY");
+    _shards = new Shard[n];
+    _nshards = n;
+    int32_t capacity = _heap->_capacity / n;
+    _heap->_capacity = capacity ? capacity : 1;
+    for (int s = 0; s < n; ++s) {
+	Shard &sh = _shards[s];
+	sh.maps[0] = sh.maps[1] = 0;
+	sh.allocators[0] = sh.allocators[1] = 0;
+	sh.heap = _heap;
+	sh.reap = 0;
+	if (s) {
+	    sh.maps[0] = new Map;
+	    sh.heap = new IPRewriterHeap;
+	    sh.heap->_capacity = _heap->_capacity;
+	}
+    }
+    // Split the index into many parts, so that threads seldom wait for
+    // each other, and a part's rehash moves few entries.
+    int nparts = 1, bits = 0;
+    for (; nparts < 64 * n; nparts *= 2)
+	++bits;
+    _index = new IndexPart[nparts];
+    _index_shift = 32 - bits;
+    for (int i = 0; i < _input_specs.size(); ++i)
+	if (_input_specs[i].kind == IPRewriterInput::i_pattern)
+	    _input_specs[i].u.pattern->set_stripes(n);
+#else
+    (void) errh;
+#endif
+    return 0;
+}
+
 int
 IPRewriterBase::initialize(ErrorHandler *errh)
 {
+    if (_shards) {
+	if (_heap->_use_count > 1)
+	    return errh->error("SHARDED rewriters cannot share MAPPING_CAPACITY");
+	for (int i = 0; i < _input_specs.size(); ++i)
+	    if (_input_specs[i].kind == IPRewriterInput::i_mapper)
+		return errh->error("input spec %d: SHARDED rewriters do not support mappers", i);
+	    else if ((_input_specs[i].kind == IPRewriterInput::i_pattern
+		      || _input_specs[i].kind == IPRewriterInput::i_keep)
+		     && _input_specs[i].reply_element != this)
+		return errh->error("input spec %d: SHARDED rewriters must be their own reply element", i);
+    }
     for (int i = 0; i < _input_specs.size(); ++i)
 	if ((_input_specs[i].kind == IPRewriterInput::i_pattern
 	     || _input_specs[i].kind == IPRewriterInput::i_keep)
@@ -206,7 +419,8 @@ IPRewriterBase::initialize(ErrorHandler *errh)
 void
 IPRewriterBase::cleanup(CleanupStage)
 {
-    shrink_heap(true);
+    for (int s = 0; s < _nshards; ++s)
+	shrink_heap(true, s);
     for (int i = 0; i < _input_specs.size(); ++i)
 	if (_input_specs[i].kind == IPRewriterInput::i_pattern)
 	    _input_specs[i].u.pattern->unuse();
@@ -216,7 +430,7 @@ IPRewriterBase::cleanup(CleanupStage)
 IPRewriterEntry *
 IPRewriterBase::get_entry(int ip_p, const IPFlowID &flowid, int input)
 {
-    IPRewriterEntry *m = _map.get(flowid);
+    IPRewriterEntry *m = shard_map(current_shard()).get(flowid);
     if (m && ip_p && m->flow()->ip_p() && m->flow()->ip_p() != ip_p)
 	return 0;
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
@@ -228,33 +442,47 @@ IPRewriterBase::get_entry(int ip_p, const IPFlowID &flowid, int input)
     return m;
 }
 
+/** @brief Add @a flow, which the current thread allocated, to its maps.
+ *
+ * @a map must be the current thread's shard's map. */
 IPRewriterEntry *
 IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
-			   Map &map, Map *reply_map_ptr)
+			   Map &map, Map *reply_map_ptr, int mapid)
 {
+    int s = current_shard();
+    flow->_shard = s;
+    flow->_mapid = mapid;
+    IPRewriterHeap *heap = shard_heap(s);
     IPRewriterBase *reply_element = _input_specs[input].reply_element;
+    lock_shard(s);
+    IPRewriterEntry *result = 0;
+
     if ((unsigned) flow->entry(false).output() >= (unsigned) noutputs()
 	|| (unsigned) flow->entry(true).output() >= (unsigned) reply_element->noutputs()) {
 	flow->owner()->destroy_flow(flow);
-	return 0;
-    }
+	goto done;
+    } else {
+	IPRewriterEntry *old = map.set(&flow->entry(false));
+	assert(!old);
 
-    IPRewriterEntry *old = map.set(&flow->entry(false));
-    assert(!old);
+	if (!reply_map_ptr)
+	    reply_map_ptr = &reply_element->shard_map(s);
+	old = reply_map_ptr->set(&flow->entry(true));
+	if (unlikely(old))	// Assume every map has the same heap.
+	    old->flow()->destroy(heap);
 
-    if (!reply_map_ptr)
-	reply_map_ptr = &reply_element->_map;
-    old = reply_map_ptr->set(&flow->entry(true));
-    if (unlikely(old))		// Assume every map has the same heap.
-	old->flow()->destroy(_heap);
+	if (_index && s != _restoring) {
+	    index_entry(&flow->entry(false), mapid);
+	    index_entry(&flow->entry(true), mapid);
+	}
+    }
 
-    Vector<IPRewriterFlow *> &myheap = _heap->_heaps[flow->guaranteed()];
-    myheap.push_back(flow);
-    push_heap(myheap.begin(), myheap.end(),
-	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
     ++_input_specs[input].count;
+    if (unlikely(s == _restoring))
+	goto balance;
+    heap->insert(flow);
 
-    if (unlikely(_heap->size() > _heap->capacity())) {
+    if (unlikely(heap->size() > heap->capacity())) {
 	// This may destroy the newly added mapping, if it has the lowest
 	// expiration time.  How can we tell?  If (1) flows are added to the
 	// heap one at a time, so the heap was formerly no bigger than the
@@ -262,76 +490,382 @@ IPRewriterBase::store_flow(IPRewriterFlow *flow, int input,
 	// destroy 'flow' if it's the top of the heap.
 	click_jiffies_t now_j = click_jiffies();
 	assert(click_jiffies_less(now_j, flow->expiry())
-	       && _heap->size() == _heap->capacity() + 1);
-	if (shrink_heap_for_new_flow(flow, now_j)) {
+	       && heap->size() == heap->capacity() + 1);
+	if (shrink_heap_for_new_flow(heap, flow, now_j)) {
 	    ++_input_specs[input].failures;
-	    return 0;
+	    goto done;
 	}
     }
 
+  balance:
     if (map.unbalanced())
 	map.rehash(map.bucket_count() + 1);
     if (reply_map_ptr != &map && reply_map_ptr->unbalanced())
 	reply_map_ptr->rehash(reply_map_ptr->bucket_count() + 1);
-    return &flow->entry(false);
+    result = &flow->entry(false);
+
+  done:
+    unlock_shard(s);
+    return result;
+}
+
+/** @brief Find @a flowid in a shard other than @a s.
+ *
+ * On success, returns the entry with its shard locked; the caller must
+ * unlock_shard(entry->flow()->shard()) when done with it.  While the lock
+ * is held the caller may rewrite packets with the flow and change its
+ * expiry in that shard's heap, but not remove it.  The index names the
+ * shard, so a miss costs one index part lock. */
+IPRewriterEntry *
+IPRewriterBase::find_foreign(const IPFlowID &flowid, int s, int mapid)
+{
+    IndexPart &part = index_part(flowid);
+    part.lock.acquire();
+    IPRewriterEntry *m = part.maps[mapid].get(flowid);
+    int t = m ? m->flow()->shard() : s;
+    part.lock.release();
+    if (t != s) {
+	// The owner may have removed the flow since; look again under its lock.
+	lock_shard(t);
+	if ((m = shard_map(t, mapid).get(flowid)))
+	    return m;
+	unlock_shard(t);
+    }
+    return 0;
+}
+
+void
+IPRewriterBase::index_entry(IPRewriterEntry *e, int mapid)
+{
+    IndexPart &part = index_part(e->hashkey());
+    part.lock.acquire();
+    part.maps[mapid].set(e);
+    part.maps[mapid].balance();
+    part.lock.release();
+}
+
+bool
+IPRewriterBase::indexed(const IPFlowID &flowid, int mapid)
+{
+    IndexPart &part = index_part(flowid);
+    part.lock.acquire();
+    bool found = part.maps[mapid].get(flowid);
+    part.lock.release();
+    return found;
+}
+
+void
+IPRewriterBase::unindex_entry(IPRewriterEntry *e, int mapid)
+{
+    IndexPart &part = index_part(e->hashkey());
+    part.lock.acquire();
+    IndexMap::iterator it = part.maps[mapid].find(e->hashkey());
+    if (it.get() == e)
+	part.maps[mapid].erase(it);
+    part.lock.release();
 }
 
 void
-IPRewriterBase::shift_heap_best_effort(click_jiffies_t now_j)
+IPRewriterBase::shift_heap_best_effort(IPRewriterHeap *heap,
+				       click_jiffies_t now_j)
 {
     // Shift flows with expired guarantees to the best-effort heap.
-    Vector<IPRewriterFlow *> &guaranteed_heap = _heap->_heaps[1];
-    while (guaranteed_heap.size() && guaranteed_heap[0]->expired(now_j)) {
-	IPRewriterFlow *mf = guaranteed_heap[0];
+    IPRewriterFlow *mf;
+    while ((mf = heap->earliest(true)) && mf->expired(now_j)) {
 	click_jiffies_t new_expiry = mf->owner()->best_effort_expiry(mf);
-	mf->change_expiry(_heap, false, new_expiry);
+	mf->change_expiry(heap, false, new_expiry);
     }
 }
 
 bool
-IPRewriterBase::shrink_heap_for_new_flow(IPRewriterFlow *flow,
+IPRewriterBase::shrink_heap_for_new_flow(IPRewriterHeap *heap,
+					 IPRewriterFlow *flow,
 					 click_jiffies_t now_j)
 {
-    shift_heap_best_effort(now_j);
+    shift_heap_best_effort(heap, now_j);
     // At this point, all flows in the guarantee heap expire in the future.
     // So remove the next-to-expire best-effort flow, unless there are none.
     // In that case we always remove the current flow to honor previous
     // guarantees (= admission control).
-    IPRewriterFlow *deadf;
-    if (_heap->_heaps[0].empty()) {
+    IPRewriterFlow *deadf = heap->earliest(false);
+    if (!deadf) {
 	assert(flow->guaranteed());
 	deadf = flow;
-    } else
-	deadf = _heap->_heaps[0][0];
-    deadf->destroy(_heap);
+    }
+    deadf->destroy(heap);
     return deadf == flow;
 }
 
+/** @brief Remove expired flows from shard @a s, then shrink it to capacity.
+ * @param clear_all if true, remove every flow
+ *
+ * Shard @a s must be the current thread's shard. */
 void
-IPRewriterBase::shrink_heap(bool clear_all)
+IPRewriterBase::shrink_heap(bool clear_all, int s)
 {
+    IPRewriterHeap *heap = shard_heap(s);
+    lock_shard(s);
     click_jiffies_t now_j = click_jiffies();
-    shift_heap_best_effort(now_j);
-    Vector<IPRewriterFlow *> &best_effort_heap = _heap->_heaps[0];
-    while (best_effort_heap.size() && best_effort_heap[0]->expired(now_j))
-	best_effort_heap[0]->destroy(_heap);
+    shift_heap_best_effort(heap, now_j);
+    IPRewriterFlow *deadf;
+    while ((deadf = heap->earliest(false)) && deadf->expired(now_j))
+	deadf->destroy(heap);
 
-    int32_t capacity = clear_all ? 0 : _heap->_capacity;
-    while (_heap->size() > capacity) {
-	IPRewriterFlow *deadf = _heap->_heaps[_heap->_heaps[0].empty()][0];
-	deadf->destroy(_heap);
+    int32_t capacity = clear_all ? 0 : heap->_capacity;
+    while (heap->size() > capacity) {
+	if (!(deadf = heap->earliest(false)))
+	    deadf = heap->earliest(true);
+	deadf->destroy(heap);
     }
+    unlock_shard(s);
+}
+
+/** @brief Shrink the current thread's shard now, and ask the other shards'
+ * threads to shrink theirs when they next see a packet.
+ * @param what reap_expired or reap_all */
+void
+IPRewriterBase::reap_shards(int what)
+{
+    int s = current_shard();
+    for (int i = 0; i < _nshards; ++i)
+	if (i != s && _shards[i].reap < (uint32_t) what)
+	    _shards[i].reap = what;
+    shrink_heap(what == reap_all, s);
 }
 
 void
 IPRewriterBase::gc_timer_hook(Timer *t, void *user_data)
 {
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(user_data);
-    rw->shrink_heap(false);
+    rw->reap_shards(reap_expired);
     if (rw->_gc_interval_sec)
 	t->reschedule_after_sec(rw->_gc_interval_sec);
 }
 
+static uint32_t
+flow_state_jiffies_to_msec(click_jiffies_t j)
+{
+    uint32_t sec = j / CLICK_HZ;
+    if (sec >= 0x7FFFFFFF / 1000)
+	return 0x7FFFFFFF;
+    return sec * 1000 + ((j % CLICK_HZ) * 1000 + CLICK_HZ - 1) / CLICK_HZ;
+}
+
+static click_jiffies_t
+flow_state_msec_to_jiffies(uint32_t ms)
+{
+    click_jiffies_t j = (ms / 1000) * CLICK_HZ + ((ms % 1000) * CLICK_HZ) / 1000;
+    return j ? j : 1;
+}
+
+/** @brief Return a binary snapshot of this element's live flows.
+ *
+ * See FlowStateHeader for the format.  Expiry times are stored relative to
+ * now, so parse_flow_state() can load the snapshot into a rewriter in
+ * another router or process. */
+String
+IPRewriterBase::unparse_flow_state()
+{
+    click_jiffies_t now_j = click_jiffies();
+    StringAccum sa;
+    sa.extend(sizeof(FlowStateHeader));
+    uint32_t count = 0;
+    Vector<IPRewriterFlow *> flows;
+    for (int s = 0; s < _nshards; ++s) {
+	lock_shard(s);
+	flows.clear();
+	shard_heap(s)->flows(flows);
+	for (IPRewriterFlow **it = flows.begin(); it != flows.end(); ++it) {
+	    IPRewriterFlow *f = *it;
+	    if (f->owner() != this)
+		continue;
+	    click_jiffies_t expiry_j = f->expiry();
+	    bool guaranteed = f->guaranteed();
+	    if (guaranteed && f->expired(now_j)) {
+		// not yet shifted to best effort
+		expiry_j = best_effort_expiry(f);
+		guaranteed = false;
+	    }
+	    if (!click_jiffies_less(now_j, expiry_j))
+		continue;
+	    uint32_t extra[flow_extra_max];
+	    int nextra = save_flow_extra(f, extra);
+	    char *x = sa.extend(sizeof(FlowStateRecord) + 4 * nextra);
+	    if (!x)
+		break;
+
+	    FlowStateRecord r;
+	    memset(&r, 0, sizeof(r));
+	    const IPFlowID &flowid = f->entry(false).flowid();
+	    IPFlowID rw_flowid = f->entry(false).rewritten_flowid();
+	    r.saddr = flowid.saddr().addr();
+	    r.daddr = flowid.daddr().addr();
+	    r.sport = flowid.sport();
+	    r.dport = flowid.dport();
+	    r.rw_saddr = rw_flowid.saddr().addr();
+	    r.rw_daddr = rw_flowid.daddr().addr();
+	    r.rw_sport = rw_flowid.sport();
+	    r.rw_dport = rw_flowid.dport();
+	    r.expiry_ms = htonl(flow_state_jiffies_to_msec(expiry_j - now_j));
+	    r.ip_p = f->ip_p();
+	    r.flags = guaranteed ? fs_guaranteed : 0;
+	    r.state = f->_state;
+	    r.reply_anno = f->reply_anno();
+	    r.input = htons(f->owner_input());
+	    r.extra = nextra;
+	    memcpy(x, &r, sizeof(r));
+	    for (int i = 0; i < nextra; ++i)
+		extra[i] = htonl(extra[i]);
+	    memcpy(x + sizeof(r), extra, 4 * nextra);
+	    ++count;
+	}
+	unlock_shard(s);
+    }
+    if (sa.out_of_memory())
+	return String::make_out_of_memory();
+
+    FlowStateHeader h;
+    memcpy(h.magic, "IPRWFLOW", sizeof(h.magic));
+    h.version = htonl(flow_state_version);
+    h.count = htonl(count);
+    memcpy(sa.data(), &h, sizeof(h));
+    return sa.take_string();
+}
+
+/** @brief Restore flow_state record @a r into shard @a s.
+ * @param extra_data the record's extra words, in network byte order
+ * @return true if the flow was restored
+ *
+ * Only parse_flow_state() calls this, with _restoring set to @a s. */
+bool
+IPRewriterBase::restore_flow(const FlowStateRecord &r, const char *extra_data,
+			     int s, click_jiffies_t now_j)
+{
+    IPFlowID flowid(IPAddress(r.saddr), r.sport,
+		    IPAddress(r.daddr), r.dport);
+    IPFlowID rw_flowid(IPAddress(r.rw_saddr), r.rw_sport,
+		       IPAddress(r.rw_daddr), r.rw_dport);
+    int input = ntohs(r.input);
+    if (input >= _input_specs.size()
+	|| (_input_specs[input].kind != IPRewriterInput::i_pattern
+	    && _input_specs[input].kind != IPRewriterInput::i_keep
+	    && _input_specs[input].kind != IPRewriterInput::i_mapper))
+	return false;
+
+    // Skip flows that would replace a mapping in either direction.
+    int mapid = flow_mapid(r.ip_p);
+    IPFlowID reply_flowid = rw_flowid.reverse();
+    IPRewriterBase *reply_element = _input_specs[input].reply_element;
+    if (_index ? indexed(flowid, mapid) : !!shard_map(s, mapid).get(flowid))
+	return false;
+    if (reply_element->_index ? reply_element->indexed(reply_flowid, mapid)
+	: !!reply_element->shard_map(s, mapid).get(reply_flowid))
+	return false;
+
+    IPRewriterEntry *m = add_flow(r.ip_p, flowid, rw_flowid, input);
+    if (!m)
+	return false;
+    IPRewriterFlow *f = m->flow();
+    IPRewriterHeap *heap = shard_heap(s);
+    f->_expiry_j = now_j + flow_state_msec_to_jiffies(ntohl(r.expiry_ms));
+    f->_guaranteed = r.flags & fs_guaranteed;
+    lock_shard(s);
+    heap->insert(f);
+    if (f->ip_p() != r.ip_p) {
+	f->destroy(heap);
+	unlock_shard(s);
+	return false;
+    }
+    f->_state = r.state;
+    f->set_reply_anno(r.reply_anno);
+    if (r.extra) {
+	uint32_t extra[flow_extra_max];
+	memcpy(extra, extra_data, 4 * r.extra);
+	for (int j = 0; j < r.extra; ++j)
+	    extra[j] = ntohl(extra[j]);
+	restore_flow_extra(f, extra, r.extra);
+    }
+    unlock_shard(s);
+    // Other threads can find the flow once it is in the index.
+    if (_index) {
+	index_entry(&f->entry(false), f->_mapid);
+	index_entry(&f->entry(true), f->_mapid);
+    }
+    return true;
+}
+
+/** @brief Add the flows in snapshot @a str to this element.
+ *
+ * Flows go in the current thread's shard.  A flow is skipped if this
+ * element already has a mapping for its flow ID or its reply flow ID, or if
+ * its input is not a pattern, keep, or mapper input here.
+ *
+ * The records are checked first, so the maps can be grown once.  Restored
+ * flows then enter the maps one by one, but the heap only after their
+ * expiry times are set, and the heap is trimmed to capacity once at the
+ * end. */
+int
+IPRewriterBase::parse_flow_state(const String &str, ErrorHandler *errh)
+{
+    FlowStateHeader h;
+    if (str.length() < (int) sizeof(h))
+	return errh->error("flow state too short");
+    memcpy(&h, str.data(), sizeof(h));
+    if (memcmp(h.magic, "IPRWFLOW", sizeof(h.magic)) != 0
+	|| ntohl(h.version) != flow_state_version)
+	return errh->error("bad flow state header");
+
+    const char *first = str.data() + sizeof(h), *x, *end = str.end();
+    uint32_t count = ntohl(h.count), restored = 0, nrecords, i;
+
+    // Find the complete records and how many flows each map will gain.
+    uint32_t want[2] = { 0, 0 };
+    for (x = first, nrecords = 0; nrecords < count; ++nrecords) {
+	FlowStateRecord r;
+	if (end - x < (int) sizeof(r))
+	    break;
+	memcpy(&r, x, sizeof(r));
+	if (r.extra > flow_extra_max
+	    || end - x < (int) (sizeof(r) + 4 * r.extra))
+	    break;
+	x += sizeof(r) + 4 * r.extra;
+	int input = ntohs(r.input);
+	if (input < _input_specs.size())
+	    want[flow_mapid(r.ip_p)] += (_input_specs[input].reply_element == this ? 2 : 1);
+    }
+
+    int s = current_shard();
+    IPRewriterHeap *heap = shard_heap(s);
+    // Grow the maps once, rather than rehashing as the flows arrive.
+    lock_shard(s);
+    for (int mapid = 0; mapid < 2; ++mapid) {
+	Map &map = shard_map(s, mapid);
+	if (map.size() + want[mapid] > 2 * map.bucket_count())
+	    map.rehash(map.size() + want[mapid]);
+    }
+    unlock_shard(s);
+
+    click_jiffies_t now_j = click_jiffies();
+    _restoring = s;
+    for (x = first, i = 0; i < nrecords; ++i) {
+	FlowStateRecord r;
+	memcpy(&r, x, sizeof(r));
+	if (restore_flow(r, x + sizeof(r), s, now_j))
+	    ++restored;
+	x += sizeof(r) + 4 * r.extra;
+    }
+    _restoring = -1;
+
+    if (heap->size() > heap->capacity())
+	shrink_heap(false, s);
+
+    if (nrecords < count)
+	return errh->error("flow state truncated after %u flows", nrecords);
+    else if (restored < count)
+	errh->warning("restored %u of %u flows", restored, count);
+    return 0;
+}
+
 String
 IPRewriterBase::read_handler(Element *e, void *user_data)
 {
@@ -354,12 +888,22 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
 	sa << count;
 	break;
     }
-    case h_size:
-	sa << rw->_heap->size();
+    case h_size: {
+	uint32_t size = 0;
+	for (int s = 0; s < rw->_nshards; ++s)
+	    size += rw->shard_heap(s)->size();
+	sa << size;
 	break;
-    case h_capacity:
-	sa << rw->_heap->_capacity;
+    }
+    case h_flow_state:
+	return rw->unparse_flow_state();
+    case h_capacity: {
+	uint32_t capacity = 0;
+	for (int s = 0; s < rw->_nshards; ++s)
+	    capacity += rw->shard_heap(s)->_capacity;
+	sa << capacity;
 	break;
+    }
     default:
 	for (int i = 0; i < rw->_input_specs.size(); ++i) {
 	    if (what != h_patterns && what != i)
@@ -396,16 +940,22 @@ IPRewriterBase::write_handler(const String &str, Element *e, void *user_data, Er
     IPRewriterBase *rw = static_cast<IPRewriterBase *>(e);
     intptr_t what = reinterpret_cast<intptr_t>(user_data);
     if (what == h_capacity) {
+	int32_t capacity;
 	if (Args(e, errh).push_back_words(str)
-	    .read_mp("CAPACITY", rw->_heap->_capacity)
+	    .read_mp("CAPACITY", capacity)
 	    .complete() < 0)
 	    return -1;
-	rw->shrink_heap(false);
+	capacity /= rw->_nshards;
+	for (int s = 0; s < rw->_nshards; ++s)
+	    rw->shard_heap(s)->_capacity = capacity;
+	rw->reap_shards(reap_expired);
 	return 0;
     } else if (what == h_clear) {
-	rw->shrink_heap(true);
+	rw->reap_shards(reap_all);
 	return 0;
-    } else
+    } else if (what == h_flow_state)
+	return rw->parse_flow_state(str, errh);
+    else
 	return -1;
 }
 
@@ -418,16 +968,11 @@ IPRewriterBase::pattern_write_handler(const String &str, Element *e, void *user_
     int r = rw->parse_input_spec(str, is, "input spec " + String(what), errh);
     if (r >= 0) {
 	// remove all existing flows created by this input
-	for (int which_heap = 0; which_heap < 2; ++which_heap) {
-	    Vector<IPRewriterFlow *> &myheap = rw->_heap->_heaps[which_heap];
-	    for (int i = myheap.size() - 1; i >= 0; --i)
-		if (myheap[i]->owner() == rw
-		    && myheap[i]->owner_input() == what) {
-		    myheap[i]->destroy(rw->_heap);
-		    if (i < myheap.size())
-			++i;
-		}
-	}
+	Vector<IPRewriterFlow *> flows;
+	rw->_heap->flows(flows);
+	for (int i = 0; i < flows.size(); ++i)
+	    if (flows[i]->owner() == rw && flows[i]->owner_input() == what)
+		flows[i]->destroy(rw->_heap);
 
 	// change pattern
 	if (rw->_input_specs[what].kind == IPRewriterInput::i_pattern)
@@ -447,10 +992,12 @@ IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
     add_read_handler("capacity", read_handler, h_capacity);
     add_write_handler("capacity", write_handler, h_capacity);
     add_write_handler("clear", write_handler, h_clear);
+    add_read_handler("flow_state", read_handler, h_flow_state, Handler::RAW);
+    add_write_handler("flow_state", write_handler, h_flow_state, Handler::RAW | Handler::EXCLUSIVE);
     for (int i = 0; i < ninputs(); ++i) {
 	String name = "pattern" + String(i);
 	add_read_handler(name, read_handler, i);
-	if (writable_patterns)
+	if (writable_patterns && !_shards)
 	    add_write_handler(name, pattern_write_handler, i, Handler::EXCLUSIVE);
     }
 }
@@ -4,6 +4,8 @@
 #include <click/timer.hh>
 #include "elements/ip/iprwmapping.hh"
 #include <click/bitvector.hh>
+#include <click/heap.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 class IPMapper;
 class IPRewriterPattern;
@@ -39,12 +41,8 @@ struct IPRewriterInput {
 
 class IPRewriterHeap { public:
 
-    IPRewriterHeap()
-	: _capacity(0x7FFFFFFF), _use_count(1) {
-    }
-    ~IPRewriterHeap() {
-	assert(size() == 0);
-    }
+    IPRewriterHeap();
+    ~IPRewriterHeap();
 
     void use() {
 	++_use_count;
@@ -56,21 +54,59 @@ class IPRewriterHeap { public:
     }
 
     Vector<IPRewriterFlow *>::size_type size() const {
-	return _heaps[0].size() + _heaps[1].size();
+	return _heaps[0].size() + _heaps[1].size()
+	    + _wheel_count[0] + _wheel_count[1];
     }
     int32_t capacity() const {
 	return _capacity;
     }
 
+    inline void insert(IPRewriterFlow *flow);
+    inline void remove(IPRewriterFlow *flow);
+    void refile(IPRewriterFlow *flow, bool guaranteed);
+    IPRewriterFlow *earliest(bool guaranteed);
+    void flows(Vector<IPRewriterFlow *> &v) const;
+
   private:
 
     enum {
 	h_best_effort = 0, h_guarantee = 1
     };
+
+    // Each class of flows is split like TimerSet's timing wheel.  The heap
+    // holds the flows whose tick (filed expiry in jiffies) is less than
+    // _wheel_now, and the wheel holds the rest: level k holds flows whose
+    // ticks agree with _wheel_now above bit (k + 1) * wheel_bits, in slot
+    // (tick >> (k * wheel_bits)) & wheel_mask, and the final slot holds
+    // flows beyond the top level.  Flows are filed by _filed_j.  A flow
+    // whose expiry moved later is refiled only when the heap or wheel
+    // reaches it, so packets on established flows do not touch the heap.
+    enum {
+	wheel_bits = 8, wheel_size = 1 << wheel_bits,
+	wheel_mask = wheel_size - 1, wheel_levels = 4,
+	wheel_slots = wheel_levels * wheel_size + 1
+    };
+    enum { wheel_place = 0xFFFFFFFFU };
     Vector<IPRewriterFlow *> _heaps[2];
+    IPRewriterFlow **_wheel[2];
+    uint64_t _wheel_now[2];
+    click_jiffies_t _wheel_now_j[2];
+    int _wheel_count[2];
     int32_t _capacity;
     uint32_t _use_count;
 
+    inline uint64_t tick(int which, click_jiffies_t j) const {
+	return _wheel_now[which] + (int32_t) (j - _wheel_now_j[which]);
+    }
+    inline void heap_insert(IPRewriterFlow *flow);
+    inline void wheel_link(IPRewriterFlow *flow, uint64_t tick);
+    inline void wheel_unlink(IPRewriterFlow *flow);
+    inline void restart(IPRewriterFlow *flow);
+    inline void file(IPRewriterFlow *flow);
+    void wheel_requeue(int which, IPRewriterFlow **slot);
+    void wheel_advance(int which, uint64_t now);
+    bool wheel_refill(int which);
+
     friend class IPRewriterBase;
     friend class IPRewriterFlow;
 
@@ -108,6 +144,23 @@ class IPRewriterBase : public Element { public:
     virtual HashContainer<IPRewriterEntry> *get_map(int mapid) {
 	return likely(mapid == IPRewriterInput::mapid_default) ? &_map : 0;
     }
+    /** @brief Return the map ID of the map holding flows for protocol @a ip_p. */
+    virtual int flow_mapid(int ip_p) const {
+	(void) ip_p;
+	return IPRewriterInput::mapid_default;
+    }
+
+    /** @brief Return the shard used by the current thread.
+     *
+     * Sharded rewriters keep one shard per router thread; others have
+     * the single shard 0. */
+    int current_shard() const {
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+	if (_shards)
+	    return click_current_thread_id;
+#endif
+	return 0;
+    }
 
     enum {
 	get_entry_check = -1, get_entry_reply = -2
@@ -122,6 +175,25 @@ class IPRewriterBase : public Element { public:
 	return flow->expiry() + _timeouts[0] - _timeouts[1];
     }
 
+    enum {
+	flow_extra_max = 8
+    };
+    /** @brief Save @a flow's subclass state for a flow_state snapshot.
+     * @param extra at least flow_extra_max words
+     * @return number of words stored in @a extra
+     *
+     * The words are stored in host byte order. */
+    virtual int save_flow_extra(const IPRewriterFlow *flow, uint32_t *extra) const {
+	(void) flow, (void) extra;
+	return 0;
+    }
+    /** @brief Restore @a flow's subclass state from a flow_state snapshot.
+     * @param extra words produced by save_flow_extra()
+     * @param n number of words in @a extra */
+    virtual void restore_flow_extra(IPRewriterFlow *flow, const uint32_t *extra, int n) {
+	(void) flow, (void) extra, (void) n;
+    }
+
     int llrpc(unsigned command, void *data);
 
   protected:
@@ -131,6 +203,39 @@ class IPRewriterBase : public Element { public:
     Vector<IPRewriterInput> _input_specs;
 
     IPRewriterHeap *_heap;
+
+    // A sharded rewriter (SHARDED keyword) keeps a map, allocator, and heap
+    // per router thread.  Shard 0 is _map, _heap, and the subclass's own
+    // allocators; the Shard entries hold the rest.  Only a shard's own
+    // thread changes its maps and heap, under the shard's lock, so that
+    // thread looks up and rewrites its flows without locking.  Other
+    // threads lock the shard to read it.  The index files every entry of
+    // every shard by flow ID, split into parts by hash, so a thread finds
+    // a flow held by another shard with one part lock.  Locks nest in the
+    // order shard, then index part.
+    struct Shard {
+	Map *maps[2];			// indexed by IPRewriterInput::mapid
+	HashAllocator *allocators[2];
+	IPRewriterHeap *heap;
+	SimpleSpinlock lock;
+	volatile uint32_t reap;		// shrink_heap() requested by another thread
+    };
+    typedef HashContainer<IPRewriterEntry, IPRewriterEntry::index_adapter> IndexMap;
+    struct IndexPart {
+	IndexMap maps[2];		// indexed by IPRewriterInput::mapid
+	SimpleSpinlock lock;
+    };
+    Shard *_shards;
+    int _nshards;
+    IndexPart *_index;
+    int _index_shift;
+
+    // While parse_flow_state() restores flows into shard _restoring,
+    // store_flow() leaves that shard's new flows out of the heap and the
+    // index; parse_flow_state() files them itself once it has set their
+    // expiry times.  -1 otherwise.
+    int _restoring;
+
     uint32_t _timeouts[2];
     uint32_t _gc_interval_sec;
     Timer _gc_timer;
@@ -146,10 +251,34 @@ class IPRewriterBase : public Element { public:
     }
 
     IPRewriterEntry *store_flow(IPRewriterFlow *flow, int input,
-				Map &map, Map *reply_map_ptr = 0);
+				Map &map, Map *reply_map_ptr = 0,
+				int mapid = IPRewriterInput::mapid_default);
     inline void unmap_flow(IPRewriterFlow *flow,
 			   Map &map, Map *reply_map_ptr = 0);
 
+    int make_shards(ErrorHandler *errh);
+    Map &shard_map(int s, int mapid = IPRewriterInput::mapid_default) {
+	if (s)
+	    return *_shards[s].maps[mapid];
+	return likely(mapid == IPRewriterInput::mapid_default) ? _map : *get_map(mapid);
+    }
+    IPRewriterHeap *shard_heap(int s) const {
+	return s ? _shards[s].heap : _heap;
+    }
+    void lock_shard(int s) {
+	if (_shards)
+	    _shards[s].lock.acquire();
+    }
+    void unlock_shard(int s) {
+	if (_shards)
+	    _shards[s].lock.release();
+    }
+    inline void check_reap(int s);
+    IPRewriterEntry *find_foreign(const IPFlowID &flowid, int s,
+				  int mapid = IPRewriterInput::mapid_default);
+    inline void retime_flow(IPRewriterFlow *flow, int s, bool guaranteed,
+			    click_jiffies_t expiry_j);
+
     static void gc_timer_hook(Timer *t, void *user_data);
 
     int parse_input_spec(const String &str, IPRewriterInput &is,
@@ -157,7 +286,10 @@ class IPRewriterBase : public Element { public:
 
     enum {			// < 0 because individual patterns are >= 0
 	h_nmappings = -1, h_mapping_failures = -2, h_patterns = -3,
-	h_size = -4, h_capacity = -5, h_clear = -6
+	h_size = -4, h_capacity = -5, h_clear = -6, h_flow_state = -7
+    };
+    enum {
+	reap_expired = 1, reap_all = 2
     };
     static String read_handler(Element *e, void *user_data);
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh);
@@ -168,9 +300,42 @@ class IPRewriterBase : public Element { public:
 
   private:
 
-    void shift_heap_best_effort(click_jiffies_t now_j);
-    bool shrink_heap_for_new_flow(IPRewriterFlow *flow, click_jiffies_t now_j);
-    void shrink_heap(bool clear_all);
+    void shift_heap_best_effort(IPRewriterHeap *heap, click_jiffies_t now_j);
+    bool shrink_heap_for_new_flow(IPRewriterHeap *heap, IPRewriterFlow *flow,
+				  click_jiffies_t now_j);
+    void shrink_heap(bool clear_all, int s = 0);
+    void reap_shards(int what);
+
+    IndexPart &index_part(const IPFlowID &flowid) const {
+	return _index[((uint32_t) flowid.hashcode() * 0x9E3779B1U) >> _index_shift];
+    }
+    void index_entry(IPRewriterEntry *e, int mapid);
+    void unindex_entry(IPRewriterEntry *e, int mapid);
+    bool indexed(const IPFlowID &flowid, int mapid);
+
+    // flow_state snapshots: a FlowStateHeader, then 'count' records, each
+    // a FlowStateRecord followed by 'extra' words.  Integers are in network
+    // byte order; addresses and ports are as in IPFlowID.
+    struct FlowStateHeader {
+	char magic[8];			// "IPRWFLOW"
+	uint32_t version;
+	uint32_t count;
+    };
+    struct FlowStateRecord {
+	uint32_t saddr, daddr, rw_saddr, rw_daddr;
+	uint16_t sport, dport, rw_sport, rw_dport;
+	int32_t expiry_ms;		// relative to the snapshot
+	uint8_t ip_p, flags, state, reply_anno;
+	uint16_t input;
+	uint8_t extra, pad;
+    };
+    enum {
+	flow_state_version = 1, fs_guaranteed = 1
+    };
+    String unparse_flow_state();
+    int parse_flow_state(const String &str, ErrorHandler *errh);
+    bool restore_flow(const FlowStateRecord &r, const char *extra_data,
+		      int s, click_jiffies_t now_j);
 
     friend class IPRewriterFlow;
 
@@ -205,11 +370,15 @@ IPRewriterInput::rewrite_flowid(const IPFlowID &flowid,
 	return IPRewriterBase::rw_addmap;
     case i_pattern: {
 	HashContainer<IPRewriterEntry> *reply_map;
-	if (likely(mapid == mapid_default))
+	int s = 0;
+	if (likely(mapid == mapid_default && !reply_element->_shards))
 	    reply_map = &reply_element->_map;
-	else
-	    reply_map = reply_element->get_map(mapid);
-	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map);
+	else {
+	    s = reply_element->current_shard();
+	    reply_map = &reply_element->shard_map(s, mapid);
+	}
+	i = u.pattern->rewrite_flowid(flowid, rewritten_flowid, *reply_map,
+				      s, reply_element->_nshards);
 	goto check_for_failure;
     }
     case i_mapper:
@@ -230,13 +399,146 @@ IPRewriterBase::unmap_flow(IPRewriterFlow *flow, Map &map,
 {
     //click_chatter("kill %s", hashkey().s().c_str());
     if (!reply_map_ptr)
-	reply_map_ptr = &_input_specs[flow->owner_input()].reply_element->_map;
+	reply_map_ptr = &_input_specs[flow->owner_input()].reply_element->shard_map(flow->shard());
     Map::iterator it = map.find(flow->entry(0).hashkey());
     if (it.get() == &flow->entry(0))
 	map.erase(it);
     it = reply_map_ptr->find(flow->entry(1).hashkey());
     if (it.get() == &flow->entry(1))
 	reply_map_ptr->erase(it);
+    if (_index) {
+	unindex_entry(&flow->entry(0), flow->_mapid);
+	unindex_entry(&flow->entry(1), flow->_mapid);
+    }
+}
+
+/** @brief Set @a flow's expiry after rewriting a packet on shard @a s.
+ * @param s the current thread's shard
+ *
+ * A flow of shard @a s is re-timed without locking unless its heap must
+ * move it.  A flow of another shard is re-timed in that shard's heap, whose
+ * lock the caller holds (see find_foreign()).  If the owner and another
+ * thread re-time a flow at once, its expiry may end up a little earlier
+ * than where the heap filed it; the flow then expires when the heap
+ * reaches it. */
+inline void
+IPRewriterBase::retime_flow(IPRewriterFlow *flow, int s, bool guaranteed,
+			    click_jiffies_t expiry_j)
+{
+    int fs = flow->shard();
+    if (fs != s || !_shards)
+	flow->change_expiry(shard_heap(fs), guaranteed, expiry_j);
+    else if (likely(guaranteed == flow->_guaranteed
+		    && !click_jiffies_less(expiry_j, flow->_filed_j)))
+	flow->_expiry_j = expiry_j;
+    else {
+	lock_shard(s);
+	flow->change_expiry(shard_heap(s), guaranteed, expiry_j);
+	unlock_shard(s);
+    }
+}
+
+/** @brief Handle shrink_heap() requests for shard @a s from other threads.
+ *
+ * Shard @a s must be the current thread's shard. */
+inline void
+IPRewriterBase::check_reap(int s)
+{
+    if (unlikely(_shards && _shards[s].reap)) {
+	uint32_t what = _shards[s].reap;
+	_shards[s].reap = 0;
+	shrink_heap(what == reap_all, s);
+    }
+}
+
+inline void
+IPRewriterHeap::heap_insert(IPRewriterFlow *flow)
+{
+    Vector<IPRewriterFlow *> &h = _heaps[flow->_guaranteed];
+    h.push_back(flow);
+    push_heap(h.begin(), h.end(),
+	      IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+}
+
+inline void
+IPRewriterHeap::wheel_link(IPRewriterFlow *flow, uint64_t tick)
+{
+    int which = flow->_guaranteed;
+    uint64_t diff = tick ^ _wheel_now[which];
+    int level = 0;
+    while (level < wheel_levels && (diff >> ((level + 1) * wheel_bits)))
+	++level;
+    IPRewriterFlow **slot = _wheel[which] + level * wheel_size;
+    if (level < wheel_levels)
+	slot += (tick >> (level * wheel_bits)) & wheel_mask;
+    if ((flow->_wheel_next = *slot))
+	flow->_wheel_next->_wheel_pprev = &flow->_wheel_next;
+    flow->_wheel_pprev = slot;
+    *slot = flow;
+    flow->_place = wheel_place;
+    ++_wheel_count[which];
+}
+
+inline void
+IPRewriterHeap::wheel_unlink(IPRewriterFlow *flow)
+{
+    if ((*flow->_wheel_pprev = flow->_wheel_next))
+	flow->_wheel_next->_wheel_pprev = flow->_wheel_pprev;
+    --_wheel_count[flow->_guaranteed];
+}
+
+inline void
+IPRewriterHeap::restart(IPRewriterFlow *flow)
+{
+    // An empty class may have idled for a long time; restart its clock at
+    // @a flow's expiry so ticks stay within range.
+    int which = flow->_guaranteed;
+    if (!_wheel_count[which] && _heaps[which].empty())
+	_wheel_now_j[which] = flow->_expiry_j;
+}
+
+inline void
+IPRewriterHeap::file(IPRewriterFlow *flow)
+{
+    int which = flow->_guaranteed;
+    flow->_filed_j = flow->_expiry_j;
+    uint64_t t = tick(which, flow->_filed_j);
+    if (t < _wheel_now[which])
+	heap_insert(flow);
+    else
+	wheel_link(flow, t);
+}
+
+/** @brief Add @a flow, which expires at flow->expiry(). */
+inline void
+IPRewriterHeap::insert(IPRewriterFlow *flow)
+{
+    restart(flow);
+    file(flow);
+}
+
+/** @brief Remove @a flow. */
+inline void
+IPRewriterHeap::remove(IPRewriterFlow *flow)
+{
+    if (flow->_place == wheel_place)
+	wheel_unlink(flow);
+    else {
+	Vector<IPRewriterFlow *> &h = _heaps[flow->_guaranteed];
+	remove_heap(h.begin(), h.end(), h.begin() + flow->_place,
+		    IPRewriterFlow::heap_less(), IPRewriterFlow::heap_place());
+	h.pop_back();
+    }
+}
+
+inline void
+IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
+			      click_jiffies_t expiry_j)
+{
+    _expiry_j = expiry_j;
+    if (unlikely(guaranteed != _guaranteed
+		 || click_jiffies_less(expiry_j, _filed_j)))
+	h->refile(this, guaranteed);
 }
 
 CLICK_ENDDECLS
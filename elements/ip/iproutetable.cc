@@ -25,6 +25,7 @@
 #include <click/glue.hh>
 #include <click/straccum.hh>
 #include <click/router.hh>
+#include <click/master.hh>
 #include "iproutetable.hh"
 CLICK_DECLS
 
@@ -86,6 +87,11 @@ IPRoute::unparse() const
 }
 
 
+IPRouteTable::IPRouteTable()
+    : _updating(0)
+{
+}
+
 void *
 IPRouteTable::cast(const char *name)
 {
@@ -164,35 +170,57 @@ IPRouteTable::push(int, Packet *p)
     }
 }
 
+void
+IPRouteTable::push_batch(int, PacketBatch &batch)
+{
+    PacketBatch run;
+    int run_port = -1;
+    while (Packet *p = batch.pop_front()) {
+	IPAddress gw;
+	int port = lookup_route(p->dst_ip_anno(), gw);
+	if (port < 0) {
+	    static int complained = 0;
+	    if (++complained <= 5)
+		click_chatter("IPRouteTable: no route for %s", p->dst_ip_anno().unparse().c_str());
+	    p->kill();
+	    continue;
+	}
+	assert(port < noutputs());
+	if (gw)
+	    p->set_dst_ip_anno(gw);
+	if (port != run_port && !run.empty())
+	    output(run_port).push_batch(run);
+	run_port = port;
+	run.push_back(p);
+    }
+    if (!run.empty())
+	output(run_port).push_batch(run);
+}
+
 
 int
-IPRouteTable::run_command(int command, const String &str, Vector<IPRoute>* old_routes, ErrorHandler *errh)
+IPRouteTable::parse_command(int command, const String &str, IPRoute &route, ErrorHandler *errh)
 {
-    IPRoute route, old_route;
     if (!cp_ip_route(str, &route, command == CMD_REMOVE, this))
 	return errh->error("expected %<ADDR/MASK [GATEWAY%s%>", (command == CMD_REMOVE ? " OUTPUT]" : "] OUTPUT"));
     else if (route.port < (command == CMD_REMOVE ? -1 : 0)
 	     || route.port >= noutputs())
 	return errh->error("bad OUTPUT");
+    route.extra = command;
+    return 0;
+}
 
+int
+IPRouteTable::apply_command(const IPRoute &route, IPRoute &old_route, ErrorHandler *errh)
+{
     int r, before = errh->nerrors();
-    if (command == CMD_ADD)
+    if (route.extra == CMD_ADD)
 	r = add_route(route, false, &old_route, errh);
-    else if (command == CMD_SET)
+    else if (route.extra == CMD_SET)
 	r = add_route(route, true, &old_route, errh);
     else
 	r = remove_route(route, &old_route, errh);
 
-    // save old route if in a transaction
-    if (r >= 0 && old_routes) {
-	if (old_route.port < 0) { // must come from add_route
-	    old_route = route;
-	    old_route.extra = CMD_ADD;
-	} else
-	    old_route.extra = command;
-	old_routes->push_back(old_route);
-    }
-
     // report common errors
     if (r == -EEXIST && errh->nerrors() == before)
 	errh->error("conflict with existing route %<%s%>", old_route.unparse().c_str());
@@ -203,19 +231,140 @@ IPRouteTable::run_command(int command, const String &str, Vector<IPRoute>* old_r
     return r;
 }
 
+/** @brief Apply @a commands in order, or none of them.
+ *
+ * Calls add_route() and remove_route() for each command.  If one fails,
+ * undoes the commands applied so far and returns its error.  Stores the route
+ * replaced or removed by the last command tried in *@a last_old_route. */
+int
+IPRouteTable::apply_commands(const Vector<IPRoute> &commands, ErrorHandler *errh,
+			     IPRoute *last_old_route)
+{
+    Vector<IPRoute> old_routes;
+    int r = 0;
+
+    for (const IPRoute *it = commands.begin(); it != commands.end(); ++it) {
+	IPRoute old_route;
+	r = apply_command(*it, old_route, errh);
+	if (last_old_route)
+	    *last_old_route = old_route;
+	if (r < 0)
+	    break;
+	if (old_route.port < 0) { // must come from add_route
+	    old_route = *it;
+	    old_route.extra = CMD_ADD;
+	} else
+	    old_route.extra = it->extra;
+	old_routes.push_back(old_route);
+    }
+
+    if (r < 0)
+	while (old_routes.size()) {
+	    const IPRoute& rt = old_routes.back();
+	    if (rt.extra == CMD_REMOVE)
+		add_route(rt, false, 0, errh);
+	    else if (rt.extra == CMD_ADD)
+		remove_route(rt, 0, errh);
+	    else
+		add_route(rt, true, 0, errh);
+	    old_routes.pop_back();
+	}
+    return r;
+}
+
+/** @brief Acquire the update lock.
+ *
+ * Another writer holding the lock may be waiting for a grace period, so the
+ * wait counts as a quiescent state for the calling thread. */
+void
+IPRouteTable::lock_updates()
+{
+    master()->acquire_quiescent(_update_lock);
+    ++_updating;
+}
+
+void
+IPRouteTable::unlock_updates()
+{
+    --_updating;
+    _update_lock.release();
+}
+
+int
+IPRouteTable::apply_update(const Vector<IPRoute> &commands, IPRoute *old_route,
+			   ErrorHandler *errh)
+{
+    if (!use_spare_table(true))
+	return apply_commands(commands, errh, old_route);
+
+    // Lookups keep using the live table while we change the spare.
+    int r = apply_commands(commands, errh, old_route);
+    if (r >= 0) {
+	swap_tables();
+	// Once no lookup can still be using the old live table, bring it up
+	// to date; it becomes the spare for the next update.
+	master()->wait_grace_period();
+	(void) apply_commands(commands, ErrorHandler::silent_handler());
+    }
+    use_spare_table(false);
+    return r;
+}
+
+int
+IPRouteTable::update_routes(const Vector<IPRoute> &commands, ErrorHandler *errh)
+{
+    lock_updates();
+    int r = apply_update(commands, 0, errh);
+    unlock_updates();
+    return r;
+}
+
+bool
+IPRouteTable::forward_update(const IPRoute &command, IPRoute *old_route,
+			     ErrorHandler *errh, int &result)
+{
+    lock_updates();
+    // The lock is recursive: _updating > 1 means this thread is already
+    // applying an update, which is calling add_route() or remove_route().
+    bool forward = _updating == 1;
+    if (forward) {
+	if (!errh)
+	    errh = ErrorHandler::silent_handler();
+	Vector<IPRoute> commands(1, command);
+	result = apply_update(commands, old_route, errh);
+    }
+    unlock_updates();
+    return forward;
+}
+
+bool
+IPRouteTable::use_spare_table(bool)
+{
+    return false;
+}
+
+void
+IPRouteTable::swap_tables()
+{
+}
+
 
 int
 IPRouteTable::add_route_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
 {
     IPRouteTable *table = static_cast<IPRouteTable *>(e);
-    return table->run_command((thunk ? CMD_SET : CMD_ADD), conf, 0, errh);
+    Vector<IPRoute> commands(1, IPRoute());
+    int r = table->parse_command((thunk ? CMD_SET : CMD_ADD), conf, commands[0], errh);
+    return r < 0 ? r : table->update_routes(commands, errh);
 }
 
 int
 IPRouteTable::remove_route_handler(const String &conf, Element *e, void *, ErrorHandler *errh)
 {
     IPRouteTable *table = static_cast<IPRouteTable *>(e);
-    return table->run_command(CMD_REMOVE, conf, 0, errh);
+    Vector<IPRoute> commands(1, IPRoute());
+    int r = table->parse_command(CMD_REMOVE, conf, commands[0], errh);
+    return r < 0 ? r : table->update_routes(commands, errh);
 }
 
 int
@@ -225,12 +374,12 @@ IPRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHandl
     String conf = cp_uncomment(conf_in);
     const char* s = conf.begin(), *end = conf.end();
 
-    Vector<IPRoute> old_routes;
-    int r = 0;
-
+    // Parse every command before changing anything.
+    Vector<IPRoute> commands;
     while (s < end) {
 	const char* nl = find(s, end, '\n');
 	String line = conf.substring(s, nl);
+	s = nl + 1;
 
 	String first_word = cp_shift_spacevec(line);
 	int command;
@@ -242,37 +391,26 @@ IPRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHandl
 	    command = CMD_SET;
 	else if (!first_word)
 	    continue;
-	else {
-	    r = errh->error("bad command %<%#s%>", first_word.c_str());
-	    goto rollback;
-	}
-
-	if ((r = table->run_command(command, line, &old_routes, errh)) < 0)
-	    goto rollback;
+	else
+	    return errh->error("bad command %<%#s%>", first_word.c_str());
 
-	s = nl + 1;
+	commands.push_back(IPRoute());
+	int r = table->parse_command(command, line, commands.back(), errh);
+	if (r < 0)
+	    return r;
     }
-    return 0;
 
-  rollback:
-    while (old_routes.size()) {
-	const IPRoute& rt = old_routes.back();
-	if (rt.extra == CMD_REMOVE)
-	    table->add_route(rt, false, 0, errh);
-	else if (rt.extra == CMD_ADD)
-	    table->remove_route(rt, 0, errh);
-	else
-	    table->add_route(rt, true, 0, errh);
-	old_routes.pop_back();
-    }
-    return r;
+    return commands.size() ? table->update_routes(commands, errh) : 0;
 }
 
 String
 IPRouteTable::table_handler(Element *e, void *)
 {
     IPRouteTable *r = static_cast<IPRouteTable*>(e);
-    return r->dump_routes();
+    r->lock_updates();
+    String s = r->dump_routes();
+    r->unlock_updates();
+    return s;
 }
 
 int
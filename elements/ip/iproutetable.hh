@@ -3,6 +3,7 @@
 #define CLICK_IPROUTETABLE_HH
 #include <click/glue.hh>
 #include <click/element.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
@@ -115,6 +116,27 @@ implementation returns an empty string.
 
 =back
 
+Subclasses that let lookups run on other threads while routes change should
+also override these two functions, which give B<update_routes> a spare copy
+of the table.
+
+=over 4
+
+=item C<bool B<use_spare_table>(bool spare)>
+
+If C<spare> is true, directs later B<add_route> and B<remove_route> calls to
+a spare copy of the table that lookups do not use, and returns true; returns
+false if there is no spare copy. If C<spare> is false, directs them back to
+the live table. The default implementation returns false.
+
+=item C<void B<swap_tables>()>
+
+Makes the spare copy live, so that later lookups use it, and makes the old
+live table the spare. Lookups already in progress may still use the old
+table until the next grace period (see Master::wait_grace_period).
+
+=back
+
 The following functions, overridden by IPRouteTable, are available for use by
 subclasses.
 
@@ -132,23 +154,57 @@ The default implementation of B<push> uses B<lookup_route> to perform IP
 routing lookup. Normally, subclasses implement their own B<push> methods,
 avoiding virtual function call overhead.
 
+=item C<void B<push_batch>(int port, PacketBatch &batch)>
+
+The default implementation of B<push_batch> also uses B<lookup_route>, and
+pushes each run of packets bound for the same output as one batch. A subclass
+whose B<push> does more than call B<lookup_route> should override
+B<push_batch> too.
+
+=item C<int B<update_routes>(const VectorE<lt>IPRouteE<gt> &commands, ErrorHandler *errh)>
+
+Applies a batch of route changes atomically: either every change takes
+effect or none does. Each element of C<commands> is a route whose C<extra>
+field is C<CMD_ADD>, C<CMD_SET> or C<CMD_REMOVE>. If B<use_spare_table>
+succeeds, the changes are made to the spare copy, which B<swap_tables> then
+publishes, so lookups never see a partly updated table; after a grace period
+the same changes are applied to the old table. Otherwise the changes are made
+in place, and undone if one fails. Returns 0 on success and negative on
+failure. Updates are serialized by a lock, so handlers on different threads
+may change routes at once.
+
+=item C<bool B<forward_update>(const IPRoute &command, IPRoute *old_route, ErrorHandler *errh, int &result)>
+
+Subclasses with a spare table call this at the start of B<add_route> and
+B<remove_route>. Unless the call comes from an update already in progress, it
+applies C<command> (with C<extra> set as for B<update_routes>) through the
+spare table, stores the result in C<result> and any replaced or removed route
+in C<*old_route>, and returns true. Otherwise it returns false, and the
+caller should change its writer table directly.
+
+=item C<void B<lock_updates>()>, C<void B<unlock_updates>()>
+
+Acquire and release the lock B<update_routes> holds. Subclasses hold it while
+changing their tables outside B<update_routes>, for example in a flush
+handler.
+
 =item C<static int B<add_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as an add-route request
-and calls B<add_route> with the results. Normally hooked up to the `C<add>'
-handler.
+and calls B<update_routes> with the results. Normally hooked up to the
+`C<add>' handler.
 
 =item C<static int B<remove_route_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback parses its input as a remove-route request and
-calls B<remove_route> with the results. Normally hooked up to the `C<remove>'
+calls B<update_routes> with the results. Normally hooked up to the `C<remove>'
 handler.
 
 =item C<static int B<ctrl_handler>(const String &, Element *, void *, ErrorHandler *)>
 
 This write handler callback function parses its input as a route control
-request and calls B<add_route> or B<remove_route> as directed. Normally hooked
-up to the `C<ctrl>' handler.
+request and passes all of its commands to one B<update_routes> call. Normally
+hooked up to the `C<ctrl>' handler.
 
 =item C<static String B<table_handler>(Element *, void *)>
 
@@ -187,6 +243,8 @@ struct IPRoute {
 
 class IPRouteTable : public Element { public:
 
+    IPRouteTable();
+
     void* cast(const char*);
     int configure(Vector<String>&, ErrorHandler*);
     void add_handlers();
@@ -196,7 +254,11 @@ class IPRouteTable : public Element { public:
     virtual int lookup_route(IPAddress addr, IPAddress& gw) const = 0;
     virtual String dump_routes();
 
+    enum { CMD_ADD, CMD_SET, CMD_REMOVE };
+    virtual int update_routes(const Vector<IPRoute> &commands, ErrorHandler *errh);
+
     void push(int port, Packet* p);
+    void push_batch(int port, PacketBatch &batch);
 
     static int add_route_handler(const String&, Element*, void*, ErrorHandler*);
     static int remove_route_handler(const String&, Element*, void*, ErrorHandler*);
@@ -204,10 +266,27 @@ class IPRouteTable : public Element { public:
     static int lookup_handler(int operation, String&, Element*, const Handler*, ErrorHandler*);
     static String table_handler(Element*, void*);
 
+  protected:
+
+    virtual bool use_spare_table(bool spare);
+    virtual void swap_tables();
+    int apply_commands(const Vector<IPRoute> &commands, ErrorHandler *errh,
+		       IPRoute *last_old_route = 0);
+
+    void lock_updates();
+    void unlock_updates();
+    bool forward_update(const IPRoute &command, IPRoute *old_route,
+			ErrorHandler *errh, int &result);
+
   private:
 
-    enum { CMD_ADD, CMD_SET, CMD_REMOVE };
-    int run_command(int command, const String &, Vector<IPRoute>* old_routes, ErrorHandler*);
+    Spinlock _update_lock;
+    int _updating;
+
+    int apply_update(const Vector<IPRoute> &commands, IPRoute *old_route,
+		     ErrorHandler *errh);
+    int parse_command(int command, const String &, IPRoute &route, ErrorHandler*);
+    int apply_command(const IPRoute &route, IPRoute &old_route, ErrorHandler*);
 
 };
 
@@ -29,7 +29,6 @@
 #include <click/straccum.hh>
 #include <click/error.hh>
 #include <click/algorithm.hh>
-#include <click/heap.hh>
 CLICK_DECLS
 
 IPRewriterFlow::IPRewriterFlow(const IPFlowID &flowid, int output,
@@ -37,8 +36,8 @@ IPRewriterFlow::IPRewriterFlow(const IPFlowID &flowid, int output,
 			       uint8_t ip_p, bool guaranteed,
 			       click_jiffies_t expiry_j,
 			       IPRewriterBase *owner, int owner_input)
-    : _expiry_j(expiry_j), _ip_p(ip_p), _state(0),
-      _guaranteed(guaranteed), _reply_anno(0),
+    : _expiry_j(expiry_j), _filed_j(expiry_j), _ip_p(ip_p), _state(0),
+      _guaranteed(guaranteed), _reply_anno(0), _shard(0), _mapid(0),
       _owner(owner), _owner_input(owner_input)
 {
     _e[0].initialize(flowid, output, false);
@@ -84,11 +83,11 @@ IPRewriterFlow::apply(WritablePacket *p, bool direction, unsigned annos)
 
 	// check for session ending flags
 	if (tcph->th_flags & TH_RST)
-	    _state |= s_both_done;
+	    change_state(s_both_done, 0);
 	else if (tcph->th_flags & TH_FIN)
-	    _state |= (s_forward_done << direction);
+	    change_state(s_forward_done << direction, 0);
 	else if (tcph->th_flags & TH_SYN)
-	    _state &= ~(s_forward_done << direction);
+	    change_state(0, s_forward_done << direction);
 
     } else if (iph->ip_p == IP_PROTO_UDP) {
 	click_udp *udph = p->udp_header();
@@ -99,36 +98,10 @@ IPRewriterFlow::apply(WritablePacket *p, bool direction, unsigned annos)
     }
 }
 
-void
-IPRewriterFlow::change_expiry(IPRewriterHeap *h, bool guaranteed,
-			      click_jiffies_t expiry_j)
-{
-    Vector<IPRewriterFlow *> &current_heap = h->_heaps[_guaranteed];
-    assert(current_heap[_place] == this);
-    _expiry_j = expiry_j;
-    if (_guaranteed != guaranteed) {
-	remove_heap(current_heap.begin(), current_heap.end(),
-		    current_heap.begin() + _place,
-		    heap_less(), heap_place());
-	current_heap.pop_back();
-	_guaranteed = guaranteed;
-	Vector<IPRewriterFlow *> &new_heap = h->_heaps[_guaranteed];
-	new_heap.push_back(this);
-	push_heap(new_heap.begin(), new_heap.end(),
-		  heap_less(), heap_place());
-    } else
-	change_heap(current_heap.begin(), current_heap.end(),
-		    current_heap.begin() + _place,
-		    heap_less(), heap_place());
-}
-
 void
 IPRewriterFlow::destroy(IPRewriterHeap *heap)
 {
-    Vector<IPRewriterFlow *> &myheap = heap->_heaps[_guaranteed];
-    remove_heap(myheap.begin(), myheap.end(), myheap.begin() + _place,
-		heap_less(), heap_place());
-    myheap.pop_back();
+    heap->remove(this);
     --_owner->_input_specs[_owner_input].count;
     _owner->destroy_flow(this);
 }
@@ -26,6 +26,7 @@ class IPRewriterEntry { public:
 	_output = output;
 	_direction = direction;
 	_hashnext = 0;
+	_indexnext = 0;
     }
 
     const IPFlowID &flowid() const {
@@ -52,12 +53,28 @@ class IPRewriterEntry { public:
 	return _flowid;
     }
 
+    // Sharded rewriters also file each entry in a cross-shard index.
+    struct index_adapter {
+	typedef IPFlowID key_type;
+	typedef const IPFlowID &key_const_reference;
+	static IPRewriterEntry *&hashnext(IPRewriterEntry *e) {
+	    return e->_indexnext;
+	}
+	static key_const_reference hashkey(const IPRewriterEntry *e) {
+	    return e->_flowid;
+	}
+	static bool hashkeyeq(const IPFlowID &a, const IPFlowID &b) {
+	    return a == b;
+	}
+    };
+
   private:
 
     IPFlowID _flowid;
     uint32_t _output : 24;
     uint8_t _direction;
     IPRewriterEntry *_hashnext;
+    IPRewriterEntry *_indexnext;
 
     friend class HashContainer_adapter<IPRewriterEntry>;
 
@@ -98,9 +115,12 @@ class IPRewriterFlow { public:
     /** @brief Set expiration time to @a expiry_j.
      * @param h heap containing this flow
      * @param guaranteed whether the flow is guaranteed
-     * @param expiry_j expiration time in absolute jiffies */
-    void change_expiry(IPRewriterHeap *h, bool guaranteed,
-		       click_jiffies_t expiry_j);
+     * @param expiry_j expiration time in absolute jiffies
+     *
+     * A later expiration time in the same heap is only recorded; @a h
+     * moves the flow when it reaches the flow's old position. */
+    inline void change_expiry(IPRewriterHeap *h, bool guaranteed,
+			      click_jiffies_t expiry_j);
 
     /** @brief Set expiration time to a timeout after @a now_j.
      * @param h heap containing this flow
@@ -131,10 +151,35 @@ class IPRewriterFlow { public:
 	return (_state & s_both_data) == s_both_data;
     }
 
+    /** @brief Set the @a set state bits and clear the @a clear bits.
+     *
+     * Two threads may rewrite packets on a sharded rewriter's flow at once,
+     * so multithreaded drivers change the state with compare-and-swap.  A
+     * change that leaves the state as it was costs no atomic operation. */
+    void change_state(uint8_t set, uint8_t clear) {
+	uint8_t old = _state, x;
+	while ((x = (old & ~clear) | set) != old) {
+#if HAVE_MULTITHREAD
+	    uint8_t cur = __sync_val_compare_and_swap(&_state, old, x);
+	    if (cur == old)
+		break;
+	    old = cur;
+#else
+	    _state = x;
+	    break;
+#endif
+	}
+    }
+
     uint8_t ip_p() const {
 	return _ip_p;
     }
 
+    /** @brief Return the index of the owner's shard holding this flow. */
+    int shard() const {
+	return _shard;
+    }
+
     IPRewriterBase *owner() const {
 	return _owner;
     }
@@ -159,7 +204,7 @@ class IPRewriterFlow { public:
 
     struct heap_less {
 	inline bool operator()(IPRewriterFlow *a, IPRewriterFlow *b) {
-	    return click_jiffies_less(a->expiry(), b->expiry());
+	    return click_jiffies_less(a->_filed_j, b->_filed_j);
 	}
     };
     struct heap_place {
@@ -174,17 +219,23 @@ class IPRewriterFlow { public:
     uint16_t _ip_csum_delta;
     uint16_t _udp_csum_delta;
     click_jiffies_t _expiry_j;
-    size_t _place : 32;
+    click_jiffies_t _filed_j;	// expiry where the heap placed us, <= _expiry_j
+    size_t _place : 32;		// heap index, or wheel_place
+    IPRewriterFlow *_wheel_next;
+    IPRewriterFlow **_wheel_pprev;
     uint8_t _ip_p;
-    uint8_t _state : 7;
-    uint8_t _guaranteed : 1;
+    uint8_t _state;
+    uint8_t _guaranteed;
     uint8_t _tflags;
     uint8_t _reply_anno;
+    uint8_t _shard;
+    uint8_t _mapid;
     IPRewriterBase *_owner;
     int _owner_input;
 
     friend class IPRewriterBase;
     friend class IPRewriterEntry;
+    friend class IPRewriterHeap;
 
   private:
 
@@ -39,9 +39,34 @@ IPRewriterPattern::IPRewriterPattern(const IPAddress &saddr, int sport,
 		       bool is_napt, bool sequential, bool same_first,
 		       uint32_t variation_top)
     : _saddr(saddr), _sport(sport), _daddr(daddr), _dport(dport),
-      _variation_top(variation_top), _next_variation(0), _is_napt(is_napt),
-      _sequential(sequential), _same_first(same_first), _refcount(0)
+      _variation_top(variation_top), _next_variation(new uint32_t[1]),
+      _nstripes(1), _is_napt(is_napt), _sequential(sequential),
+      _same_first(same_first), _refcount(0)
 {
+    _next_variation[0] = 0;
+}
+
+IPRewriterPattern::~IPRewriterPattern()
+{
+    delete[] _next_variation;
+}
+
+/** @brief Prepare for rewrite_flowid() calls with up to @a nstripes stripes.
+ *
+ * Each stripe keeps its own sequential position, so the threads of a
+ * sharded rewriter can rewrite flows with one pattern at once. */
+void
+IPRewriterPattern::set_stripes(int nstripes)
+{
+    if (nstripes > _nstripes) {
+	uint32_t *next = new uint32_t[nstripes];
+	memcpy(next, _next_variation, _nstripes * sizeof(uint32_t));
+	for (int i = _nstripes; i < nstripes; ++i)
+	    next[i] = 0;
+	delete[] _next_variation;
+	_next_variation = next;
+	_nstripes = nstripes;
+    }
 }
 
 namespace {
@@ -216,10 +241,17 @@ IPRewriterPattern::parse_with_ports(const String &conf, IPRewriterInput *input,
 	&& parse_ports(port_words, input, e, errh);
 }
 
+/** @brief Choose a rewritten flow ID for @a flowid.
+ *
+ * Variations already used in @a reply_map are skipped.  If @a nstripes > 1,
+ * only variations congruent to @a stripe modulo @a nstripes are used, so
+ * that rewriters sharded by thread never pick the same variation from two
+ * shards. */
 int
 IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 				  IPFlowID &rewritten_flowid,
-				  const HashContainer<IPRewriterEntry> &reply_map)
+				  const HashContainer<IPRewriterEntry> &reply_map,
+				  int stripe, int nstripes)
 {
     rewritten_flowid = flowid;
     if (_saddr)
@@ -234,22 +266,31 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
     if (_variation_top) {
 	IPFlowID lookup = rewritten_flowid.reverse();
 	uint32_t base = (_is_napt ? ntohs(_sport) : ntohl(_saddr.addr()));
+	if ((uint32_t) stripe > _variation_top)
+	    return IPRewriterBase::rw_drop;
 
 	uint32_t val;
 	if (_same_first
-	    && (val = ntohs(flowid.sport()) - base) <= _variation_top) {
+	    && (val = ntohs(flowid.sport()) - base) <= _variation_top
+	    && val % nstripes == (uint32_t) stripe) {
 	    lookup.set_dport(flowid.sport());
 	    if (!reply_map.find(lookup))
 		goto found_variation;
 	}
 
 	if (_sequential)
-	    val = (_next_variation > _variation_top ? 0 : _next_variation);
+	    val = (_next_variation[stripe] > _variation_top ? 0 : _next_variation[stripe]);
 	else
 	    val = click_random(0, _variation_top);
+	if (nstripes > 1) {
+	    val += stripe - val % nstripes;
+	    if (val > _variation_top)
+		val = stripe;
+	}
 
-	for (uint32_t count = 0; count <= _variation_top;
-	     ++count, val = (val == _variation_top ? 0 : val + 1)) {
+	for (uint32_t count = 0; count <= (_variation_top - stripe) / nstripes;
+	     ++count, val = (_variation_top - val < (uint32_t) nstripes
+			     ? stripe : val + nstripes)) {
 	    if (_is_napt)
 		lookup.set_dport(htons(base + val));
 	    else
@@ -265,7 +306,7 @@ IPRewriterPattern::rewrite_flowid(const IPFlowID &flowid,
 	    rewritten_flowid.set_sport(lookup.dport());
 	else
 	    rewritten_flowid.set_saddr(lookup.daddr());
-	_next_variation = val + 1;
+	_next_variation[stripe] = val + 1;
     }
 
     return IPRewriterBase::rw_addmap;
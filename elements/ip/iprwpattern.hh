@@ -15,6 +15,7 @@ class IPRewriterPattern { public:
 		      const IPAddress &daddr, int dport,
 		      bool is_napt, bool sequential, bool same_first,
 		      uint32_t variation);
+    ~IPRewriterPattern();
     static bool parse(const Vector<String> &words, IPRewriterPattern **result,
 		      Element *context, ErrorHandler *errh);
     static bool parse_ports(const Vector<String> &words, IPRewriterInput *input,
@@ -37,8 +38,10 @@ class IPRewriterPattern { public:
 	return _daddr;
     }
 
+    void set_stripes(int nstripes);
     int rewrite_flowid(const IPFlowID &flowid, IPFlowID &rewritten_flowid,
-		       const HashContainer<IPRewriterEntry> &reply_map);
+		       const HashContainer<IPRewriterEntry> &reply_map,
+		       int stripe = 0, int nstripes = 1);
 
     String unparse() const;
 
@@ -50,7 +53,8 @@ class IPRewriterPattern { public:
     int _dport;			// net byte order
 
     uint32_t _variation_top;
-    uint32_t _next_variation;
+    uint32_t *_next_variation;	// one per stripe
+    int _nstripes;
 
     bool _is_napt;
     bool _sequential;
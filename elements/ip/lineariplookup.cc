@@ -210,11 +210,9 @@ LinearIPLookup::dump_routes()
     return sa.take_string();
 }
 
-void
-LinearIPLookup::push(int, Packet *p)
+inline int
+LinearIPLookup::cached_lookup_entry(IPAddress a)
 {
-#define EXCHANGE(a,b,t) { t = a; a = b; b = t; }
-    IPAddress a = p->dst_ip_anno();
     int ei = -1;
 
     if (a && a == _last_addr)
@@ -234,6 +232,16 @@ LinearIPLookup::push(int, Packet *p)
 	static int complained = 0;
 	if (++complained <= 5)
 	    click_chatter("LinearIPLookup: no route for %s", a.unparse().c_str());
+    }
+
+    return ei;
+}
+
+void
+LinearIPLookup::push(int, Packet *p)
+{
+    int ei = cached_lookup_entry(p->dst_ip_anno());
+    if (ei < 0) {
 	p->kill();
 	return;
     }
@@ -244,6 +252,29 @@ LinearIPLookup::push(int, Packet *p)
     output(e.port).push(p);
 }
 
+void
+LinearIPLookup::push_batch(int, PacketBatch &batch)
+{
+    PacketBatch run;
+    int run_port = -1;
+    while (Packet *p = batch.pop_front()) {
+	int ei = cached_lookup_entry(p->dst_ip_anno());
+	if (ei < 0) {
+	    p->kill();
+	    continue;
+	}
+	const IPRoute &e = _t[ei];
+	if (e.gw)
+	    p->set_dst_ip_anno(e.gw);
+	if (e.port != run_port && !run.empty())
+	    output(run_port).push_batch(run);
+	run_port = e.port;
+	run.push_back(p);
+    }
+    if (!run.empty())
+	output(run_port).push_batch(run);
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(IPRouteTable)
 EXPORT_ELEMENT(LinearIPLookup)
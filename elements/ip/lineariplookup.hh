@@ -91,6 +91,7 @@ class LinearIPLookup : public IPRouteTable { public:
     int initialize(ErrorHandler *);
 
     void push(int port, Packet *p);
+    void push_batch(int port, PacketBatch &batch);
 
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
@@ -113,6 +114,7 @@ class LinearIPLookup : public IPRouteTable { public:
 #endif
 
     int lookup_entry(IPAddress) const;
+    inline int cached_lookup_entry(IPAddress);
 
 };
 
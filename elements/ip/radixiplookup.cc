@@ -25,6 +25,7 @@
 #include <click/error.hh>
 #include <click/glue.hh>
 #include <click/straccum.hh>
+#include <click/master.hh>
 #include "radixiplookup.hh"
 CLICK_DECLS
 
@@ -135,8 +136,14 @@ RadixIPLookup::Radix::change(uint32_t addr, uint32_t mask, int key, bool set)
 
 
 RadixIPLookup::RadixIPLookup()
-    : _vfree(-1), _default_key(0), _radix(Radix::make_radix(24, 256))
 {
+    for (int i = 0; i < 2; ++i) {
+	_t[i].vfree = -1;
+	_t[i].default_key = 0;
+	_t[i].radix = 0;
+    }
+    _t[0].radix = Radix::make_radix(24, 256);
+    _live = _writer = &_t[0];
 }
 
 RadixIPLookup::~RadixIPLookup()
@@ -144,98 +151,163 @@ RadixIPLookup::~RadixIPLookup()
 }
 
 
+int
+RadixIPLookup::initialize(ErrorHandler *errh)
+{
+    // Other threads may look up routes while a handler changes them, so
+    // keep a spare copy of the table for update_routes().
+    if (master()->nthreads() > 1) {
+	Table *t = &_t[0];
+	if (!(_t[1].radix = Radix::make_radix(24, 256)))
+	    return errh->error("out of memory");
+	for (int j = t->vfree; j >= 0; j = t->v[j].extra)
+	    t->v[j].kill();
+	// Holding the update lock makes add_route() change _writer directly.
+	lock_updates();
+	_writer = &_t[1];
+	for (int i = 0; i < t->v.size(); i++)
+	    if (t->v[i].real())
+		(void) add_route(t->v[i], false, 0, errh);
+	_writer = &_t[0];
+	unlock_updates();
+    }
+    return 0;
+}
+
 void
 RadixIPLookup::cleanup(CleanupStage)
 {
-    _v.clear();
-    Radix::free_radix(_radix);
-    _radix = 0;
+    for (Table *t = _t; t != _t + 2; ++t) {
+	t->v.clear();
+	if (t->radix)
+	    Radix::free_radix(t->radix);
+	t->radix = 0;
+    }
+}
+
+bool
+RadixIPLookup::use_spare_table(bool spare)
+{
+    if (!_t[1].radix)
+	return false;
+    Table *live = _live;
+    _writer = (spare ? &_t[live == &_t[0]] : live);
+    return true;
+}
+
+void
+RadixIPLookup::swap_tables()
+{
+    Table *old = _live;
+    click_fence();
+    _live = _writer;
+    _writer = old;
 }
 
 
 String
 RadixIPLookup::dump_routes()
 {
+    Table *t = _writer;
     StringAccum sa;
-    for (int j = _vfree; j >= 0; j = _v[j].extra)
-	_v[j].kill();
-    for (int i = 0; i < _v.size(); i++)
-	if (_v[i].real())
-	    _v[i].unparse(sa, true) << '\n';
+    for (int j = t->vfree; j >= 0; j = t->v[j].extra)
+	t->v[j].kill();
+    for (int i = 0; i < t->v.size(); i++)
+	if (t->v[i].real())
+	    t->v[i].unparse(sa, true) << '\n';
     return sa.take_string();
 }
 
 
 int
-RadixIPLookup::add_route(const IPRoute &route, bool set, IPRoute *old_route, ErrorHandler *)
+RadixIPLookup::add_route(const IPRoute &route, bool set, IPRoute *old_route, ErrorHandler *errh)
 {
-    int found = (_vfree < 0 ? _v.size() : _vfree), last_key;
+    int r;
+    if (_t[1].radix) {
+	IPRoute command = route;
+	command.extra = (set ? CMD_SET : CMD_ADD);
+	if (forward_update(command, old_route, errh, r))
+	    return r;
+    }
+
+    Table *t = _writer;
+    int found = (t->vfree < 0 ? t->v.size() : t->vfree), last_key;
     if (route.mask) {
 	uint32_t addr = ntohl(route.addr.addr());
 	uint32_t mask = ntohl(route.mask.addr());
-	last_key = _radix->change(addr, mask, found + 1, set);
+	last_key = t->radix->change(addr, mask, found + 1, set);
     } else {
-	last_key = _default_key;
+	last_key = t->default_key;
 	if (!last_key || set)
-	    _default_key = found + 1;
+	    t->default_key = found + 1;
     }
 
     if (last_key && old_route)
-	*old_route = _v[last_key - 1];
+	*old_route = t->v[last_key - 1];
     if (last_key && !set)
 	return -EEXIST;
 
-    if (found == _v.size())
-	_v.push_back(route);
+    if (found == t->v.size())
+	t->v.push_back(route);
     else {
-	_vfree = _v[found].extra;
-	_v[found] = route;
+	t->vfree = t->v[found].extra;
+	t->v[found] = route;
     }
-    _v[found].extra = -1;
+    t->v[found].extra = -1;
 
     if (last_key) {
-	_v[last_key - 1].extra = _vfree;
-	_vfree = last_key - 1;
+	t->v[last_key - 1].extra = t->vfree;
+	t->vfree = last_key - 1;
     }
 
     return 0;
 }
 
 int
-RadixIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler*)
+RadixIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler *errh)
 {
+    int r;
+    if (_t[1].radix) {
+	IPRoute command = route;
+	command.extra = CMD_REMOVE;
+	if (forward_update(command, old_route, errh, r))
+	    return r;
+    }
+
+    Table *t = _writer;
     int last_key;
     if (route.mask) {
 	uint32_t addr = ntohl(route.addr.addr());
 	uint32_t mask = ntohl(route.mask.addr());
 	// NB: this will never actually make changes
-	last_key = _radix->change(addr, mask, 0, false);
+	last_key = t->radix->change(addr, mask, 0, false);
     } else
-	last_key = _default_key;
+	last_key = t->default_key;
 
     if (last_key && old_route)
-	*old_route = _v[last_key - 1];
-    if (!last_key || !route.match(_v[last_key - 1]))
+	*old_route = t->v[last_key - 1];
+    if (!last_key || !route.match(t->v[last_key - 1]))
 	return -ENOENT;
-    _v[last_key - 1].extra = _vfree;
-    _vfree = last_key - 1;
+    t->v[last_key - 1].extra = t->vfree;
+    t->vfree = last_key - 1;
 
     if (route.mask) {
 	uint32_t addr = ntohl(route.addr.addr());
 	uint32_t mask = ntohl(route.mask.addr());
-	(void) _radix->change(addr, mask, 0, true);
+	(void) t->radix->change(addr, mask, 0, true);
     } else
-	_default_key = 0;
+	t->default_key = 0;
     return 0;
 }
 
 int
 RadixIPLookup::lookup_route(IPAddress addr, IPAddress &gw) const
 {
-    int key = Radix::lookup(_radix, _default_key, ntohl(addr.addr()));
+    const Table *t = _live;
+    int key = Radix::lookup(t->radix, t->default_key, ntohl(addr.addr()));
     if (key) {
-	gw = _v[key - 1].gw;
-	return _v[key - 1].port;
+	gw = t->v[key - 1].gw;
+	return t->v[key - 1].port;
     } else {
 	gw = 0;
 	return -1;
@@ -61,6 +61,10 @@ operation.
 
 =n
 
+In a multithreaded router, RadixIPLookup keeps a second copy of its table.
+Handler updates change that copy and then publish it, so lookups on other
+threads never see a partly applied update and never wait for one.
+
 See IPRouteTable for a performance comparison of the various IP routing
 elements.
 
@@ -77,6 +81,7 @@ class RadixIPLookup : public IPRouteTable { public:
     const char *port_count() const		{ return "1/-"; }
     const char *processing() const		{ return PUSH; }
 
+    int initialize(ErrorHandler *);
     void cleanup(CleanupStage);
 
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
@@ -84,16 +89,27 @@ class RadixIPLookup : public IPRouteTable { public:
     int lookup_route(IPAddress, IPAddress&) const;
     String dump_routes();
 
+  protected:
+
+    bool use_spare_table(bool spare);
+    void swap_tables();
+
   private:
 
     class Radix;
 
-    // Simple routing table
-    Vector<IPRoute> _v;
-    int _vfree;
+    struct Table {
+	// Simple routing table
+	Vector<IPRoute> v;
+	int vfree;
+
+	int default_key;
+	Radix *radix;
+    };
 
-    int _default_key;
-    Radix *_radix;
+    Table _t[2];
+    Table * volatile _live;	// used by lookups
+    Table *_writer;		// changed by add_route and remove_route
 
 };
 
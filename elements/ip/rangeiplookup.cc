@@ -23,22 +23,30 @@
 #include <click/ipaddress.hh>
 #include <click/straccum.hh>
 #include <click/router.hh>
+#include <click/master.hh>
 #include <click/error.hh>
 CLICK_DECLS
 
 RangeIPLookup::RangeIPLookup()
-    : _range_base((uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t))),
-      _range_len((uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t))),
-      _range_t((uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t))),
-      _active(false)
+    : _live(&_ranges[0]), _active(false)
 {
+    memset(_ranges, 0, sizeof(_ranges));
+    _ranges[0].base = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+    _ranges[0].len = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+    _ranges[0].t = (uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t));
 }
 
 RangeIPLookup::~RangeIPLookup()
 {
-    CLICK_LFREE(_range_base, (1 << KICKSTART_BITS) * sizeof(uint32_t));
-    CLICK_LFREE(_range_len, (1 << KICKSTART_BITS) * sizeof(uint32_t));
-    CLICK_LFREE(_range_t, RANGES_MAX * sizeof(uint32_t));
+    // The vport tables are ours only if there is a spare copy.
+    bool own_vport = _ranges[1].vport;
+    for (Ranges *r = _ranges; r != _ranges + 2; ++r) {
+	CLICK_LFREE(r->base, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	CLICK_LFREE(r->len, (1 << KICKSTART_BITS) * sizeof(uint32_t));
+	CLICK_LFREE(r->t, RANGES_MAX * sizeof(uint32_t));
+	if (own_vport && r->vport)
+	    CLICK_LFREE(r->vport, DirectIPLookup::vport_capacity_limit * sizeof(DirectIPLookup::VirtualPort));
+    }
 }
 
 int
@@ -52,8 +60,24 @@ RangeIPLookup::configure(Vector<String> &conf, ErrorHandler *errh)
 }
 
 int
-RangeIPLookup::initialize(ErrorHandler *)
+RangeIPLookup::initialize(ErrorHandler *errh)
 {
+    if (!_ranges[0].base || !_ranges[0].len || !_ranges[0].t)
+	return errh->error("out of memory");
+    // Other threads may look up routes while a handler changes them, so
+    // build updated ranges in a spare copy, with its own copy of the vport
+    // table.
+    if (master()->nthreads() > 1) {
+	for (int i = 0; i < 2; ++i)
+	    if (!(_ranges[i].vport = (DirectIPLookup::VirtualPort *) CLICK_LALLOC(DirectIPLookup::vport_capacity_limit * sizeof(DirectIPLookup::VirtualPort))))
+		return errh->error("out of memory");
+	Ranges &r = _ranges[1];
+	r.base = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+	r.len = (uint32_t *) CLICK_LALLOC((1 << KICKSTART_BITS) * sizeof(uint32_t));
+	if (!(r.t = (uint32_t *) CLICK_LALLOC(RANGES_MAX * sizeof(uint32_t)))
+	    || !r.base || !r.len)
+	    return errh->error("out of memory");
+    }
     expand();
     _active = true;
     return 0;
@@ -90,21 +114,22 @@ RangeIPLookup::push(int, Packet *p)
 int
 RangeIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
 {
+    const Ranges *r = _live;
     uint32_t ip_addr = ntohl(dest.addr());
     uint32_t lowerbound, upperbound, middle;
     uint32_t i = ip_addr >> RANGE_SHIFT; // kickstart table index = MS bits
     uint16_t vport_i;
 
-    lowerbound = _range_base[i];
-    upperbound = lowerbound + _range_len[i];
+    lowerbound = r->base[i];
+    upperbound = lowerbound + r->len[i];
     i = ip_addr & RANGE_MASK;		// Compare only masked LS bits
 
     // Binary search for a matching range
     while (upperbound > lowerbound) {
 	middle = (upperbound + lowerbound) >> 1;
-	if (i < (_range_t[middle] & RANGE_MASK))
+	if (i < (r->t[middle] & RANGE_MASK))
 	    upperbound = middle;
-	else if (i < (_range_t[middle + 1] & RANGE_MASK)) {
+	else if (i < (r->t[middle + 1] & RANGE_MASK)) {
 	    lowerbound = middle;
 	    break;
 	} else
@@ -112,9 +137,9 @@ RangeIPLookup::lookup_route(IPAddress dest, IPAddress &gw) const
     }
 
     // MS bits of the found range contain an index into the output port table
-    vport_i = _range_t[lowerbound] >> RANGE_SHIFT;
-    gw = _helper._vport[vport_i].gw;
-    return _helper._vport[vport_i].port;
+    vport_i = r->t[lowerbound] >> RANGE_SHIFT;
+    gw = r->vport[vport_i].gw;
+    return r->vport[vport_i].port;
 }
 
 void
@@ -127,21 +152,63 @@ RangeIPLookup::add_handlers()
 int
 RangeIPLookup::add_route(const IPRoute& route, bool allow_replace, IPRoute* old_route, ErrorHandler *errh)
 {
+    // expand() publishes the change, so no spare copy is needed here.
+    lock_updates();
     int error = _helper.add_route(route, allow_replace, old_route, errh);
     if (error == 0 && _active)
 	expand();
+    unlock_updates();
     return error;
 }
 
 int
 RangeIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandler *errh)
 {
+    // expand() publishes the change, so no spare copy is needed here.
+    lock_updates();
     int error = _helper.remove_route(route, old_route, errh);
     if (error == 0 && _active)
 	expand();
+    unlock_updates();
     return error;
 }
 
+int
+RangeIPLookup::update_routes(const Vector<IPRoute> &commands, ErrorHandler *errh)
+{
+    // Expand once for the whole batch, not once per command.  Expand even
+    // if the batch was rolled back: without a spare copy, the live ranges
+    // may point into _helper's reallocated vport table.
+    lock_updates();
+    bool active = _active;
+    _active = false;
+    int r = apply_commands(commands, errh);
+    _active = active;
+    if (active)
+	expand();
+    unlock_updates();
+    return r;
+}
+
+/** @brief Rebuild the lookup ranges and make them live.
+ *
+ * With a spare copy, builds the ranges there, publishes them, and waits for
+ * lookups on other threads to finish with the old copy, which becomes the
+ * next spare. */
+void
+RangeIPLookup::expand()
+{
+    Ranges *r = _live;
+    if (_ranges[1].t)
+	r = &_ranges[r == &_ranges[0]];
+    expand(r);
+    if (r != _live) {
+	click_fence();
+	_live = r;
+	master()->wait_grace_period();
+    }
+}
+
 /*
  * On each routing table update, we distill the address range based lookup
  * table from the structures provided by the DirectIPLookup class.
@@ -151,7 +218,7 @@ RangeIPLookup::remove_route(const IPRoute& route, IPRoute* old_route, ErrorHandl
  * the future, which would not depend on huge directiplookup tables.
  */
 void
-RangeIPLookup::expand()
+RangeIPLookup::expand(Ranges *r)
 {
     uint32_t range_t_index = 0;
     uint32_t tbl_0_23_index = 0;
@@ -162,7 +229,7 @@ RangeIPLookup::expand()
 	uint16_t vport_i, vport_i1;
 
 	vport_i = 0xffff;       // Duh!
-	_range_base[range_base] = range_t_index;
+	r->base[range_base] = range_t_index;
 
 	for (range_len = 0;
 	  tbl_0_23_index < ((range_base + 1) << (24 - KICKSTART_BITS));
@@ -175,7 +242,7 @@ RangeIPLookup::expand()
 		    vport_i1 = _helper._tbl_24_31[tbl_24_31_index + j];
 		    if (vport_i != vport_i1) {
 			vport_i = vport_i1;
-			_range_t[range_t_index] =
+			r->t[range_t_index] =
 					vport_i << (32 - KICKSTART_BITS) |
 					(((tbl_0_23_index << 8) + j) &
 					(0xffffffff >> KICKSTART_BITS));
@@ -187,7 +254,7 @@ RangeIPLookup::expand()
 		vport_i1 = _helper._tbl_0_23[tbl_0_23_index];
 		if (vport_i != vport_i1) {
 		    vport_i = vport_i1;
-		    _range_t[range_t_index] =
+		    r->t[range_t_index] =
 					vport_i << (32 - KICKSTART_BITS) |
 					((tbl_0_23_index << 8) &
 					(0xffffffff >> KICKSTART_BITS));
@@ -196,12 +263,19 @@ RangeIPLookup::expand()
 		}
 	    }
 	}
-	_range_len[range_base] = range_len - 1;
+	r->len[range_base] = range_len - 1;
     }
 
+    // Lookups read output ports from a copy of the vport table if the
+    // ranges may be live while _helper changes.
+    if (!_ranges[1].t)
+	r->vport = _helper._vport;
+    else
+	memcpy(r->vport, _helper._vport, _helper._vport_size * sizeof(DirectIPLookup::VirtualPort));
+
 #ifdef RANGEIPLOOKUP_VERBOSE
     click_chatter("Range expansion done: %d ranges using %d + %d bytes",
-		  range_t_index, sizeof(_range_base) + sizeof(_range_len),
+		  range_t_index, 2 * (1 << KICKSTART_BITS) * sizeof(uint32_t),
 		  range_t_index * sizeof(uint32_t));
 #endif
 }
@@ -210,9 +284,8 @@ void
 RangeIPLookup::flush_table()
 {
     _helper.flush();
-    memset(_range_base, 0, sizeof(_range_base));
-    memset(_range_len, 0, sizeof(_range_len));
-    memset(_range_t, 0, sizeof(_range_t));
+    if (_active)
+	expand();
 }
 
 int
@@ -220,7 +293,9 @@ RangeIPLookup::flush_handler(const String &, Element *e, void *,
                                 ErrorHandler *)
 {
     RangeIPLookup *t = static_cast<RangeIPLookup *>(e);
+    t->lock_updates();
     t->flush_table();
+    t->unlock_updates();
     return 0;
 }
 
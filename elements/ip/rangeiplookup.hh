@@ -38,6 +38,12 @@ RangeIPLookup maintains a large DirectIPLookup table as well as its own
 tables.  Although this subsidiary table is only accessed during route updates,
 it significantly adds to RangeIPLookup's total memory footprint.
 
+Each update rebuilds the lookup structure from the DirectIPLookup table; a
+`C<ctrl>' update with many commands rebuilds it only once.  In a
+multithreaded router, RangeIPLookup keeps a second, equally small lookup
+structure: updates rebuild that copy and then publish it, so lookups on other
+threads never see a partly built structure and never wait for an update.
+
 =h table read-only
 
 Outputs a human-readable version of the current routing table.
@@ -99,22 +105,30 @@ class RangeIPLookup : public IPRouteTable { public:
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
     int lookup_route(IPAddress, IPAddress&) const;
     String dump_routes();
+    int update_routes(const Vector<IPRoute> &commands, ErrorHandler *errh);
 
     static int flush_handler(const String &, Element *, void *, ErrorHandler *);
 
   protected:
 
+    struct Ranges {
+	uint32_t *base;
+	uint32_t *len;
+	uint32_t *t;
+	DirectIPLookup::VirtualPort *vport;
+    };
+
     void flush_table();
     void expand();
+    void expand(Ranges *r);
 
     enum { KICKSTART_BITS = 12 };
     enum { RANGES_MAX = 256 * 1024 };
     enum { RANGE_MASK = 0xffffffff >> KICKSTART_BITS };
     enum { RANGE_SHIFT = 32 - KICKSTART_BITS };
 
-    uint32_t *_range_base;
-    uint32_t *_range_len;
-    uint32_t *_range_t;
+    Ranges _ranges[2];
+    Ranges * volatile _live;	// used by lookups
     bool _active;
 
     DirectIPLookup::Table _helper;
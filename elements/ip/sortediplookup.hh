@@ -32,6 +32,10 @@ class SortedIPLookup : public LinearIPLookup { public:
     int configure(Vector<String> &, ErrorHandler *);
 
     void push(int port, Packet *p);
+    // LinearIPLookup's push_batch() would use the wrong lookup_entry()
+    void push_batch(int port, PacketBatch &batch) {
+	Element::push_batch(port, batch);
+    }
 
     int add_route(const IPRoute&, bool, IPRoute*, ErrorHandler *);
     int remove_route(const IPRoute&, IPRoute*, ErrorHandler *);
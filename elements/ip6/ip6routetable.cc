@@ -82,8 +82,11 @@ IP6RouteTable::add_route_handler(const String &conf, Element *e, void *, ErrorHa
 
     if (ok >= 0 && (port < 0 || port >= r->noutputs()))
         ok = errh->error("output port out of range");
-    if (ok >= 0)
+    if (ok >= 0) {
+	r->_update_lock.acquire();
         ok = r->add_route(dst, mask, gw, port, errh);
+	r->_update_lock.release();
+    }
     return ok;
 }
 
@@ -102,8 +105,11 @@ IP6RouteTable::remove_route_handler(const String &conf, Element *e, void *, Erro
 	.read_mp("PREFIX", IP6PrefixArg(true), a, mask)
 	.complete();
 
-    if (ok >= 0)
+    if (ok >= 0) {
+	r->_update_lock.acquire();
 	ok = r->remove_route(a, mask, errh);
+	r->_update_lock.release();
+    }
     return ok;
 }
 
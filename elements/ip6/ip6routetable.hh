@@ -3,6 +3,7 @@
 #define CLICK_IP6ROUTETABLE_HH
 #include <click/glue.hh>
 #include <click/element.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 class IP6RouteTable : public Element { public:
@@ -18,6 +19,10 @@ class IP6RouteTable : public Element { public:
     static int ctrl_handler(const String&, Element*, void*, ErrorHandler*);
     static String table_handler(Element*, void*);
 
+  private:
+
+    Spinlock _update_lock;	// serializes the route-changing handlers
+
 };
 
 CLICK_ENDDECLS
@@ -2,37 +2,51 @@
 #define CLICK_IPSECAES_HH
 #include <click/element.hh>
 #include <click/glue.hh>
+#include "sadatatuple.hh"
 CLICK_DECLS
 
 /*
  * =c
- * IPsecAES(ENCRYPT)
+ * IPsecAES(ENCRYPT [, IMPLEMENTATION])
  * =s ipsec
- * encrypt packet using DES-CBC
+ * encrypt packet using AES-CBC
  * =d
  *
- * Encrypts or decrypts packet using DES-CBC. If the first argument is 0,
- * IPsecAES will decrypt. If the first argument is 1, IPsecAES will encrypt.
- * KEY is the DES secret key. Gets IV value from ESP header. IGNORE is the
- * number of bytes at the end of the payload to ignore. By default, IGNORE is
- * 12, which is the number of SHA1 authentication digest bytes for ESP or AH.
+ * Encrypts or decrypts packet using AES-CBC with a 128-bit key. If the first
+ * argument is 0, IPsecAES will decrypt. If the first argument is 1, IPsecAES
+ * will encrypt. The key comes from the security association named by the
+ * packet's SA annotation. Gets IV value from ESP header. The last 12 bytes of
+ * the payload, which hold the SHA1 authentication digest for ESP or AH, are
+ * not encrypted unless needed to fill the last 16-byte block.
  *
- * =a IPsecESPEncap, IPsecESPUnencap, IPsecAuthSHA1
+ * The key schedules are expanded once per security association and kept
+ * with it. On x86 processors with the AES-NI instructions, IPsecAES uses
+ * them in place of the lookup tables; it checks for them when the router is
+ * initialized. When packets arrive in a batch, IPsecAES encrypts up to four
+ * packets at once, so that their blocks fill the AES unit's pipeline.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item IMPLEMENTATION
+ *
+ * One of "auto", "table", or "aesni".  The AES code to use; "aesni" falls
+ * back to "auto", which picks AES-NI if the CPU has it, on CPUs without
+ * AES-NI.  Default is "auto".
+ *
+ * =back
+ *
+ * =h implementation read-only
+ * Returns "aesni" or "table", depending on which AES code is in use.
+ *
+ * =a IPsecESPEncap, IPsecESPUnencap, IPsecAuthHMACSHA1, IPsecBenchmark
  */
 
-# define GETU32(pt) (((unsigned long)(pt)[0] << 24) ^ ((unsigned long)(pt)[1] << 16) ^ ((unsigned long)(pt)[2] <<  8) ^ ((unsigned long)(pt)[3]))
+# define GETU32(pt) (((uint32_t)(pt)[0] << 24) ^ ((uint32_t)(pt)[1] << 16) ^ ((uint32_t)(pt)[2] <<  8) ^ ((uint32_t)(pt)[3]))
 # define PUTU32(ct, st) { (ct)[0] = (char)((st) >> 24); (ct)[1] = (char)((st) >> 16); (ct)[2] = (char)((st) >>  8); (ct)[3] = (char)(st); }
 /*#endif*/
 
-#define AES_MAXNR 14
-#define AES_BLOCK_SIZE 16
-
-struct aes_key_st {
-    unsigned long rd_key[4 *(AES_MAXNR + 1)];
-    int rounds;
-};
-typedef struct aes_key_st AES_KEY;
-
 
 class Address;
 
@@ -49,19 +63,37 @@ class Aes : public Element {
 
    int configure(Vector<String> &, ErrorHandler *);
    int initialize(ErrorHandler *);
+   void add_handlers();
 
    Packet *simple_action(Packet *);
+   void push_batch(int port, PacketBatch &batch);
 
    enum { AES_DECRYPT = 0, AES_ENCRYPT = 1 };
 
+   /* The blocks of one packet to be run through CBC mode. */
+   struct Job {
+     unsigned char *data;
+     const unsigned char *iv;
+     int nblocks;
+     const AES_KEY *key;
+   };
+
  private:
-   int AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-   int AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
-   void AES_encrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
-   void AES_decrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+   enum { BATCH_JOBS = 16 };
+   enum { IMPL_AUTO = -1, IMPL_TABLE = 0, IMPL_AESNI = 1 };
+
+   static int AES_set_encrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+   static int AES_set_decrypt_key(const unsigned char *userKey, const int bits, AES_KEY *key);
+   static void AES_encrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+   static void AES_decrypt(const unsigned char *in, unsigned char *out,const AES_KEY *key);
+   static const AES_KEY *sa_key(SADataTuple *sa_data, int op, int impl);
+   static void cbc_table(const Job &job, int op);
+   WritablePacket *prepare(Packet *p, Job &job);
+   void crypt(Job *jobs, int njobs) const;
+   static String implementation_handler(Element *, void *);
    unsigned _op;
+   int _impl;
    int _ignore;
-   AES_KEY _key;
 };
 
 CLICK_ENDDECLS
@@ -120,6 +120,12 @@ IPsecESPUnencap::simple_action(Packet *p)
   return p;
 }
 
+void
+IPsecESPUnencap::push_batch(int port, PacketBatch &batch)
+{
+  simple_push_batch<IPsecESPUnencap>(port, batch);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPsecESPUnencap)
 ELEMENT_MT_SAFE(IPsecESPUnencap)
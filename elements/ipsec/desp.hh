@@ -31,6 +31,7 @@ public:
   int checkreplaywindow(SADataTuple * sa_data,unsigned long seq);
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, PacketBatch &batch);
 };
 
 CLICK_ENDDECLS
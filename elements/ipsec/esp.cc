@@ -97,6 +97,12 @@ IPsecESPEncap::simple_action(Packet *p)
   return(q);
 }
 
+void
+IPsecESPEncap::push_batch(int port, PacketBatch &batch)
+{
+  simple_push_batch<IPsecESPEncap>(port, batch);
+}
+
 
 
 CLICK_ENDDECLS
@@ -43,6 +43,7 @@ public:
   int configure(Vector<String> &, ErrorHandler *);
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, PacketBatch &batch);
 
 private:
 
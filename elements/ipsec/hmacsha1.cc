@@ -31,11 +31,10 @@
 #include "elements/ipsec/hmac.hh"
 #include "satable.hh"
 #include "sadatatuple.hh"
+#include "sha1mb.hh"
+#include <click/packetbatch.hh>
 CLICK_DECLS
 
-#define SHA_DIGEST_LEN 20
-#define KEY_SIZE 16
-
 IPsecAuthHMACSHA1::IPsecAuthHMACSHA1()
 {
 }
@@ -47,54 +46,139 @@ IPsecAuthHMACSHA1::~IPsecAuthHMACSHA1()
 int
 IPsecAuthHMACSHA1::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh).read_mp("VERIFY", _op).complete();
+    String impl = "auto";
+    if (Args(conf, this, errh)
+	.read_mp("VERIFY", _op)
+	.read("IMPLEMENTATION", WordArg(), impl)
+	.complete() < 0)
+	return -1;
+    if ((_impl = sha1mb_parse(impl)) < SHA1MB_AUTO)
+	return errh->error("unknown IMPLEMENTATION %<%s%>", impl.c_str());
+    return 0;
 }
 
 int
 IPsecAuthHMACSHA1::initialize(ErrorHandler *)
 {
   _drops = 0;
+  _count = 0;
+  _impl = sha1mb_select(_impl);
   return 0;
 }
 
+void
+IPsecAuthHMACSHA1::drop(Packet *p)
+{
+  if (_drops == 0)
+    click_chatter("Invalid SHA1 authentication digest");
+  _drops++;
+  if (noutputs() > 1)
+    output(1).push(p);
+  else
+    p->kill();
+}
 
+/* Return p if it can be hashed, or drop it and return 0. */
 Packet *
-IPsecAuthHMACSHA1::simple_action(Packet *p)
+IPsecAuthHMACSHA1::check(Packet *p)
 {
-  SADataTuple * sa_data=(SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(p);
-  unsigned int len;
-  // compute HMAC
-  len = SHA_DIGEST_LEN;
+  if (!IPSEC_SA_DATA_REFERENCE_ANNO(p)) {
+    click_chatter("IPsecAuthHMACSHA1: packet without security association");
+    p->kill();
+    return 0;
+  }
+  if (_op == VERIFY_AUTH && p->length() < AUTH_LEN) {
+    drop(p);
+    return 0;
+  }
+  return p;
+}
 
+/* Compute the HMAC of each of ps[0..n-1], leaving out the digest when
+   verifying.  The keys are only 16 bytes long and are not padded to the
+   SHA-1 block size, so the inner and outer hashes start from the pads
+   themselves. */
+void
+IPsecAuthHMACSHA1::compute(Packet **ps, int n, unsigned char (*digest)[DIGEST_LEN])
+{
+  SHA1MBJob jobs[BATCH];
+  unsigned char inner[BATCH][DIGEST_LEN];
+  int trailer = (_op == VERIFY_AUTH ? AUTH_LEN : 0);
+
+  for (int i = 0; i < n; i++) {
+    SADataTuple *sa_data = (SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(ps[i]);
+    jobs[i].prefix = sa_data->hmac_ipad;
+    jobs[i].prefix_len = KEY_SIZE;
+    jobs[i].data = ps[i]->data();
+    jobs[i].len = ps[i]->length() - trailer;
+    jobs[i].digest = inner[i];
+  }
+  sha1mb_hash(jobs, n, _impl);
+
+  for (int i = 0; i < n; i++) {
+    SADataTuple *sa_data = (SADataTuple *)IPSEC_SA_DATA_REFERENCE_ANNO(ps[i]);
+    jobs[i].prefix = sa_data->hmac_opad;
+    jobs[i].data = inner[i];
+    jobs[i].len = DIGEST_LEN;
+    jobs[i].digest = digest[i];
+  }
+  sha1mb_hash(jobs, n, _impl);
+  _count += n;
+}
+
+/* Append or check the digest of p. */
+Packet *
+IPsecAuthHMACSHA1::finish(Packet *p, const unsigned char *digest)
+{
   if (_op == COMPUTE_AUTH) {
-    unsigned char digest [SHA_DIGEST_LEN];
-    HMAC(sa_data->Authentication_key,KEY_SIZE,(u_char*) p->data(),p->length(),digest,&len);
-    WritablePacket *q = p->put(12);
-    u_char *ah = ((u_char*)q->data())+q->length()-12;
-    memmove(ah, digest, 12);
+    WritablePacket *q = p->put(AUTH_LEN);
+    if (!q)
+      return 0;
+    u_char *ah = ((u_char*)q->data())+q->length()-AUTH_LEN;
+    memcpy(ah, digest, AUTH_LEN);
     return q;
   }
   else {
-    const u_char *ah = p->data()+p->length()-12;
-    unsigned char digest [SHA_DIGEST_LEN];
-
-    HMAC(sa_data->Authentication_key,KEY_SIZE,(u_char*) p->data(),p->length()-12,digest,&len);
-    if (memcmp(ah, digest, 12)) {
-      if (_drops == 0)
-	click_chatter("Invalid SHA1 authentication digest");
-      _drops++;
-      if (noutputs() > 1)
-	output(1).push(p);
-      else
-	p->kill();
+    const u_char *ah = p->data()+p->length()-AUTH_LEN;
+    if (memcmp(ah, digest, AUTH_LEN)) {
+      drop(p);
       return 0;
     }
     //remove digest
-    p->take(12);
+    p->take(AUTH_LEN);
     return p;
   }
 }
 
+Packet *
+IPsecAuthHMACSHA1::simple_action(Packet *p)
+{
+  unsigned char digest[1][DIGEST_LEN];
+  if (!(p = check(p)))
+    return 0;
+  compute(&p, 1, digest);
+  return finish(p, digest[0]);
+}
+
+void
+IPsecAuthHMACSHA1::push_batch(int, PacketBatch &batch)
+{
+  PacketBatch out;
+  Packet *ps[BATCH];
+  unsigned char digest[BATCH][DIGEST_LEN];
+  while (!batch.empty()) {
+    int n = 0;
+    while (n < BATCH && !batch.empty())
+      if ((ps[n] = check(batch.pop_front())))
+	n++;
+    compute(ps, n, digest);
+    for (int i = 0; i < n; i++)
+      if (Packet *q = finish(ps[i], digest[i]))
+	out.push_back(q);
+  }
+  output(0).push_batch(out);
+}
+
 String
 IPsecAuthHMACSHA1::drop_handler(Element *e, void *)
 {
@@ -102,10 +186,21 @@ IPsecAuthHMACSHA1::drop_handler(Element *e, void *)
   return String(a->_drops);
 }
 
+String
+IPsecAuthHMACSHA1::read_handler(Element *e, void *thunk)
+{
+  IPsecAuthHMACSHA1 *a = (IPsecAuthHMACSHA1 *)e;
+  if (thunk)
+    return String(sha1mb_name(a->_impl));
+  return String(a->_count);
+}
+
 void
 IPsecAuthHMACSHA1::add_handlers()
 {
   add_read_handler("drops", drop_handler, 0);
+  add_read_handler("count", read_handler, 0);
+  add_read_handler("implementation", read_handler, 1);
 }
 
 #include "sha1_impl.cc"
@@ -113,4 +208,5 @@ IPsecAuthHMACSHA1::add_handlers()
 
 CLICK_ENDDECLS
 EXPORT_ELEMENT(IPsecAuthHMACSHA1)
+ELEMENT_REQUIRES(IPsecSHA1MB)
 ELEMENT_MT_SAFE(IPsecAuthHMACSHA1)
@@ -7,16 +7,46 @@ CLICK_DECLS
 
 /*
  * =c
- * IPsecAuthHMACSHA1(VERIFY)
+ * IPsecAuthHMACSHA1(VERIFY [, IMPLEMENTATION])
  * =s ipsec
  * verify SHA1 authentication digest.
  * =d
  *
  * If first argument is 0, computes SHA1 authentication digest for ESP packet
  * per RFC 2404, 2406. If first argument is 1, verify SHA1 digest and remove
- * authentication bits.
+ * authentication bits.  Packets that fail verification are dropped, or
+ * emitted on output 1 if there is one.
  *
- * =a IPsecESPEncap, IPsecDES
+ * The key pads are kept with each security association.  Batches of packets
+ * are hashed together, several at a time in the lanes of SSE2 or AVX2
+ * registers, or one at a time with the SHA-NI instructions, as the CPU
+ * allows.
+ *
+ * Keyword arguments are:
+ *
+ * =over 8
+ *
+ * =item IMPLEMENTATION
+ *
+ * One of "auto", "generic", "sse2", "avx2", or "shani".  The SHA-1 code to
+ * use; implementations this CPU does not support fall back to "auto", which
+ * picks the fastest.  Default is "auto".
+ *
+ * =back
+ *
+ * =h count read-only
+ *
+ * Returns the number of packets authenticated or verified.
+ *
+ * =h drops read-only
+ *
+ * Returns the number of packets that failed verification.
+ *
+ * =h implementation read-only
+ *
+ * Returns the SHA-1 implementation in use.
+ *
+ * =a IPsecESPEncap, IPsecDES, IPsecBenchmark
  */
 
 class IPsecAuthHMACSHA1 : public Element {
@@ -33,16 +63,26 @@ public:
   int initialize(ErrorHandler *);
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, PacketBatch &batch);
   void add_handlers();
 
   static String drop_handler(Element *e, void *thunk);
+  static String read_handler(Element *e, void *thunk);
 
 private:
 
   int _op;
+  int _impl;
   atomic_uint32_t _drops;
+  atomic_uint32_t _count;
 
   enum { COMPUTE_AUTH = 0, VERIFY_AUTH = 1 };
+  enum { BATCH = 16, DIGEST_LEN = 20, AUTH_LEN = 12 };
+
+  Packet *check(Packet *p);
+  void compute(Packet **ps, int n, unsigned char (*digest)[DIGEST_LEN]);
+  Packet *finish(Packet *p, const unsigned char *digest);
+  void drop(Packet *p);
 };
 
 CLICK_ENDDECLS
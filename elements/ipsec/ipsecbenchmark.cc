@@ -0,0 +1,178 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * ipsecbenchmark.{cc,hh} -- measure IPsec tunnel throughput
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "ipsecbenchmark.hh"
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/glue.hh>
+#include <click/timestamp.hh>
+#include <click/packetbatch.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPsecBenchmark::IPsecBenchmark()
+    : _received(0), _intact(0)
+{
+}
+
+IPsecBenchmark::~IPsecBenchmark()
+{
+}
+
+int
+IPsecBenchmark::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String sizes = "64 512 1500";
+    String enc_key = "0123456789abcdef", auth_key = "fedcba9876543210";
+    _packets = 100000;
+    _batch = 32;
+    _spi = 1;
+    if (Args(conf, this, errh)
+	.read("SIZES", AnyArg(), sizes)
+	.read("PACKETS", _packets)
+	.read("BATCH", _batch)
+	.read("SPI", _spi)
+	.read("ENCRYPT_KEY", enc_key)
+	.read("AUTH_KEY", auth_key)
+	.complete() < 0)
+	return -1;
+
+    Vector<String> words;
+    cp_spacevec(sizes, words);
+    _sizes.clear();
+    for (String *w = words.begin(); w != words.end(); ++w) {
+	int size;
+	if (!IntArg().parse(*w, size) || size < 28)
+	    return errh->error("SIZES must be lengths of at least 28");
+	_sizes.push_back(size);
+    }
+    if (_packets < 0 || _batch <= 0)
+	return errh->error("bad PACKETS or BATCH");
+    if (!_spi)
+	return errh->error("SPI must be nonzero");
+    if (enc_key.length() != KEY_SIZE || auth_key.length() != KEY_SIZE)
+	return errh->error("keys must be %d bytes long", KEY_SIZE);
+    _sa = SADataTuple(enc_key.data(), auth_key.data(), 1, 64);
+    return 0;
+}
+
+/** @brief Make a UDP packet of @a size bytes annotated with the SA.
+ *
+ * Every packet of a given size is the same, so the input can check what
+ * comes back against one copy. */
+Packet *
+IPsecBenchmark::make_packet(int size) const
+{
+    WritablePacket *q = Packet::make(size);
+    if (!q)
+	return 0;
+    click_ip *ip = reinterpret_cast<click_ip *>(q->data());
+    memset(ip, 0, sizeof(click_ip) + sizeof(click_udp));
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_len = htons(size);
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_src.s_addr = htonl(0x0A000001);
+    ip->ip_dst.s_addr = htonl(0x0A000002);
+    ip->ip_sum = click_in_cksum((const unsigned char *) ip, sizeof(click_ip));
+    q->set_ip_header(ip, sizeof(click_ip));
+
+    click_udp *udp = q->udp_header();
+    udp->uh_sport = htons(1024);
+    udp->uh_dport = htons(9);
+    udp->uh_ulen = htons(size - sizeof(click_ip));
+    unsigned char *x = reinterpret_cast<unsigned char *>(udp + 1);
+    for (int i = sizeof(click_ip) + sizeof(click_udp); i < size; ++i)
+	*x++ = i;
+
+    SET_IPSEC_SPI_ANNO(q, _spi);
+    SET_IPSEC_SA_DATA_REFERENCE_ANNO(q, (uintptr_t) &_sa);
+    return q;
+}
+
+void
+IPsecBenchmark::push(int, Packet *p)
+{
+    ++_received;
+    if (p->length() == (uint32_t) _expected.length()
+	&& memcmp(p->data(), _expected.data(), p->length()) == 0)
+	++_intact;
+    p->kill();
+}
+
+String
+IPsecBenchmark::benchmark()
+{
+    StringAccum sa;
+    for (int *size = _sizes.begin(); size != _sizes.end(); ++size) {
+	Packet *t = make_packet(*size);
+	if (!t)
+	    return "out of memory\n";
+	_expected = String(reinterpret_cast<const char *>(t->data()), *size);
+	t->kill();
+	_received = _intact = 0;
+	click_cycles_t cycles = 0;
+	Timestamp elapsed;
+	for (int sent = 0; sent < _packets; ) {
+	    PacketBatch batch;
+	    for (; sent < _packets && (int) batch.count() < _batch; ++sent)
+		if (Packet *p = make_packet(*size))
+		    batch.push_back(p);
+	    Timestamp t0 = Timestamp::now();
+	    click_cycles_t c0 = click_get_cycles();
+	    output(0).push_batch(batch);
+	    cycles += click_get_cycles() - c0;
+	    elapsed += Timestamp::now() - t0;
+	}
+
+	// Gbit/s is bits per nanosecond; print it with two decimals.
+	uint64_t nsec = elapsed.nsecval();
+	uint64_t centigbps = (nsec ? (uint64_t) *size * 800 * _packets / nsec : 0);
+	uint64_t pps = (nsec ? (uint64_t) _packets * 1000000000 / nsec : 0);
+	sa << *size << " bytes: "
+	   << (_packets ? cycles / _packets : 0) << " cycles/packet, "
+	   << (_packets ? nsec / _packets : 0) << " ns/packet, "
+	   << pps << " packets/s, "
+	   << (centigbps / 100) << '.' << ((centigbps / 10) % 10)
+	   << (centigbps % 10) << " Gbit/s, "
+	   << _received << " received, " << _intact << " intact\n";
+    }
+    _expected = String();
+    return sa.take_string();
+}
+
+String
+IPsecBenchmark::read_handler(Element *e, void *)
+{
+    return static_cast<IPsecBenchmark *>(e)->benchmark();
+}
+
+void
+IPsecBenchmark::add_handlers()
+{
+    add_read_handler("benchmark", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(IPsecBenchmark)
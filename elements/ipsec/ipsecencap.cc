@@ -155,6 +155,12 @@ IPsecEncap::simple_action(Packet *p_in)
   return p;
 }
 
+void
+IPsecEncap::push_batch(int port, PacketBatch &batch)
+{
+  simple_push_batch<IPsecEncap>(port, batch);
+}
+
 String
 IPsecEncap::read_handler(Element *e, void *thunk)
 {
@@ -95,6 +95,7 @@ class IPsecEncap : public Element { public:
   void add_handlers();
 
   Packet *simple_action(Packet *);
+  void push_batch(int port, PacketBatch &batch);
 
  private:
 
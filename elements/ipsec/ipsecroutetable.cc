@@ -289,14 +289,20 @@ int
 IPsecRouteTable::add_route_handler(const String &conf, Element *e, void *thunk, ErrorHandler *errh)
 {
     IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
-    return table->run_command((thunk ? CMD_SET : CMD_ADD), conf, 0, errh);
+    table->_update_lock.acquire();
+    int r = table->run_command((thunk ? CMD_SET : CMD_ADD), conf, 0, errh);
+    table->_update_lock.release();
+    return r;
 }
 
 int
 IPsecRouteTable::remove_route_handler(const String &conf, Element *e, void *, ErrorHandler *errh)
 {
     IPsecRouteTable *table = static_cast<IPsecRouteTable *>(e);
-    return table->run_command(CMD_REMOVE, conf, 0, errh);
+    table->_update_lock.acquire();
+    int r = table->run_command(CMD_REMOVE, conf, 0, errh);
+    table->_update_lock.release();
+    return r;
 }
 
 int
@@ -309,6 +315,7 @@ IPsecRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHa
     Vector<IPsecRoute> old_routes;
     int r = 0;
 
+    table->_update_lock.acquire();
     while (s < end) {
 	const char* nl = find(s, end, '\n');
 	String line = conf.substring(s, nl);
@@ -333,6 +340,7 @@ IPsecRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHa
 
 	s = nl + 1;
     }
+    table->_update_lock.release();
     return 0;
 
   rollback:
@@ -346,6 +354,7 @@ IPsecRouteTable::ctrl_handler(const String &conf_in, Element *e, void *, ErrorHa
 	    table->add_route(rt, true, 0, errh);
 	old_routes.pop_back();
     }
+    table->_update_lock.release();
     return r;
 }
 
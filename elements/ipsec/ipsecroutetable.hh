@@ -3,6 +3,7 @@
 #define CLICK_IPSECROUTETABLE_HH
 #include <click/glue.hh>
 #include <click/element.hh>
+#include <click/sync.hh>
 #include "satable.hh"
 #include "sadatatuple.hh"
 CLICK_DECLS
@@ -222,6 +223,7 @@ class IPsecRouteTable : public Element { public:
 
   private:
     enum { CMD_ADD, CMD_SET, CMD_REMOVE };
+    Spinlock _update_lock;	// serializes the route-changing handlers
     int run_command(int command, const String &, Vector<IPsecRoute>* old_routes, ErrorHandler*);
 
 };
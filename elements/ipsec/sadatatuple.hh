@@ -28,6 +28,16 @@ CLICK_DECLS
 
 #define KEY_SIZE 16
 
+#define AES_MAXNR 14
+#define AES_BLOCK_SIZE 16
+
+/* Expanded AES key schedule, in the form IPsecAES uses. */
+struct aes_key_st {
+    uint32_t rd_key[4 *(AES_MAXNR + 1)];
+    int rounds;			/* 0 until the schedule is filled in */
+};
+typedef struct aes_key_st AES_KEY;
+
 /* Security Parameter Index (SPI) Class*/
 
 class SPI {
@@ -80,6 +90,14 @@ class SADataTuple {
     uint8_t  ooowin;	/* out-of-order window size */
     uint32_t bitmap;	/* Support out-of-order receive support */
     uint32_t lastseq;	/* in host order */
+    /* Key schedules for decryption and encryption, expanded by IPsecAES
+       when it first uses this SA; indexed by [implementation][operation],
+       since the table and AES-NI code lay round keys out differently */
+    AES_KEY aes_key[2][2];
+    /* HMAC key pads, Authentication_key XOR 0x36 and XOR 0x5c, for
+       IPsecAuthHMACSHA1 */
+    uint8_t hmac_ipad[KEY_SIZE];
+    uint8_t hmac_opad[KEY_SIZE];
 
     SADataTuple() {
 	memset(this, 0, sizeof(*this));
@@ -90,6 +108,10 @@ class SADataTuple {
 		memset(this, 0, sizeof(*this));
 		memcpy(Encryption_key, enc_key, KEY_SIZE);
 		memcpy(Authentication_key, Auth_key, KEY_SIZE);
+		for (int i = 0; i < KEY_SIZE; i++) {
+		    hmac_ipad[i] = Authentication_key[i] ^ 0x36;
+		    hmac_opad[i] = Authentication_key[i] ^ 0x5c;
+		}
 		replay_start_counter = counter;
 		ooowin = o_oowin;
 	        bitmap=0;
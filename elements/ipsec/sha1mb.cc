@@ -0,0 +1,383 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * sha1mb.{cc,hh} -- SHA-1 over many messages at once
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#ifndef HAVE_IPSEC
+# error "Must #define HAVE_IPSEC in config.h"
+#endif
+#include "sha1mb.hh"
+#include <click/glue.hh>
+
+/* The vector code needs the SSE registers, which the kernel drivers cannot
+   use freely, and compiler support for per-function target options. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && !CLICK_LINUXMODULE && !CLICK_BSDMODULE \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+# define CLICK_SHA1MB_X86 1
+# include <cpuid.h>
+# include <immintrin.h>
+#endif
+
+CLICK_DECLS
+
+static const uint32_t sha1mb_iv[5] = {
+    0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U
+};
+
+static const char * const sha1mb_names[SHA1MB_NIMPL] = {
+    "generic", "sse2", "avx2", "shani"
+};
+
+static inline uint32_t
+sha1mb_load_be32(const unsigned char *p)
+{
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16)
+	| ((uint32_t) p[2] << 8) | p[3];
+}
+
+static inline void
+sha1mb_store_digest(unsigned char *d, const uint32_t *h)
+{
+    for (int i = 0; i < 5; ++i, d += 4) {
+	d[0] = h[i] >> 24;
+	d[1] = h[i] >> 16;
+	d[2] = h[i] >> 8;
+	d[3] = h[i];
+    }
+}
+
+static inline int
+sha1mb_nblocks(const SHA1MBJob &job)
+{
+    // room for the 0x80 byte and the 8-byte bit count
+    return (job.prefix_len + job.len + 8) / 64 + 1;
+}
+
+/** @brief Return block @a k of @a job's padded message.
+ *
+ * Blocks that lie within the data are returned in place.  Others, which
+ * hold prefix or padding bytes, are assembled in @a buf. */
+static const unsigned char *
+sha1mb_block(const SHA1MBJob &job, int k, int nblocks, unsigned char *buf)
+{
+    int off = 64 * k, end = job.prefix_len + job.len;
+    if (off >= job.prefix_len && off + 64 <= end)
+	return job.data + (off - job.prefix_len);
+
+    memset(buf, 0, 64);
+    if (off < job.prefix_len)
+	memcpy(buf, job.prefix + off, job.prefix_len - off);
+    int lo = (off > job.prefix_len ? off : job.prefix_len);
+    int hi = (off + 64 < end ? off + 64 : end);
+    if (lo < hi)
+	memcpy(buf + (lo - off), job.data + (lo - job.prefix_len), hi - lo);
+    if (end >= off && end < off + 64)
+	buf[end - off] = 0x80;
+    if (k == nblocks - 1) {
+	uint64_t bits = (uint64_t) end << 3;
+	for (int i = 0; i < 8; ++i)
+	    buf[63 - i] = bits >> (8 * i);
+    }
+    return buf;
+}
+
+#define SHA1MB_ROL(x, n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define SHA1MB_F0(b, c, d)	((b & c) | (~b & d))
+#define SHA1MB_F1(b, c, d)	(b ^ c ^ d)
+#define SHA1MB_F2(b, c, d)	((b & c) | (d & (b | c)))
+
+/* One block's 80 rounds.  V is uint32_t for one message, or a GCC vector
+   of uint32_t with one message per lane; the same expressions serve both.
+   The message schedule w is overwritten. */
+template <typename V> static inline __attribute__((always_inline)) void
+sha1mb_compress(V *h, V *w)
+{
+    V a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t;
+    int i;
+#define SHA1MB_STEP(a, b, c, d, e, j, f, k)				\
+    if ((j) >= 16) {							\
+	t = w[((j) + 13) & 15] ^ w[((j) + 8) & 15] ^ w[((j) + 2) & 15] ^ w[(j) & 15]; \
+	w[(j) & 15] = SHA1MB_ROL(t, 1);					\
+    }									\
+    e += SHA1MB_ROL(a, 5) + f(b, c, d) + w[(j) & 15] + (k);		\
+    b = SHA1MB_ROL(b, 30)
+#define SHA1MB_STEP5(f, k)						\
+    SHA1MB_STEP(a, b, c, d, e, i, f, k);				\
+    SHA1MB_STEP(e, a, b, c, d, i + 1, f, k);				\
+    SHA1MB_STEP(d, e, a, b, c, i + 2, f, k);				\
+    SHA1MB_STEP(c, d, e, a, b, i + 3, f, k);				\
+    SHA1MB_STEP(b, c, d, e, a, i + 4, f, k)
+    for (i = 0; i < 20; i += 5) {
+	SHA1MB_STEP5(SHA1MB_F0, 0x5A827999U);
+    }
+    for (; i < 40; i += 5) {
+	SHA1MB_STEP5(SHA1MB_F1, 0x6ED9EBA1U);
+    }
+    for (; i < 60; i += 5) {
+	SHA1MB_STEP5(SHA1MB_F2, 0x8F1BBCDCU);
+    }
+    for (; i < 80; i += 5) {
+	SHA1MB_STEP5(SHA1MB_F1, 0xCA62C1D6U);
+    }
+#undef SHA1MB_STEP5
+#undef SHA1MB_STEP
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void
+sha1mb_hash_generic(const SHA1MBJob &job)
+{
+    uint32_t h[5], w[16];
+    unsigned char buf[64];
+    memcpy(h, sha1mb_iv, sizeof(h));
+    int nblocks = sha1mb_nblocks(job);
+    for (int k = 0; k < nblocks; ++k) {
+	const unsigned char *p = sha1mb_block(job, k, nblocks, buf);
+	for (int i = 0; i < 16; ++i)
+	    w[i] = sha1mb_load_be32(p + 4 * i);
+	sha1mb_compress<uint32_t>(h, w);
+    }
+    sha1mb_store_digest(job.digest, h);
+}
+
+/* Hash up to N messages, one per lane.  Lanes run until the longest
+   message is done; a lane that has finished hashes leftover words, and its
+   result is ignored. */
+template <typename V, int N> static inline __attribute__((always_inline)) void
+sha1mb_hash_lanes(SHA1MBJob *jobs, int njobs)
+{
+    union { V v[16]; uint32_t u[16][N]; } w;
+    union { V v[5]; uint32_t u[5][N]; } h;
+    unsigned char buf[N][64];
+    int nblocks[N], maxblocks = 0;
+
+    memset(&w, 0, sizeof(w));
+    for (int i = 0; i < 5; ++i)
+	for (int l = 0; l < N; ++l)
+	    h.u[i][l] = sha1mb_iv[i];
+    for (int l = 0; l < njobs; ++l) {
+	nblocks[l] = sha1mb_nblocks(jobs[l]);
+	if (nblocks[l] > maxblocks)
+	    maxblocks = nblocks[l];
+    }
+
+    for (int k = 0; k < maxblocks; ++k) {
+	for (int l = 0; l < njobs; ++l)
+	    if (k < nblocks[l]) {
+		const unsigned char *p = sha1mb_block(jobs[l], k, nblocks[l], buf[l]);
+		for (int i = 0; i < 16; ++i)
+		    w.u[i][l] = sha1mb_load_be32(p + 4 * i);
+	    }
+	sha1mb_compress<V>(h.v, w.v);
+	for (int l = 0; l < njobs; ++l)
+	    if (k == nblocks[l] - 1) {
+		uint32_t d[5];
+		for (int i = 0; i < 5; ++i)
+		    d[i] = h.u[i][l];
+		sha1mb_store_digest(jobs[l].digest, d);
+	    }
+    }
+}
+
+#if CLICK_SHA1MB_X86
+typedef uint32_t sha1mb_v4 __attribute__((vector_size(16)));
+typedef uint32_t sha1mb_v8 __attribute__((vector_size(32)));
+
+__attribute__((target("sse2"))) static void
+sha1mb_hash_sse2(SHA1MBJob *jobs, int njobs)
+{
+    sha1mb_hash_lanes<sha1mb_v4, 4>(jobs, njobs);
+}
+
+__attribute__((target("avx2"))) static void
+sha1mb_hash_avx2(SHA1MBJob *jobs, int njobs)
+{
+    sha1mb_hash_lanes<sha1mb_v8, 8>(jobs, njobs);
+}
+
+/* Rounds 4g to 4g+3 for g >= 4.  ex and ey alternate between e0 and e1,
+   and m0 holds message words 4g to 4g+3; the caller rotates m0..m3.  The
+   last few steps compute message words that are never used. */
+#define SHA1MB_NI_STEP(g, ex, ey, m0, m1, m2, m3)	\
+    ex = _mm_sha1nexte_epu32(ex, m0);			\
+    ey = abcd;						\
+    m1 = _mm_sha1msg2_epu32(m1, m0);			\
+    abcd = _mm_sha1rnds4_epu32(abcd, ex, (g) / 5);	\
+    m3 = _mm_sha1msg1_epu32(m3, m0);			\
+    m2 = _mm_xor_si128(m2, m0)
+
+__attribute__((target("sha,ssse3,sse4.1"))) static void
+sha1mb_hash_shani(SHA1MBJob *jobs, int njobs)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    unsigned char buf[64];
+    for (; njobs > 0; ++jobs, --njobs) {
+	__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) sha1mb_iv), 0x1B);
+	__m128i e0 = _mm_set_epi32(sha1mb_iv[4], 0, 0, 0), e1;
+	int nblocks = sha1mb_nblocks(*jobs);
+	for (int k = 0; k < nblocks; ++k) {
+	    const unsigned char *p = sha1mb_block(*jobs, k, nblocks, buf);
+	    __m128i abcd_save = abcd, e0_save = e0, m0, m1, m2, m3;
+
+	    // rounds 0-15 load the message
+	    m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) p), bswap);
+	    e0 = _mm_add_epi32(e0, m0);
+	    e1 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+	    m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16)), bswap);
+	    e1 = _mm_sha1nexte_epu32(e1, m1);
+	    e0 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	    m0 = _mm_sha1msg1_epu32(m0, m1);
+
+	    m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 32)), bswap);
+	    e0 = _mm_sha1nexte_epu32(e0, m2);
+	    e1 = abcd;
+	    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+	    m1 = _mm_sha1msg1_epu32(m1, m2);
+	    m0 = _mm_xor_si128(m0, m2);
+
+	    m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 48)), bswap);
+	    e1 = _mm_sha1nexte_epu32(e1, m3);
+	    e0 = abcd;
+	    m0 = _mm_sha1msg2_epu32(m0, m3);
+	    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+	    m2 = _mm_sha1msg1_epu32(m2, m3);
+	    m1 = _mm_xor_si128(m1, m3);
+
+	    SHA1MB_NI_STEP(4, e0, e1, m0, m1, m2, m3);
+	    SHA1MB_NI_STEP(5, e1, e0, m1, m2, m3, m0);
+	    SHA1MB_NI_STEP(6, e0, e1, m2, m3, m0, m1);
+	    SHA1MB_NI_STEP(7, e1, e0, m3, m0, m1, m2);
+	    SHA1MB_NI_STEP(8, e0, e1, m0, m1, m2, m3);
+	    SHA1MB_NI_STEP(9, e1, e0, m1, m2, m3, m0);
+	    SHA1MB_NI_STEP(10, e0, e1, m2, m3, m0, m1);
+	    SHA1MB_NI_STEP(11, e1, e0, m3, m0, m1, m2);
+	    SHA1MB_NI_STEP(12, e0, e1, m0, m1, m2, m3);
+	    SHA1MB_NI_STEP(13, e1, e0, m1, m2, m3, m0);
+	    SHA1MB_NI_STEP(14, e0, e1, m2, m3, m0, m1);
+	    SHA1MB_NI_STEP(15, e1, e0, m3, m0, m1, m2);
+	    SHA1MB_NI_STEP(16, e0, e1, m0, m1, m2, m3);
+	    SHA1MB_NI_STEP(17, e1, e0, m1, m2, m3, m0);
+	    SHA1MB_NI_STEP(18, e0, e1, m2, m3, m0, m1);
+	    SHA1MB_NI_STEP(19, e1, e0, m3, m0, m1, m2);
+
+	    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+	    abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+	uint32_t h[5];
+	_mm_storeu_si128((__m128i *) h, _mm_shuffle_epi32(abcd, 0x1B));
+	h[4] = _mm_extract_epi32(e0, 3);
+	sha1mb_store_digest(jobs->digest, h);
+    }
+}
+
+#undef SHA1MB_NI_STEP
+#endif
+
+static bool sha1mb_supported[SHA1MB_NIMPL];
+static int sha1mb_best = -1;
+
+static void
+sha1mb_detect()
+{
+    /* Racing threads all store the same values. */
+    sha1mb_supported[SHA1MB_GENERIC] = true;
+    int best = SHA1MB_GENERIC;
+#if CLICK_SHA1MB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+	sha1mb_supported[best = SHA1MB_SSE2] = true;
+    unsigned a, b, c, d;
+    if (__get_cpuid_max(0, 0) >= 7
+	&& __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1")) {
+	__cpuid_count(7, 0, a, b, c, d);
+	if (b & (1U << 29))	// SHA extensions
+	    sha1mb_supported[best = SHA1MB_SHANI] = true;
+    }
+    // Eight AVX2 lanes outrun SHA-NI when there are messages to fill them.
+    if (__builtin_cpu_supports("avx2"))
+	sha1mb_supported[best = SHA1MB_AVX2] = true;
+#endif
+    sha1mb_best = best;
+}
+
+int
+sha1mb_select(int impl)
+{
+    if (sha1mb_best < 0)
+	sha1mb_detect();
+    if (impl >= 0 && impl < SHA1MB_NIMPL && sha1mb_supported[impl])
+	return impl;
+    return sha1mb_best;
+}
+
+void
+sha1mb_hash(SHA1MBJob *jobs, int njobs, int impl)
+{
+#if CLICK_SHA1MB_X86
+    if (impl == SHA1MB_SHANI) {
+	sha1mb_hash_shani(jobs, njobs);
+	return;
+    } else if (impl == SHA1MB_AVX2 || impl == SHA1MB_SSE2) {
+	int lanes = (impl == SHA1MB_AVX2 ? 8 : 4);
+	// A pass costs the same however many lanes are busy, so leave a
+	// remainder that fills few of them to single-message code.
+	bool shani = sha1mb_supported[SHA1MB_SHANI];
+	int fill = (shani ? lanes - lanes / 4 : 2);
+	while (njobs >= fill) {
+	    int n = (njobs < lanes ? njobs : lanes);
+	    if (impl == SHA1MB_AVX2)
+		sha1mb_hash_avx2(jobs, n);
+	    else
+		sha1mb_hash_sse2(jobs, n);
+	    jobs += n;
+	    njobs -= n;
+	}
+	if (shani) {
+	    sha1mb_hash_shani(jobs, njobs);
+	    return;
+	}
+    }
+#endif
+    for (; njobs > 0; ++jobs, --njobs)
+	sha1mb_hash_generic(*jobs);
+}
+
+const char *
+sha1mb_name(int impl)
+{
+    return (impl >= 0 && impl < SHA1MB_NIMPL ? sha1mb_names[impl] : "auto");
+}
+
+int
+sha1mb_parse(const String &s)
+{
+    if (s == "auto")
+	return SHA1MB_AUTO;
+    for (int i = 0; i < SHA1MB_NIMPL; ++i)
+	if (s == sha1mb_names[i])
+	    return i;
+    return -2;
+}
+
+CLICK_ENDDECLS
+ELEMENT_PROVIDES(IPsecSHA1MB)
@@ -0,0 +1,44 @@
+#ifndef CLICK_IPSEC_SHA1MB_HH
+#define CLICK_IPSEC_SHA1MB_HH
+#include <click/string.hh>
+CLICK_DECLS
+
+/*
+ * sha1mb.hh -- SHA-1 over many messages at once
+ *
+ * sha1mb_hash() computes the SHA-1 digests of several messages.  Depending
+ * on the CPU it hashes them one at a time with the SHA-NI instructions, or
+ * side by side in the lanes of SSE2 (4 lanes) or AVX2 (8 lanes) registers,
+ * or one at a time in portable C.  Messages too few to fill the lanes are
+ * hashed one at a time.  Each message is a short prefix followed by data, so
+ * HMAC key pads need not be copied in front of packet data.
+ */
+
+#define SHA1MB_DIGEST_LEN	20
+
+struct SHA1MBJob {
+    const unsigned char *prefix;	/* at most 64 bytes */
+    int prefix_len;
+    const unsigned char *data;
+    int len;
+    unsigned char *digest;		/* SHA1MB_DIGEST_LEN bytes */
+};
+
+enum {
+    SHA1MB_AUTO = -1, SHA1MB_GENERIC = 0, SHA1MB_SSE2, SHA1MB_AVX2,
+    SHA1MB_SHANI, SHA1MB_NIMPL
+};
+
+/* Return impl if this CPU supports it, or the best supported
+   implementation if impl is SHA1MB_AUTO or unsupported. */
+int sha1mb_select(int impl);
+/* Hash jobs[0] through jobs[njobs-1] with implementation impl, which must
+   come from sha1mb_select(). */
+void sha1mb_hash(SHA1MBJob *jobs, int njobs, int impl);
+/* Return impl's name: "generic", "sse2", "avx2", or "shani". */
+const char *sha1mb_name(int impl);
+/* Return the implementation named s, SHA1MB_AUTO for "auto", or -2. */
+int sha1mb_parse(const String &s);
+
+CLICK_ENDDECLS
+#endif
@@ -83,6 +83,8 @@ FromSimDevice::initialize(ErrorHandler *errh)
   Router* myrouter = router();
   _fd = myrouter->sim_get_ifid(_ifname.c_str());
   if (_fd < 0) return errh->error("unable to open netowrk interface");
+  if (_fd > Router::SIM_MAX_IFID)
+    return errh->error("interface id %d out of range", _fd);
   // create packet buffer
   _packetbuf = new unsigned char[_packetbuf_size];
   if (!_packetbuf) {
@@ -91,7 +93,8 @@ FromSimDevice::initialize(ErrorHandler *errh)
   }
 
   // Request that we get packets sent to us from the simulator
-  myrouter->sim_listen(_fd,eindex());
+  if (myrouter->sim_listen(_fd,eindex()) < 0)
+    return errh->error("cannot listen on interface %d", _fd);
 
   // Set the promisc mode on the interface
   if (_promisc) {
@@ -138,10 +141,17 @@ FromSimDevice::set_annotations(Packet *p,int ptype)
 int
 FromSimDevice::incoming_packet(int ifid,int ptype,const unsigned char* data,
 			       int len,simclick_simpacketinfo* pinfo){
+  if (Packet *p = Packet::make(data, len))
+    return incoming_packet(ifid, ptype, p, pinfo);
+  return -1;
+}
+
+int
+FromSimDevice::incoming_packet(int ifid,int ptype,Packet *p,
+			       simclick_simpacketinfo* pinfo){
   int result = 0;
   (void) ifid;
 
-  Packet *p = Packet::make(data, len);
   set_annotations(p,ptype);
   p->set_sim_packetinfo(pinfo);
   output(0).push(p);
@@ -149,6 +159,17 @@ FromSimDevice::incoming_packet(int ifid,int ptype,const unsigned char* data,
   return result;
 }
 
+int
+FromSimDevice::incoming_batch(int ifid,int ptype,PacketBatch &batch){
+  (void) ifid;
+
+  for (Packet *p = batch.front(); p; p = p->next())
+    set_annotations(p,ptype);
+  output(0).push_batch(batch);
+
+  return 0;
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(ns)
 EXPORT_ELEMENT(FromSimDevice)
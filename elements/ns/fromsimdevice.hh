@@ -75,6 +75,9 @@ class FromSimDevice : public Element {
   int fd() const			{ return _fd; }
   int incoming_packet(int ifid,int ptype,const unsigned char* data,int len,
 		      simclick_simpacketinfo* pinfo);
+  int incoming_packet(int ifid,int ptype,Packet *p,
+		      simclick_simpacketinfo* pinfo);
+  int incoming_batch(int ifid,int ptype,PacketBatch &batch);
 };
 
 CLICK_ENDDECLS
@@ -15,6 +15,13 @@ SimPacketAnalyzer::~SimPacketAnalyzer()
 {
 }
 
+void
+SimPacketAnalyzer::analyze_into(Packet *p, int offset, char *buf, int len)
+{
+  String s = analyze(p, offset);
+  strncpy(buf, s.c_str(), len);
+}
+
 
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(ns)
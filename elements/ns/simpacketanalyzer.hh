@@ -14,7 +14,9 @@ CLICK_DECLS
  * =d
  *
  * Implement this interface for specific protocols to allow analysis of
- * packets in ToSimTrace.
+ * packets in ToSimTrace. ToSimTrace's binary mode calls analyze_into(),
+ * which by default copies the result of analyze(); analyzers may override
+ * it to write straight into the trace record without building a String.
  *
  * =a
  * ToSimTrace
@@ -31,6 +33,7 @@ public:
   const char *port_count() const  { return PORTS_0_0; }
 
   virtual String analyze(Packet*, int offset) = 0;
+  virtual void analyze_into(Packet*, int offset, char *buf, int len);
 
 private:
 
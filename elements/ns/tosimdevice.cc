@@ -44,7 +44,8 @@
 CLICK_DECLS
 
 ToSimDevice::ToSimDevice()
-  : _fd(-1), _my_fd(false), _task(this), _encap_type(SIMCLICK_PTYPE_ETHER)
+  : _fd(-1), _my_fd(false), _task(this), _encap_type(SIMCLICK_PTYPE_ETHER),
+    _zero_copy(true)
 {
 }
 
@@ -60,6 +61,7 @@ ToSimDevice::configure(Vector<String> &conf, ErrorHandler *errh)
   if (Args(conf, this, errh)
       .read_mp("DEVNAME", _ifname)
       .read_p("ENCAP", WordArg(), encap_type)
+      .read("ZEROCOPY", _zero_copy)
       .complete() < 0)
     return -1;
   if (!_ifname)
@@ -89,6 +91,11 @@ ToSimDevice::initialize(ErrorHandler *errh)
   if (_fd < 0) return -1;
 
   _my_fd = true;
+  if (_zero_copy
+      && simclick_sim_command(myrouter->simnode(), SIMCLICK_SUPPORTS,
+			      SIMCLICK_SEND_BUFFER) <= 0)
+    _zero_copy = false;
+
   if (input_is_pull(0)) {
     ScheduleInfo::join_scheduler(this, &_task, errh);
     _signal = Notifier::upstream_empty_signal(this, 0, &_task);
@@ -109,8 +116,20 @@ ToSimDevice::send_packet(Packet *p)
   Router* myrouter = router();
   int retval;
   // We send out either ethernet or IP
-  retval = myrouter->sim_write(_fd,_encap_type,p->data(),p->length(),
-				 p->get_sim_packetinfo());
+  if (_zero_copy) {
+    // The simulator may keep the buffer, so it must not be shared.
+    WritablePacket *q = p->uniqueify();
+    if (!q)
+      return;
+    retval = myrouter->sim_write(_fd,_encap_type,q);
+    if (retval >= 0)
+      return;
+    // The simulator refused the buffer and left it to us; send a copy.
+    p = q;
+  }
+  simclick_simpacketinfo pinfo;
+  p->copy_sim_packetinfo(&pinfo);
+  retval = myrouter->sim_write(_fd,_encap_type,p->data(),p->length(),&pinfo);
   p->kill();
 }
 
@@ -52,6 +52,12 @@ CLICK_DECLS
  * Word.  The interface's encapsulation type.  Options are ETHER, IP, and
  * UNKNOWN; default is ETHER.
  *
+ * =item ZEROCOPY
+ *
+ * Boolean.  If true, and the simulator supports the SIMCLICK_SEND_BUFFER
+ * command, hand packet buffers to the simulator without copying them.  The
+ * simulator releases each packet when it is done with it.  Default is true.
+ *
  * =back
  *
  * =a
@@ -93,6 +99,7 @@ class ToSimDevice : public Element { public:
     bool _my_fd;
     Task _task;
     int _encap_type;
+    bool _zero_copy;
     NotifierSignal _signal;
 
     void send_packet(Packet *);
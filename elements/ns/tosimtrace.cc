@@ -33,11 +33,15 @@
 #include "tosimtrace.hh"
 #include <click/packet_anno.hh>
 #include <click/string.hh>
+#include <click/error.hh>
+#include <string.h>
+#include <errno.h>
 
 CLICK_DECLS
 
 ToSimTrace::ToSimTrace()
-                : _packetAnalyzer(0), _offset(0), _checkPaint(false)
+                : _packetAnalyzer(0), _offset(0), _checkPaint(false),
+		  _binary(false), _fp(0)
 {
         additional_info_ = "";
 }
@@ -56,23 +60,67 @@ ToSimTrace::configure(Vector<String> &conf, ErrorHandler *errh)
 	    .read("ADDITIONAL_INFO", additional_info_)
 	    .read("ANALYZER", ElementCastArg("SimPacketAnalyzer"), _packetAnalyzer)
 	    .read("OFFSET", _offset)
+	    .read("BINARY", _binary)
+	    .read("FILE", FilenameArg(), _filename)
 	    .complete() < 0)
                 return -1;
+        if (_filename)
+                _binary = true;
+        if (_binary && (event_.length() >= (int) sizeof(_record.event)
+                        || additional_info_.length() >= (int) sizeof(_record.info)))
+                return errh->error("binary traces allow EVENT up to %d and ADDITIONAL_INFO up to %d characters",
+                                   (int) sizeof(_record.event) - 1, (int) sizeof(_record.info) - 1);
+        return 0;
+}
+
+
+int
+ToSimTrace::initialize(ErrorHandler *errh)
+{
+        if (!_binary)
+                return 0;
+
+        if (_filename) {
+                assert(!_fp);
+                _fp = fopen(_filename.c_str(), "wb");
+                if (!_fp)
+                        return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+                simclick_trace_header h;
+                memset(&h, 0, sizeof(h));
+                strncpy(h.magic, SIMCLICK_TRACE_MAGIC, sizeof(h.magic));
+                h.version = SIMCLICK_TRACE_VERSION;
+                h.record_size = sizeof(simclick_trace_record);
+                if (fwrite(&h, sizeof(h), 1, _fp) != 1)
+                        return errh->error("%s: unable to write file header", _filename.c_str());
+        } else if (simclick_sim_command(router()->simnode(), SIMCLICK_SUPPORTS,
+                                        SIMCLICK_TRACE_RECORD) <= 0) {
+                errh->warning("simulator does not support binary trace records, using text");
+                _binary = false;
+                return 0;
+        }
+
+        // fields that do not change between packets are filled in once
+        memset(&_record, 0, sizeof(_record));
+        _record.node_id = router()->sim_get_node_id();
+        strncpy(_record.event, event_.c_str(), sizeof(_record.event) - 1);
+        strncpy(_record.info, additional_info_.c_str(), sizeof(_record.info) - 1);
         return 0;
 }
 
 
 void
-ToSimTrace::push(int, Packet *packet)
+ToSimTrace::cleanup(CleanupStage)
 {
-	struct timeval now = Timestamp::now().timeval();
-        simclick_simpacketinfo* pinfo = packet->get_sim_packetinfo();
+        if (_fp)
+                fclose(_fp);
+        _fp = 0;
+}
 
-        // the nsclick interface uses pinfo to store ns2 information that needs to traversed through the click graph. The 'id' field is used to store the ns2 id of the packet. If the packet is generated by click this is only set when the packet arrives at ns2 for the first time. We need to set it here for correct tracing.
 
-        if (pinfo->id < 0) {
-	    pinfo->id = router()->sim_get_next_pkt_id();
-        }
+void
+ToSimTrace::trace_text(Packet *packet, simclick_simpacketinfo *pinfo)
+{
+	struct timeval now = Timestamp::now().timeval();
 
         char buffer[250];
 
@@ -84,6 +132,46 @@ ToSimTrace::push(int, Packet *packet)
         sprintf(buffer, "%s %f _%i_ RTR --- %i raw %i [%s %s]", event_.c_str(), Timestamp(now).doubleval(), router()->sim_get_node_id(), pinfo->id, packet->length()-_offset, additional_info_.c_str(), analysis.c_str());
 
         router()->sim_trace(buffer);
+}
+
+
+void
+ToSimTrace::trace_binary(Packet *packet, simclick_simpacketinfo *pinfo)
+{
+        Timestamp now = Timestamp::now();
+        _record.sec = now.sec();
+        _record.usec = now.usec();
+        _record.packet_id = pinfo->id;
+        _record.length = packet->length() - _offset;
+        if (_packetAnalyzer != 0)
+                _packetAnalyzer->analyze_into(packet, _offset, _record.analysis, sizeof(_record.analysis));
+
+        if (_fp)
+                fwrite(&_record, sizeof(_record), 1, _fp);
+        else
+                router()->sim_trace(&_record);
+}
+
+
+void
+ToSimTrace::push(int, Packet *packet)
+{
+        simclick_simpacketinfo* pinfo = packet->get_sim_packetinfo();
+        if (!pinfo) {
+                output(0).push(packet);
+                return;
+        }
+
+        // the nsclick interface uses pinfo to store ns2 information that needs to traversed through the click graph. The 'id' field is used to store the ns2 id of the packet. If the packet is generated by click this is only set when the packet arrives at ns2 for the first time. We need to set it here for correct tracing.
+
+        if (pinfo->id < 0) {
+	    pinfo->id = router()->sim_get_next_pkt_id();
+        }
+
+        if (_binary)
+                trace_binary(packet, pinfo);
+        else
+                trace_text(packet, pinfo);
 
         output(0).push(packet);
 }
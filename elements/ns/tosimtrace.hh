@@ -8,7 +8,7 @@ CLICK_DECLS
 
 /*
 =c
-ToSimTrace()
+ToSimTrace(EVENT [, I<keywords> ADDITIONAL_INFO, ANALYZER, OFFSET, BINARY, FILE])
 
 =s traces
 
@@ -28,6 +28,39 @@ are traced as raw at the ns2 level, ToSimTrace traces the packets as raw
 as well, but to distinguish you can add the packet type in additional info or
 use a SimPacketAnalyzer).
 
+Keyword arguments are:
+
+=over 8
+
+=item ADDITIONAL_INFO
+
+String. Added to each entry. Default is empty.
+
+=item ANALYZER
+
+Name of a SimPacketAnalyzer element whose analysis is added to each entry.
+
+=item OFFSET
+
+Integer. Offset of the traced data in the packet, passed to ANALYZER and
+subtracted from the traced length. Default is 0.
+
+=item BINARY
+
+Boolean. If true, hand each entry to the simulator as a fixed-layout
+simclick_trace_record (see simclick.h) instead of formatting ns2 trace text.
+This is much cheaper per packet. Falls back to text, with a warning, if the
+simulator does not support binary records. Binary records hold at most 7
+characters of EVENT and 55 of ADDITIONAL_INFO. Default is false.
+
+=item FILE
+
+Filename. If given, write binary trace records to FILE instead of passing
+them to the simulator. Implies BINARY. Use the ns/simtrace2ns tool to
+convert one or more such files to ns2 trace text.
+
+=back
+
 =a
 SimPacketAnalyzer
 */
@@ -42,6 +75,8 @@ public:
   const char* port_count() const { return PORTS_1_1; }
 
   int configure(Vector<String> &conf, ErrorHandler *errh);
+  int initialize(ErrorHandler *errh);
+  void cleanup(CleanupStage stage);
   void push(int, Packet *packet);
 
 private:
@@ -51,6 +86,13 @@ private:
   String	_encap;
   int		_offset;
   bool		_checkPaint;
+  bool		_binary;
+  String	_filename;
+  FILE		*_fp;
+  simclick_trace_record _record;
+
+  void trace_text(Packet *packet, simclick_simpacketinfo *pinfo);
+  void trace_binary(Packet *packet, simclick_simpacketinfo *pinfo);
 
 };
 
@@ -1065,6 +1065,202 @@ CompressedProgram::unparse() const
 }
 
 
+//
+// SPECIALIZED PROGRAMS
+//
+
+void
+SpecializedProgram::clear()
+{
+    _nodes.clear();
+    _values.clear();
+    _targets.clear();
+    _shape = shape_none;
+    _safe_length = (unsigned) -1;
+    _base0 = 0;
+}
+
+/** @brief Specialize @a zprog.
+ * @param base_offsets ascending offsets at which each packet header starts
+ *   in @a zprog's offset space
+ * @param nbases number of base offsets
+ *
+ * A @a zprog offset belongs to the last base whose offset it reaches.  The
+ * pointers later passed to match() must correspond to these bases.  Returns
+ * false, leaving the program empty, if @a zprog matches everything (so needs
+ * no specialization) or @a nbases is not positive. */
+bool
+SpecializedProgram::compile(const CompressedProgram &zprog,
+			    const int *base_offsets, int nbases)
+{
+    clear();
+    const uint32_t *zbegin = zprog.begin(), *zend = zprog.end();
+    if (zprog.output_everything() >= 0 || zbegin == zend
+	|| nbases < 1)
+	return false;
+
+    // Compressed jumps count words; ours name nodes.
+    Vector<int> nodeno(zend - zbegin, -1);
+    int n = 0;
+    for (const uint32_t *pr = zbegin; pr < zend; pr += 4 + (pr[0] >> 17))
+	nodeno[pr - zbegin] = n++;
+
+    bool multibase = false;
+    for (const uint32_t *pr = zbegin; pr < zend; pr += 4 + (pr[0] >> 17)) {
+	Node x;
+	int off = (int16_t) pr[0];
+	int b = nbases - 1;
+	while (b > 0 && off < base_offsets[b])
+	    --b;
+	x.offset = off - base_offsets[b];
+	x.base = b;
+	x.mask = pr[3];
+	x.nvalues = pr[0] >> 17;
+	x.padding = 0;
+	if (x.nvalues <= 2) {
+	    x.kind = (x.nvalues == 1 ? k_single : k_pair);
+	    x.value[0] = pr[4];
+	    x.value[1] = pr[3 + x.nvalues];
+	} else {
+	    x.kind = (x.nvalues <= max_linear ? k_linear : k_bsearch);
+	    x.value[0] = x.value[1] = _values.size();
+	    for (uint32_t k = 0; k < x.nvalues; ++k)
+		_values.push_back(pr[4 + k]);
+	    if (x.kind == k_bsearch)
+		click_qsort(&_values[x.value[0]], x.nvalues);
+	}
+	for (int k = 0; k < 2; ++k) {
+	    int32_t j = pr[1 + k];
+	    x.j[k] = (j > 0 ? nodeno[pr - zbegin + j] : j);
+	    assert(x.j[k] != 0 || j == 0);
+	}
+	if (_nodes.empty())
+	    _base0 = b;
+	else if (b != _base0)
+	    multibase = true;
+	_nodes.push_back(x);
+    }
+
+    collapse_chains();
+    remove_unreachable();
+
+    bool single = true;
+    for (const Node *x = _nodes.begin(); x != _nodes.end(); ++x)
+	if (x->kind != k_single)
+	    single = false;
+    if (single)
+	_shape = (multibase ? shape_single_multibase : shape_single);
+    else
+	_shape = (multibase ? shape_general_multibase : shape_general);
+    _safe_length = zprog.safe_length();
+    return true;
+}
+
+namespace {
+struct SwitchEntry {
+    uint32_t value;
+    int order;
+    int32_t j;
+    bool operator<(const SwitchEntry &x) const {
+	return value < x.value || (value == x.value && order < x.order);
+    }
+};
+}
+
+void
+SpecializedProgram::collapse_chains()
+{
+    // Jumps always go forward, so a chain never loops back on itself.  A node
+    // absorbed into an earlier chain may still be reached from elsewhere; it
+    // stays as it is, but does not start a chain of its own.
+    Vector<int> absorbed(_nodes.size(), 0);
+    Vector<SwitchEntry> entries;
+    for (int i = 0; i < _nodes.size(); ++i) {
+	if (absorbed[i])
+	    continue;
+	uint32_t nvalues = _nodes[i].nvalues;
+	int last = i;
+	for (int k = _nodes[i].j[0];
+	     k > 0 && same_word(_nodes[i], _nodes[k]); k = _nodes[k].j[0]) {
+	    assert(k > last);
+	    nvalues += _nodes[k].nvalues;
+	    last = k;
+	}
+	if (nvalues < min_switch)
+	    continue;
+
+	entries.clear();
+	for (int k = i; ; k = _nodes[k].j[0]) {
+	    const Node &x = _nodes[k];
+	    for (uint32_t v = 0; v < x.nvalues; ++v) {
+		SwitchEntry e;
+		e.value = node_value(x, v);
+		e.order = entries.size();
+		e.j = x.j[1];
+		entries.push_back(e);
+	    }
+	    if (k != i)
+		absorbed[k] = 1;
+	    if (k == last)
+		break;
+	}
+	click_qsort(entries.begin(), entries.size());
+
+	Node &x = _nodes[i];
+	x.kind = k_switch;
+	x.value[0] = _values.size();
+	x.value[1] = _targets.size();
+	x.j[0] = _nodes[last].j[0];
+	x.j[1] = 0;
+	for (SwitchEntry *e = entries.begin(); e != entries.end(); ++e)
+	    // keep only the earliest test of each value
+	    if (e == entries.begin() || e[-1].value != e->value) {
+		_values.push_back(e->value);
+		_targets.push_back(e->j);
+	    }
+	x.nvalues = _values.size() - x.value[0];
+    }
+}
+
+void
+SpecializedProgram::remove_unreachable()
+{
+    Vector<int> nodeno(_nodes.size(), -1);
+    nodeno[0] = 0;
+    int n = 0;
+    for (int i = 0; i < _nodes.size(); ++i)
+	if (nodeno[i] >= 0) {
+	    nodeno[i] = n++;
+	    const Node &x = _nodes[i];
+	    for (int k = 0; k < 2; ++k)
+		if (x.j[k] > 0)
+		    nodeno[x.j[k]] = 0;
+	    if (x.kind == k_switch)
+		for (uint32_t k = 0; k < x.nvalues; ++k)
+		    if (_targets[x.value[1] + k] > 0)
+			nodeno[_targets[x.value[1] + k]] = 0;
+	}
+    if (n == _nodes.size())
+	return;
+
+    for (int i = 0; i < _nodes.size(); ++i)
+	if (nodeno[i] >= 0) {
+	    Node &x = _nodes[i];
+	    for (int k = 0; k < 2; ++k)
+		if (x.j[k] > 0)
+		    x.j[k] = nodeno[x.j[k]];
+	    if (x.kind == k_switch)
+		for (uint32_t k = 0; k < x.nvalues; ++k) {
+		    int32_t &j = _targets[x.value[1] + k];
+		    if (j > 0)
+			j = nodeno[j];
+		}
+	    _nodes[nodeno[i]] = x;
+	}
+    _nodes.resize(n);
+}
+
+
 //
 // RUNNING
 //
@@ -254,6 +254,90 @@ class CompressedProgram { public:
 };
 
 
+/** @brief A CompressedProgram specialized for fast matching.
+ *
+ * SpecializedProgram turns a CompressedProgram into an array of fixed-size
+ * decision nodes.  Each node knows which packet header its word comes from
+ * and how to search its values (tests against one or two values carry them
+ * inline), so matching never decodes instruction words.  The match loop is
+ * chosen by program shape: programs whose nodes all test a single value
+ * against a single header run the tightest loop.
+ *
+ * Long chains of nodes that test the same header word, each falling through
+ * to the next on failure, collapse into one multiway node that looks the word
+ * up in a sorted table of values.  Large ACLs with one rule per host or port
+ * compile to such chains.  The first value to appear in the chain wins, so
+ * the result is the same as walking the chain.
+ *
+ * A SpecializedProgram covers only packets at least safe_length() bytes long;
+ * shorter packets, and programs that match everything, must be handed to the
+ * interpreter. */
+class SpecializedProgram { public:
+
+    SpecializedProgram()
+	: _shape(shape_none), _safe_length((unsigned) -1), _base0(0) {
+    }
+
+    bool empty() const {
+	return _shape == shape_none;
+    }
+    unsigned safe_length() const {
+	return _safe_length;
+    }
+    int nnodes() const {
+	return _nodes.size();
+    }
+
+    bool compile(const CompressedProgram &zprog,
+		 const int *base_offsets, int nbases);
+    void clear();
+
+    inline int match(const unsigned char * const *base) const;
+
+  private:
+
+    enum { k_single, k_pair, k_linear, k_bsearch, k_switch };
+    enum { shape_none, shape_single, shape_single_multibase,
+	   shape_general, shape_general_multibase };
+    enum { max_linear = 4, min_switch = 8 };
+
+    struct Node {
+	int16_t offset;		// relative to base[base]
+	uint8_t base;
+	uint8_t kind;
+	uint32_t mask;
+	uint32_t value[2];	// k_single, k_pair: the values; otherwise
+				// value[0] indexes the first value in _values
+				// and, for k_switch, value[1] indexes the
+				// first target in _targets
+	uint32_t nvalues;
+	int32_t j[2];		// > 0: node index; <= 0: negated output
+	uint32_t padding;
+    };
+
+    Vector<Node> _nodes;
+    Vector<uint32_t> _values;
+    Vector<int32_t> _targets;
+    int _shape;
+    unsigned _safe_length;
+    int _base0;				// the base of a single-base program
+
+    uint32_t node_value(const Node &x, uint32_t k) const {
+	return x.nvalues <= 2 ? x.value[k] : _values[x.value[0] + k];
+    }
+    bool same_word(const Node &x, const Node &y) const {
+	return x.base == y.base && x.offset == y.offset && x.mask == y.mask;
+    }
+    void collapse_chains();
+    void remove_unreachable();
+
+    inline int step(const Node &x, uint32_t data) const;
+    template <bool single, bool multibase>
+    inline int run(const unsigned char * const *base) const;
+
+};
+
+
 class DominatorOptimizer { public:
 
     DominatorOptimizer(Program *p);
@@ -364,6 +448,83 @@ Program::match(const Packet *p)
     return -pos;
 }
 
+// The steps branch on each comparison rather than indexing 'j' with its
+// result: a predicted branch lets the CPU fetch the next node before the
+// packet data arrives.
+
+inline int
+SpecializedProgram::step(const Node &x, uint32_t data) const
+{
+    if (x.kind == k_single) {
+	if (data == x.value[0])
+	    return x.j[1];
+    } else if (x.kind == k_pair) {
+	if (data == x.value[0] || data == x.value[1])
+	    return x.j[1];
+    } else {
+	const uint32_t *v = _values.begin() + x.value[0];
+	const uint32_t *e = v + x.nvalues;
+	if (x.kind == k_linear) {
+	    for (; v != e; ++v)
+		if (*v == data)
+		    return x.j[1];
+	} else {
+	    const uint32_t *first = v;
+	    while (v < e) {
+		const uint32_t *m = v + (e - v) / 2;
+		if (*m == data)
+		    return (x.kind == k_switch
+			    ? _targets[x.value[1] + (m - first)] : x.j[1]);
+		else if (*m < data)
+		    v = m + 1;
+		else
+		    e = m;
+	    }
+	}
+    }
+    return x.j[0];
+}
+
+template <bool single, bool multibase>
+inline int
+SpecializedProgram::run(const unsigned char * const *base) const
+{
+    const Node *n = _nodes.begin();	// avoid bounds checking
+    const unsigned char *b0 = base[_base0];
+    int pos = 0;
+    do {
+	const Node &x = n[pos];
+	const unsigned char *b = (multibase ? base[x.base] : b0);
+	uint32_t data = *(const uint32_t *) (b + x.offset);
+	data &= x.mask;
+	if (!single)
+	    pos = step(x, data);
+	else if (data == x.value[0])
+	    pos = x.j[1];
+	else
+	    pos = x.j[0];
+    } while (pos > 0);
+    return -pos;
+}
+
+/** @brief Return the output for a packet.
+ * @param base packet data pointers, one per base offset passed to compile()
+ * @pre !empty() and the packet is at least safe_length() bytes long */
+inline int
+SpecializedProgram::match(const unsigned char * const *base) const
+{
+    switch (_shape) {
+    case shape_single:
+	return run<true, false>(base);
+    case shape_single_multibase:
+	return run<true, true>(base);
+    case shape_general:
+	return run<false, false>(base);
+    default:
+	return run<false, true>(base);
+    }
+}
+
 }}
 CLICK_ENDDECLS
 #endif
@@ -222,6 +222,10 @@ Classifier::configure(Vector<String> &conf, ErrorHandler *errh)
     if (!errh->nerrors()) {
 	prog.warn_unused_outputs(noutputs(), errh);
 	_prog = prog;
+	Classification::Wordwise::CompressedProgram zprog;
+	zprog.compile(prog, false, 0);
+	static const int base_offset = 0;
+	_sprog.compile(zprog, &base_offset, 1);
 	return 0;
     } else
 	return -1;
@@ -243,7 +247,23 @@ Classifier::add_handlers()
 void
 Classifier::push(int, Packet *p)
 {
-    checked_output_push(_prog.match(p), p);
+    checked_output_push(match(p), p);
+}
+
+void
+Classifier::push_batch(int, PacketBatch &batch)
+{
+    // Push each run of packets bound for the same output as one batch.
+    PacketBatch run;
+    int run_port = -1;
+    while (Packet *p = batch.pop_front()) {
+	int port = match(p);
+	if (port != run_port)
+	    checked_output_push_batch(run_port, run);
+	run_port = port;
+	run.push_back(p);
+    }
+    checked_output_push_batch(run_port, run);
 }
 
 CLICK_ENDDECLS
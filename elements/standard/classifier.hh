@@ -70,6 +70,10 @@ CLICK_DECLS
  *   safe length 22
  *   alignment offset 0
  *
+ * Classifier runs a specialized form of this program, with fixed-size steps
+ * that search multi-valued tests directly, for packets long enough to need no
+ * length checks; shorter packets fall back to interpreting the program above.
+ *
  * =a IPClassifier, IPFilter */
 
 class Classifier : public Element { public:
@@ -88,6 +92,10 @@ class Classifier : public Element { public:
     void add_handlers();
 
     void push(int port, Packet *);
+    void push_batch(int port, PacketBatch &batch);
+
+    inline int match(const Packet *p);
+    int match_interpreted(const Packet *p)	{ return _prog.match(p); }
 
     Classification::Wordwise::Program empty_program(ErrorHandler *errh) const;
     static void parse_program(Classification::Wordwise::Program &prog,
@@ -96,10 +104,20 @@ class Classifier : public Element { public:
   protected:
 
     Classification::Wordwise::Program _prog;
+    Classification::Wordwise::SpecializedProgram _sprog;
 
     static String program_string(Element *, void *);
 
 };
 
+inline int
+Classifier::match(const Packet *p)
+{
+    if (_sprog.empty() || p->length() < _sprog.safe_length())
+	return _prog.match(p);
+    const unsigned char *data = p->data() - _prog.align_offset();
+    return _sprog.match(&data);
+}
+
 CLICK_ENDDECLS
 #endif
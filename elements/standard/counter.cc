@@ -107,6 +107,18 @@ Counter::simple_action(Packet *p)
   return p;
 }
 
+void
+Counter::push_batch(int port, PacketBatch &batch)
+{
+    simple_push_batch<Counter>(port, batch);
+}
+
+PacketBatch
+Counter::pull_batch(int port, unsigned max)
+{
+    return simple_pull_batch<Counter>(port, max);
+}
+
 
 enum { H_COUNT, H_BYTE_COUNT, H_RATE, H_BIT_RATE, H_BYTE_RATE, H_RESET,
        H_COUNT_CALL, H_BYTE_COUNT_CALL };
@@ -115,6 +115,8 @@ class Counter : public Element { public:
     int llrpc(unsigned, void *);
 
     Packet *simple_action(Packet *);
+    void push_batch(int port, PacketBatch &batch);
+    PacketBatch pull_batch(int port, unsigned max);
 
   private:
 
@@ -63,16 +63,19 @@ Discard::push(int, Packet *p)
     p->kill();
 }
 
+void
+Discard::push_batch(int, PacketBatch &batch)
+{
+    _count += batch.count();
+    batch.kill();
+}
+
 bool
 Discard::run_task(Task *)
 {
-    unsigned x = _burst;
-    Packet *p;
-    while (x && (p = input(0).pull())) {
-	p->kill();
-	--x;
-    }
-    unsigned sent = _burst - x;
+    PacketBatch batch = input(0).pull_batch(_burst);
+    unsigned sent = batch.count();
+    batch.kill();
 
     _count += sent;
     if (_active && (sent || _signal))
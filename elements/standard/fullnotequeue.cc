@@ -80,6 +80,38 @@ FullNoteQueue::pull(int)
 	return pull_failure();
 }
 
+void
+FullNoteQueue::push_batch(int, PacketBatch &batch)
+{
+    // Code taken from push().
+    while (Packet *p = batch.pop_front()) {
+	Storage::index_type h = _head, t = _tail, nt = next_i(t);
+	if (nt != h)
+	    push_success(h, t, nt, p);
+	else
+	    push_failure(p);
+    }
+}
+
+PacketBatch
+FullNoteQueue::pull_batch(int, unsigned max)
+{
+    // Code taken from pull().  Only a pull that finds the queue empty
+    // counts towards sleepiness.
+    PacketBatch batch;
+    while (batch.count() < max) {
+	Storage::index_type h = _head, t = _tail, nh = next_i(h);
+	if (h != t)
+	    batch.push_back(pull_success(h, nh));
+	else {
+	    if (batch.empty())
+		pull_failure();
+	    break;
+	}
+    }
+    return batch;
+}
+
 CLICK_ENDDECLS
 ELEMENT_REQUIRES(NotifierQueue)
 EXPORT_ELEMENT(FullNoteQueue FullNoteQueue-FullNoteQueue)
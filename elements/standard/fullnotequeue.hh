@@ -78,6 +78,8 @@ class FullNoteQueue : public NotifierQueue { public:
 
     void push(int port, Packet *p);
     Packet *pull(int port);
+    void push_batch(int port, PacketBatch &batch);
+    PacketBatch pull_batch(int port, unsigned max);
 
   protected:
 
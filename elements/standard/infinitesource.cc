@@ -28,7 +28,7 @@
 CLICK_DECLS
 
 InfiniteSource::InfiniteSource()
-  : _packet(0), _task(this)
+  : _packet(0), _batch(false), _task(this)
 {
 }
 
@@ -55,7 +55,7 @@ InfiniteSource::configure(Vector<String> &conf, ErrorHandler *errh)
   counter_t limit = -1;
   int burstsize = 1;
   int datasize = -1;
-  bool active = true, stop = false, timestamp = true;
+  bool active = true, stop = false, timestamp = true, batch = false;
 
   if (Args(conf, this, errh)
       .read_p("DATA", data)
@@ -66,6 +66,7 @@ InfiniteSource::configure(Vector<String> &conf, ErrorHandler *errh)
       .read("LENGTH", datasize)
       .read("DATASIZE", datasize) // deprecated
       .read("STOP", stop)
+      .read("BATCH", batch)
       .complete() < 0)
       return -1;
   if (burstsize < 1)
@@ -79,6 +80,7 @@ InfiniteSource::configure(Vector<String> &conf, ErrorHandler *errh)
   _active = active;
   _stop = stop;
   _timestamp = timestamp;
+  _batch = batch;
 
   setup_packet();
 
@@ -110,12 +112,17 @@ InfiniteSource::run_task(Task *)
     int n = _burstsize;
     if (_limit >= 0 && _count + n >= (ucounter_t) _limit)
 	n = (_count > (ucounter_t) _limit ? 0 : _limit - _count);
+    PacketBatch batch;
     for (int i = 0; i < n; i++) {
 	Packet *p = _packet->clone();
 	if (_timestamp)
 	    p->timestamp_anno().assign_now();
-	output(0).push(p);
+	if (_batch)
+	    batch.push_back(p);
+	else
+	    output(0).push(p);
     }
+    output(0).push_batch(batch);
     _count += n;
     if (n > 0)
 	_task.fast_reschedule();
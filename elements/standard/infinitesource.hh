@@ -57,6 +57,11 @@ false.
 Boolean. If false, do not set the timestamp annotation on generated
 packets. Defaults to true.
 
+=item BATCH
+
+Boolean. If true, push each burst of BURST packets downstream as one batch
+(see Element::push_batch) rather than one packet at a time. Default is false.
+
 =back
 
 To generate a particular traffic pattern, use this element and RatedSource
@@ -132,6 +137,7 @@ class InfiniteSource : public Element, public ActiveNotifier { public:
     bool _active;
     bool _stop;
     bool _timestamp;
+    bool _batch;
     Task _task;
     String _data;
     NotifierSignal _nonfull_signal;
@@ -0,0 +1,315 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * mpmcqueue.{cc,hh} -- lock-free multi-producer, multi-consumer queue
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "mpmcqueue.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+CLICK_DECLS
+
+MPMCQueue::MPMCQueue()
+    : _slots(0), _mask(0), _highwater_length(0), _sleepiness(0)
+{
+    _enqueue_pos = _dequeue_pos = 0;
+    _drops = 0;
+}
+
+MPMCQueue::~MPMCQueue()
+{
+}
+
+void *
+MPMCQueue::cast(const char *n)
+{
+    if (strcmp(n, "MPMCQueue") == 0)
+	return (MPMCQueue *)this;
+    else if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_empty_note);
+    else if (strcmp(n, Notifier::FULL_NOTIFIER) == 0)
+	return static_cast<Notifier *>(&_full_note);
+    else
+	return Element::cast(n);
+}
+
+int
+MPMCQueue::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t capacity = 1024;
+    if (Args(conf, this, errh).read_p("CAPACITY", capacity).complete() < 0)
+	return -1;
+    if (capacity == 0 || capacity > 0x40000000)
+	return errh->error("CAPACITY out of range");
+    _mask = 1;
+    while (_mask < capacity)
+	_mask <<= 1;
+    --_mask;
+
+    _empty_note.initialize(Notifier::EMPTY_NOTIFIER, router());
+    _full_note.initialize(Notifier::FULL_NOTIFIER, router());
+    _full_note.set_active(true, false);
+    return 0;
+}
+
+int
+MPMCQueue::initialize(ErrorHandler *errh)
+{
+    _slots = (Slot *) CLICK_LALLOC(sizeof(Slot) * (_mask + 1));
+    if (!_slots)
+	return errh->error("out of memory");
+    for (uint32_t i = 0; i <= _mask; ++i) {
+	_slots[i].seq = i;
+	_slots[i].p = 0;
+    }
+    return 0;
+}
+
+void
+MPMCQueue::cleanup(CleanupStage)
+{
+    if (_slots) {
+	for (uint32_t pos = _dequeue_pos; pos != _enqueue_pos; ++pos)
+	    if (_slots[pos & _mask].seq.value() == pos + 1)
+		_slots[pos & _mask].p->kill();
+	CLICK_LFREE(_slots, sizeof(Slot) * (_mask + 1));
+	_slots = 0;
+    }
+}
+
+/** @brief Claim up to @a n consecutive free slots for pushing.
+ *
+ * Returns the number of slots claimed, which is 0 only if the queue is full
+ * or @a n is 0, and sets @a pos to the first claimed position. */
+unsigned
+MPMCQueue::claim_push(unsigned n, uint32_t &pos)
+{
+    if (n == 0)
+	return 0;
+    uint32_t p = _enqueue_pos;
+    while (1) {
+	unsigned k = 0;
+	while (k < n && _slots[(p + k) & _mask].seq.value() == p + k)
+	    ++k;
+	if (k == 0) {
+	    // Either the slot still holds a packet from the previous lap (the
+	    // queue is full) or another pusher already took position p.
+	    if ((int32_t) (_slots[p & _mask].seq.value() - p) < 0)
+		return 0;
+	    p = _enqueue_pos;
+	} else {
+	    // The CAS fails only if another pusher claimed a position first;
+	    // nobody waits for us between the claim and the publish.
+	    uint32_t old = _enqueue_pos.compare_swap(p, p + k);
+	    if (old == p) {
+		pos = p;
+		return k;
+	    }
+	    p = old;
+	}
+    }
+}
+
+/** @brief Claim up to @a n consecutive full slots for pulling.
+ *
+ * Returns the number of slots claimed, which is 0 only if the queue is empty
+ * (or its first packet is not yet published) or @a n is 0, and sets @a pos
+ * to the first claimed position. */
+unsigned
+MPMCQueue::claim_pull(unsigned n, uint32_t &pos)
+{
+    if (n == 0)
+	return 0;
+    uint32_t p = _dequeue_pos;
+    while (1) {
+	unsigned k = 0;
+	while (k < n && _slots[(p + k) & _mask].seq.value() == p + k + 1)
+	    ++k;
+	if (k == 0) {
+	    if ((int32_t) (_slots[p & _mask].seq.value() - (p + 1)) < 0)
+		return 0;
+	    p = _dequeue_pos;
+	} else {
+	    uint32_t old = _dequeue_pos.compare_swap(p, p + k);
+	    if (old == p) {
+		pos = p;
+		return k;
+	    }
+	    p = old;
+	}
+    }
+}
+
+void
+MPMCQueue::push_success(uint32_t pos, unsigned n)
+{
+    int s = pos + n - _dequeue_pos.value();
+    if (s > _highwater_length)
+	_highwater_length = s;
+
+    _empty_note.wake();
+
+    if (s >= capacity()) {
+	_full_note.sleep();
+	// As in FullNoteQueue: a concurrent pull might have woken the
+	// notifier just before we put it to sleep.
+	if (size() < capacity())
+	    _full_note.wake();
+    }
+}
+
+void
+MPMCQueue::push_failure(Packet *p)
+{
+    if (_drops == 0)
+	click_chatter("%{element}: overflow", this);
+    _drops++;
+    checked_output_push(1, p);
+}
+
+void
+MPMCQueue::pull_success()
+{
+    _sleepiness = 0;
+    _full_note.wake();
+}
+
+void
+MPMCQueue::pull_failure()
+{
+    if (_sleepiness >= SLEEPINESS_TRIGGER) {
+	_empty_note.sleep();
+	// A concurrent push might have woken the notifier just before we put
+	// it to sleep.
+	if (size())
+	    _empty_note.wake();
+    } else
+	++_sleepiness;
+}
+
+void
+MPMCQueue::push(int, Packet *p)
+{
+    uint32_t pos;
+    if (claim_push(1, pos)) {
+	Slot &s = _slots[pos & _mask];
+	s.p = p;
+	s.seq = pos + 1;
+	push_success(pos, 1);
+    } else
+	push_failure(p);
+}
+
+Packet *
+MPMCQueue::pull(int)
+{
+    uint32_t pos;
+    if (claim_pull(1, pos)) {
+	Slot &s = _slots[pos & _mask];
+	Packet *p = s.p;
+	s.seq = pos + _mask + 1;
+	pull_success();
+	return p;
+    } else {
+	pull_failure();
+	return 0;
+    }
+}
+
+void
+MPMCQueue::push_batch(int, PacketBatch &batch)
+{
+    while (!batch.empty()) {
+	uint32_t pos;
+	unsigned n = claim_push(batch.count(), pos);
+	if (!n) {
+	    while (Packet *p = batch.pop_front())
+		push_failure(p);
+	    return;
+	}
+	for (unsigned i = 0; i < n; ++i) {
+	    Slot &s = _slots[(pos + i) & _mask];
+	    s.p = batch.pop_front();
+	    s.seq = pos + i + 1;
+	}
+	push_success(pos, n);
+    }
+}
+
+PacketBatch
+MPMCQueue::pull_batch(int, unsigned max)
+{
+    PacketBatch batch;
+    uint32_t pos;
+    if (unsigned n = claim_pull(max, pos)) {
+	for (unsigned i = 0; i < n; ++i) {
+	    Slot &s = _slots[(pos + i) & _mask];
+	    batch.push_back(s.p);
+	    s.seq = pos + i + _mask + 1;
+	}
+	pull_success();
+    } else if (max)
+	pull_failure();
+    return batch;
+}
+
+String
+MPMCQueue::read_handler(Element *e, void *thunk)
+{
+    MPMCQueue *q = static_cast<MPMCQueue *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+      case 0:
+	return String(q->size());
+      case 1:
+	return String(q->highwater_length());
+      case 2:
+	return String(q->capacity());
+      case 3:
+	return String(q->drops());
+      default:
+	return "";
+    }
+}
+
+int
+MPMCQueue::write_handler(const String &, Element *e, void *thunk, ErrorHandler *errh)
+{
+    MPMCQueue *q = static_cast<MPMCQueue *>(e);
+    switch (reinterpret_cast<intptr_t>(thunk)) {
+      case 0:
+	q->_drops = 0;
+	q->_highwater_length = q->size();
+	return 0;
+      case 1:
+	while (Packet *p = q->pull(0))
+	    q->checked_output_push(1, p);
+	return 0;
+      default:
+	return errh->error("internal error");
+    }
+}
+
+void
+MPMCQueue::add_handlers()
+{
+    add_read_handler("length", read_handler, (void *)0);
+    add_read_handler("highwater_length", read_handler, (void *)1);
+    add_read_handler("capacity", read_handler, (void *)2, Handler::CALM);
+    add_read_handler("drops", read_handler, (void *)3);
+    add_write_handler("reset_counts", write_handler, (void *)0, Handler::BUTTON | Handler::NONEXCLUSIVE);
+    add_write_handler("reset", write_handler, (void *)1, Handler::BUTTON);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(MPMCQueue)
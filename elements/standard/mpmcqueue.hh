@@ -0,0 +1,144 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_MPMCQUEUE_HH
+#define CLICK_MPMCQUEUE_HH
+#include <click/element.hh>
+#include <click/atomic.hh>
+#include <click/notifier.hh>
+CLICK_DECLS
+
+/*
+=c
+
+MPMCQueue
+MPMCQueue(CAPACITY)
+
+=s storage
+
+stores packets in a lock-free FIFO queue
+
+=d
+
+Stores incoming packets in a first-in-first-out queue.  Drops incoming
+packets if the queue already holds CAPACITY packets.  CAPACITY is rounded up
+to a power of two; the default is 1024.
+
+Like ThreadSafeQueue, MPMCQueue supports any number of concurrent pushers
+and pullers.  Unlike ThreadSafeQueue, a pusher or puller that is preempted
+halfway through an operation never makes other threads wait for it.  Each
+slot in the queue's ring carries a sequence number saying whether it is
+ready to be filled or emptied, so threads claim slots independently.  (A
+packet whose pusher was preempted before it finished storing the packet
+stays invisible to pullers until the pusher resumes; pullers see the queue
+as empty at that point rather than waiting.)
+
+MPMCQueue has non-full and non-empty notifiers, with the same semantics as
+Queue's.  Batched pushes and pulls claim all their slots with a single
+atomic operation.
+
+MPMCQueue is not a Storage element, so elements such as RED that inspect
+their upstream queue's length cannot find it.
+
+=h length read-only
+
+Returns the current number of packets in the queue.  The result may be out
+of date by the time it is returned.
+
+=h highwater_length read-only
+
+Returns the maximum number of packets that have ever been in the queue at
+once.  Concurrent pushers may make this slightly low.
+
+=h capacity read-only
+
+Returns the queue's capacity.
+
+=h drops read-only
+
+Returns the number of packets dropped by the queue so far.
+
+=h reset_counts write-only
+
+When written, resets the C<drops> and C<highwater_length> counters.
+
+=h reset write-only
+
+When written, drops all packets in the queue.
+
+=a Queue, ThreadSafeQueue */
+
+class MPMCQueue : public Element { public:
+
+    MPMCQueue();
+    ~MPMCQueue();
+
+    const char *class_name() const		{ return "MPMCQueue"; }
+    const char *port_count() const		{ return PORTS_1_1X2; }
+    const char *processing() const		{ return "h/lh"; }
+    void *cast(const char *);
+
+    int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
+    void cleanup(CleanupStage stage);
+    void add_handlers();
+
+    inline int size() const;
+    int capacity() const			{ return _mask + 1; }
+    uint32_t drops() const			{ return _drops; }
+    int highwater_length() const		{ return _highwater_length; }
+
+    void push(int port, Packet *p);
+    Packet *pull(int port);
+    void push_batch(int port, PacketBatch &batch);
+    PacketBatch pull_batch(int port, unsigned max);
+
+  private:
+
+    // A slot with sequence number pos is free for the pusher that claims
+    // position pos; a slot with sequence number pos + 1 holds the packet for
+    // the puller that claims position pos.
+    struct Slot {
+	atomic_uint32_t seq;
+	Packet * volatile p;
+    };
+
+    enum { cache_line_size = 64 };
+
+    // The positions are written by different threads, so keep them on
+    // different cache lines.
+    atomic_uint32_t _enqueue_pos;
+    char _enqueue_pad[cache_line_size - sizeof(atomic_uint32_t)];
+    atomic_uint32_t _dequeue_pos;
+    char _dequeue_pad[cache_line_size - sizeof(atomic_uint32_t)];
+
+    Slot *_slots;
+    uint32_t _mask;
+
+    atomic_uint32_t _drops;
+    int _highwater_length;
+    int _sleepiness;
+    ActiveNotifier _empty_note;
+    ActiveNotifier _full_note;
+
+    enum { SLEEPINESS_TRIGGER = 9 };
+
+    unsigned claim_push(unsigned n, uint32_t &pos);
+    unsigned claim_pull(unsigned n, uint32_t &pos);
+    void push_success(uint32_t pos, unsigned n);
+    void push_failure(Packet *p);
+    void pull_success();
+    void pull_failure();
+
+    static String read_handler(Element *e, void *user_data);
+    static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh);
+
+};
+
+inline int
+MPMCQueue::size() const
+{
+    int32_t s = _enqueue_pos.value() - _dequeue_pos.value();
+    return s < 0 ? 0 : (s > capacity() ? capacity() : s);
+}
+
+CLICK_ENDDECLS
+#endif
@@ -44,6 +44,18 @@ Strip::simple_action(Packet *p)
     return p;
 }
 
+void
+Strip::push_batch(int port, PacketBatch &batch)
+{
+    simple_push_batch<Strip>(port, batch);
+}
+
+PacketBatch
+Strip::pull_batch(int port, unsigned max)
+{
+    return simple_pull_batch<Strip>(port, max);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(Strip)
 ELEMENT_MT_SAFE(Strip)
@@ -49,7 +49,7 @@ When written, resets the C<drops> and C<highwater_length> counters.
 
 When written, drops all packets in the queue.
 
-=a Queue, SimpleQueue, NotifierQueue, MixedQueue, FrontDropQueue */
+=a Queue, SimpleQueue, NotifierQueue, MixedQueue, FrontDropQueue, MPMCQueue */
 
 class ThreadSafeQueue : public FullNoteQueue { public:
 
@@ -63,6 +63,13 @@ class ThreadSafeQueue : public FullNoteQueue { public:
 
     void push(int port, Packet *);
     Packet *pull(int port);
+    // FullNoteQueue's batch methods are not thread safe
+    void push_batch(int port, PacketBatch &batch) {
+	Element::push_batch(port, batch);
+    }
+    PacketBatch pull_batch(int port, unsigned max) {
+	return Element::pull_batch(port, max);
+    }
 
   private:
 
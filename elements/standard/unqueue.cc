@@ -73,10 +73,11 @@ Unqueue::run_task(Task *)
     }
 
     while (worked < limit && _active) {
-	if (Packet *p = input(0).pull()) {
-	    ++worked;
-	    ++_count;
-	    output(0).push(p);
+	PacketBatch batch = input(0).pull_batch(limit - worked);
+	if (!batch.empty()) {
+	    worked += batch.count();
+	    _count += batch.count();
+	    output(0).push_batch(batch);
 	} else if (!_signal)
 	    goto out;
 	else
@@ -19,7 +19,9 @@ pull-to-push converter
 Pulls packets whenever they are available, then pushes them out
 its single output. Pulls a maximum of BURST packets every time
 it is scheduled. Default BURST is 1. If BURST
-is less than 0, pull until nothing comes back.
+is less than 0, pull until nothing comes back. Packets move as batches of up
+to BURST packets (see Element::push_batch), which batch-aware elements on
+either side process with one call per batch.
 
 Keyword arguments are:
 
@@ -43,6 +43,18 @@ Unstrip::simple_action(Packet *p)
   return p->push(_nbytes);
 }
 
+void
+Unstrip::push_batch(int port, PacketBatch &batch)
+{
+  simple_push_batch<Unstrip>(port, batch);
+}
+
+PacketBatch
+Unstrip::pull_batch(int port, unsigned max)
+{
+  return simple_pull_batch<Unstrip>(port, max);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(Unstrip)
 ELEMENT_MT_SAFE(Unstrip)
@@ -65,7 +65,13 @@ IPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
     _udp_timeouts[0] *= CLICK_HZ; // change timeouts to jiffies
     _udp_timeouts[1] *= CLICK_HZ;
 
-    return TCPRewriter::configure(conf, errh);
+    if (TCPRewriter::configure(conf, errh) < 0)
+	return -1;
+    for (int s = 1; s < _nshards; ++s) {
+	_shards[s].maps[IPRewriterInput::mapid_iprewriter_udp] = new Map;
+	_shards[s].allocators[1] = new HashAllocator(sizeof(IPRewriterFlow));
+    }
+    return 0;
 }
 
 inline IPRewriterEntry *
@@ -75,7 +81,7 @@ IPRewriter::get_entry(int ip_p, const IPFlowID &flowid, int input)
 	return TCPRewriter::get_entry(ip_p, flowid, input);
     if (ip_p != IP_PROTO_UDP)
 	return 0;
-    IPRewriterEntry *m = _udp_map.get(flowid);
+    IPRewriterEntry *m = shard_map(current_shard(), IPRewriterInput::mapid_iprewriter_udp).get(flowid);
     if (!m && (unsigned) input < (unsigned) _input_specs.size()) {
 	IPRewriterInput &is = _input_specs[input];
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
@@ -92,8 +98,9 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
     if (ip_p == IP_PROTO_TCP)
 	return TCPRewriter::add_flow(ip_p, flowid, rewritten_flowid, input);
 
+    int s = current_shard();
     void *data;
-    if (!(data = _udp_allocator.allocate()))
+    if (!(data = udp_allocator(s).allocate()))
 	return 0;
 
     IPRewriterFlow *flow = new(data) IPRewriterFlow
@@ -102,7 +109,10 @@ IPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	 !!_udp_timeouts[1], click_jiffies() + relevant_timeout(_udp_timeouts),
 	 this, input);
 
-    return store_flow(flow, input, _udp_map, &reply_udp_map(input));
+    return store_flow(flow, input,
+		      shard_map(s, IPRewriterInput::mapid_iprewriter_udp),
+		      &reply_udp_map(input, s),
+		      IPRewriterInput::mapid_iprewriter_udp);
 }
 
 void
@@ -124,13 +134,20 @@ IPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    HashContainer<IPRewriterEntry> *map = (iph->ip_p == IP_PROTO_TCP ? &_map : &_udp_map);
-    IPRewriterEntry *m = map->get(flowid);
-
-    if (!m) {			// create new mapping
+    int s = current_shard();
+    check_reap(s);
+    int mapid = (iph->ip_p == IP_PROTO_TCP ? IPRewriterInput::mapid_default : IPRewriterInput::mapid_iprewriter_udp);
+    IPRewriterEntry *m = shard_map(s, mapid).get(flowid);
+
+    // A thread rewrites its own shard's flows without locking, and another
+    // shard's flows under that shard's lock.
+    int fs = s;
+    if (!m && _shards && (m = find_foreign(flowid, s, mapid)))
+	fs = m->flow()->shard();
+    else if (!m) {		// create new mapping
 	IPRewriterInput &is = _input_specs.at_u(port);
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
-	int result = is.rewrite_flowid(flowid, rewritten_flowid, p, iph->ip_p == IP_PROTO_TCP ? 0 : IPRewriterInput::mapid_iprewriter_udp);
+	int result = is.rewrite_flowid(flowid, rewritten_flowid, p, mapid);
 	if (result == rw_addmap)
 	    m = IPRewriter::add_flow(iph->ip_p, flowid, rewritten_flowid, port);
 	if (!m) {
@@ -146,15 +163,19 @@ IPRewriter::push(int port, Packet *p_in)
 	TCPFlow *tcpmf = static_cast<TCPFlow *>(mf);
 	tcpmf->apply(p, m->direction(), _annos);
 	if (_timeouts[1])
-	    tcpmf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	    retime_flow(tcpmf, s, true, now_j + _timeouts[1]);
 	else
-	    tcpmf->change_expiry(_heap, false, now_j + tcp_flow_timeout(tcpmf));
+	    retime_flow(tcpmf, s, false, now_j + tcp_flow_timeout(tcpmf));
     } else {
 	mf->apply(p, m->direction(), _annos);
-	mf->change_expiry_by_timeout(_heap, now_j, _udp_timeouts);
+	retime_flow(mf, s, !!_udp_timeouts[1],
+		    now_j + relevant_timeout(_udp_timeouts));
     }
 
-    output(m->output()).push(p);
+    int o = m->output();
+    if (fs != s)
+	unlock_shard(fs);
+    output(o).push(p);
 }
 
 String
@@ -163,9 +184,14 @@ IPRewriter::udp_mappings_handler(Element *e, void *)
     IPRewriter *rw = (IPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_udp_map.begin(); iter.live(); ++iter) {
-	iter->flow()->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	rw->lock_shard(s);
+	Map &map = rw->shard_map(s, IPRewriterInput::mapid_iprewriter_udp);
+	for (Map::iterator iter = map.begin(); iter.live(); ++iter) {
+	    iter->flow()->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	rw->unlock_shard(s);
     }
     return sa.take_string();
 }
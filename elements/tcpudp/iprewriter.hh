@@ -162,6 +162,22 @@ element, in which case this element will share the other element's capacity.
 Boolean. If true, then set the destination IP address annotation on passing
 packets to the rewritten destination address. Default is true.
 
+=item SHARDED
+
+Boolean.  If true, keep a separate flow table, with an equal share of
+MAPPING_CAPACITY, for each thread of a multithreaded user-level driver.
+Packets on flows in the current thread's table are rewritten without
+locking.  A packet whose flow lives in another thread's table is still
+rewritten: an index shared by the threads names the table, which the packet
+then locks.  For best performance both directions of a flow should reach the
+same thread.  Pattern inputs divide their port or
+address range among the threads.  A SHARDED rewriter must be its own reply
+element and cannot share MAPPING_CAPACITY or use IPMapper inputs.  Its
+'patternN' handlers are read-only, and its mapping counts are approximate:
+the 'clear' and 'capacity' handlers trim another thread's table only when
+that thread next handles a packet.  Has no effect with one thread.  Default
+is false.
+
 =back
 
 =h nmappings r
@@ -197,6 +213,19 @@ relevant output port is starred.
 Returns a human-readable description of the IPRewriter's current set of
 UDP mappings.
 
+=h flow_state rw
+
+Returns a binary snapshot of the IPRewriter's live mappings: flow IDs,
+rewritten flow IDs, input numbers, TCP state, and expiry times relative to
+the time of the read.  Writing a snapshot adds its mappings to this
+IPRewriter, as if their flows had arrived on the same inputs, so a
+replacement router or process can take over established flows.  Mappings
+this IPRewriter already has, and mappings for inputs that are not pattern or
+keep inputs here, are skipped with a warning.  For example, at user level:
+
+   Script(TYPE SIGNAL USR1, printn >/var/run/rw.state rw.flow_state);
+   Script(write rw.flow_state $(cat /var/run/rw.state));
+
 =a TCPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter */
 
@@ -219,6 +248,10 @@ class IPRewriter : public TCPRewriter { public:
 	else
 	    return 0;
     }
+    int flow_mapid(int ip_p) const {
+	return ip_p == IP_PROTO_TCP ? IPRewriterInput::mapid_default
+	    : IPRewriterInput::mapid_iprewriter_udp;
+    }
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
@@ -239,9 +272,12 @@ class IPRewriter : public TCPRewriter { public:
     SizedHashAllocator<sizeof(IPRewriterFlow)> _udp_allocator;
     uint32_t _udp_timeouts[2];
 
-    inline Map &reply_udp_map(int input) const {
+    inline Map &reply_udp_map(int input, int s) const {
 	IPRewriter *x = static_cast<IPRewriter *>(_input_specs[input].reply_element);
-	return x->_udp_map;
+	return s ? *x->_shards[s].maps[IPRewriterInput::mapid_iprewriter_udp] : x->_udp_map;
+    }
+    HashAllocator &udp_allocator(int s) {
+	return s ? *_shards[s].allocators[1] : _udp_allocator;
     }
     static String udp_mappings_handler(Element *e, void *user_data);
 
@@ -254,9 +290,11 @@ IPRewriter::destroy_flow(IPRewriterFlow *flow)
     if (flow->ip_p() == IP_PROTO_TCP)
 	TCPRewriter::destroy_flow(flow);
     else {
-	unmap_flow(flow, _udp_map, &reply_udp_map(flow->owner_input()));
+	int s = flow->shard();
+	unmap_flow(flow, shard_map(s, IPRewriterInput::mapid_iprewriter_udp),
+		   &reply_udp_map(flow->owner_input(), s));
 	flow->~IPRewriterFlow();
-	_udp_allocator.deallocate(flow);
+	udp_allocator(s).deallocate(flow);
     }
 }
 
@@ -47,6 +47,35 @@ TCPRewriter::TCPFlow::update_seqno_delta(bool direction,
     }
 }
 
+/** @brief Store the sequence number deltas in @a x, which has room for 7
+ * words, and return the number of words stored. */
+int
+TCPRewriter::TCPFlow::save_seqno_state(uint32_t *x) const
+{
+    if (!_tflags)
+	return 0;
+    x[0] = _tflags;
+    for (int d = 0; d < 2; ++d) {
+	x[1 + d] = _trigger[d];
+	x[3 + d] = _delta[d];
+	x[5 + d] = _old_delta[d];
+    }
+    return 7;
+}
+
+void
+TCPRewriter::TCPFlow::restore_seqno_state(const uint32_t *x, int n)
+{
+    if (n < 7)
+	return;
+    _tflags = x[0];
+    for (int d = 0; d < 2; ++d) {
+	_trigger[d] = x[1 + d];
+	_delta[d] = x[3 + d];
+	_old_delta[d] = x[5 + d];
+    }
+}
+
 void
 TCPRewriter::TCPFlow::apply_sack(bool direction, click_tcp *tcph, int len)
 {
@@ -137,14 +166,16 @@ TCPRewriter::TCPFlow::apply(WritablePacket *p, bool direction, unsigned annos)
 
     // track connection state
     bool have_payload = ((iph->ip_hl + tcph->th_off) << 2) < ntohs(iph->ip_len);
+    uint8_t set = 0, clear = 0;
     if (tcph->th_flags & TH_RST)
-	_state |= s_both_done;
+	set = s_both_done;
     else if (tcph->th_flags & TH_FIN)
-	_state |= s_forward_done << direction;
+	set = s_forward_done << direction;
     else if ((tcph->th_flags & TH_SYN) || have_payload)
-	_state &= ~(s_forward_done << direction);
+	clear = s_forward_done << direction;
     if (have_payload)
-	_state |= s_forward_data << direction;
+	set |= s_forward_data << direction;
+    change_state(set, clear);
 
     // end if weird transport length
     if (p->transport_length() < (tcph->th_off << 2))
@@ -210,7 +241,7 @@ TCPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
     _timeouts[0] = 300;		// nodata: 5 minutes (should be > TCP_DONE)
     _tcp_data_timeout = 86400;	// 24 hours
     _tcp_done_timeout = 240;	// 4 minutes
-    bool dst_anno = true, has_reply_anno = false;
+    bool dst_anno = true, has_reply_anno = false, sharded = false;
     int reply_anno;
 
     if (Args(this, errh).bind(conf)
@@ -221,6 +252,7 @@ TCPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("TCP_DONE_TIMEOUT", SecondsArg(), _tcp_done_timeout)
 	.read("DST_ANNO", dst_anno)
 	.read("REPLY_ANNO", AnnoArg(1), reply_anno).read_status(has_reply_anno)
+	.read("SHARDED", sharded)
 	.consume() < 0)
 	return -1;
 
@@ -228,15 +260,21 @@ TCPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
     _tcp_data_timeout *= CLICK_HZ; // IPRewriterBase handles the others
     _tcp_done_timeout *= CLICK_HZ;
 
-    return IPRewriterBase::configure(conf, errh);
+    if (IPRewriterBase::configure(conf, errh) < 0
+	|| (sharded && make_shards(errh) < 0))
+	return -1;
+    for (int s = 1; s < _nshards; ++s)
+	_shards[s].allocators[0] = new HashAllocator(sizeof(TCPFlow));
+    return 0;
 }
 
 IPRewriterEntry *
 TCPRewriter::add_flow(int /*ip_p*/, const IPFlowID &flowid,
 		      const IPFlowID &rewritten_flowid, int input)
 {
+    int s = current_shard();
     void *data;
-    if (!(data = _allocator.allocate()))
+    if (!(data = flow_allocator(s).allocate()))
 	return 0;
 
     TCPFlow *flow = new(data) TCPFlow
@@ -245,7 +283,22 @@ TCPRewriter::add_flow(int /*ip_p*/, const IPFlowID &flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts),
 	 this, input);
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard_map(s));
+}
+
+int
+TCPRewriter::save_flow_extra(const IPRewriterFlow *flow, uint32_t *extra) const
+{
+    if (flow->ip_p() != IP_PROTO_TCP)
+	return 0;
+    return static_cast<const TCPFlow *>(flow)->save_seqno_state(extra);
+}
+
+void
+TCPRewriter::restore_flow_extra(IPRewriterFlow *flow, const uint32_t *extra, int n)
+{
+    if (flow->ip_p() == IP_PROTO_TCP)
+	static_cast<TCPFlow *>(flow)->restore_seqno_state(extra, n);
 }
 
 void
@@ -267,9 +320,16 @@ TCPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map.get(flowid);
-
-    if (!m) {			// create new mapping
+    int s = current_shard();
+    check_reap(s);
+    IPRewriterEntry *m = shard_map(s).get(flowid);
+
+    // A thread rewrites its own shard's flows without locking, and another
+    // shard's flows under that shard's lock.
+    int fs = s;
+    if (!m && _shards && (m = find_foreign(flowid, s)))
+	fs = m->flow()->shard();
+    else if (!m) {		// create new mapping
 	IPRewriterInput &is = _input_specs.at_u(port);
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
 	int result = is.rewrite_flowid(flowid, rewritten_flowid, p);
@@ -287,11 +347,14 @@ TCPRewriter::push(int port, Packet *p_in)
 
     click_jiffies_t now_j = click_jiffies();
     if (_timeouts[1])
-	mf->change_expiry(_heap, true, now_j + _timeouts[1]);
+	retime_flow(mf, s, true, now_j + _timeouts[1]);
     else
-	mf->change_expiry(_heap, false, now_j + tcp_flow_timeout(mf));
+	retime_flow(mf, s, false, now_j + tcp_flow_timeout(mf));
 
-    output(m->output()).push(p);
+    int o = m->output();
+    if (fs != s)
+	unlock_shard(fs);
+    output(o).push(p);
 }
 
 
@@ -301,10 +364,14 @@ TCPRewriter::tcp_mappings_handler(Element *e, void *)
     TCPRewriter *rw = (TCPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); ++iter) {
-	TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
-	f->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	rw->lock_shard(s);
+	for (Map::iterator iter = rw->shard_map(s).begin(); iter.live(); ++iter) {
+	    TCPFlow *f = static_cast<TCPFlow *>(iter->flow());
+	    f->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	rw->unlock_shard(s);
     }
     return sa.take_string();
 }
@@ -73,6 +73,12 @@ element, in which case this element will share the other element's capacity.
 Boolean. If true, then set the destination IP address annotation on passing
 packets to the rewritten destination address. Default is true.
 
+=item SHARDED
+
+Boolean.  If true, keep a flow table per thread of a multithreaded driver, so
+that established flows are rewritten without locking.  See IPRewriter for
+restrictions.  Default is false.
+
 =back
 
 =h mappings read-only
@@ -80,6 +86,11 @@ packets to the rewritten destination address. Default is true.
 Returns a human-readable description of the TCPRewriter's current set of
 mappings.
 
+=h flow_state rw
+
+Returns or loads a binary snapshot of the TCPRewriter's live mappings.  See
+IPRewriter.
+
 =a IPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 FTPPortMapper */
 
@@ -111,6 +122,9 @@ class TCPRewriter : public IPRewriterBase { public:
 
 	void unparse(StringAccum &sa, bool direction, click_jiffies_t now) const;
 
+	int save_seqno_state(uint32_t *x) const;
+	void restore_seqno_state(const uint32_t *x, int n);
+
       private:
 
 	tcp_seq_t _trigger[2];
@@ -135,6 +149,8 @@ class TCPRewriter : public IPRewriterBase { public:
     click_jiffies_t best_effort_expiry(const IPRewriterFlow *flow) {
 	return flow->expiry() + tcp_flow_timeout(static_cast<const TCPFlow *>(flow)) - _timeouts[1];
     }
+    int save_flow_extra(const IPRewriterFlow *flow, uint32_t *extra) const;
+    void restore_flow_extra(IPRewriterFlow *flow, const uint32_t *extra, int n);
 
     void push(int, Packet *);
 
@@ -156,6 +172,10 @@ class TCPRewriter : public IPRewriterBase { public:
 	    return _timeouts[0];
     }
 
+    HashAllocator &flow_allocator(int s) {
+	return s ? *_shards[s].allocators[0] : _allocator;
+    }
+
     static String tcp_mappings_handler(Element *, void *);
 
 };
@@ -163,9 +183,10 @@ class TCPRewriter : public IPRewriterBase { public:
 inline void
 TCPRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    unmap_flow(flow, _map);
+    int s = flow->shard();
+    unmap_flow(flow, shard_map(s));
     static_cast<TCPFlow *>(flow)->~TCPFlow();
-    _allocator.deallocate(flow);
+    flow_allocator(s).deallocate(flow);
 }
 
 inline tcp_seq_t
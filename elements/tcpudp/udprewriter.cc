@@ -46,7 +46,7 @@ UDPRewriter::cast(const char *n)
 int
 UDPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    bool dst_anno = true, has_reply_anno = false;
+    bool dst_anno = true, has_reply_anno = false, sharded = false;
     int reply_anno;
     _timeouts[0] = 300;		// 5 minutes
 
@@ -55,19 +55,26 @@ UDPRewriter::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("REPLY_ANNO", AnnoArg(1), reply_anno).read_status(has_reply_anno)
 	.read("UDP_TIMEOUT", SecondsArg(), _timeouts[0])
 	.read("UDP_GUARANTEE", SecondsArg(), _timeouts[1])
+	.read("SHARDED", sharded)
 	.consume() < 0)
 	return -1;
 
     _annos = (dst_anno ? 1 : 0) + (has_reply_anno ? 2 + (reply_anno << 2) : 0);
-    return IPRewriterBase::configure(conf, errh);
+    if (IPRewriterBase::configure(conf, errh) < 0
+	|| (sharded && make_shards(errh) < 0))
+	return -1;
+    for (int s = 1; s < _nshards; ++s)
+	_shards[s].allocators[0] = new HashAllocator(sizeof(IPRewriterFlow));
+    return 0;
 }
 
 IPRewriterEntry *
 UDPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 		      const IPFlowID &rewritten_flowid, int input)
 {
+    int s = current_shard();
     void *data;
-    if (!(data = _allocator.allocate()))
+    if (!(data = flow_allocator(s).allocate()))
 	return 0;
 
     IPRewriterFlow *flow = new(data) IPRewriterFlow
@@ -76,7 +83,7 @@ UDPRewriter::add_flow(int ip_p, const IPFlowID &flowid,
 	 !!_timeouts[1], click_jiffies() + relevant_timeout(_timeouts),
 	 this, input);
 
-    return store_flow(flow, input, _map);
+    return store_flow(flow, input, shard_map(s));
 }
 
 void
@@ -101,9 +108,16 @@ UDPRewriter::push(int port, Packet *p_in)
     }
 
     IPFlowID flowid(p);
-    IPRewriterEntry *m = _map.get(flowid);
-
-    if (!m) {			// create new mapping
+    int s = current_shard();
+    check_reap(s);
+    IPRewriterEntry *m = shard_map(s).get(flowid);
+
+    // A thread rewrites its own shard's flows without locking, and another
+    // shard's flows under that shard's lock.
+    int fs = s;
+    if (!m && _shards && (m = find_foreign(flowid, s)))
+	fs = m->flow()->shard();
+    else if (!m) {		// create new mapping
 	IPRewriterInput &is = _input_specs.at_u(port);
 	IPFlowID rewritten_flowid = IPFlowID::uninitialized_t();
 	int result = is.rewrite_flowid(flowid, rewritten_flowid, p);
@@ -118,9 +132,13 @@ UDPRewriter::push(int port, Packet *p_in)
 
     IPRewriterFlow *mf = static_cast<IPRewriterFlow *>(m->flow());
     mf->apply(p, m->direction(), _annos);
-    mf->change_expiry_by_timeout(_heap, click_jiffies(), _timeouts);
+    retime_flow(mf, s, !!_timeouts[1],
+		click_jiffies() + relevant_timeout(_timeouts));
 
-    output(m->output()).push(p);
+    int o = m->output();
+    if (fs != s)
+	unlock_shard(fs);
+    output(o).push(p);
 }
 
 
@@ -130,9 +148,13 @@ UDPRewriter::dump_mappings_handler(Element *e, void *)
     UDPRewriter *rw = (UDPRewriter *)e;
     click_jiffies_t now = click_jiffies();
     StringAccum sa;
-    for (Map::iterator iter = rw->_map.begin(); iter.live(); ++iter) {
-	iter->flow()->unparse(sa, iter->direction(), now);
-	sa << '\n';
+    for (int s = 0; s < rw->_nshards; ++s) {
+	rw->lock_shard(s);
+	for (Map::iterator iter = rw->shard_map(s).begin(); iter.live(); ++iter) {
+	    iter->flow()->unparse(sa, iter->direction(), now);
+	    sa << '\n';
+	}
+	rw->unlock_shard(s);
     }
     return sa.take_string();
 }
@@ -143,6 +143,12 @@ element, in which case this element will share the other element's capacity.
 Boolean. If true, then set the destination IP address annotation on passing
 packets to the rewritten destination address. Default is true.
 
+=item SHARDED
+
+Boolean.  If true, keep a flow table per thread of a multithreaded driver, so
+that established flows are rewritten without locking.  See IPRewriter for
+restrictions.  Default is false.
+
 =back
 
 =h mappings read-only
@@ -150,6 +156,11 @@ packets to the rewritten destination address. Default is true.
 Returns a human-readable description of the UDPRewriter's current set of
 mappings.
 
+=h flow_state rw
+
+Returns or loads a binary snapshot of the UDPRewriter's live mappings.  See
+IPRewriter.
+
 =a TCPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter */
 
@@ -176,6 +187,10 @@ class UDPRewriter : public IPRewriterBase { public:
     SizedHashAllocator<sizeof(IPRewriterFlow)> _allocator;
     unsigned _annos;
 
+    HashAllocator &flow_allocator(int s) {
+	return s ? *_shards[s].allocators[0] : _allocator;
+    }
+
     static String dump_mappings_handler(Element *, void *);
 
     friend class IPRewriter;
@@ -186,9 +201,10 @@ class UDPRewriter : public IPRewriterBase { public:
 inline void
 UDPRewriter::destroy_flow(IPRewriterFlow *flow)
 {
-    unmap_flow(flow, _map);
+    int s = flow->shard();
+    unmap_flow(flow, shard_map(s));
     flow->~IPRewriterFlow();
-    _allocator.deallocate(flow);
+    flow_allocator(s).deallocate(flow);
 }
 
 CLICK_ENDDECLS
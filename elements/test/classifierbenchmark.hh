@@ -0,0 +1,87 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CLASSIFIERBENCHMARK_HH
+#define CLICK_CLASSIFIERBENCHMARK_HH
+#include <click/element.hh>
+CLICK_DECLS
+class Classifier;
+class IPFilter;
+
+/*
+=c
+
+ClassifierBenchmark(CLASSIFIER, [I<keywords>])
+
+=s test
+
+compares interpreted and specialized classification
+
+=d
+
+Passes packets through unchanged, keeping copies of the first SAMPLES of
+them.  Reading the C<benchmark> handler classifies the saved packets
+ITERATIONS times with CLASSIFIER's interpreted program and ITERATIONS times
+with its specialized program, and reports the cycles each took per
+classification.
+
+CLASSIFIER must be a Classifier, IPClassifier, or IPFilter element.  The
+benchmark calls its matching code directly; CLASSIFIER's outputs see none of
+the benchmark's packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item SAMPLES
+
+Integer.  The number of packets to keep.  Default is 64.
+
+=item ITERATIONS
+
+Integer.  The number of passes over the saved packets for each program.
+Default is 10000.
+
+=back
+
+=h benchmark read-only
+
+Runs the benchmark and returns a line like "C<interpreted 30, specialized 21
+cycles per classification>".  If the two programs disagree on any packet's
+output, returns an error message instead.
+
+=h count read-only
+
+Returns the number of packets saved so far.
+
+=a Classifier, IPClassifier, IPFilter */
+
+class ClassifierBenchmark : public Element { public:
+
+    ClassifierBenchmark();
+    ~ClassifierBenchmark();
+
+    const char *class_name() const		{ return "ClassifierBenchmark"; }
+    const char *port_count() const		{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh);
+    void cleanup(CleanupStage stage);
+    void add_handlers();
+
+    Packet *simple_action(Packet *p);
+
+  private:
+
+    Classifier *_classifier;
+    IPFilter *_ipfilter;
+    int _samples;
+    int _iterations;
+    Vector<Packet *> _packets;
+
+    inline int match(const Packet *p, bool specialized) const;
+    String benchmark() const;
+
+    static String read_handler(Element *e, void *user_data);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,242 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * incksumtest.{cc,hh} -- regression test element for Internet checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "incksumtest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/vector.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+InCksumTest::InCksumTest()
+    : _benchmark(0), _implementation("auto")
+{
+}
+
+InCksumTest::~InCksumTest()
+{
+}
+
+int
+InCksumTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh)
+	.read("IMPLEMENTATION", WordArg(), _implementation)
+	.read("BENCHMARK", _benchmark).complete();
+}
+
+// The RFC 1071 algorithm, one halfword at a time.
+static uint16_t
+reference_in_cksum(const unsigned char *x, int len)
+{
+    uint32_t sum = 0;
+    for (; len > 1; x += 2, len -= 2)
+	sum += *reinterpret_cast<const uint16_t *>(x);
+    if (len == 1) {
+	uint16_t odd = 0;
+	*reinterpret_cast<unsigned char *>(&odd) = *x;
+	sum += odd;
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum += (sum >> 16);
+    return ~sum;
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+enum { buffer_size = 9002, long_buffer_size = 65536 + 64 };
+
+#if !CLICK_LINUXMODULE
+// Compare each implementation the CPU supports with "generic".
+int
+InCksumTest::check_implementations(ErrorHandler *errh)
+{
+    unsigned char *buf = new unsigned char[long_buffer_size];
+    uint32_t r = 0x87654321;
+    for (int i = 0; i < long_buffer_size; i++) {
+	r = r * 1103515245 + 12345;
+	buf[i] = r >> 24;
+    }
+
+    // odd lengths around the vector loop strides, and long buffers
+    Vector<int> lengths;
+    for (int len = 60; len <= 200; len++)
+	lengths.push_back(len);
+    int long_lengths[] = { 1499, 1500, 4095, 8999, 9000, 32767, 65535 };
+    for (size_t i = 0; i < sizeof(long_lengths) / sizeof(long_lengths[0]); i++)
+	lengths.push_back(long_lengths[i]);
+
+    Vector<uint16_t> expected;
+    click_in_cksum_set_implementation("generic");
+    for (int align = 0; align < 32; align++)
+	for (int i = 0; i < lengths.size(); i++)
+	    expected.push_back(click_in_cksum(buf + align, lengths[i]));
+
+    const char *impls[] = { "sse2", "avx2" };
+    int result = 0;
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]) && result == 0; k++) {
+	if (click_in_cksum_set_implementation(impls[k]) < 0)
+	    continue;
+	uint16_t *e = expected.begin();
+	for (int align = 0; align < 32 && result == 0; align++)
+	    for (int i = 0; i < lengths.size(); i++, e++)
+		if (click_in_cksum(buf + align, lengths[i]) != *e) {
+		    result = errh->error("%s click_in_cksum mismatch at alignment %d, length %d", impls[k], align, lengths[i]);
+		    break;
+		}
+    }
+
+    delete[] buf;
+    return result;
+}
+#endif
+
+int
+InCksumTest::initialize(ErrorHandler *errh)
+{
+#if !CLICK_LINUXMODULE
+    if (check_implementations(errh) < 0)
+	return -1;
+    if (click_in_cksum_set_implementation(_implementation.c_str()) < 0)
+	return errh->error("IMPLEMENTATION %<%s%> not available", _implementation.c_str());
+#else
+    if (_implementation != "auto")
+	return errh->error("IMPLEMENTATION %<%s%> not available", _implementation.c_str());
+#endif
+
+    uint16_t *buf16 = new uint16_t[buffer_size / 2];
+    unsigned char *buf = reinterpret_cast<unsigned char *>(buf16);
+    uint32_t r = 0x12345678;
+    for (int i = 0; i < buffer_size; i++) {
+	r = r * 1103515245 + 12345;
+	buf[i] = r >> 24;
+    }
+
+    // click_in_cksum requires two-byte alignment
+    int lengths[] = { 0, 1, 2, 3, 19, 20, 31, 32, 33, 63, 64, 65, 127, 128,
+		      129, 255, 576, 1499, 1500, 9000 };
+    for (int align = 0; align < 16; align += 2)
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+	    const unsigned char *x = buf + align;
+	    int len = lengths[i];
+	    if (click_in_cksum(x, len) != reference_in_cksum(x, len)) {
+		delete[] buf16;
+		return errh->error("click_in_cksum mismatch at alignment %d, length %d", align, len);
+	    }
+	}
+
+    // all-ones words must not overflow the accumulator
+    memset(buf, 0xFF, buffer_size);
+    for (int len = 8000; len <= 9000; len += 100)
+	if (click_in_cksum(buf, len) != reference_in_cksum(buf, len)) {
+	    delete[] buf16;
+	    return errh->error("click_in_cksum mismatch on 0xFF data, length %d", len);
+	}
+    delete[] buf16;
+
+    // incremental updates
+    click_ip iph;
+    memset(&iph, 0, sizeof(iph));
+    iph.ip_v = 4;
+    iph.ip_hl = sizeof(click_ip) >> 2;
+    iph.ip_len = htons(84);
+    iph.ip_ttl = 64;
+    iph.ip_p = IP_PROTO_UDP;
+    iph.ip_src.s_addr = htonl(0x0A000001);
+    iph.ip_dst.s_addr = htonl(0xC0A80102);
+    iph.ip_sum = click_in_cksum((const unsigned char *) &iph, sizeof(iph));
+    CHECK(click_in_cksum((const unsigned char *) &iph, sizeof(iph)) == 0);
+
+    for (int ttl = 63; ttl >= 0; ttl--) {
+	click_update_ip_ttl(&iph, ttl);
+	CHECK(iph.ip_ttl == ttl);
+	CHECK(click_in_cksum((const unsigned char *) &iph, sizeof(iph)) == 0);
+    }
+
+    uint32_t addrs[] = { 0, 0xFFFFFFFFU, 0x12345678, 0xFFFF0000U, 0x0000FFFFU };
+    for (size_t i = 0; i < sizeof(addrs) / sizeof(addrs[0]); i++) {
+	uint32_t old_w = iph.ip_src.s_addr;
+	iph.ip_src.s_addr = addrs[i];
+	click_update_in_cksum32(&iph.ip_sum, old_w, addrs[i]);
+	CHECK(click_in_cksum((const unsigned char *) &iph, sizeof(iph)) == 0);
+	uint16_t expected = iph.ip_sum;
+	iph.ip_sum = 0;
+	iph.ip_sum = click_in_cksum((const unsigned char *) &iph, sizeof(iph));
+	CHECK(iph.ip_sum == expected || (iph.ip_sum ^ expected) == 0xFFFF);
+    }
+
+    // pseudoheader checksum against a constructed pseudoheader
+    {
+	uint16_t pseudo[6];
+	memcpy(&pseudo[0], &iph.ip_src, 4);
+	memcpy(&pseudo[2], &iph.ip_dst, 4);
+	pseudo[4] = htons(iph.ip_p);
+	pseudo[5] = htons(64);
+	uint16_t data_csum = 0x1234;
+	uint32_t sum = (uint16_t) ~reference_in_cksum((const unsigned char *) pseudo, sizeof(pseudo));
+	sum += (uint16_t) ~data_csum;
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	uint16_t expected = ~(sum + (sum >> 16));
+	CHECK(click_in_cksum_pseudohdr(data_csum, &iph, 64) == expected);
+    }
+
+#if !CLICK_LINUXMODULE
+    if (_benchmark)
+	errh->message("click_in_cksum implementation: %s", click_in_cksum_implementation());
+#endif
+    if (_benchmark)
+	benchmark(errh);
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+static volatile uint32_t benchmark_sink;
+
+void
+InCksumTest::benchmark(ErrorHandler *errh)
+{
+    uint16_t *buf16 = new uint16_t[buffer_size / 2];
+    const unsigned char *buf = reinterpret_cast<unsigned char *>(buf16);
+    memset(buf16, 0x5A, buffer_size);
+
+    int lengths[] = { 20, 64, 576, 1500, 9000 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+	int len = lengths[i];
+	uint32_t total = 0;	// keeps the loops from being optimized away
+
+	click_cycles_t c0 = click_get_cycles();
+	for (uint32_t j = 0; j < _benchmark; j++)
+	    total += reference_in_cksum(buf + (j & 2), len);
+	click_cycles_t c1 = click_get_cycles();
+	for (uint32_t j = 0; j < _benchmark; j++)
+	    total += click_in_cksum(buf + (j & 2), len);
+	click_cycles_t c2 = click_get_cycles();
+
+	double bytes = (double) len * _benchmark;
+	double ref_rate = c1 > c0 ? bytes / (double) (c1 - c0) : 0;
+	double rate = c2 > c1 ? bytes / (double) (c2 - c1) : 0;
+	errh->message("length %d: reference %.2f bytes/cycle, click_in_cksum %.2f bytes/cycle",
+		      len, ref_rate, rate);
+	benchmark_sink = total;
+    }
+
+    delete[] buf16;
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(InCksumTest)
@@ -0,0 +1,69 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_INCKSUMTEST_HH
+#define CLICK_INCKSUMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+InCksumTest([I<keywords> IMPLEMENTATION, BENCHMARK])
+
+=s test
+
+runs regression tests for Internet checksum functions
+
+=d
+
+InCksumTest runs regression tests for click_in_cksum(),
+click_in_cksum_pseudohdr(), and the incremental checksum update functions at
+initialization time. click_in_cksum() is compared against a simple
+halfword-at-a-time reference over many lengths and alignments. Each
+implementation of click_in_cksum() the CPU supports, "generic", "sse2", and
+"avx2", is also checked against "generic" on long, odd-length, and
+misaligned buffers. It does not route packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item IMPLEMENTATION
+
+One of "auto", "generic", "sse2", or "avx2". The click_in_cksum()
+implementation used for the remaining tests and the benchmark, and by the
+rest of the router afterwards. It is an error if the CPU lacks it. Default
+is "auto", which picks the fastest one the CPU supports.
+
+=item BENCHMARK
+
+Unsigned. If BENCHMARK is a positive number N, InCksumTest also checksums
+buffers of several lengths N times each, with both click_in_cksum() and the
+reference, and reports the bytes per cycle each achieves. Cycle counts are
+available only on x86.
+
+=back
+
+*/
+
+class InCksumTest : public Element { public:
+
+    InCksumTest();
+    ~InCksumTest();
+
+    const char *class_name() const		{ return "InCksumTest"; }
+
+    int configure(Vector<String> &, ErrorHandler *);
+    int initialize(ErrorHandler *);
+
+  private:
+
+    uint32_t _benchmark;
+    String _implementation;
+
+    int check_implementations(ErrorHandler *);
+    void benchmark(ErrorHandler *);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,192 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * iprewriterbenchmark.{cc,hh} -- benchmark rewriter flow setup and lookup
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "iprewriterbenchmark.hh"
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/glue.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+IPRewriterBenchmark::IPRewriterBenchmark()
+{
+    _received[0] = _received[1] = 0;
+}
+
+IPRewriterBenchmark::~IPRewriterBenchmark()
+{
+}
+
+int
+IPRewriterBenchmark::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _flows = 100000;
+    _packets = 1000000;
+    _saddr = IPAddress(htonl(0x01000001));
+    _daddr = IPAddress(htonl(0x02000000));
+    if (Args(conf, this, errh)
+	.read("FLOWS", _flows)
+	.read("PACKETS", _packets)
+	.read("SADDR", _saddr)
+	.read("DADDR", _daddr)
+	.complete() < 0)
+	return -1;
+    if (_flows <= 0 || _packets < 0)
+	return errh->error("bad FLOWS or PACKETS");
+    return 0;
+}
+
+Packet *
+IPRewriterBenchmark::make_packet(IPAddress saddr, uint16_t sport,
+				 IPAddress daddr, uint16_t dport,
+				 uint8_t flags) const
+{
+    WritablePacket *q = Packet::make(sizeof(click_ip) + sizeof(click_tcp));
+    if (!q)
+	return 0;
+    memset(q->data(), 0, q->length());
+    click_ip *ip = reinterpret_cast<click_ip *>(q->data());
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_len = htons(q->length());
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_TCP;
+    ip->ip_src = saddr;
+    ip->ip_dst = daddr;
+    q->set_ip_header(ip, sizeof(click_ip));
+    q->set_dst_ip_anno(daddr);
+
+    click_tcp *tcp = q->tcp_header();
+    tcp->th_sport = sport;
+    tcp->th_dport = dport;
+    tcp->th_off = sizeof(click_tcp) >> 2;
+    tcp->th_flags = flags;
+    tcp->th_win = htons(32120);
+    return q;
+}
+
+void
+IPRewriterBenchmark::push(int port, Packet *p)
+{
+    const click_ip *iph = p->ip_header();
+    const click_tcp *tcph = p->tcp_header();
+    if (port == 0) {
+	uint32_t i = ntohl(iph->ip_dst.s_addr) - ntohl(_daddr.addr());
+	if (i < (uint32_t) _rewritten.size()) {
+	    _rewritten[i] = IPFlowID(p);
+	    ++_received[0];
+	}
+    } else {
+	uint32_t i = ntohl(iph->ip_src.s_addr) - ntohl(_daddr.addr());
+	if (i < (uint32_t) _flows && iph->ip_dst == _saddr
+	    && tcph->th_dport == sport(i))
+	    ++_received[1];
+    }
+    p->kill();
+}
+
+/** @brief Run phases 1 and 2: set up the flows and send packets on them. */
+String
+IPRewriterBenchmark::setup()
+{
+    StringAccum sa;
+    uint32_t daddr = ntohl(_daddr.addr());
+    _rewritten.assign(_flows, IPFlowID());
+
+    // Phase 1: one packet per new flow.
+    _received[0] = 0;
+    click_cycles_t c0 = click_get_cycles();
+    for (int i = 0; i < _flows; ++i)
+	if (Packet *p = make_packet(_saddr, sport(i), IPAddress(htonl(daddr + i)),
+				    htons(80), TH_SYN))
+	    output(0).push(p);
+    click_cycles_t c = click_get_cycles() - c0;
+    sa << "setup " << _flows << " flows: " << (c / _flows)
+       << " cycles/packet, " << _received[0] << " rewritten\n";
+
+    // Phase 2: packets on established flows, in an order that defeats
+    // caching of recently used flows.
+    if (_packets) {
+	_received[0] = 0;
+	c0 = click_get_cycles();
+	for (int k = 0; k < _packets; ++k) {
+	    uint32_t i = ((uint32_t) k * 2654435761U) % _flows;
+	    if (Packet *p = make_packet(_saddr, sport(i), IPAddress(htonl(daddr + i)),
+					htons(80), TH_ACK))
+		output(0).push(p);
+	}
+	c = click_get_cycles() - c0;
+	sa << "established " << _packets << " packets: " << (c / _packets)
+	   << " cycles/packet, " << _received[0] << " rewritten\n";
+    }
+
+    return sa.take_string();
+}
+
+/** @brief Run phase 3: send one reply per flow rewritten by setup(). */
+String
+IPRewriterBenchmark::reply()
+{
+    StringAccum sa;
+    int replies = 0;
+    _received[1] = 0;
+    click_cycles_t c0 = click_get_cycles();
+    for (int i = 0; i < _rewritten.size(); ++i) {
+	const IPFlowID &f = _rewritten[i];
+	if (!f.saddr())
+	    continue;
+	if (Packet *p = make_packet(f.daddr(), f.dport(), f.saddr(), f.sport(),
+				    TH_ACK))
+	    output(1).push(p);
+	++replies;
+    }
+    click_cycles_t c = click_get_cycles() - c0;
+    sa << "reply " << replies << " packets: " << (replies ? c / replies : 0)
+       << " cycles/packet, " << _received[1] << " restored\n";
+
+    _rewritten.clear();
+    return sa.take_string();
+}
+
+String
+IPRewriterBenchmark::read_handler(Element *e, void *user_data)
+{
+    IPRewriterBenchmark *bm = static_cast<IPRewriterBenchmark *>(e);
+    switch (reinterpret_cast<intptr_t>(user_data)) {
+    case h_setup:
+	return bm->setup();
+    case h_reply:
+	return bm->reply();
+    default: {
+	String s = bm->setup();
+	return s + bm->reply();
+    }
+    }
+}
+
+void
+IPRewriterBenchmark::add_handlers()
+{
+    add_read_handler("benchmark", read_handler, h_benchmark);
+    add_read_handler("setup", read_handler, h_setup);
+    add_read_handler("reply", read_handler, h_reply);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(IPRewriterBenchmark)
@@ -0,0 +1,177 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * iproutetablebenchmark.{cc,hh} -- benchmark routing table updates
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "elements/ip/iproutetable.hh"
+#include "iproutetablebenchmark.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/glue.hh>
+#include <click/timestamp.hh>
+#include <click/standard/scheduleinfo.hh>
+CLICK_DECLS
+
+IPRouteTableBenchmark::IPRouteTableBenchmark()
+    : _table(0), _task(this), _running(false), _concurrent_lookups(0),
+      _sink(0)
+{
+}
+
+IPRouteTableBenchmark::~IPRouteTableBenchmark()
+{
+}
+
+int
+IPRouteTableBenchmark::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    Element *e;
+    _routes = 10000;
+    _batch = 16;
+    _updates = 100;
+    _lookups = 1000000;
+    if (Args(conf, this, errh)
+	.read_mp("TABLE", e)
+	.read("ROUTES", _routes)
+	.read("BATCH", _batch)
+	.read("UPDATES", _updates)
+	.read("LOOKUPS", _lookups)
+	.complete() < 0)
+	return -1;
+    if (!(_table = static_cast<IPRouteTable *>(e->cast("IPRouteTable"))))
+	return errh->error("TABLE must be an IPRouteTable element");
+    if (_table->noutputs() == 0)
+	return errh->error("TABLE has no outputs");
+    if (_routes <= 0 || _batch <= 0 || _batch > _routes
+	|| _updates < 0 || _lookups < 0)
+	return errh->error("bad ROUTES, BATCH, UPDATES, or LOOKUPS");
+    return 0;
+}
+
+int
+IPRouteTableBenchmark::initialize(ErrorHandler *errh)
+{
+    ScheduleInfo::initialize_task(this, &_task, false, errh);
+    return 0;
+}
+
+bool
+IPRouteTableBenchmark::run_task(Task *)
+{
+    if (!_running)
+	return false;
+    IPAddress gw;
+    uint32_t sum = 0;
+    for (int i = 0; i < 256; ++i)
+	sum += _table->lookup_route(IPAddress(click_random()), gw);
+    _sink += sum;
+    _concurrent_lookups += 256;
+    _task.fast_reschedule();
+    return true;
+}
+
+/** @brief Append the command that adds or removes route @a i.
+ *
+ * Route @a i is a /24 whose network number is @a i times an odd constant,
+ * so the first 2^24 routes are distinct. */
+void
+IPRouteTableBenchmark::make_route(int i, bool add, Vector<IPRoute> &commands) const
+{
+    uint32_t net = ((uint32_t) i * 2654435761U) & 0xFFFFFF;
+    IPRoute r(IPAddress(htonl(net << 8)), IPAddress::make_prefix(24),
+	      IPAddress(), i % _table->noutputs());
+    r.extra = (add ? IPRouteTable::CMD_ADD : IPRouteTable::CMD_REMOVE);
+    commands.push_back(r);
+}
+
+String
+IPRouteTableBenchmark::benchmark()
+{
+    ErrorHandler *errh = ErrorHandler::silent_handler();
+    StringAccum sa;
+
+    Vector<IPRoute> commands;
+    for (int i = 0; i < _routes; ++i)
+	make_route(i, true, commands);
+    Timestamp t0 = Timestamp::now();
+    if (_table->update_routes(commands, errh) < 0)
+	return "could not load routes\n";
+    Timestamp load = Timestamp::now() - t0;
+    sa << "routes " << _routes << ", load " << load.usecval() << " us\n";
+
+    // Replace the oldest BATCH routes on each update while the task looks
+    // up addresses.
+    _concurrent_lookups = 0;
+    _running = true;
+    _task.reschedule();
+    Timestamp total, max;
+    int lo = 0, updates;
+    for (updates = 0; updates < _updates; ++updates, lo += _batch) {
+	commands.clear();
+	for (int j = 0; j < _batch; ++j) {
+	    make_route(lo + j, false, commands);
+	    make_route(lo + _routes + j, true, commands);
+	}
+	t0 = Timestamp::now();
+	if (_table->update_routes(commands, errh) < 0)
+	    break;
+	Timestamp t = Timestamp::now() - t0;
+	total += t;
+	if (t > max)
+	    max = t;
+    }
+    _running = false;
+    if (updates < _updates)
+	sa << "update " << updates << " failed\n";
+    else if (updates)
+	sa << "updates " << updates << " x " << _batch << " routes: mean "
+	   << (total.usecval() / updates) << " us, max "
+	   << max.usecval() << " us\n";
+    sa << "concurrent lookups " << _concurrent_lookups << '\n';
+
+    if (_lookups) {
+	IPAddress gw;
+	uint32_t sum = 0;
+	click_cycles_t c0 = click_get_cycles();
+	for (int i = 0; i < _lookups; ++i)
+	    sum += _table->lookup_route(IPAddress(click_random()), gw);
+	click_cycles_t c = click_get_cycles() - c0;
+	_sink += sum;
+	sa << "lookup " << (c / _lookups) << " cycles\n";
+    }
+
+    // Leave the table as we found it.
+    commands.clear();
+    for (int i = lo; i < lo + _routes; ++i)
+	make_route(i, false, commands);
+    _table->update_routes(commands, errh);
+    return sa.take_string();
+}
+
+String
+IPRouteTableBenchmark::read_handler(Element *e, void *)
+{
+    return static_cast<IPRouteTableBenchmark *>(e)->benchmark();
+}
+
+void
+IPRouteTableBenchmark::add_handlers()
+{
+    add_read_handler("benchmark", read_handler, 0);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(IPRouteTable)
+EXPORT_ELEMENT(IPRouteTableBenchmark)
@@ -19,11 +19,17 @@
 #include <click/config.h>
 #include "packettest.hh"
 #include <click/error.hh>
+#include <click/args.hh>
 #include <clicknet/ip.h>
 #include <clicknet/ip6.h>
+#if CLICK_USERLEVEL
+# include <sys/time.h>
+# include <sys/resource.h>
+#endif
 CLICK_DECLS
 
 PacketTest::PacketTest()
+    : _benchmark(0)
 {
 }
 
@@ -35,6 +41,69 @@ PacketTest::~PacketTest()
 #define CHECK_DATA(x, y, l) CHECK(memcmp((x), (y), (l)) == 0)
 #define CHECK_ALIGNED(x) CHECK((reinterpret_cast<uintptr_t>((x)) & 3) == 0)
 
+int
+PacketTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read("BENCHMARK", _benchmark).complete();
+}
+
+#if CLICK_USERLEVEL
+static Timestamp
+cpu_time()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return Timestamp(ru.ru_utime) + Timestamp(ru.ru_stime);
+}
+
+static void
+report_rate(const char *what, uint32_t n, const Timestamp &t0, ErrorHandler *errh)
+{
+    Timestamp delta = cpu_time() - t0;
+    double secs = delta.doubleval();
+    errh->message("%s: %{timestamp}s, %.0f/s", what, &delta, secs > 0 ? n / secs : 0.);
+}
+
+void
+PacketTest::benchmark(ErrorHandler *errh)
+{
+    const unsigned char data[60] = { 0 };
+
+    Timestamp t0 = cpu_time();
+    for (uint32_t i = 0; i < _benchmark; i++)
+	if (Packet *p = Packet::make(data, sizeof(data)))
+	    p->kill();
+    report_rate("make", _benchmark, t0, errh);
+
+    Packet *q = Packet::make(data, sizeof(data));
+    t0 = cpu_time();
+    for (uint32_t i = 0; i < _benchmark; i++)
+	if (Packet *p = q->clone())
+	    p->kill();
+    report_rate("clone", _benchmark, t0, errh);
+
+# if CLICK_NS
+    simclick_simpacketinfo pinfo = { 1, 2, 3 };
+    t0 = cpu_time();
+    for (uint32_t i = 0; i < _benchmark; i++)
+	if (Packet *p = Packet::make(data, sizeof(data))) {
+	    p->set_sim_packetinfo(&pinfo);
+	    p->kill();
+	}
+    report_rate("make with sim packet info", _benchmark, t0, errh);
+
+    q->set_sim_packetinfo(&pinfo);
+    t0 = cpu_time();
+    for (uint32_t i = 0; i < _benchmark; i++)
+	if (Packet *p = q->clone())
+	    p->kill();
+    report_rate("clone with sim packet info", _benchmark, t0, errh);
+# endif
+
+    q->kill();
+}
+#endif
+
 int
 PacketTest::initialize(ErrorHandler *errh)
 {
@@ -91,14 +160,36 @@ PacketTest::initialize(ErrorHandler *errh)
     p1->kill();
     p3->kill();
 
-#if 0
-    // time cloning
-    p = Packet::make(4);
-    for (int i = 0; i < 40000000; i++)
-	p->clone()->kill();
+#if CLICK_NS
+    // Simulator packet info is created on demand and copied on clone.
+    p = Packet::make(lowers, 20);
+    CHECK(!p->has_sim_packetinfo());
+    simclick_simpacketinfo pinfo;
+    p->copy_sim_packetinfo(&pinfo);
+    CHECK(pinfo.id == -1 && pinfo.fid == -1 && pinfo.simtype == -1);
+    CHECK(!p->has_sim_packetinfo());
+    CHECK(p->get_sim_packetinfo()->id == -1);
+    p->get_sim_packetinfo()->id = 7;
+    Packet *q = p->clone();
+    CHECK(q->has_sim_packetinfo() && q->get_sim_packetinfo()->id == 7);
+    CHECK(q->get_sim_packetinfo() != p->get_sim_packetinfo());
+    q->get_sim_packetinfo()->id = 8;
+    CHECK(p->get_sim_packetinfo()->id == 7);
+    q->kill();
+    p->set_sim_packetinfo(0);
+    CHECK(!p->has_sim_packetinfo());
+    p->kill();
+    // A recycled packet does not keep stale info.
+    p = Packet::make(lowers, 20);
+    CHECK(!p->has_sim_packetinfo());
     p->kill();
 #endif
 
+#if CLICK_USERLEVEL
+    if (_benchmark)
+	benchmark(errh);
+#endif
+
     // test shift_data()
     p = Packet::make(10, lowers, 60, 4);
     CHECK(p->headroom() == 10 && p->tailroom() == 4);
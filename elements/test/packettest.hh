@@ -7,7 +7,7 @@ CLICK_DECLS
 /*
 =c
 
-PacketTest()
+PacketTest([I<keywords> BENCHMARK])
 
 =s test
 
@@ -18,6 +18,11 @@ runs regression tests for Packet
 PacketTest runs Packet regression tests at initialization time. It does not
 route packets.
 
+If BENCHMARK is a positive number N, PacketTest also times N iterations each
+of making and killing a packet, and of cloning and killing one, and reports
+the rates (user-level drivers only). In the ns driver it additionally times packets that carry
+simulator packet info, which is allocated only for packets that need it.
+
 =a
 
 CheckPacket */
@@ -29,8 +34,17 @@ class PacketTest : public Element { public:
 
     const char *class_name() const		{ return "PacketTest"; }
 
+    int configure(Vector<String> &, ErrorHandler *);
     int initialize(ErrorHandler *);
 
+  private:
+
+    uint32_t _benchmark;
+
+#if CLICK_USERLEVEL
+    void benchmark(ErrorHandler *);
+#endif
+
 };
 
 CLICK_ENDDECLS
@@ -21,6 +21,8 @@
 #include <click/confparse.hh>
 #include <click/router.hh>
 #include <click/error.hh>
+#include <click/args.hh>
+#include <sched.h>
 CLICK_DECLS
 
 QueueThreadTest1::QueueThreadTest1()
@@ -120,6 +122,195 @@ QueueThreadTest2::run_task(Task *)
     return true;
 }
 
+
+
+QueueThreadBenchmark::QueueThreadBenchmark()
+    : _queue(0), _full_note(0), _npushers(4), _npullers(4), _packets(100000),
+      _batch(1), _go(false), _pushers_done(false), _seen(0)
+{
+}
+
+QueueThreadBenchmark::~QueueThreadBenchmark()
+{
+}
+
+int
+QueueThreadBenchmark::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    if (Args(conf, this, errh)
+	.read_mp("QUEUE", _queue)
+	.read("PUSHERS", _npushers)
+	.read("PULLERS", _npullers)
+	.read("PACKETS", _packets)
+	.read("BATCH", _batch)
+	.complete() < 0)
+	return -1;
+    if (_npushers <= 0 || _npullers <= 0)
+	return errh->error("need at least one pusher and one puller");
+    if (_packets == 0 || (uint64_t) _packets * _npushers > 0x10000000)
+	return errh->error("PACKETS out of range");
+    if (_batch == 0)
+	_batch = 1;
+    return 0;
+}
+
+inline void
+QueueThreadBenchmark::see(Packet *p)
+{
+    // Distinct packets have distinct values, so threads never write the
+    // same byte unless a packet is duplicated.
+    ++_seen[*reinterpret_cast<const uint32_t *>(p->data())];
+}
+
+void
+QueueThreadBenchmark::push(int, Packet *p)
+{
+    // the queue dropped p
+    see(p);
+    p->kill();
+}
+
+void
+QueueThreadBenchmark::run_pusher(ThreadState *ts)
+{
+    while (!_go)
+	sched_yield();
+    PacketBatch batch;
+    for (Packet **pp = ts->packets.begin(); pp != ts->packets.end(); ++pp) {
+	while (_full_note && !_full_note->active())
+	    sched_yield();
+	if (_batch == 1)
+	    _queue->push(0, *pp);
+	else {
+	    batch.push_back(*pp);
+	    if (batch.count() == _batch || pp + 1 == ts->packets.end())
+		_queue->push_batch(0, batch);
+	}
+    }
+    ts->packets.clear();
+}
+
+void
+QueueThreadBenchmark::run_puller(ThreadState *ts)
+{
+    while (!_go)
+	sched_yield();
+    while (1) {
+	// Pushers are joined before _pushers_done is set, so once it is set,
+	// an empty pull means the queue stays empty.
+	bool done = _pushers_done;
+	int n = 0;
+	if (_batch == 1) {
+	    if (Packet *p = _queue->pull(0)) {
+		ts->packets.push_back(p);
+		n = 1;
+	    }
+	} else {
+	    PacketBatch batch = _queue->pull_batch(0, _batch);
+	    while (Packet *p = batch.pop_front()) {
+		ts->packets.push_back(p);
+		++n;
+	    }
+	}
+	if (n == 0) {
+	    if (done)
+		break;
+	    sched_yield();
+	}
+    }
+}
+
+void *
+QueueThreadBenchmark::pusher_thread(void *arg)
+{
+    ThreadState *ts = static_cast<ThreadState *>(arg);
+    ts->bench->run_pusher(ts);
+    return 0;
+}
+
+void *
+QueueThreadBenchmark::puller_thread(void *arg)
+{
+    ThreadState *ts = static_cast<ThreadState *>(arg);
+    ts->bench->run_puller(ts);
+    return 0;
+}
+
+int
+QueueThreadBenchmark::initialize(ErrorHandler *errh)
+{
+    int before = errh->nerrors();
+    _full_note = static_cast<Notifier *>(_queue->cast(Notifier::FULL_NOTIFIER));
+    uint32_t total = _packets * _npushers;
+    _seen = new uint8_t[total];
+    memset(_seen, 0, total);
+
+    // Make the packets ahead of time so the benchmark measures the queue.
+    Vector<ThreadState> threads(_npushers + _npullers, ThreadState());
+    for (int i = 0; i < threads.size(); ++i) {
+	threads[i].bench = this;
+	threads[i].id = i;
+    }
+    for (int i = 0; i < _npushers; ++i)
+	for (uint32_t j = 0; j < _packets; ++j) {
+	    WritablePacket *p = Packet::make(4);
+	    *reinterpret_cast<uint32_t *>(p->data()) = i * _packets + j;
+	    threads[i].packets.push_back(p);
+	}
+
+    int err = 0, nstarted;
+    for (nstarted = 0; nstarted < threads.size() && !err; ++nstarted)
+	err = pthread_create(&threads[nstarted].thread, 0,
+			     nstarted < _npushers ? pusher_thread : puller_thread,
+			     &threads[nstarted]);
+    if (err) {
+	--nstarted;
+	errh->error("cannot start thread: %s", strerror(err));
+    }
+
+    Timestamp start = Timestamp::now();
+    _go = true;
+    for (int i = 0; i < nstarted && i < _npushers; ++i)
+	pthread_join(threads[i].thread, 0);
+    _pushers_done = true;
+    for (int i = _npushers; i < nstarted; ++i)
+	pthread_join(threads[i].thread, 0);
+    Timestamp elapsed = Timestamp::now() - start;
+
+    uint32_t pulled = 0;
+    for (int i = _npushers; i < threads.size(); ++i) {
+	for (Packet **pp = threads[i].packets.begin(); pp != threads[i].packets.end(); ++pp) {
+	    see(*pp);
+	    (*pp)->kill();
+	}
+	pulled += threads[i].packets.size();
+    }
+    for (int i = 0; i < _npushers; ++i)	// left over if a thread failed
+	for (Packet **pp = threads[i].packets.begin(); pp != threads[i].packets.end(); ++pp)
+	    (*pp)->kill();
+
+    if (!err) {
+	uint32_t lost = 0, duplicated = 0;
+	for (uint32_t v = 0; v < total; ++v)
+	    if (_seen[v] == 0)
+		++lost;
+	    else if (_seen[v] > 1)
+		++duplicated;
+	double secs = elapsed.doubleval();
+	errh->message("%s: %d pushers, %d pullers, batch %u: %u packets in %{timestamp}s (%u pulled, %.0f packets/s)",
+		      _queue->class_name(), _npushers, _npullers, _batch,
+		      total, &elapsed, pulled, secs > 0 ? total / secs : 0.);
+	if (lost)
+	    errh->error("%u packets lost", lost);
+	if (duplicated)
+	    errh->error("%u packets duplicated", duplicated);
+    }
+
+    delete[] _seen;
+    _seen = 0;
+    return errh->nerrors() == before ? 0 : -1;
+}
+
 ELEMENT_REQUIRES(userlevel umultithread)
-EXPORT_ELEMENT(QueueThreadTest1 QueueThreadTest2)
+EXPORT_ELEMENT(QueueThreadTest1 QueueThreadTest2 QueueThreadBenchmark)
 CLICK_ENDDECLS
@@ -78,5 +78,102 @@ class QueueThreadTest2 : public Element { public:
 
 };
 
+
+
+/*
+=c
+
+QueueThreadBenchmark(QUEUE, [I<keywords>])
+
+=s test
+
+benchmarks a queue under contention
+
+=d
+
+At initialization time, QueueThreadBenchmark starts PUSHERS threads that push
+PACKETS packets each into the QUEUE element and PULLERS threads that pull
+them out, all at once, and reports how long it took.  It then checks that
+every packet came out exactly once.  Packets the queue drops count as coming
+out if the queue's drop output is connected to QueueThreadBenchmark's input.
+Pushers back off while the queue's full notifier says it is full, so drops
+should be rare.
+
+Use it to compare thread-safe queues such as ThreadSafeQueue and MPMCQueue.
+
+Keyword arguments are:
+
+=over 8
+
+=item PUSHERS
+
+Integer.  Number of pushing threads.  Default is 4.
+
+=item PULLERS
+
+Integer.  Number of pulling threads.  Default is 4.
+
+=item PACKETS
+
+Integer.  Number of packets each pusher pushes.  Default is 100000.
+
+=item BATCH
+
+Integer.  If greater than 1, pushers and pullers move packets with
+push_batch() and pull_batch() calls of up to BATCH packets.  Default is 1.
+
+=back
+
+=e
+
+  q :: MPMCQueue(1024);
+  Idle -> q -> Idle;
+  q[1] -> b :: QueueThreadBenchmark(q, PUSHERS 8, PULLERS 2);
+
+=a QueueThreadTest1, MPMCQueue, ThreadSafeQueue
+
+*/
+
+class QueueThreadBenchmark : public Element { public:
+
+    QueueThreadBenchmark();
+    ~QueueThreadBenchmark();
+
+    const char *class_name() const		{ return "QueueThreadBenchmark"; }
+    const char *port_count() const		{ return "0-1/0"; }
+    const char *processing() const		{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh);
+    int initialize(ErrorHandler *errh);
+
+    void push(int port, Packet *p);
+
+  private:
+
+    struct ThreadState {
+	QueueThreadBenchmark *bench;
+	int id;
+	pthread_t thread;
+	Vector<Packet *> packets;
+    };
+
+    Element *_queue;
+    Notifier *_full_note;
+    int _npushers;
+    int _npullers;
+    uint32_t _packets;
+    unsigned _batch;
+    volatile bool _go;
+    volatile bool _pushers_done;
+    uint8_t *_seen;
+
+    inline void see(Packet *p);
+    void run_pusher(ThreadState *ts);
+    void run_puller(ThreadState *ts);
+    static void *pusher_thread(void *arg);
+    static void *puller_thread(void *arg);
+
+};
+
 CLICK_ENDDECLS
 #endif
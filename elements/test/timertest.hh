@@ -39,7 +39,14 @@ is printed to standard error.
 
 Integer.  If set to a positive number, then TimerTest runs a timer
 manipulation benchmark at installation time involving BENCHMARK total
-timers.  Default is 0 (don't benchmark).
+timers, reports the cycles each phase took per timer, and checks that the
+timers come due in expiry order.  Default is 0 (don't benchmark).
+
+=item WHEEL
+
+Boolean.  If true, the benchmark runs with the thread's timers in a timing
+wheel (see TimerSet::set_timer_wheel()) rather than a heap.  The previous
+setting is restored afterwards.  Default is false.
 
 =back
 
@@ -78,10 +85,12 @@ class TimerTest : public Element { public:
 
     Timer _timer;
     int _benchmark;
+    bool _wheel;
 
+    void benchmark(ErrorHandler *errh);
     void benchmark_schedules(Timer *ts, int nts, const Timestamp &now);
     void benchmark_changes(Timer *ts, int nts, const Timestamp &now);
-    void benchmark_fires(Timer *ts, int nts, const Timestamp &now);
+    int benchmark_fires(Timer *ts, int nts, const Timestamp &now);
 
     enum { h_scheduled, h_expiry, h_schedule_after, h_unschedule };
     static String read_handler(Element *e, void *user_data);
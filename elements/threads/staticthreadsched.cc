@@ -69,5 +69,15 @@ StaticThreadSched::initial_home_thread_id(const Element *e)
 	return THREAD_UNKNOWN;
 }
 
+bool
+StaticThreadSched::thread_pinned(const Element *e)
+{
+    int eidx = e->eindex();
+    if (eidx >= 0 && eidx < _thread_preferences.size()
+	&& _thread_preferences[eidx] != THREAD_UNKNOWN)
+	return true;
+    return _next_thread_sched && _next_thread_sched->thread_pinned(e);
+}
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(StaticThreadSched)
@@ -14,6 +14,10 @@ CLICK_DECLS
  * Statically binds elements to threads. If more than one StaticThreadSched
  * is specified, they will all run. The one that runs later may override an
  * earlier run.
+ *
+ * Tasks bound by StaticThreadSched are pinned: when the driver runs with
+ * work stealing enabled (see click(1)'s --work-stealing option), idle threads
+ * never steal them.
  * =a
  * ThreadMonitor, BalancedThreadSched
  */
@@ -28,6 +32,7 @@ class StaticThreadSched : public Element, public ThreadSched { public:
     int configure(Vector<String> &, ErrorHandler *);
 
     int initial_home_thread_id(const Element *e);
+    bool thread_pinned(const Element *e);
 
   private:
 
@@ -23,10 +23,11 @@
 #include <click/glue.hh>
 #include <elements/wifi/path.hh>
 #include <click/straccum.hh>
+#include <click/heap.hh>
 CLICK_DECLS
 
 LinkTable::LinkTable()
-  : _timer(this)
+  : _graph_stale(true), _timer(this)
 {
 }
 
@@ -88,6 +89,7 @@ LinkTable::take_state(Element *e, ErrorHandler *) {
 
   _hosts = q->_hosts;
   _links = q->_links;
+  _graph_stale = true;
   dijkstra(true);
   dijkstra(false);
 }
@@ -137,6 +139,7 @@ LinkTable::clear()
 {
   _hosts.clear();
   _links.clear();
+  _graph_stale = true;
 
 }
 bool
@@ -156,11 +159,13 @@ LinkTable::update_link(IPAddress from, IPAddress to,
     HostInfo foo = HostInfo(from);
     _hosts.insert(from, foo);
     nfrom = _hosts.findp(from);
+    _graph_stale = true;
   }
   HostInfo *nto = _hosts.findp(to);
   if (!nto) {
     _hosts.insert(to, HostInfo(to));
     nto = _hosts.findp(to);
+    _graph_stale = true;
   }
 
   assert(nfrom);
@@ -170,8 +175,12 @@ LinkTable::update_link(IPAddress from, IPAddress to,
   LinkInfo *lnfo = _links.findp(p);
   if (!lnfo) {
     _links.insert(p, LinkInfo(from, to, seq, age, metric));
+    _graph_stale = true;
   } else {
+    uint32_t old_metric = lnfo->_metric;
     lnfo->update(seq, age, metric);
+    if (lnfo->_metric != old_metric)
+      note_metric_change(from, to, old_metric, lnfo->_metric);
   }
   return true;
 }
@@ -476,6 +485,8 @@ LinkTable::clear_stale() {
       }
     }
   }
+  if (links.size() != _links.size())
+    _graph_stale = true;
   _links.clear();
 
   for (LTIter iter = links.begin(); iter.live(); iter++) {
@@ -511,116 +522,325 @@ LinkTable::get_neighbors(IPAddress ip)
 
   return neighbors;
 }
-void
-LinkTable::dijkstra(bool from_me)
+namespace {
+struct DijkstraEntry {
+  uint32_t dist;
+  int host;
+  DijkstraEntry(uint32_t d, int h) : dist(d), host(h) { }
+};
+
+// Hosts with equal metrics come off the heap in index order.
+inline bool
+operator<(const DijkstraEntry &a, const DijkstraEntry &b)
 {
-  Timestamp start = Timestamp::now();
-  IPAddress src = _ip;
+  return a.dist < b.dist || (a.dist == b.dist && a.host < b.host);
+}
+}
 
+void
+LinkTable::rebuild_graph()
+{
+  // Number the hosts in the order the original dijkstra() visited them.
   typedef HashMap<IPAddress, bool> IPMap;
   IPMap ip_addrs;
-
-  for (HTIter iter = _hosts.begin(); iter.live(); iter++) {
+  for (HTIter iter = _hosts.begin(); iter.live(); iter++)
     ip_addrs.insert(iter.value()._ip, true);
-  }
 
+  _dense_index.clear();
+  _dense_ip.clear();
   for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-    /* clear them all initially */
-    HostInfo *n = _hosts.findp(i.key());
-    n->clear(from_me);
+    _dense_index.insert(i.key(), _dense_ip.size());
+    _dense_ip.push_back(i.key());
   }
-  HostInfo *root_info = _hosts.findp(src);
-
 
-  assert(root_info);
+  int n = _dense_ip.size();
+  _dense_links.clear();
+  _out_start.assign(n + 1, 0);
+  _in_start.assign(n + 1, 0);
+  for (LTIter iter = _links.begin(); iter.live(); iter++) {
+    int *from = _dense_index.findp(iter.value()._from);
+    int *to = _dense_index.findp(iter.value()._to);
+    if (!from || !to || !iter.value()._metric)
+      continue;
+    DenseLink l;
+    l._from = *from;
+    l._to = *to;
+    l._metric = iter.value()._metric;
+    _dense_links.push_back(l);
+    _out_start[l._from + 1]++;
+    _in_start[l._to + 1]++;
+  }
+
+  for (int i = 0; i < n; i++) {
+    _out_start[i + 1] += _out_start[i];
+    _in_start[i + 1] += _in_start[i];
+  }
+  _out_links.assign(_dense_links.size(), 0);
+  _in_links.assign(_dense_links.size(), 0);
+  Vector<int> out_pos(_out_start), in_pos(_in_start);
+  for (int k = 0; k < _dense_links.size(); k++) {
+    _out_links[out_pos[_dense_links[k]._from]++] = k;
+    _in_links[in_pos[_dense_links[k]._to]++] = k;
+  }
+
+  for (int t = 0; t < 2; t++) {
+    _trees[t]._valid = false;
+    _trees[t]._changes.clear();
+  }
+  _graph_stale = false;
+}
 
-  if (from_me) {
-    root_info->_prev_from_me = root_info->_ip;
-    root_info->_metric_from_me = 0;
-  } else {
-    root_info->_prev_to_me = root_info->_ip;
-    root_info->_metric_to_me = 0;
+void
+LinkTable::note_metric_change(IPAddress from, IPAddress to,
+			      uint32_t old_metric, uint32_t new_metric)
+{
+  if (_graph_stale)
+    return;
+  // rebuild_graph() leaves out metric-0 links, so a link moving to or from
+  // metric 0 changes the graph itself.
+  if (old_metric == 0 || new_metric == 0) {
+    _graph_stale = true;
+    return;
+  }
+  int *f = _dense_index.findp(from);
+  int *t = _dense_index.findp(to);
+  if (!f || !t)
+    return;
+  for (int k = _out_start[*f]; k < _out_start[*f + 1]; k++) {
+    DenseLink &l = _dense_links[_out_links[k]];
+    if (l._to == *t) {
+      MetricChange c;
+      c._link = _out_links[k];
+      c._old_metric = old_metric;
+      c._new_metric = new_metric;
+      l._metric = new_metric;
+      for (int i = 0; i < 2; i++)
+	if (_trees[i]._valid)
+	  _trees[i]._changes.push_back(c);
+      return;
+    }
   }
+}
 
-  IPAddress current_min_ip = root_info->_ip;
+/* In the tree for from_me, the links leaving host i are _out_links and lead
+ * to their _to hosts; in the tree to me, they are _in_links and lead to
+ * their _from hosts. */
 
-  while (current_min_ip) {
-    HostInfo *current_min = _hosts.findp(current_min_ip);
-    assert(current_min);
-    if (from_me) {
-      current_min->_marked_from_me = true;
-    } else {
-      current_min->_marked_to_me = true;
+void
+LinkTable::full_dijkstra(bool from_me)
+{
+  SPTree &t = _trees[from_me];
+  const Vector<int> &start = (from_me ? _out_start : _in_start);
+  const Vector<int> &links = (from_me ? _out_links : _in_links);
+  int n = _dense_ip.size();
+  t._dist.assign(n, DIST_INFINITE);
+  t._prev.assign(n, -1);
+  t._changes.clear();
+  t._valid = false;
+
+  int *root = _dense_index.findp(_ip);
+  if (!root)
+    return;
+  t._dist[*root] = 0;
+  t._prev[*root] = *root;
+
+  // Relax only on strictly shorter paths, so each host keeps the first
+  // predecessor, in heap order, that reaches it at its final metric.
+  Vector<DijkstraEntry> heap;
+  heap.push_back(DijkstraEntry(0, *root));
+  while (heap.size()) {
+    DijkstraEntry e = heap[0];
+    pop_heap(heap.begin(), heap.end(), less<DijkstraEntry>());
+    heap.pop_back();
+    if (e.dist != t._dist[e.host])
+      continue;
+    for (int k = start[e.host]; k < start[e.host + 1]; k++) {
+      const DenseLink &l = _dense_links[links[k]];
+      int w = (from_me ? l._to : l._from);
+      uint32_t d = e.dist + l._metric;
+      if (d < t._dist[w]) {
+	t._dist[w] = d;
+	t._prev[w] = e.host;
+	heap.push_back(DijkstraEntry(d, w));
+	push_heap(heap.begin(), heap.end(), less<DijkstraEntry>());
+      }
     }
+  }
 
+  t._valid = true;
+  for (int i = 0; i < n; i++)
+    publish_host(from_me, i);
+}
 
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *neighbor = _hosts.findp(i.key());
-      assert(neighbor);
-      bool marked = neighbor->_marked_to_me;
-      if (from_me) {
-	marked = neighbor->_marked_from_me;
-      }
-
-      if (marked) {
-	continue;
-      }
+/* Recompute host w's predecessor: among its neighbors that reach it at its
+ * metric, the one full_dijkstra() would have taken off the heap first. */
+void
+LinkTable::fix_prev(bool from_me, int w)
+{
+  SPTree &t = _trees[from_me];
+  if (t._prev[w] == w)
+    return;
+  const Vector<int> &start = (from_me ? _in_start : _out_start);
+  const Vector<int> &links = (from_me ? _in_links : _out_links);
+  int best = -1;
+  if (t._dist[w] != DIST_INFINITE)
+    for (int k = start[w]; k < start[w + 1]; k++) {
+      const DenseLink &l = _dense_links[links[k]];
+      int p = (from_me ? l._from : l._to);
+      if (t._dist[p] != DIST_INFINITE && p != w
+	  && t._dist[p] + l._metric == t._dist[w]
+	  && (best < 0 || DijkstraEntry(t._dist[p], p) < DijkstraEntry(t._dist[best], best)))
+	best = p;
+    }
+  t._prev[w] = best;
+}
 
-      IPPair pair = IPPair(neighbor->_ip, current_min_ip);
-      if (from_me) {
-	pair = IPPair(current_min_ip, neighbor->_ip);
+/* Update tree from_me for a change to one link's metric, given trees
+ * computed with the old metric. */
+void
+LinkTable::update_dijkstra(bool from_me, const MetricChange &c)
+{
+  SPTree &t = _trees[from_me];
+  const Vector<int> &start = (from_me ? _out_start : _in_start);
+  const Vector<int> &links = (from_me ? _out_links : _in_links);
+  const DenseLink &link = _dense_links[c._link];
+  int u = (from_me ? link._from : link._to);
+  int v = (from_me ? link._to : link._from);
+  if (u == v || t._dist[u] == DIST_INFINITE)
+    return;
+
+  Vector<int> changed;
+  Vector<DijkstraEntry> heap;
+  if (c._new_metric > c._old_metric) {
+    // Only hosts whose path used the link can get worse: the link's
+    // subtree.  Give them the best metric through the rest of the tree.
+    if (t._prev[v] != u)
+      return;
+    Vector<bool> in_subtree(t._dist.size(), false);
+    changed.push_back(v);
+    in_subtree[v] = true;
+    for (int i = 0; i < changed.size(); i++) {
+      int x = changed[i];
+      for (int k = start[x]; k < start[x + 1]; k++) {
+	const DenseLink &l = _dense_links[links[k]];
+	int w = (from_me ? l._to : l._from);
+	if (t._prev[w] == x && !in_subtree[w]) {
+	  in_subtree[w] = true;
+	  changed.push_back(w);
+	}
       }
-      LinkInfo *lnfo = _links.findp(pair);
-      if (!lnfo || !lnfo->_metric) {
-	continue;
+    }
+    for (int i = 0; i < changed.size(); i++)
+      t._dist[changed[i]] = DIST_INFINITE;
+    const Vector<int> &in_start = (from_me ? _in_start : _out_start);
+    const Vector<int> &in_links = (from_me ? _in_links : _out_links);
+    for (int i = 0; i < changed.size(); i++) {
+      int x = changed[i];
+      for (int k = in_start[x]; k < in_start[x + 1]; k++) {
+	const DenseLink &l = _dense_links[in_links[k]];
+	int p = (from_me ? l._from : l._to);
+	if (!in_subtree[p] && t._dist[p] != DIST_INFINITE
+	    && t._dist[p] + l._metric < t._dist[x])
+	  t._dist[x] = t._dist[p] + l._metric;
       }
-      uint32_t neighbor_metric = neighbor->_metric_to_me;
-      uint32_t current_metric = current_min->_metric_to_me;
-
-      if (from_me) {
-	neighbor_metric = neighbor->_metric_from_me;
-	current_metric = current_min->_metric_from_me;
+      if (t._dist[x] != DIST_INFINITE) {
+	heap.push_back(DijkstraEntry(t._dist[x], x));
+	push_heap(heap.begin(), heap.end(), less<DijkstraEntry>());
       }
-
-
-      uint32_t adjusted_metric = current_metric + lnfo->_metric;
-      if (!neighbor_metric ||
-	  adjusted_metric < neighbor_metric) {
-	if (from_me) {
-	  neighbor->_metric_from_me = adjusted_metric;
-	  neighbor->_prev_from_me = current_min_ip;
-	} else {
-	  neighbor->_metric_to_me = adjusted_metric;
-	  neighbor->_prev_to_me = current_min_ip;
-	}
-
+    }
+  } else if (c._new_metric < c._old_metric) {
+    // Only hosts reachable through the link can get better.
+    uint32_t d = t._dist[u] + c._new_metric;
+    if (d > t._dist[v])
+      return;
+    changed.push_back(v);
+    if (d < t._dist[v]) {
+      t._dist[v] = d;
+      heap.push_back(DijkstraEntry(d, v));
+    }
+  } else
+    return;
+
+  while (heap.size()) {
+    DijkstraEntry e = heap[0];
+    pop_heap(heap.begin(), heap.end(), less<DijkstraEntry>());
+    heap.pop_back();
+    if (e.dist != t._dist[e.host])
+      continue;
+    for (int k = start[e.host]; k < start[e.host + 1]; k++) {
+      const DenseLink &l = _dense_links[links[k]];
+      int w = (from_me ? l._to : l._from);
+      uint32_t d = e.dist + l._metric;
+      if (d < t._dist[w]) {
+	t._dist[w] = d;
+	changed.push_back(w);
+	heap.push_back(DijkstraEntry(d, w));
+	push_heap(heap.begin(), heap.end(), less<DijkstraEntry>());
       }
     }
+  }
 
-    current_min_ip = IPAddress();
-    uint32_t  min_metric = ~0;
-    for (IPMap::const_iterator i = ip_addrs.begin(); i.live(); i++) {
-      HostInfo *nfo = _hosts.findp(i.key());
-      uint32_t metric = nfo->_metric_to_me;
-      bool marked = nfo->_marked_to_me;
-      if (from_me) {
-	metric = nfo->_metric_from_me;
-	marked = nfo->_marked_from_me;
-      }
-      if (!marked && metric &&
-	  metric < min_metric) {
-        current_min_ip = nfo->_ip;
-        min_metric = metric;
-      }
+  // A host's predecessor can change if its metric changed, if a
+  // neighbor's metric changed, or if it is the link's end.
+  Vector<int> fix(changed);
+  for (int i = 0; i < changed.size(); i++) {
+    int x = changed[i];
+    for (int k = start[x]; k < start[x + 1]; k++) {
+      const DenseLink &l = _dense_links[links[k]];
+      fix.push_back(from_me ? l._to : l._from);
     }
+  }
+  for (int i = 0; i < fix.size(); i++) {
+    fix_prev(from_me, fix[i]);
+    publish_host(from_me, fix[i]);
+  }
+}
 
+/* Copy host i's metric and predecessor to its HostInfo. */
+void
+LinkTable::publish_host(bool from_me, int i)
+{
+  SPTree &t = _trees[from_me];
+  HostInfo *nfo = _hosts.findp(_dense_ip[i]);
+  if (!nfo)
+    return;
+  bool reached = t._dist[i] != DIST_INFINITE;
+  IPAddress prev = (reached ? _dense_ip[t._prev[i]] : IPAddress());
+  uint32_t metric = (reached ? t._dist[i] : 0);
+  if (from_me) {
+    nfo->_prev_from_me = prev;
+    nfo->_metric_from_me = metric;
+    nfo->_marked_from_me = reached;
+  } else {
+    nfo->_prev_to_me = prev;
+    nfo->_metric_to_me = metric;
+    nfo->_marked_to_me = reached;
+  }
+}
 
+void
+LinkTable::dijkstra(bool from_me)
+{
+  Timestamp start = Timestamp::now();
+
+  if (_graph_stale)
+    rebuild_graph();
+  SPTree &t = _trees[from_me];
+  if (!t._valid || t._changes.size() > MAX_INCREMENTAL_CHANGES)
+    full_dijkstra(from_me);
+  else if (t._changes.size()) {
+    // The tree was computed with the metrics from before the queued
+    // changes.  Restore those, then apply the changes in order.
+    for (int i = t._changes.size() - 1; i >= 0; i--)
+      _dense_links[t._changes[i]._link]._metric = t._changes[i]._old_metric;
+    for (int i = 0; i < t._changes.size(); i++) {
+      _dense_links[t._changes[i]._link]._metric = t._changes[i]._new_metric;
+      update_dijkstra(from_me, t._changes[i]);
+    }
+    t._changes.clear();
   }
 
   dijkstra_time = Timestamp::now() - start;
-  //StringAccum sa;
-  //sa << "dijstra took " << finish - start;
-  //click_chatter("%s: %s\n", name().c_str(), sa.take_string().c_str());
 }
 
 
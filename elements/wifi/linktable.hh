@@ -16,7 +16,9 @@ CLICK_DECLS
  * Keeps a Link state database and calculates Weighted Shortest Path
  * for other elements
  * =d
- * Runs dijkstra's algorithm occasionally.
+ * Runs dijkstra's algorithm occasionally.  After a change to the metric of
+ * an existing link, the next run updates the previous shortest-path trees
+ * instead of recomputing them.
  * =a ARPTable
  *
  */
@@ -232,6 +234,47 @@ protected:
   HTable _hosts;
   LTable _links;
 
+  // dijkstra() works on a dense-index copy of the link graph.  Hosts are
+  // numbered in the order the original quadratic scan visited them, so
+  // equal-metric paths break ties the same way.  The copy is rebuilt when
+  // hosts or links come and go; metric changes are queued for each tree.
+  struct DenseLink {
+    int _from;
+    int _to;
+    uint32_t _metric;
+  };
+  struct MetricChange {
+    int _link;
+    uint32_t _old_metric;
+    uint32_t _new_metric;
+  };
+  struct SPTree {
+    Vector<uint32_t> _dist;	// DIST_INFINITE if unreachable
+    Vector<int> _prev;		// -1 if unreachable
+    Vector<MetricChange> _changes;
+    bool _valid;
+    SPTree() : _valid(false) { }
+  };
+  enum { DIST_INFINITE = 0xFFFFFFFFU };
+  enum { MAX_INCREMENTAL_CHANGES = 8 };
+
+  bool _graph_stale;
+  HashMap<IPAddress, int> _dense_index;
+  Vector<IPAddress> _dense_ip;
+  Vector<DenseLink> _dense_links;
+  Vector<int> _out_start;	// _out_links[_out_start[i]...] leave host i
+  Vector<int> _out_links;
+  Vector<int> _in_start;	// _in_links[_in_start[i]...] enter host i
+  Vector<int> _in_links;
+  SPTree _trees[2];		// indexed by from_me
+
+  void rebuild_graph();
+  void note_metric_change(IPAddress from, IPAddress to,
+			  uint32_t old_metric, uint32_t new_metric);
+  void full_dijkstra(bool from_me);
+  void update_dijkstra(bool from_me, const MetricChange &c);
+  void fix_prev(bool from_me, int w);
+  void publish_host(bool from_me, int i);
 
   IPAddress _ip;
   Timestamp _stale_timeout;
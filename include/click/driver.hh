@@ -8,6 +8,7 @@
 #if CLICK_USERLEVEL
 CLICK_DECLS
 class Router;
+class RouterImage;
 class Master;
 class ErrorHandler;
 class Lexer;
@@ -18,6 +19,7 @@ void click_static_cleanup();
 
 Lexer *click_lexer();
 Router *click_read_router(String filename, bool is_expr, ErrorHandler * = 0, bool initialize = true, Master * = 0);
+RouterImage *click_read_router_image(String filename, bool is_expr, ErrorHandler * = 0);
 
 String click_compile_archive_file(const Vector<ArchiveElement> &ar,
 		const ArchiveElement *ae,
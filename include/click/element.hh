@@ -5,6 +5,7 @@
 #include <click/vector.hh>
 #include <click/string.hh>
 #include <click/packet.hh>
+#include <click/packetbatch.hh>
 #include <click/handler.hh>
 CLICK_DECLS
 class Router;
@@ -26,6 +27,11 @@ class EtherAddress;
 # define CLICK_ELEMENT_DEPRECATED CLICK_DEPRECATED
 #endif
 
+// Runtime profiling of port transfers and tasks; see Element::Profile.
+#if CLICK_USERLEVEL
+# define HAVE_ELEMENT_PROFILE 1
+#endif
+
 class Element { public:
 
     Element();
@@ -36,6 +42,8 @@ class Element { public:
     virtual void push(int port, Packet *p);
     virtual Packet *pull(int port) CLICK_WARN_UNUSED_RESULT;
     virtual Packet *simple_action(Packet *p);
+    virtual void push_batch(int port, PacketBatch &batch);
+    virtual PacketBatch pull_batch(int port, unsigned max) CLICK_WARN_UNUSED_RESULT;
 
     virtual bool run_task(Task *task);	// return true iff did useful work
     virtual void run_timer(Timer *timer);
@@ -46,6 +54,9 @@ class Element { public:
 #endif
 
     inline void checked_output_push(int port, Packet *p) const;
+    inline void checked_output_push_batch(int port, PacketBatch &batch) const;
+    template <typename E> inline void simple_push_batch(int port, PacketBatch &batch);
+    template <typename E> inline PacketBatch simple_pull_batch(int port, unsigned max);
 
     // ELEMENT CHARACTERISTICS
     virtual const char *class_name() const = 0;
@@ -207,6 +218,13 @@ class Element { public:
     virtual int llrpc(unsigned command, void* arg);
     int local_llrpc(unsigned command, void* arg);
 
+#if HAVE_ELEMENT_PROFILE
+    // PROFILING
+    struct Profile;
+    static bool profiling;
+    inline const Profile *profile() const;
+#endif
+
     class Port { public:
 
 	inline bool active() const;
@@ -215,6 +233,8 @@ class Element { public:
 
 	inline void push(Packet* p) const;
 	inline Packet* pull() const;
+	inline void push_batch(PacketBatch &batch) const;
+	inline PacketBatch pull_batch(unsigned max) const;
 
 #if CLICK_STATS >= 1
 	unsigned npackets() const	{ return _packets; }
@@ -222,6 +242,13 @@ class Element { public:
 
       private:
 
+#if HAVE_ELEMENT_PROFILE
+	void profiled_push(Packet *p) const;
+	Packet *profiled_pull() const;
+	void profiled_push_batch(PacketBatch &batch) const;
+	PacketBatch profiled_pull_batch(unsigned max) const;
+#endif
+
 	Element* _e;
 	int _port;
 #if HAVE_BOUND_PORT_TRANSFER
@@ -284,6 +311,16 @@ class Element { public:
     static int write_cycles_handler(const String &, Element *, void *, ErrorHandler *);
 #endif
 
+#if HAVE_ELEMENT_PROFILE
+    Profile *_profile;		// Input ports, output ports, then tasks.
+
+    static void profile_begin(click_cycles_t &saved_child_cycles,
+			      click_cycles_t &start_cycles);
+    static void profile_end(Profile *profile, uint32_t npackets,
+			    click_cycles_t saved_child_cycles,
+			    click_cycles_t start_cycles);
+#endif
+
     Element(const Element &);
     Element &operator=(const Element &);
 
@@ -302,8 +339,10 @@ class Element { public:
     inline void add_data_handlers(const String &name, int flags, HandlerCallback callback, void *data);
 
     friend class Router;
-#if CLICK_STATS >= 2
+#if CLICK_STATS >= 2 || HAVE_ELEMENT_PROFILE
     friend class Task;
+#endif
+#if CLICK_STATS >= 2
     friend class Master;
     friend class TimerSet;
 # if CLICK_USERLEVEL
@@ -314,6 +353,40 @@ class Element { public:
 };
 
 
+#if HAVE_ELEMENT_PROFILE
+/** @class Element::Profile
+ * @brief Profile counters for an element port or for an element's tasks.
+ *
+ * While Element::profiling is true, every transfer over a port and every
+ * task run updates a Profile belonging to the element being called.  Its
+ * pushes are charged to its input ports, its pulls to its output ports, and
+ * its tasks' runs to a separate Profile.  Self cycles exclude time spent in
+ * the transfers the element made in turn; inclusive cycles include it.
+ *
+ * The counters are not updated atomically, so concurrent threads may lose
+ * updates.  Router::enable_profile() and the global @c profile handler
+ * start profiling.
+ */
+struct Element::Profile {
+    uint64_t calls;		///< Push, pull, or task calls
+    uint64_t packets;		///< Packets transferred
+    click_cycles_t self_cycles;	///< Cycles in the element itself
+    click_cycles_t inclusive_cycles; ///< Cycles including nested calls
+};
+
+/** @brief Return the element's profile counters, or null if the element
+ * has never been profiled.
+ *
+ * The result holds ninputs() input port counters, then noutputs() output
+ * port counters, then one counter for the element's tasks. */
+inline const Element::Profile *
+Element::profile() const
+{
+    return _profile;
+}
+#endif
+
+
 /** @brief Initialize static data for this element class.
  *
  * Elements that need to initialize global state, such as global hash tables
@@ -599,6 +672,12 @@ Element::Port::push(Packet* p) const
 #if CLICK_STATS >= 1
     ++_packets;
 #endif
+#if HAVE_ELEMENT_PROFILE
+    if (unlikely(profiling)) {
+	profiled_push(p);
+	return;
+    }
+#endif
 #if CLICK_STATS >= 2
     ++_e->input(_port)._packets;
     click_cycles_t c0 = click_get_cycles();
@@ -640,6 +719,16 @@ inline Packet*
 Element::Port::pull() const
 {
     assert(_e);
+#if HAVE_ELEMENT_PROFILE
+    if (unlikely(profiling)) {
+	Packet *p = profiled_pull();
+# if CLICK_STATS >= 1
+	if (p)
+	    ++_packets;
+# endif
+	return p;
+    }
+#endif
 #if CLICK_STATS >= 2
     click_cycles_t c0 = click_get_cycles();
 # if HAVE_BOUND_PORT_TRANSFER
@@ -688,6 +777,143 @@ Element::checked_output_push(int port, Packet* p) const
 	p->kill();
 }
 
+/** @brief Push the packets in @a batch over this port.
+ *
+ * Like push(), but transfers every packet in @a batch, in order, with a
+ * single call to the next element's @link Element::push_batch()
+ * push_batch() @endlink function.  On return @a batch is empty.  Does
+ * nothing if @a batch is empty.
+ */
+inline void
+Element::Port::push_batch(PacketBatch &batch) const
+{
+    assert(_e);
+    if (batch.empty())
+	return;
+#if CLICK_STATS >= 1
+    _packets += batch.count();
+#endif
+#if HAVE_ELEMENT_PROFILE
+    if (unlikely(profiling)) {
+	profiled_push_batch(batch);
+	batch.clear();
+	return;
+    }
+#endif
+#if CLICK_STATS >= 2
+    _e->input(_port)._packets += batch.count();
+    click_cycles_t c0 = click_get_cycles();
+    _e->push_batch(_port, batch);
+    click_cycles_t x = click_get_cycles() - c0;
+    ++_e->_calls;
+    _e->_self_cycles += x;
+    _owner->_child_cycles += x;
+#else
+    _e->push_batch(_port, batch);
+#endif
+    batch.clear();
+}
+
+/** @brief Pull up to @a max packets over this port and return them.
+ *
+ * Like pull(), but calls the previous element's @link Element::pull_batch()
+ * pull_batch() @endlink function, which may return up to @a max packets.
+ * An empty result means no packets were available.
+ */
+inline PacketBatch
+Element::Port::pull_batch(unsigned max) const
+{
+    assert(_e);
+#if HAVE_ELEMENT_PROFILE
+    if (unlikely(profiling)) {
+	PacketBatch batch = profiled_pull_batch(max);
+# if CLICK_STATS >= 1
+	_packets += batch.count();
+# endif
+	return batch;
+    }
+#endif
+#if CLICK_STATS >= 2
+    click_cycles_t c0 = click_get_cycles();
+    PacketBatch batch = _e->pull_batch(_port, max);
+    click_cycles_t x = click_get_cycles() - c0;
+    ++_e->_calls;
+    _e->_self_cycles += x;
+    _owner->_child_cycles += x;
+    _e->output(_port)._packets += batch.count();
+#else
+    PacketBatch batch = _e->pull_batch(_port, max);
+#endif
+#if CLICK_STATS >= 1
+    _packets += batch.count();
+#endif
+    return batch;
+}
+
+/** @brief Push @a batch to output @a port, or kill its packets if @a port is
+ * out of range.
+ *
+ * On return @a batch is empty.
+ *
+ * @note It is invalid to call checked_output_push_batch() on a pull output
+ * @a port.
+ */
+inline void
+Element::checked_output_push_batch(int port, PacketBatch &batch) const
+{
+    if ((unsigned) port < (unsigned) noutputs())
+	_ports[1][port].push_batch(batch);
+    else
+	batch.kill();
+}
+
+/** @brief Implement push_batch() for a simple_action() element.
+ *
+ * @param port the input port number receiving the batch
+ * @param batch the packets
+ *
+ * Calls E::simple_action() on each packet in @a batch and pushes the
+ * resulting packets to output @a port as one batch.  E must be this
+ * element's class; naming it lets the compiler call (and inline) its
+ * simple_action() directly rather than through the virtual table.  Use like
+ * this:
+ *
+ * @code
+ * void push_batch(int port, PacketBatch &batch) {
+ *     simple_push_batch<Strip>(port, batch);
+ * }
+ * @endcode
+ */
+template <typename E> inline void
+Element::simple_push_batch(int port, PacketBatch &batch)
+{
+    E *e = static_cast<E *>(this);
+    PacketBatch out;
+    while (Packet *p = batch.pop_front())
+	if ((p = e->E::simple_action(p)))
+	    out.push_back(p);
+    output(port).push_batch(out);
+}
+
+/** @brief Implement pull_batch() for a simple_action() element.
+ *
+ * @param port the output port number receiving the pull request
+ * @param max maximum number of packets to return
+ *
+ * Pulls up to @a max packets from input @a port and returns the results of
+ * calling E::simple_action() on each.  See simple_push_batch().
+ */
+template <typename E> inline PacketBatch
+Element::simple_pull_batch(int port, unsigned max)
+{
+    E *e = static_cast<E *>(this);
+    PacketBatch in = input(port).pull_batch(max), out;
+    while (Packet *p = in.pop_front())
+	if ((p = e->E::simple_action(p)))
+	    out.push_back(p);
+    return out;
+}
+
 #undef PORT_ASSIGN
 CLICK_ENDDECLS
 #endif
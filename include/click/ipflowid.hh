@@ -150,22 +150,18 @@ inline IPFlowID IPFlowID::rev() const
 }
 
 
-#define ROT(v, r) ((v)<<(r) | ((unsigned)(v))>>(32-(r)))
-
 inline hashcode_t IPFlowID::hashcode() const
 {
-    // more complicated hashcode, but causes less collision
-    uint16_t s = ntohs(sport());
-    uint16_t d = ntohs(dport());
-    hashcode_t sx = CLICK_NAME(hashcode)(saddr());
-    hashcode_t dx = CLICK_NAME(hashcode)(daddr());
-    return (ROT(sx, s%16)
-	    ^ ROT(dx, 31-d%16))
-	^ ((d << 16) | s);
+    // Multiply every key bit into the high half of a 64-bit product, so
+    // flows that differ only in a few address and port bits still spread
+    // over the buckets.
+    uint64_t x = ((uint64_t) saddr().addr() << 32) | daddr().addr();
+    x *= 0x9E3779B97F4A7C15ULL;
+    x ^= ((uint32_t) ntohs(dport()) << 16) | ntohs(sport());
+    x *= 0x9E3779B97F4A7C15ULL;
+    return x >> 32;
 }
 
-#undef ROT
-
 inline bool operator==(const IPFlowID &a, const IPFlowID &b)
 {
     return a.sport() == b.sport() && a.dport() == b.dport()
@@ -7,6 +7,7 @@
 #include <click/variableenv.hh>
 CLICK_DECLS
 class LexerExtra;
+class RouterImage;
 
 enum Lexemes {
     lexEOF = 0,
@@ -112,6 +113,9 @@ class Lexer { public:
     bool ystatement(int nested = 0);
 
     Router *create_router(Master *);
+#if !CLICK_LINUXMODULE
+    RouterImage *create_router_image();
+#endif
 
   private:
 
@@ -195,7 +199,9 @@ class Lexer { public:
     int remove_element_type(int, int *);
     int make_compound_element(int);
     void expand_compound_element(int, VariableEnvironment &);
+    void expand_compounds();
     void add_router_connections(int, const Vector<int> &);
+    void expand_router_connections(const Vector<int> &router_id);
     void yrequire_library(const String &value);
     void yconnection_check_useless(const Vector<int> &x, bool isoutput);
     static void yconnection_analyze_ports(const Vector<int> &x, bool isoutput,
@@ -211,6 +217,45 @@ class Lexer { public:
 
 };
 
+#if !CLICK_LINUXMODULE
+/** @class RouterImage
+ * @brief A parsed and flattened router configuration.
+ *
+ * Lexer::create_router_image() records the elements, element classes and
+ * connections a configuration expands to.  RouterImage::create_router() then
+ * builds routers from that record without lexing the configuration again or
+ * expanding compound elements, so many routers can be instantiated cheaply
+ * from one parse.  create_router() does not modify the image. */
+class RouterImage { public:
+
+    RouterImage() {
+    }
+
+    int nelements() const		{ return _elements.size(); }
+
+    Router *create_router(Master *master, ErrorHandler *errh) const;
+
+  private:
+
+    struct ElementImage {
+	Lexer::ElementFactory factory;
+	uintptr_t thunk;
+	String name;
+	String configuration;
+	String filename;
+	unsigned lineno;
+    };
+
+    String _configuration;
+    Vector<ElementImage> _elements;
+    Vector<Router::Connection> _conn;
+    Vector<String> _requirements;
+
+    friend class Lexer;
+
+};
+#endif
+
 class LexerExtra { public:
 
     LexerExtra()			{ }
@@ -30,8 +30,17 @@ class Master { public:
 
     inline int nthreads() const;
     inline RouterThread *thread(int id) const;
+    RouterThread *current_thread() const;
     void wake_somebody();
 
+    void set_timer_wheel(bool wheel);
+
+    bool work_stealing() const			{ return _work_stealing; }
+    void set_work_stealing(bool stealing)	{ _work_stealing = stealing; }
+
+    void wait_grace_period();
+    void acquire_quiescent(Spinlock &lock);
+
 #if CLICK_USERLEVEL
     int add_signal_handler(int signo, Router *router, String handler);
     int remove_signal_handler(int signo, Router *router, String handler);
@@ -44,6 +53,18 @@ class Master { public:
 #if CLICK_NS
     void initialize_ns(simclick_node_t *simnode);
     simclick_node_t *simnode() const		{ return _simnode; }
+
+    struct SimStats {
+	uint64_t batches;		// simclick_click_send_batch calls
+	uint64_t batch_packets;		// packets delivered in batches
+	uint64_t driver_runs_saved;	// driver passes avoided by batching
+	uint64_t unknown_ifid_drops;	// packets for ifids with no listener
+	uint64_t wakeups_scheduled;	// SIMCLICK_SCHEDULE requests made
+	uint64_t wakeups_suppressed;	// requests skipped as redundant
+	uint64_t wakeups_spurious;	// simclick_click_run with nothing to do
+    };
+    SimStats &sim_stats()			{ return _sim_stats; }
+    const SimStats &sim_stats() const		{ return _sim_stats; }
 #endif
 
 #if CLICK_DEBUG_MASTER || CLICK_DEBUG_SCHEDULING
@@ -59,6 +80,7 @@ class Master { public:
     // THREADS
     RouterThread **_threads;
     int _nthreads;
+    volatile bool _work_stealing;
 
     // ROUTERS
     Router *_routers;
@@ -68,6 +90,10 @@ class Master { public:
     void run_router(Router*, bool foreground);
     void unregister_router(Router*);
 
+    // GRACE PERIODS
+    RouterThread *begin_quiescent_wait();
+    void end_quiescent_wait(RouterThread *self);
+
 #if CLICK_LINUXMODULE
     spinlock_t _master_lock;
     struct task_struct *_master_lock_task;
@@ -104,6 +130,7 @@ class Master { public:
 
 #if CLICK_NS
     simclick_node_t *_simnode;
+    SimStats _sim_stats;
 #endif
 
     Master(const Master&);
@@ -55,12 +55,26 @@ class Packet { public:
     static inline Packet *make(struct mbuf *mbuf) CLICK_WARN_UNUSED_RESULT;
 #endif
 #if CLICK_USERLEVEL
+    typedef void (*buffer_destructor_type)(unsigned char *buf, size_t size, void *argument);
     static WritablePacket *make(unsigned char *data, uint32_t length,
-				void (*destructor)(unsigned char *, size_t)) CLICK_WARN_UNUSED_RESULT;
+				buffer_destructor_type destructor,
+				void *argument = 0) CLICK_WARN_UNUSED_RESULT;
 #endif
 
     static void static_cleanup();
 
+#if HAVE_CLICK_PACKET_POOL
+    enum {
+	pool_max_buffer_sizes = 4	///< Maximum number of pooled buffer
+					///  sizes
+    };
+    static int set_pool_parameters(int size, int global_count,
+				   const uint32_t *buffer_sizes,
+				   int nbuffer_sizes);
+    static String unparse_pool_parameters();
+    static String unparse_pool_statistics();
+#endif
+
     inline void kill();
 
     inline bool shared() const;
@@ -347,25 +361,29 @@ class Packet { public:
     inline void set_packet_type_anno(PacketType t);
 
 #if CLICK_NS
-    class SimPacketinfoWrapper { public:
-	simclick_simpacketinfo _pinfo;
-	SimPacketinfoWrapper() {
-	    // The uninitialized value for the simulator packet data can't be
-	    // all zeros (0 is a valid packet id) or random junk out of memory
-	    // since the simulator will look at this info to see if the packet
-	    // was originally generated by it. Accidental collisions with
-	    // other packet IDs or bogus packet IDs can cause weird things to
-	    // happen. So we set it to all -1 here to keep the simulator from
-	    // getting confused.
-	    memset(&_pinfo,-1,sizeof(_pinfo));
-	}
-    };
-    simclick_simpacketinfo *get_sim_packetinfo() {
-	return &(_sim_packetinfo._pinfo);
-    }
-    void set_sim_packetinfo(simclick_simpacketinfo* pinfo) {
-	_sim_packetinfo._pinfo = *pinfo;
+    /** @brief Return true iff the packet has simulator packet info.
+     *
+     * Packets received from the simulator have it; packets generated by
+     * Click have none until get_sim_packetinfo() or set_sim_packetinfo()
+     * is called. */
+    bool has_sim_packetinfo() const {
+	return _sim_packetinfo != 0;
     }
+    /** @brief Return the packet's simulator packet info, creating it if
+     * necessary.
+     *
+     * Newly created info has every field set to -1: 0 is a valid simulator
+     * packet id, and the simulator uses this info to recognize packets it
+     * generated.  Returns null only if memory is exhausted. */
+    inline simclick_simpacketinfo *get_sim_packetinfo();
+    /** @brief Copy the packet's simulator packet info into @a pinfo.
+     *
+     * If the packet has none, every field of @a pinfo is set to -1.  Unlike
+     * get_sim_packetinfo(), this never allocates. */
+    inline void copy_sim_packetinfo(simclick_simpacketinfo *pinfo) const;
+    /** @brief Set the packet's simulator packet info to a copy of
+     * *@a pinfo.  A null @a pinfo removes it. */
+    void set_sim_packetinfo(const simclick_simpacketinfo *pinfo);
 #endif
 
     /** @brief Return the next packet annotation. */
@@ -673,14 +691,18 @@ class Packet { public:
     unsigned char *_tail; /* one beyond end of packet */
     unsigned char *_end;  /* one beyond end of allocated buffer */
 # if CLICK_USERLEVEL
-    void (*_destructor)(unsigned char *, size_t);
+    buffer_destructor_type _destructor;
+    void *_destructor_argument;
 # endif
 # if CLICK_BSDMODULE
     struct mbuf *_m;
+# endif
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+    int _pool_node;	// NUMA node whose pool supplied the buffer, or -1
 # endif
     AllAnno _aa;
 # if CLICK_NS
-    SimPacketinfoWrapper _sim_packetinfo;
+    simclick_simpacketinfo *_sim_packetinfo;
 # endif
 #endif
 
@@ -696,6 +718,10 @@ class Packet { public:
 #if !CLICK_LINUXMODULE
     bool alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom);
 #endif
+#if CLICK_NS
+    void alloc_sim_packetinfo();
+    void free_sim_packetinfo();
+#endif
 #if CLICK_BSDMODULE
     static void assimilate_mbuf(Packet *p);
     void assimilate_mbuf();
@@ -741,7 +767,7 @@ class WritablePacket : public Packet { public:
     ~WritablePacket() { }
 
 #if HAVE_CLICK_PACKET_POOL
-    static WritablePacket *pool_allocate(bool with_data);
+    static WritablePacket *pool_allocate(int size_class);
     static WritablePacket *pool_allocate(uint32_t headroom, uint32_t length,
 					 uint32_t tailroom);
     static void recycle(WritablePacket *p);
@@ -814,11 +840,36 @@ WritablePacket::initialize()
     _destructor = 0;
 # elif CLICK_BSDMODULE
     _m = 0;
+# endif
+# if CLICK_NS
+    _sim_packetinfo = 0;
+# endif
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+    _pool_node = -1;
 # endif
     clear_annotations();
 }
 #endif
 
+#if CLICK_NS
+inline simclick_simpacketinfo *
+Packet::get_sim_packetinfo()
+{
+    if (!_sim_packetinfo)
+	alloc_sim_packetinfo();
+    return _sim_packetinfo;
+}
+
+inline void
+Packet::copy_sim_packetinfo(simclick_simpacketinfo *pinfo) const
+{
+    if (_sim_packetinfo)
+	*pinfo = *_sim_packetinfo;
+    else
+	memset(pinfo, -1, sizeof(*pinfo));
+}
+#endif
+
 /** @brief Return the packet's data pointer.
  *
  * This is the pointer to the first byte of packet data. */
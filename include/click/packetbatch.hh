@@ -0,0 +1,132 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETBATCH_HH
+#define CLICK_PACKETBATCH_HH
+#include <click/packet.hh>
+CLICK_DECLS
+
+/** @file <click/packetbatch.hh>
+ * @brief A list of packets transferred together.
+ */
+
+/** @class PacketBatch
+ * @brief An ordered list of packets.
+ *
+ * A PacketBatch moves several packets across a port with a single call; see
+ * Element::push_batch() and Element::pull_batch().  The packets are linked
+ * through their Packet::next() annotations, so a batch never allocates.  A
+ * packet may belong to at most one batch at a time, and code that holds a
+ * packet in a batch must not use its next() annotation for anything else.
+ *
+ * PacketBatch does not own its packets: destroying a batch does not kill
+ * them.  Use kill() to free every packet in a batch.
+ *
+ * To walk a batch without removing packets:
+ * @code
+ * for (Packet *p = batch.front(); p; p = p->next())
+ *     ...;
+ * @endcode
+ */
+class PacketBatch { public:
+
+    /** @brief Construct an empty batch. */
+    PacketBatch()
+	: _head(0), _tail(0), _count(0) {
+    }
+
+    /** @brief Return the number of packets in the batch. */
+    unsigned count() const {
+	return _count;
+    }
+    /** @brief Return true iff the batch contains no packets. */
+    bool empty() const {
+	return !_head;
+    }
+
+    /** @brief Return the first packet in the batch, or null if empty. */
+    Packet *front() const {
+	return _head;
+    }
+    /** @brief Return the last packet in the batch, or null if empty. */
+    Packet *back() const {
+	return _tail;
+    }
+
+    inline void push_back(Packet *p);
+    inline Packet *pop_front();
+    inline void append(PacketBatch &x);
+
+    /** @brief Forget the batch's packets without killing them. */
+    void clear() {
+	_head = _tail = 0;
+	_count = 0;
+    }
+    inline void kill();
+
+  private:
+
+    Packet *_head;
+    Packet *_tail;
+    unsigned _count;
+
+};
+
+/** @brief Add packet @a p to the end of the batch.
+ *
+ * Overwrites @a p's next() annotation. */
+inline void
+PacketBatch::push_back(Packet *p)
+{
+    p->set_next(0);
+    if (_tail)
+	_tail->set_next(p);
+    else
+	_head = p;
+    _tail = p;
+    ++_count;
+}
+
+/** @brief Remove and return the first packet in the batch.
+ *
+ * Returns null if the batch is empty.  The returned packet's next()
+ * annotation is cleared. */
+inline Packet *
+PacketBatch::pop_front()
+{
+    Packet *p = _head;
+    if (p) {
+	_head = p->next();
+	if (!_head)
+	    _tail = 0;
+	p->set_next(0);
+	--_count;
+    }
+    return p;
+}
+
+/** @brief Move all packets from @a x to the end of this batch.
+ *
+ * Leaves @a x empty. */
+inline void
+PacketBatch::append(PacketBatch &x)
+{
+    if (x._head) {
+	if (_tail)
+	    _tail->set_next(x._head);
+	else
+	    _head = x._head;
+	_tail = x._tail;
+	_count += x._count;
+	x.clear();
+    }
+}
+
+/** @brief Kill every packet in the batch, leaving it empty. */
+inline void
+PacketBatch::kill()
+{
+    while (Packet *p = pop_front())
+	p->kill();
+}
+
+CLICK_ENDDECLS
+#endif
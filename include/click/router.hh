@@ -18,6 +18,9 @@ class HashMap_ArenaFactory;
 class NotifierSignal;
 class ThreadSched;
 class Handler;
+#if CLICK_NS
+class FromSimDevice;
+#endif
 class NameInfo;
 
 class Router { public:
@@ -103,6 +106,13 @@ class Router { public:
     void unparse_connections(StringAccum& sa, const String& indent = String()) const;
 
     String element_ports_string(const Element *e) const;
+
+#if HAVE_ELEMENT_PROFILE
+    // PROFILING
+    void enable_profile();
+    void reset_profile();
+    void unparse_profile(StringAccum &sa) const;
+#endif
     //@}
 
     // INITIALIZATION
@@ -191,22 +201,33 @@ class Router { public:
     /** @endcond never */
 
 #if CLICK_NS
+    // sim_listen rejects ifids above this, so a bad ifid cannot make the
+    // listener table huge.
+    enum { SIM_MAX_IFID = 1023 };
+
     simclick_node_t *simnode() const;
     int sim_get_ifid(const char* ifname);
     int sim_listen(int ifid, int element);
     int sim_if_ready(int ifid);
     int sim_write(int ifid, int ptype, const unsigned char *, int len,
 		  simclick_simpacketinfo *pinfo);
+    int sim_write(int ifid, int ptype, WritablePacket *p);
     int sim_incoming_packet(int ifid, int ptype, const unsigned char *,
 			    int len, simclick_simpacketinfo* pinfo);
+    int sim_incoming_packet(int ifid, int ptype, unsigned char *, int len,
+			    simclick_buffer_destructor destructor, void *arg,
+			    simclick_simpacketinfo* pinfo);
+    int sim_incoming_batch(const simclick_packet_t *packets, int npackets);
     void sim_trace(const char* event);
+    int sim_trace(const simclick_trace_record *rec);
     int sim_get_node_id();
     int sim_get_next_pkt_id();
     int sim_if_promisc(int ifid);
 
   protected:
-    Vector<Vector<int> *> _listenvecs;
-    Vector<int>* sim_listenvec(int ifid);
+    // _sim_listeners[ifid] lists the FromSimDevices listening on ifid.
+    Vector<Vector<FromSimDevice *> > _sim_listeners;
+    inline const Vector<FromSimDevice *> *sim_listeners(int ifid) const;
 #endif
 
   private:
@@ -55,6 +55,15 @@ class RouterThread : private TaskLink { public:
 
     inline bool stop_flag() const;
 
+    uint64_t steals() const		{ return _steals; }
+    uint64_t idle_passes() const	{ return _idle_passes; }
+#if CLICK_USERLEVEL
+    /** @brief Return the task this thread is running, or null.
+     *
+     * Safe to call from a signal handler running on this thread. */
+    Task *current_task() const		{ return _current_task; }
+#endif
+
     void driver();
     void driver_once();
 
@@ -143,10 +152,27 @@ class RouterThread : private TaskLink { public:
     SelectSet _selects;
 #endif
 
+    uint64_t _steals;			// tasks this thread stole
+    uint64_t _idle_passes;		// trips to the OS with no tasks
+#if CLICK_USERLEVEL
+    Task * volatile _current_task;	// for the sampling profiler
+#endif
+#if HAVE_MULTITHREAD
+    volatile bool _idle;		// in run_os() with no tasks
+    volatile int _steal_from;		// thread that asked to be robbed
+    volatile uint32_t _epoch;		// odd while outside element code;
+					// see Master::wait_grace_period()
+#endif
+
 #if CLICK_LINUXMODULE
     bool _greedy;
 #endif
 
+#if CLICK_NS
+    Timestamp _ns_wakeup;		// earliest wakeup requested from the
+					// simulator and not yet delivered
+#endif
+
 #if CLICK_BSDMODULE
     // XXX FreeBSD
     u_int64_t _old_tsc; /* MARKO - temp. */
@@ -208,6 +234,15 @@ class RouterThread : private TaskLink { public:
     inline void run_tasks(int ntasks);
     inline void process_pending();
     inline void run_os();
+#if HAVE_MULTITHREAD
+    inline bool task_stealable(Task *t) const;
+    Task *stealable_task() const;
+    bool steal_tasks();
+    void wake_idle_thread();
+#endif
+#if CLICK_NS
+    void ns_schedule_wakeup();
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     void client_set_tickets(int client, int tickets);
     inline void client_update_pass(int client, const Timestamp &before);
@@ -216,6 +251,9 @@ class RouterThread : private TaskLink { public:
     void task_reheapify_from(int pos, Task*);
 #endif
     inline bool current_thread_is_running() const;
+    inline void enter_quiescent_state();
+    inline void leave_quiescent_state();
+    void block_tasks_wait();
 
     friend class Task;
     friend class Master;
@@ -330,6 +368,29 @@ RouterThread::task_end() const
 #endif
 }
 
+/** @brief Mark this thread as blocked outside element code.
+ *
+ * Until leave_quiescent_state(), Master::wait_grace_period() does not wait
+ * for this thread. */
+inline void
+RouterThread::enter_quiescent_state()
+{
+#if HAVE_MULTITHREAD
+    click_fence();
+    ++_epoch;
+#endif
+}
+
+/** @brief Mark this thread as about to run element code again. */
+inline void
+RouterThread::leave_quiescent_state()
+{
+#if HAVE_MULTITHREAD
+    ++_epoch;
+    click_fence();
+#endif
+}
+
 inline bool
 RouterThread::current_thread_is_running() const
 {
@@ -357,23 +418,10 @@ RouterThread::block_tasks(bool scheduled)
     assert(!current_thread_is_running());
     if (!scheduled)
 	++_task_blocker_waiting;
-    while (1) {
-	uint32_t blocker = _task_blocker.value();
-	if ((int32_t) blocker >= 0
-	    && _task_blocker.compare_swap(blocker, blocker + 1) == blocker)
-	    break;
-#if CLICK_LINUXMODULE
-	// 3.Nov.2008: Must allow other threads a chance to run.  Otherwise,
-	// soft lock is possible: the thread in block_tasks() waits for
-	// RouterThread::_linux_task to complete a task set, but
-	// RouterThread::_linux_task can't run until the thread in
-	// block_tasks() relinquishes the CPU.
-	//
-	// We might be able to avoid schedule() in some cases, but don't
-	// bother to try.
-	schedule();
-#endif
-    }
+    uint32_t blocker = _task_blocker.value();
+    if ((int32_t) blocker < 0
+	|| _task_blocker.compare_swap(blocker, blocker + 1) != blocker)
+	block_tasks_wait();
     --_task_blocker_waiting;
 }
 
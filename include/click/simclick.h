@@ -46,8 +46,25 @@ typedef struct simclick_node {
     struct timeval curtime;
 } simclick_node_t;
 
+/*
+ * Different nodes may be driven from different threads at once. Calls on
+ * one node are serialized by a per-node lock, and the simulator may call
+ * back into that node from simclick_sim_send or simclick_sim_command.
+ * simclick_click_kill must not overlap any other call on the same node.
+ */
 int simclick_click_create(simclick_node_t *sim, const char *router_file);
 
+/*
+ * simclick_click_create parses each router file only once and builds later
+ * nodes that name the same file from the cached result. Element
+ * configurations are still interpreted per node, so names like "eth0:ip"
+ * resolve through that node's SIMCLICK_IPADDR_FROM_NAME and
+ * SIMCLICK_MACADDR_FROM_NAME commands. simclick_click_flush_configs
+ * discards the cache, for instance after a router file has changed; nodes
+ * already created are unaffected.
+ */
+void simclick_click_flush_configs(void);
+
 int simclick_click_send(simclick_node_t *sim,
 			int ifid,int type,const unsigned char* data,int len,
 			simclick_simpacketinfo* pinfo);
@@ -55,10 +72,64 @@ int simclick_sim_send(simclick_node_t *sim,
 		      int ifid,int type, const unsigned char* data,int len,
 		      simclick_simpacketinfo*);
 
+/*
+ * Zero-copy packet handoff. simclick_click_send_buffer transfers ownership
+ * of "data" to Click instead of copying it; Click calls
+ * destructor(data, len, arg) once it is done with the buffer, possibly
+ * after simclick_click_send_buffer returns. Simulators that support the
+ * SIMCLICK_SEND_BUFFER command receive Click's outgoing packets the same
+ * way, and must call the supplied destructor when they are done. The
+ * simclick_simpacketinfo passed with SIMCLICK_SEND_BUFFER, like that passed
+ * to simclick_sim_send, is only valid for the duration of the call. A
+ * simulator that returns a negative value from SIMCLICK_SEND_BUFFER has not
+ * taken the buffer and must not call the destructor; Click then sends the
+ * packet with simclick_sim_send instead.
+ */
+typedef void (*simclick_buffer_destructor)(unsigned char *data, size_t len,
+					   void *arg);
+
+int simclick_click_send_buffer(simclick_node_t *sim,
+			       int ifid, int type, unsigned char *data, int len,
+			       simclick_buffer_destructor destructor, void *arg,
+			       simclick_simpacketinfo *pinfo);
+
+/*
+ * Batched packet delivery. simclick_click_send_batch injects npackets
+ * packets, possibly on different interfaces, and then runs Click once,
+ * rather than once per packet as simclick_click_send does. This is meant
+ * for bursts of frames that arrive at the same simulated time. A packet
+ * with a non-null destructor is handed to Click without copying, as in
+ * simclick_click_send_buffer; otherwise its data is copied. Consecutive
+ * packets with the same ifid and type reach FromSimDevice, and elements
+ * downstream of it, as one PacketBatch.
+ */
+typedef struct {
+    int ifid;
+    int type;
+    unsigned char *data;
+    int len;
+    simclick_buffer_destructor destructor;
+    void *arg;
+    simclick_simpacketinfo *pinfo;
+} simclick_packet_t;
+
+int simclick_click_send_batch(simclick_node_t *sim,
+			      const simclick_packet_t *packets, int npackets);
+
 void simclick_click_run(simclick_node_t *sim);
 
 void simclick_click_kill(simclick_node_t *sim);
 
+/*
+ * simclick_click_record starts logging the calls the simulator makes into
+ * this node (packets sent, runs and handler calls, with simulated and
+ * wall-clock times) to "filename", replacing any log already in progress.
+ * Call it after simclick_click_create. A null filename stops logging;
+ * simclick_click_kill also stops it. ns/nsclick-replay replays such a log
+ * into Click without the simulator. Returns 0 on success, -1 on error.
+ */
+int simclick_click_record(simclick_node_t *sim, const char *filename);
+
 /*
  * simclick_click_read_handler will allocate a buffer of adequate length
  * to receive the handler information. This buffer must be freed
@@ -105,6 +176,59 @@ int simclick_gettimeofday(struct timeval* tv);
 #define SIMCLICK_GET_NEXT_PKT_ID	10 // none
 #define SIMCLICK_CHANGE_CHANNEL		11 // int ifid, int channelid
 #define SIMCLICK_IF_PROMISC		12 // int ifid
+#define SIMCLICK_SEND_BUFFER		13 // int ifid, int type,
+					   // unsigned char *data, int len,
+					   // simclick_buffer_destructor destructor,
+					   // void *arg,
+					   // simclick_simpacketinfo *pinfo
+
+/*
+ * Click only sends SIMCLICK_SCHEDULE when its earliest timer moves earlier
+ * than the wakeup it last requested. Tasks are not covered by timers: after
+ * simclick_click_send or simclick_click_run, a simulator can ask
+ * simclick_click_command(sim, SIMCLICK_TASKS_PENDING), which returns 1 if
+ * Click has tasks that want to run again, and then schedule a zero-delay
+ * simclick_click_run.
+ */
+#define SIMCLICK_TASKS_PENDING		14 // none (click command)
+
+/*
+ * simclick_click_command(sim, SIMCLICK_TIMER_WHEEL, 1) makes the node keep
+ * its timers in a hierarchical timing wheel instead of a heap, which makes
+ * scheduling and unscheduling constant time. 0 restores the heap. Timers
+ * fire in the same order either way.
+ */
+#define SIMCLICK_TIMER_WHEEL		16 // int enable (click command)
+
+/*
+ * Binary trace records. ToSimTrace's BINARY mode passes each trace event to
+ * the simulator as a simclick_trace_record through SIMCLICK_TRACE_RECORD,
+ * instead of formatting ns-2 trace text for SIMCLICK_TRACE. Its FILE
+ * keyword writes the records to a file instead: a simclick_trace_header
+ * followed by records. ns/simtrace2ns converts such a file to ns-2 text.
+ * Strings in a record are NUL-padded and truncated to fit.
+ */
+#define SIMCLICK_TRACE_RECORD		15 // const simclick_trace_record *rec
+
+#define SIMCLICK_TRACE_MAGIC		"SCTRACE"
+#define SIMCLICK_TRACE_VERSION		1
+
+typedef struct {
+    char magic[8];		/* SIMCLICK_TRACE_MAGIC */
+    int version;		/* SIMCLICK_TRACE_VERSION */
+    int record_size;		/* sizeof(simclick_trace_record) */
+} simclick_trace_header;
+
+typedef struct {
+    long long sec;		/* Event time */
+    int usec;
+    int node_id;		/* Simulator node ID */
+    int packet_id;		/* Simulator packet ID */
+    int length;			/* Traced packet length */
+    char event[8];		/* Event id: "r", "f", "D", "s", ... */
+    char info[56];		/* ADDITIONAL_INFO */
+    char analysis[64];		/* Analyzer output */
+} simclick_trace_record;
 
 int simclick_sim_command(simclick_node_t *sim, int cmd, ...);
 int simclick_click_command(simclick_node_t *sim, int cmd, ...);
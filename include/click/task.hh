@@ -343,6 +343,10 @@ class Task : private TaskLink { public:
 
     void move_thread_second_half();
 
+#if HAVE_ELEMENT_PROFILE
+    bool profiled_call();
+#endif
+
     static inline Task *pending_to_task(uintptr_t ptr);
     inline Task *pending_to_task() const;
 
@@ -613,6 +617,11 @@ Task::fire()
     _cycle_runs++;
 #endif
     bool work_done;
+#if HAVE_ELEMENT_PROFILE
+    if (unlikely(Element::profiling))
+	work_done = profiled_call();
+    else
+#endif
     if (!_hook)
 	work_done = ((Element*)_thunk)->run_task(this);
     else
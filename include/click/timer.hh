@@ -301,6 +301,8 @@ class Timer { public:
     void *_thunk;
     Element *_owner;
     RouterThread *_thread;
+    Timer *_wheel_next;		// valid only while in a TimerSet's wheel
+    Timer **_wheel_pprev;
 
     Timer &operator=(const Timer &x);
 
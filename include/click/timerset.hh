@@ -4,6 +4,7 @@
 #include <click/timer.hh>
 #include <click/sync.hh>
 #include <click/vector.hh>
+#include <click/heap.hh>
 CLICK_DECLS
 class Router;
 class RouterThread;
@@ -12,6 +13,7 @@ class Timer;
 class TimerSet { public:
 
     TimerSet();
+    ~TimerSet();
 
     Timestamp next_timer_expiry() const		{ return _timer_expiry; }
     inline Timestamp next_timer_expiry_adjusted() const;
@@ -26,6 +28,9 @@ class TimerSet { public:
     unsigned timer_stride() const		{ return _timer_stride; }
     void set_max_timer_stride(unsigned timer_stride);
 
+    bool timer_wheel() const			{ return _wheel != 0; }
+    void set_timer_wheel(bool wheel);
+
     void kill_router(Router *router);
 
     void run_timers(RouterThread *thread, Master *master);
@@ -72,9 +77,38 @@ class TimerSet { public:
     Timestamp _timer_check;
     uint32_t _timer_check_reports;
 
+    // Optional hierarchical timing wheel.  When _wheel is nonnull, the heap
+    // holds exactly the timers whose tick (expiry in msec) is less than
+    // _wheel_now, and the wheel holds the rest.  Level k holds timers whose
+    // ticks agree with _wheel_now above bit (k + 1) * wheel_bits, in slot
+    // (tick >> (k * wheel_bits)) & wheel_mask; the final slot holds timers
+    // beyond the top level.  The heap is refilled from the wheel whenever it
+    // empties, so the heap's first element is always the earliest timer.
+    enum {
+	wheel_bits = 8, wheel_size = 1 << wheel_bits,
+	wheel_mask = wheel_size - 1, wheel_levels = 4,
+	wheel_schedpos1 = 0x7FFFFFFF
+    };
+    Timer **_wheel;
+    uint64_t _wheel_now;
+    unsigned _wheel_count;
+
+    static inline uint64_t wheel_tick(const Timestamp &t) {
+	return (uint64_t) t.sec() * 1000 + t.msec();
+    }
+    inline void heap_insert(Timer *t);
+    inline void wheel_link(Timer *t, uint64_t tick);
+    inline void wheel_unlink(Timer *t);
+    inline void wheel_insert(Timer *t);
+    void wheel_requeue(Timer **slot);
+    void wheel_advance(uint64_t now);
+    bool wheel_refill();
+
     inline void run_one_timer(Timer *);
 
     void set_timer_expiry() {
+	if (unlikely(_timer_heap.empty() && _wheel_count))
+	    wheel_refill();
 	if (_timer_heap.size())
 	    _timer_expiry = _timer_heap.at_u(0).expiry;
 	else
@@ -90,6 +124,51 @@ class TimerSet { public:
 
 };
 
+inline void
+TimerSet::heap_insert(Timer *t)
+{
+    t->_schedpos1 = _timer_heap.size() + 1;
+    _timer_heap.push_back(heap_element(t));
+    push_heap<4>(_timer_heap.begin(), _timer_heap.end(), heap_less(), heap_place());
+}
+
+inline void
+TimerSet::wheel_link(Timer *t, uint64_t tick)
+{
+    uint64_t diff = tick ^ _wheel_now;
+    int level = 0;
+    while (level < wheel_levels && (diff >> ((level + 1) * wheel_bits)))
+	++level;
+    Timer **slot = _wheel + level * wheel_size;
+    if (level < wheel_levels)
+	slot += (tick >> (level * wheel_bits)) & wheel_mask;
+    if ((t->_wheel_next = *slot))
+	t->_wheel_next->_wheel_pprev = &t->_wheel_next;
+    t->_wheel_pprev = slot;
+    *slot = t;
+    t->_schedpos1 = wheel_schedpos1;
+    ++_wheel_count;
+}
+
+inline void
+TimerSet::wheel_unlink(Timer *t)
+{
+    if ((*t->_wheel_pprev = t->_wheel_next))
+	t->_wheel_next->_wheel_pprev = t->_wheel_pprev;
+    t->_schedpos1 = 0;
+    --_wheel_count;
+}
+
+inline void
+TimerSet::wheel_insert(Timer *t)
+{
+    uint64_t tick = wheel_tick(t->_expiry);
+    if (tick < _wheel_now)
+	heap_insert(t);
+    else
+	wheel_link(t, tick);
+}
+
 inline Timestamp
 TimerSet::next_timer_expiry_adjusted() const
 {
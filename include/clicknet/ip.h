@@ -129,6 +129,17 @@ struct click_ip {
  *
  * @a x must be two-byte aligned. */
 uint16_t click_in_cksum(const unsigned char *x, int len);
+/** @brief Return the name of the vector implementation click_in_cksum()
+ * uses for longer buffers: "avx2", "sse2", or "generic". */
+const char *click_in_cksum_implementation(void);
+/** @brief Make click_in_cksum() use implementation @a name for longer
+ * buffers.
+ * @param name "auto", "generic", "sse2", or "avx2"
+ * @return 0 on success, -1 if @a name is unknown or the CPU lacks it
+ *
+ * "auto", the default, picks the fastest implementation the CPU supports.
+ * This is meant for tests and benchmarks. */
+int click_in_cksum_set_implementation(const char *name);
 uint16_t click_in_cksum_pseudohdr_raw(uint32_t csum, uint32_t src, uint32_t dst, int proto, int packet_len);
 #else
 # define click_in_cksum(addr, len) \
@@ -182,6 +193,34 @@ click_update_in_cksum(uint16_t *csum, uint16_t old_hw, uint16_t new_hw)
     *csum = ~(sum + (sum >> 16));
 }
 
+/** @brief Incrementally adjust an Internet checksum for a changed word.
+ * @param[in, out] csum points to checksum
+ * @param old_w old 32-bit word, such as an IP address
+ * @param new_w new 32-bit word
+ *
+ * Equivalent to calling click_update_in_cksum() for each halfword of the
+ * word, but folds both halfwords first. */
+static inline void
+click_update_in_cksum32(uint16_t *csum, uint32_t old_w, uint32_t new_w)
+{
+    uint32_t sum = (~*csum & 0xFFFF) + (~old_w & 0xFFFF) + (~old_w >> 16)
+	+ (new_w & 0xFFFF) + (new_w >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    *csum = ~(sum + (sum >> 16));
+}
+
+/** @brief Set an IP header's TTL, incrementally adjusting its checksum.
+ * @param iph IP header
+ * @param ttl new TTL */
+static inline void
+click_update_ip_ttl(struct click_ip *iph, uint8_t ttl)
+{
+    uint16_t *hw = (uint16_t *) iph + 4;	/* ip_ttl and ip_p */
+    uint16_t old_hw = *hw;
+    iph->ip_ttl = ttl;
+    click_update_in_cksum(&iph->ip_sum, old_hw, *hw);
+}
+
 /** @brief Potentially fix a zero-valued Internet checksum.
  * @param[in, out] csum points to checksum
  * @param x data to checksum
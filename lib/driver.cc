@@ -483,15 +483,13 @@ click_static_cleanup()
 # endif /* HAVE_DYNAMIC_LINKING */
 }
 
-Router *
-click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initialize, Master *master)
+static int
+read_router_string(String &filename, bool is_expr, String &config_str,
+		   Vector<ArchiveElement> &archive, ErrorHandler *errh)
 {
-    if (!errh)
-	errh = ErrorHandler::silent_handler();
     int before = errh->nerrors();
 
     // read file
-    String config_str;
     if (is_expr) {
 	config_str = filename;
 	filename = "config";
@@ -501,20 +499,32 @@ click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initia
 	    filename = "<stdin>";
     }
     if (errh->nerrors() > before)
-	return 0;
+	return -1;
 
     // find config string in archive
-    Vector<ArchiveElement> archive;
     if (config_str.length() != 0 && config_str[0] == '!') {
 	ArchiveElement::parse(config_str, archive, errh);
 	if (ArchiveElement *ae = ArchiveElement::find(archive, "config"))
 	    config_str = ae->data;
-	else {
-	    errh->error("%s: archive has no %<config%> section", filename.c_str());
-	    return 0;
-	}
+	else
+	    return errh->error("%s: archive has no %<config%> section", filename.c_str());
     }
 
+    return 0;
+}
+
+Router *
+click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initialize, Master *master)
+{
+    if (!errh)
+	errh = ErrorHandler::silent_handler();
+    int before = errh->nerrors();
+
+    String config_str;
+    Vector<ArchiveElement> archive;
+    if (read_router_string(filename, is_expr, config_str, archive, errh) < 0)
+	return 0;
+
     // lex
     Lexer *l = click_lexer();
     RequireLexerExtra lextra(&archive);
@@ -534,6 +544,34 @@ click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initia
     return router;
 }
 
+RouterImage *
+click_read_router_image(String filename, bool is_expr, ErrorHandler *errh)
+{
+    if (!errh)
+	errh = ErrorHandler::silent_handler();
+    int before = errh->nerrors();
+
+    String config_str;
+    Vector<ArchiveElement> archive;
+    if (read_router_string(filename, is_expr, config_str, archive, errh) < 0)
+	return 0;
+
+    // lex
+    Lexer *l = click_lexer();
+    RequireLexerExtra lextra(&archive);
+    int cookie = l->begin_parse(config_str, filename, &lextra, errh);
+    while (l->ystatement())
+	/* do nothing */;
+    RouterImage *image = l->create_router_image();
+    l->end_parse(cookie);
+
+    if (errh->nerrors() > before) {
+	delete image;
+	return 0;
+    }
+    return image;
+}
+
 CLICK_ENDDECLS
 #endif /* CLICK_USERLEVEL */
 
@@ -67,6 +67,20 @@ const char Element::PROCESSING_A_AH[] = "a/ah";
 const char Element::COMPLETE_FLOW[] = "x/x";
 
 int Element::nelements_allocated = 0;
+#if HAVE_ELEMENT_PROFILE
+/** @brief True iff port transfers and tasks should update profiles.
+ *
+ * When false, the only profiling cost is a test of this flag per transfer.
+ * See Element::Profile. */
+bool Element::profiling = false;
+
+// Cycles spent in profiled calls nested inside the current one.
+# if HAVE___THREAD_STORAGE_CLASS
+static __thread click_cycles_t profile_child_cycles;
+# else
+static click_cycles_t profile_child_cycles;
+# endif
+#endif
 
 /** @mainpage Click
  *  @section  Introduction
@@ -422,6 +436,9 @@ void BetterIPCounter3::push(int port, Packet *p) {
 Element::Element()
     : _router(0), _eindex(-1)
 {
+#if HAVE_ELEMENT_PROFILE
+    _profile = 0;
+#endif
     nelements_allocated++;
     _ports[0] = _ports[1] = &_inline_ports[0];
     _nports[0] = _nports[1] = 0;
@@ -438,6 +455,9 @@ Element::~Element()
 	delete[] _ports[0];
     if (_ports[1] < _inline_ports || _ports[1] > _inline_ports + INLINE_PORTS)
 	delete[] _ports[1];
+#if HAVE_ELEMENT_PROFILE
+    delete[] _profile;
+#endif
 }
 
 // CHARACTERISTICS
@@ -2826,6 +2846,91 @@ Element::local_llrpc(unsigned command, void *data)
 #endif
 }
 
+#if HAVE_ELEMENT_PROFILE
+// PROFILING
+
+void
+Element::profile_begin(click_cycles_t &saved_child_cycles,
+		       click_cycles_t &start_cycles)
+{
+    saved_child_cycles = profile_child_cycles;
+    profile_child_cycles = 0;
+    start_cycles = click_get_cycles();
+}
+
+void
+Element::profile_end(Profile *profile, uint32_t npackets,
+		     click_cycles_t saved_child_cycles,
+		     click_cycles_t start_cycles)
+{
+    click_cycles_t x = click_get_cycles() - start_cycles;
+    ++profile->calls;
+    profile->packets += npackets;
+    profile->inclusive_cycles += x;
+    profile->self_cycles += x - profile_child_cycles;
+    profile_child_cycles = saved_child_cycles + x;
+}
+
+void
+Element::Port::profiled_push(Packet *p) const
+{
+    click_cycles_t saved = 0, start = 0;
+    Profile *profile = _e->_profile;
+    if (profile)
+	profile_begin(saved, start);
+#if HAVE_BOUND_PORT_TRANSFER
+    _bound.push(_e, _port, p);
+#else
+    _e->push(_port, p);
+#endif
+    if (profile)
+	profile_end(profile + _port, 1, saved, start);
+}
+
+Packet *
+Element::Port::profiled_pull() const
+{
+    click_cycles_t saved = 0, start = 0;
+    Profile *profile = _e->_profile;
+    if (profile)
+	profile_begin(saved, start);
+#if HAVE_BOUND_PORT_TRANSFER
+    Packet *p = _bound.pull(_e, _port);
+#else
+    Packet *p = _e->pull(_port);
+#endif
+    if (profile)
+	profile_end(profile + _e->ninputs() + _port, p != 0, saved, start);
+    return p;
+}
+
+void
+Element::Port::profiled_push_batch(PacketBatch &batch) const
+{
+    click_cycles_t saved = 0, start = 0;
+    Profile *profile = _e->_profile;
+    uint32_t n = batch.count();
+    if (profile)
+	profile_begin(saved, start);
+    _e->push_batch(_port, batch);
+    if (profile)
+	profile_end(profile + _port, n, saved, start);
+}
+
+PacketBatch
+Element::Port::profiled_pull_batch(unsigned max) const
+{
+    click_cycles_t saved = 0, start = 0;
+    Profile *profile = _e->_profile;
+    if (profile)
+	profile_begin(saved, start);
+    PacketBatch batch = _e->pull_batch(_port, max);
+    if (profile)
+	profile_end(profile + _e->ninputs() + _port, batch.count(), saved, start);
+    return batch;
+}
+#endif
+
 // RUNNING
 
 /** @brief Push packet @a p onto push input @a port.
@@ -2925,6 +3030,48 @@ Element::simple_action(Packet *p)
     return p;
 }
 
+/** @brief Push the packets in @a batch onto push input @a port.
+ *
+ * @param port the input port number on which the packets arrive
+ * @param batch the packets
+ *
+ * An upstream element transferred every packet in @a batch to this element
+ * with one call to Port::push_batch().  push_batch() must account for each
+ * packet just as push() would; it may leave @a batch in any state.
+ *
+ * The default implementation calls push() for each packet in order, so
+ * elements need not know about batches.  Elements on hot paths override it
+ * to process the whole batch and pass it on with a single call;
+ * simple_action() elements can use simple_push_batch().
+ */
+void
+Element::push_batch(int port, PacketBatch &batch)
+{
+    while (Packet *p = batch.pop_front())
+	push(port, p);
+}
+
+/** @brief Pull up to @a max packets from pull output @a port.
+ *
+ * @param port the output port number receiving the pull request
+ * @param max maximum number of packets to return
+ * @return a batch of at most @a max packets, empty if none were available
+ *
+ * The default implementation calls pull() until it returns null or @a max
+ * packets have been collected.  See also simple_pull_batch().
+ */
+PacketBatch
+Element::pull_batch(int port, unsigned max)
+{
+    PacketBatch batch;
+    while (batch.count() < max)
+	if (Packet *p = pull(port))
+	    batch.push_back(p);
+	else
+	    break;
+    return batch;
+}
+
 /** @brief Run the element's task.
  *
  * @return true if the task accomplished some meaningful work, false otherwise
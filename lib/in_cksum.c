@@ -17,37 +17,178 @@
 #endif
 
 #if !CLICK_LINUXMODULE
-uint16_t
-click_in_cksum(const unsigned char *addr, int len)
+/*
+ * click_in_cksum sums the data as 32-bit words into a 64-bit accumulator,
+ * which cannot overflow for any int length, and folds the result to 16 bits
+ * at the end.  The one's-complement sum is byte-order independent, so this
+ * gives the same result as summing 16-bit words.  On x86, longer buffers
+ * are summed with SSE2 or AVX2, chosen at runtime by CPU detection.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && !CLICK_BSDMODULE \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+# define CLICK_IN_CKSUM_X86 1
+# include <immintrin.h>
+#endif
+
+/* Buffers shorter than this are not worth the vector setup. */
+#define CLICK_IN_CKSUM_VECTOR_MIN	64
+
+static inline uint16_t
+in_cksum_fold64(uint64_t sum)
 {
-    int nleft = len;
-    const uint16_t *w = (const uint16_t *)addr;
-    uint32_t sum = 0;
-    uint16_t answer = 0;
-
-    /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
-     */
-    while (nleft > 1)  {
-	sum += *w++;
-	nleft -= 2;
-    }
+    sum = (sum & 0xFFFFFFFFU) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFU) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
 
+static inline uint64_t
+in_cksum_tail(uint64_t sum, const unsigned char *x, int len)
+{
+    uint32_t w;
+    uint16_t hw;
+    for (; len >= 4; x += 4, len -= 4) {
+	memcpy(&w, x, 4);
+	sum += w;
+    }
+    if (len >= 2) {
+	memcpy(&hw, x, 2);
+	sum += hw;
+	x += 2;
+	len -= 2;
+    }
     /* mop up an odd byte, if necessary */
-    if (nleft == 1) {
-	*(unsigned char *)(&answer) = *(const unsigned char *)w ;
-	sum += answer;
+    if (len == 1) {
+	hw = 0;
+	*(unsigned char *) &hw = *x;
+	sum += hw;
+    }
+    return sum;
+}
+
+static uint16_t
+in_cksum_generic(const unsigned char *x, int len)
+{
+    uint64_t sum = 0;
+    uint32_t w[4];
+    for (; len >= 16; x += 16, len -= 16) {
+	memcpy(w, x, 16);
+	sum += (uint64_t) w[0] + w[1] + w[2] + w[3];
+    }
+    return in_cksum_fold64(in_cksum_tail(sum, x, len));
+}
+
+#if CLICK_IN_CKSUM_X86
+/* Each 32-bit word is zero-extended into a 64-bit lane and added there. */
+__attribute__((target("sse2"))) static uint16_t
+in_cksum_sse2(const unsigned char *x, int len)
+{
+    __m128i zero = _mm_setzero_si128(), acc0 = zero, acc1 = zero;
+    uint64_t s[2];
+    for (; len >= 32; x += 32, len -= 32) {
+	__m128i a = _mm_loadu_si128((const __m128i *) x);
+	__m128i b = _mm_loadu_si128((const __m128i *) (x + 16));
+	acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+	acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+	acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+	acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+    }
+    _mm_storeu_si128((__m128i *) s, _mm_add_epi64(acc0, acc1));
+    return in_cksum_fold64(in_cksum_tail(s[0] + s[1], x, len));
+}
+
+__attribute__((target("avx2"))) static uint16_t
+in_cksum_avx2(const unsigned char *x, int len)
+{
+    __m256i zero = _mm256_setzero_si256(), acc0 = zero, acc1 = zero;
+    __m128i acc;
+    uint64_t s[2];
+    for (; len >= 64; x += 64, len -= 64) {
+	__m256i a = _mm256_loadu_si256((const __m256i *) x);
+	__m256i b = _mm256_loadu_si256((const __m256i *) (x + 32));
+	acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+	acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+	acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+	acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
     }
+    acc0 = _mm256_add_epi64(acc0, acc1);
+    acc = _mm_add_epi64(_mm256_castsi256_si128(acc0),
+			_mm256_extracti128_si256(acc0, 1));
+    _mm_storeu_si128((__m128i *) s, acc);
+    return in_cksum_fold64(in_cksum_tail(s[0] + s[1], x, len));
+}
+#endif
+
+typedef uint16_t (*in_cksum_function)(const unsigned char *, int);
+static uint16_t in_cksum_select(const unsigned char *x, int len);
+static in_cksum_function in_cksum_vector = in_cksum_select;
+static const char *in_cksum_vector_name;
+
+static uint16_t
+in_cksum_select(const unsigned char *x, int len)
+{
+    /* Racing threads all store the same values. */
+#if CLICK_IN_CKSUM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+	in_cksum_vector_name = "avx2";
+	in_cksum_vector = in_cksum_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+	in_cksum_vector_name = "sse2";
+	in_cksum_vector = in_cksum_sse2;
+    } else
+#endif
+    {
+	in_cksum_vector_name = "generic";
+	in_cksum_vector = in_cksum_generic;
+    }
+    return in_cksum_vector(x, len);
+}
+
+uint16_t
+click_in_cksum(const unsigned char *addr, int len)
+{
+    if (len < CLICK_IN_CKSUM_VECTOR_MIN)
+	return in_cksum_generic(addr, len);
+    else
+	return in_cksum_vector(addr, len);
+}
 
-    /* add back carry outs from top 16 bits to low 16 bits */
-    sum = (sum & 0xffff) + (sum >> 16);
-    sum += (sum >> 16);
-    /* guaranteed now that the lower 16 bits of sum are correct */
+const char *
+click_in_cksum_implementation(void)
+{
+    if (!in_cksum_vector_name)
+	(void) in_cksum_select((const unsigned char *) "", 0);
+    return in_cksum_vector_name;
+}
 
-    answer = ~sum;              /* truncate to 16 bits */
-    return answer;
+int
+click_in_cksum_set_implementation(const char *name)
+{
+#if CLICK_IN_CKSUM_X86
+    __builtin_cpu_init();
+#endif
+    if (strcmp(name, "auto") == 0)
+	(void) in_cksum_select((const unsigned char *) "", 0);
+    else if (strcmp(name, "generic") == 0) {
+	in_cksum_vector_name = "generic";
+	in_cksum_vector = in_cksum_generic;
+    }
+#if CLICK_IN_CKSUM_X86
+    else if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+	in_cksum_vector_name = "sse2";
+	in_cksum_vector = in_cksum_sse2;
+    } else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+	in_cksum_vector_name = "avx2";
+	in_cksum_vector = in_cksum_avx2;
+    }
+#endif
+    else
+	return -1;
+    return 0;
 }
 
 uint16_t
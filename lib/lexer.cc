@@ -1913,41 +1913,19 @@ Lexer::expand_compound_element(int which, VariableEnvironment &ve)
   }
 }
 
-Router *
-Lexer::create_router(Master *master)
+void
+Lexer::expand_compounds()
 {
-  Router *router = new Router(_file._big_string, master);
-  if (!router)
-    return 0;
-
-  // expand compounds
   for (int i = 0; i < _global_scope.size(); i++)
     _c->scope().define(_global_scope.name(i), _global_scope.value(i), true);
   int initial_elements_size = _c->_elements.size();
   for (int i = 0; i < initial_elements_size; i++)
     expand_compound_element(i, _c->scope());
+}
 
-  // add elements to router
-  Vector<int> router_id;
-  for (int i = 0; i < _c->_elements.size(); i++) {
-    int etype = _c->_elements[i];
-    if (etype == TUNNEL_TYPE)
-      router_id.push_back(-1);
-#if CLICK_LINUXMODULE
-    else if (_element_types[etype].module && router->add_module_ref(_element_types[etype].module) < 0) {
-      _errh->lerror(_c->element_landmark(i), "module for element type %<%s%> unloaded", _element_types[etype].name.c_str());
-      router_id.push_back(-1);
-    }
-#endif
-    else if (Element *e = (*_element_types[etype].factory)(_element_types[etype].thunk)) {
-      int ei = router->add_element(e, _c->_element_names[i], _c->_element_configurations[i], _c->_element_filenames[i], _c->_element_linenos[i]);
-      router_id.push_back(ei);
-    } else {
-      _errh->lerror(_c->element_landmark(i), "failed to create element %<%s%>", _c->_element_names[i].c_str());
-      router_id.push_back(-1);
-    }
-  }
-
+void
+Lexer::expand_router_connections(const Vector<int> &router_id)
+{
   // first-level connection expansion
   if (_tunnels.size()) {
     for (const Connection *cp = _c->_conn.begin(); cp != _c->_conn.end(); ++cp)
@@ -1972,8 +1950,43 @@ Lexer::create_router(Master *master)
     (*cp)[1].idx = router_id[(*cp)[1].idx];
   }
 
-  // sort and add connections to router
+  // sort connections
   click_qsort(_c->_conn.begin(), _c->_conn.size());
+}
+
+Router *
+Lexer::create_router(Master *master)
+{
+  Router *router = new Router(_file._big_string, master);
+  if (!router)
+    return 0;
+
+  // expand compounds
+  expand_compounds();
+
+  // add elements to router
+  Vector<int> router_id;
+  for (int i = 0; i < _c->_elements.size(); i++) {
+    int etype = _c->_elements[i];
+    if (etype == TUNNEL_TYPE)
+      router_id.push_back(-1);
+#if CLICK_LINUXMODULE
+    else if (_element_types[etype].module && router->add_module_ref(_element_types[etype].module) < 0) {
+      _errh->lerror(_c->element_landmark(i), "module for element type %<%s%> unloaded", _element_types[etype].name.c_str());
+      router_id.push_back(-1);
+    }
+#endif
+    else if (Element *e = (*_element_types[etype].factory)(_element_types[etype].thunk)) {
+      int ei = router->add_element(e, _c->_element_names[i], _c->_element_configurations[i], _c->_element_filenames[i], _c->_element_linenos[i]);
+      router_id.push_back(ei);
+    } else {
+      _errh->lerror(_c->element_landmark(i), "failed to create element %<%s%>", _c->_element_names[i].c_str());
+      router_id.push_back(-1);
+    }
+  }
+
+  // expand and add connections to router
+  expand_router_connections(router_id);
   for (Connection *cp = _c->_conn.begin(); cp != _c->_conn.end(); ++cp)
     if ((*cp)[0].idx >= 0 && (*cp)[1].idx >= 0)
       router->add_connection((*cp)[1].idx, (*cp)[1].port, (*cp)[0].idx, (*cp)[0].port);
@@ -1985,6 +1998,91 @@ Lexer::create_router(Master *master)
   return router;
 }
 
+#if !CLICK_LINUXMODULE
+RouterImage *
+Lexer::create_router_image()
+{
+  RouterImage *image = new RouterImage;
+  if (!image)
+    return 0;
+  image->_configuration = _file._big_string;
+
+  // expand compounds
+  expand_compounds();
+
+  // record elements; element classes are resolved now, but elements are
+  // created by RouterImage::create_router
+  Vector<int> router_id;
+  for (int i = 0; i < _c->_elements.size(); i++) {
+    int etype = _c->_elements[i];
+    if (etype == TUNNEL_TYPE)
+      router_id.push_back(-1);
+    else {
+      RouterImage::ElementImage ei;
+      ei.factory = _element_types[etype].factory;
+      ei.thunk = _element_types[etype].thunk;
+      ei.name = _c->_element_names[i];
+      ei.configuration = _c->_element_configurations[i];
+      ei.filename = _c->_element_filenames[i];
+      ei.lineno = _c->_element_linenos[i];
+      router_id.push_back(image->_elements.size());
+      image->_elements.push_back(ei);
+    }
+  }
+
+  // expand and record connections
+  expand_router_connections(router_id);
+  for (Connection *cp = _c->_conn.begin(); cp != _c->_conn.end(); ++cp)
+    if ((*cp)[0].idx >= 0 && (*cp)[1].idx >= 0)
+      image->_conn.push_back(*cp);
+
+  image->_requirements = _requirements;
+  return image;
+}
+
+
+//
+// ROUTERIMAGE
+//
+
+// Routers built from one image may run on different threads, and String
+// reference counts are not atomic in single-threaded builds, so each router
+// gets private copies of the image's strings.
+static inline String
+private_copy(const String &s)
+{
+  return String(s.data(), s.length());
+}
+
+Router *
+RouterImage::create_router(Master *master, ErrorHandler *errh) const
+{
+  Router *router = new Router(private_copy(_configuration), master);
+  if (!router)
+    return 0;
+
+  Vector<int> router_id;
+  for (const ElementImage *ei = _elements.begin(); ei != _elements.end(); ++ei)
+    if (Element *e = (*ei->factory)(ei->thunk))
+      router_id.push_back(router->add_element(e, private_copy(ei->name), private_copy(ei->configuration), private_copy(ei->filename), ei->lineno));
+    else {
+      errh->lerror(Lexer::Compound::landmark_string(ei->filename, ei->lineno), "failed to create element %<%s%>", ei->name.c_str());
+      router_id.push_back(-1);
+    }
+
+  for (const Router::Connection *cp = _conn.begin(); cp != _conn.end(); ++cp) {
+    int fromi = router_id[(*cp)[1].idx], toi = router_id[(*cp)[0].idx];
+    if (fromi >= 0 && toi >= 0)
+      router->add_connection(fromi, (*cp)[1].port, toi, (*cp)[0].port);
+  }
+
+  for (int i = 0; i < _requirements.size(); i += 2)
+    router->add_requirement(private_copy(_requirements[i]), private_copy(_requirements[i+1]));
+
+  return router;
+}
+#endif
+
 
 //
 // LEXEREXTRA
@@ -28,6 +28,9 @@
 #if CLICK_USERLEVEL
 # include <fcntl.h>
 # include <click/userutils.hh>
+# if HAVE_MULTITHREAD
+#  include <sched.h>
+# endif
 #endif
 CLICK_DECLS
 
@@ -43,6 +46,7 @@ Master::Master(int nthreads)
 {
     _refcount = 0;
     _master_paused = 0;
+    _work_stealing = false;
 
     _nthreads = nthreads + 1;
     _threads = new RouterThread *[_nthreads];
@@ -65,6 +69,7 @@ Master::Master(int nthreads)
 
 #if CLICK_NS
     _simnode = 0;
+    memset(&_sim_stats, 0, sizeof(_sim_stats));
 #endif
 }
 
@@ -143,6 +148,119 @@ Master::unblock_all()
 	_threads[i]->unblock_tasks();
 }
 
+/** @brief Select the timer backend for every thread.
+ *
+ * With @a wheel true, each thread keeps its timers in a hierarchical timing
+ * wheel; otherwise they use the default heap.  See
+ * TimerSet::set_timer_wheel(). */
+void
+Master::set_timer_wheel(bool wheel)
+{
+    for (int i = 0; i < _nthreads; ++i)
+	_threads[i]->timer_set().set_timer_wheel(wheel);
+}
+
+
+// GRACE PERIODS
+
+/** @brief Return the thread whose driver is running on the calling thread.
+ *
+ * Returns null if the caller is not running a driver, for instance if it is
+ * a handler thread outside the driver loops. */
+RouterThread *
+Master::current_thread() const
+{
+    for (int i = 1; i < _nthreads; ++i)
+	if (_threads[i]->current_thread_is_running())
+	    return _threads[i];
+    return 0;
+}
+
+/** @brief Prepare the calling thread to spin waiting for another thread.
+ *
+ * If the caller is a driver thread running element code, marks it quiescent
+ * and returns it; pass the result to end_quiescent_wait() once the wait is
+ * over.  The thread being waited for may itself be in wait_grace_period(),
+ * waiting for the caller. */
+RouterThread *
+Master::begin_quiescent_wait()
+{
+#if HAVE_MULTITHREAD
+    RouterThread *self = current_thread();
+    if (self && !(self->_epoch & 1)) {
+	self->enter_quiescent_state();
+	return self;
+    }
+#endif
+    return 0;
+}
+
+void
+Master::end_quiescent_wait(RouterThread *self)
+{
+    if (self)
+	self->leave_quiescent_state();
+}
+
+/** @brief Acquire @a lock, counting the wait as a quiescent state.
+ *
+ * Use this for locks whose holders may call wait_grace_period().  The caller
+ * must not hold pointers to published data across the call. */
+void
+Master::acquire_quiescent(Spinlock &lock)
+{
+    if (!lock.attempt()) {
+	RouterThread *self = begin_quiescent_wait();
+	lock.acquire();
+	end_quiescent_wait(self);
+    }
+}
+
+/** @brief Wait until no other thread can still be using data unpublished
+ * before the call.
+ *
+ * A writer that replaces a shared structure by storing a pointer to a new
+ * version calls wait_grace_period() before freeing or modifying the old
+ * version.  Readers need no locks, but must not keep pointers to the
+ * structure between calls into their elements.  The function returns once
+ * every other running thread has returned to its driver loop or blocked
+ * waiting for events.  It returns at once in single-threaded drivers.
+ *
+ * The caller must not hold pointers to published data across the call. */
+void
+Master::wait_grace_period()
+{
+#if HAVE_MULTITHREAD
+    // The waiting thread counts as quiescent, so that two threads waiting
+    // at once do not wait for each other.
+    RouterThread *self = current_thread();
+    if (self)
+	self->enter_quiescent_state();
+    else
+	click_fence();
+
+    Vector<uint32_t> epochs(_nthreads, 0);
+    for (int i = 1; i < _nthreads; ++i)
+	epochs[i] = _threads[i]->_epoch;
+    for (int i = 1; i < _nthreads; ++i) {
+	RouterThread *t = _threads[i];
+	// An odd epoch means the thread was outside element code.
+	while (t != self && !(epochs[i] & 1) && t->_epoch == epochs[i]) {
+# if CLICK_LINUXMODULE
+	    schedule();
+# elif CLICK_USERLEVEL
+	    sched_yield();
+# endif
+	}
+    }
+
+    if (self)
+	self->leave_quiescent_state();
+    else
+	click_fence();
+#endif
+}
+
 
 // ROUTERS
 
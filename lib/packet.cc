@@ -23,9 +23,16 @@
 #include <click/packet_anno.hh>
 #include <click/glue.hh>
 #include <click/sync.hh>
+#include <click/straccum.hh>
+#include <click/vector.hh>
 #if CLICK_USERLEVEL
 # include <unistd.h>
 #endif
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD && defined(__linux__)
+# include <sched.h>
+# include <dirent.h>
+# include <ctype.h>
+#endif
 CLICK_DECLS
 
 /** @file packet.hh
@@ -211,7 +218,7 @@ Packet::~Packet()
 	_data_packet->kill();
 # if CLICK_USERLEVEL
     else if (_head && _destructor)
-	_destructor(_head, _end - _head);
+	_destructor(_head, _end - _head, _destructor_argument);
     else
 	delete[] _head;
 # elif CLICK_BSDMODULE
@@ -219,15 +226,88 @@ Packet::~Packet()
 	m_freem(_m);
 # endif
     _head = _data = 0;
+# if CLICK_NS
+    if (_sim_packetinfo)
+	free_sim_packetinfo();
+# endif
 #endif
 }
 
+#if CLICK_NS
+// Simulator packet info is kept outside the Packet and allocated only for
+// packets that need it: those received from the simulator, and those that
+// reach an element like ToSimTrace.  Freed blocks are kept on a per-thread
+// list for reuse.
+# define CLICK_SIM_PACKETINFO_POOL_SIZE	1000
+namespace {
+union SimPacketinfoData {
+    SimPacketinfoData *next;
+    simclick_simpacketinfo pinfo;
+};
+struct SimPacketinfoPool {
+    SimPacketinfoData *pd;
+    unsigned pdcount;
+};
+}
+# if HAVE___THREAD_STORAGE_CLASS
+static __thread SimPacketinfoPool sim_packetinfo_pool;
+# else
+static SimPacketinfoPool sim_packetinfo_pool;
+# endif
+
+void
+Packet::alloc_sim_packetinfo()
+{
+    SimPacketinfoData *pd = sim_packetinfo_pool.pd;
+    if (pd) {
+	sim_packetinfo_pool.pd = pd->next;
+	--sim_packetinfo_pool.pdcount;
+    } else if (!(pd = new SimPacketinfoData)) {
+	_sim_packetinfo = 0;
+	return;
+    }
+    // The uninitialized value can't be all zeros (0 is a valid packet id):
+    // the simulator looks at this info to see if it generated the packet.
+    memset(&pd->pinfo, -1, sizeof(pd->pinfo));
+    _sim_packetinfo = &pd->pinfo;
+}
+
+void
+Packet::free_sim_packetinfo()
+{
+    SimPacketinfoData *pd = reinterpret_cast<SimPacketinfoData *>(_sim_packetinfo);
+    _sim_packetinfo = 0;
+    if (sim_packetinfo_pool.pdcount == CLICK_SIM_PACKETINFO_POOL_SIZE)
+	delete pd;
+    else {
+	pd->next = sim_packetinfo_pool.pd;
+	sim_packetinfo_pool.pd = pd;
+	++sim_packetinfo_pool.pdcount;
+    }
+}
+
+void
+Packet::set_sim_packetinfo(const simclick_simpacketinfo *pinfo)
+{
+    if (!pinfo) {
+	if (_sim_packetinfo)
+	    free_sim_packetinfo();
+	return;
+    }
+    if (!_sim_packetinfo)
+	alloc_sim_packetinfo();
+    if (_sim_packetinfo)
+	*_sim_packetinfo = *pinfo;
+}
+#endif
+
 #if !CLICK_LINUXMODULE
 
 # if HAVE_CLICK_PACKET_POOL
 #  define CLICK_PACKET_POOL_BUFSIZ		2048
 #  define CLICK_PACKET_POOL_SIZE		1000
 #  define CLICK_GLOBAL_PACKET_POOL_COUNT	16
+#  define CLICK_PACKET_POOL_MAX_NODES		8
 namespace {
 struct PacketData {
     PacketData *next;
@@ -235,21 +315,86 @@ struct PacketData {
     PacketData *pool_next;
 #  endif
 };
+struct PacketPoolStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t refills;
+    uint64_t overflows;
+};
 struct PacketPool {
     WritablePacket *p;
     unsigned pcount;
-    PacketData *pd;
-    unsigned pdcount;
+    PacketData *pd[Packet::pool_max_buffer_sizes];
+    unsigned pdcount[Packet::pool_max_buffer_sizes];
+    PacketPoolStats stats;
 #  if HAVE_MULTITHREAD
     PacketPool *chain;
+    int thread_id;
+    int node;
 #  endif
 };
 }
+
+// Set by Packet::set_pool_parameters().
+static unsigned packet_pool_size = CLICK_PACKET_POOL_SIZE;
+static unsigned global_packet_pool_count = CLICK_GLOBAL_PACKET_POOL_COUNT;
+static uint32_t packet_pool_bufsiz[Packet::pool_max_buffer_sizes] = {
+    CLICK_PACKET_POOL_BUFSIZ
+};
+static int packet_pool_nbufsiz = 1;
+
+/** @brief Return the smallest pooled buffer size class that fits @a n
+ * bytes, or -1 if @a n is too big for every class. */
+static inline int
+packet_pool_class(uint32_t n)
+{
+    for (int c = 0; c < packet_pool_nbufsiz; ++c)
+	if (n <= packet_pool_bufsiz[c])
+	    return c;
+    return -1;
+}
+
 #  if HAVE_MULTITHREAD
+namespace {
+// The shared pool of one NUMA node.  A pooled buffer remembers the node
+// whose pool supplied it (Packet::_pool_node), and returns to that node's
+// pool when another node frees it.
+struct PacketPoolNode {
+    PacketPool pool;		// full batches of free packets and buffers
+    // Buffers returned by other nodes, until they fill a batch.
+    PacketData *remote[Packet::pool_max_buffer_sizes];
+    unsigned remotecount[Packet::pool_max_buffer_sizes];
+    volatile uint32_t lock;
+};
+}
+
 static __thread PacketPool *thread_packet_pool;
 static PacketPool *all_thread_packet_pools;
-static PacketPool global_packet_pool;
-static volatile uint32_t global_packet_pool_lock;
+static volatile uint32_t all_thread_packet_pools_lock;
+static PacketPoolNode packet_pool_nodes[CLICK_PACKET_POOL_MAX_NODES];
+
+/** @brief Return the NUMA node of the CPU running the calling thread. */
+static int
+current_numa_node()
+{
+#   if CLICK_USERLEVEL && defined(__linux__)
+    int cpu = sched_getcpu();
+    char buf[64];
+    sprintf(buf, "/sys/devices/system/cpu/cpu%d", cpu);
+    int node = -1;
+    if (DIR *dir = (cpu >= 0 ? opendir(buf) : 0)) {
+	while (struct dirent *d = readdir(dir))
+	    if (memcmp(d->d_name, "node", 4) == 0 && isdigit((unsigned char) d->d_name[4])) {
+		node = atoi(d->d_name + 4);
+		break;
+	    }
+	closedir(dir);
+    }
+    if (node >= 0)
+	return node % CLICK_PACKET_POOL_MAX_NODES;
+#   endif
+    return 0;
+}
 
 static inline PacketPool *
 get_packet_pool()
@@ -257,28 +402,41 @@ get_packet_pool()
     PacketPool *pp = thread_packet_pool;
     if (!pp && (pp = new PacketPool)) {
 	memset(pp, 0, sizeof(PacketPool));
-	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
+#   if CLICK_USERLEVEL && HAVE___THREAD_STORAGE_CLASS
+	pp->thread_id = click_current_thread_id;
+#   endif
+	pp->node = current_numa_node();
+	while (atomic_uint32_t::swap(all_thread_packet_pools_lock, 1) == 1)
 	    /* do nothing */;
 	pp->chain = all_thread_packet_pools;
 	all_thread_packet_pools = pp;
 	thread_packet_pool = pp;
 	click_compiler_fence();
-	global_packet_pool_lock = 0;
+	all_thread_packet_pools_lock = 0;
     }
     return pp;
 }
+#  elif CLICK_NS && HAVE___THREAD_STORAGE_CLASS
+// Simulators may run independent nodes on parallel threads.
+static __thread PacketPool packet_pool;
 #  else
 static PacketPool packet_pool;
 #  endif
 
 WritablePacket *
-WritablePacket::pool_allocate(bool with_data)
+WritablePacket::pool_allocate(int size_class)
 {
 #  if HAVE_MULTITHREAD
     PacketPool &packet_pool = *get_packet_pool();
+    // A thread refills only from its own node's shared pool.  Buffers there
+    // all came from that node; packets are not tagged, and stay on the node
+    // that freed them.
+    PacketPoolNode &pool_node = packet_pool_nodes[packet_pool.node];
+    PacketPool &global_packet_pool = pool_node.pool;
     if ((!packet_pool.p && global_packet_pool.p)
-	|| (with_data && !packet_pool.pd && global_packet_pool.pd)) {
-	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
+	|| (size_class >= 0 && !packet_pool.pd[size_class]
+	    && global_packet_pool.pd[size_class])) {
+	while (atomic_uint32_t::swap(pool_node.lock, 1) == 1)
 	    /* do nothing */;
 
 	WritablePacket *pp;
@@ -286,30 +444,36 @@ WritablePacket::pool_allocate(bool with_data)
 	    global_packet_pool.p = static_cast<WritablePacket *>(pp->prev());
 	    --global_packet_pool.pcount;
 	    packet_pool.p = pp;
-	    packet_pool.pcount = CLICK_PACKET_POOL_SIZE;
+	    packet_pool.pcount = packet_pool_size;
+	    ++packet_pool.stats.refills;
 	}
 
 	PacketData *pd;
-	if (with_data && !packet_pool.pd && (pd = global_packet_pool.pd)) {
-	    global_packet_pool.pd = pd->pool_next;
-	    --global_packet_pool.pdcount;
-	    packet_pool.pd = pd;
-	    packet_pool.pdcount = CLICK_PACKET_POOL_SIZE;
+	if (size_class >= 0 && !packet_pool.pd[size_class]
+	    && (pd = global_packet_pool.pd[size_class])) {
+	    global_packet_pool.pd[size_class] = pd->pool_next;
+	    --global_packet_pool.pdcount[size_class];
+	    packet_pool.pd[size_class] = pd;
+	    packet_pool.pdcount[size_class] = packet_pool_size;
+	    ++packet_pool.stats.refills;
 	}
 
 	click_compiler_fence();
-	global_packet_pool_lock = 0;
+	pool_node.lock = 0;
     }
 #  else
-    (void) with_data;
+    (void) size_class;
 #  endif
 
     WritablePacket *p = packet_pool.p;
     if (p) {
 	packet_pool.p = static_cast<WritablePacket *>(p->next());
 	--packet_pool.pcount;
-    } else
+	++packet_pool.stats.hits;
+    } else {
 	p = new WritablePacket;
+	++packet_pool.stats.misses;
+    }
     return p;
 }
 
@@ -318,21 +482,23 @@ WritablePacket::pool_allocate(uint32_t headroom, uint32_t length,
 			      uint32_t tailroom)
 {
     uint32_t n = headroom + length + tailroom;
-    if (n < CLICK_PACKET_POOL_BUFSIZ)
-	n = CLICK_PACKET_POOL_BUFSIZ;
-    WritablePacket *p = pool_allocate(n == CLICK_PACKET_POOL_BUFSIZ);
+    int c = packet_pool_class(n);
+    if (c >= 0)
+	n = packet_pool_bufsiz[c];
+    WritablePacket *p = pool_allocate(c);
     if (p) {
 	p->initialize();
 	PacketData *pd;
 #  if HAVE_MULTITHREAD
 	PacketPool &packet_pool = *thread_packet_pool;
 #  endif
-	if (n == CLICK_PACKET_POOL_BUFSIZ && (pd = packet_pool.pd)) {
-	    packet_pool.pd = pd->next;
-	    --packet_pool.pdcount;
+	if (c >= 0 && (pd = packet_pool.pd[c])) {
+	    packet_pool.pd[c] = pd->next;
+	    --packet_pool.pdcount[c];
+	    ++packet_pool.stats.hits;
 	    p->_head = reinterpret_cast<unsigned char *>(pd);
 	} else if ((p->_head = new unsigned char[n]))
-	    /* OK */;
+	    ++packet_pool.stats.misses;
 	else {
 	    delete p;
 	    return 0;
@@ -340,33 +506,87 @@ WritablePacket::pool_allocate(uint32_t headroom, uint32_t length,
 	p->_data = p->_head + headroom;
 	p->_tail = p->_data + length;
 	p->_end = p->_head + n;
+#  if HAVE_MULTITHREAD
+	if (c >= 0)
+	    p->_pool_node = packet_pool.node;
+#  endif
     }
     return p;
 }
 
+#  if HAVE_MULTITHREAD
+/** @brief Return @a data, a free buffer of size class @a c, to the shared
+ * pool of @a node, whose pool supplied it.
+ *
+ * The thread calling this runs on another node.  Buffers wait in a partial
+ * batch until there are enough to fill a batch. */
+static void
+recycle_remote_buffer(unsigned char *data, int c, int node,
+		      PacketPool &packet_pool)
+{
+    PacketPoolNode &pool_node = packet_pool_nodes[node];
+    PacketData *pd = reinterpret_cast<PacketData *>(data);
+    while (atomic_uint32_t::swap(pool_node.lock, 1) == 1)
+	/* do nothing */;
+
+    pd->next = pool_node.remote[c];
+    pool_node.remote[c] = pd;
+    if (++pool_node.remotecount[c] >= packet_pool_size) {
+	if (pool_node.pool.pdcount[c] >= global_packet_pool_count) {
+	    while ((pd = pool_node.remote[c])) {
+		pool_node.remote[c] = pd->next;
+		delete[] reinterpret_cast<unsigned char *>(pd);
+	    }
+	    packet_pool.stats.overflows += pool_node.remotecount[c];
+	} else {
+	    pd->pool_next = pool_node.pool.pd[c];
+	    pool_node.pool.pd[c] = pd;
+	    ++pool_node.pool.pdcount[c];
+	    pool_node.remote[c] = 0;
+	}
+	pool_node.remotecount[c] = 0;
+    }
+
+    click_compiler_fence();
+    pool_node.lock = 0;
+}
+#  endif
+
 void
 WritablePacket::recycle(WritablePacket *p)
 {
     unsigned char *data = 0;
-    if (!p->_data_packet && p->_head && !p->_destructor
-	&& p->_end - p->_head == CLICK_PACKET_POOL_BUFSIZ) {
-	data = p->_head;
-	p->_head = 0;
+    int c = -1;
+    if (!p->_data_packet && p->_head && !p->_destructor) {
+	uint32_t n = p->_end - p->_head;
+	c = packet_pool_class(n);
+	if (c >= 0 && n == packet_pool_bufsiz[c]) {
+	    data = p->_head;
+	    p->_head = 0;
+	}
     }
 
 #  if HAVE_MULTITHREAD
     PacketPool &packet_pool = *get_packet_pool();
-    if ((packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE)
-	|| (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE)) {
-	while (atomic_uint32_t::swap(global_packet_pool_lock, 1) == 1)
+    if (data && p->_pool_node >= 0 && p->_pool_node != packet_pool.node) {
+	recycle_remote_buffer(data, c, p->_pool_node, packet_pool);
+	data = 0;
+    }
+    if ((packet_pool.p && packet_pool.pcount >= packet_pool_size)
+	|| (data && packet_pool.pd[c]
+	    && packet_pool.pdcount[c] >= packet_pool_size)) {
+	PacketPoolNode &pool_node = packet_pool_nodes[packet_pool.node];
+	PacketPool &global_packet_pool = pool_node.pool;
+	while (atomic_uint32_t::swap(pool_node.lock, 1) == 1)
 	    /* do nothing */;
 
-	if (packet_pool.p && packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
+	if (packet_pool.p && packet_pool.pcount >= packet_pool_size) {
+	    if (global_packet_pool.pcount >= global_packet_pool_count) {
 		while (WritablePacket *p = packet_pool.p) {
 		    packet_pool.p = static_cast<WritablePacket *>(p->next());
 		    ::operator delete((void *) p);
 		}
+		packet_pool.stats.overflows += packet_pool.pcount;
 	    } else {
 		packet_pool.p->set_prev(global_packet_pool.p);
 		global_packet_pool.p = packet_pool.p;
@@ -376,32 +596,36 @@ WritablePacket::recycle(WritablePacket *p)
 	    packet_pool.pcount = 0;
 	}
 
-	if (data && packet_pool.pd && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
-	    if (global_packet_pool.pdcount == CLICK_GLOBAL_PACKET_POOL_COUNT) {
-		while (PacketData *pd = packet_pool.pd) {
-		    packet_pool.pd = pd->next;
+	if (data && packet_pool.pd[c]
+	    && packet_pool.pdcount[c] >= packet_pool_size) {
+	    if (global_packet_pool.pdcount[c] >= global_packet_pool_count) {
+		while (PacketData *pd = packet_pool.pd[c]) {
+		    packet_pool.pd[c] = pd->next;
 		    delete[] reinterpret_cast<unsigned char *>(pd);
 		}
+		packet_pool.stats.overflows += packet_pool.pdcount[c];
 	    } else {
-		packet_pool.pd->pool_next = global_packet_pool.pd;
-		global_packet_pool.pd = packet_pool.pd;
-		++global_packet_pool.pdcount;
-		packet_pool.pd = 0;
+		packet_pool.pd[c]->pool_next = global_packet_pool.pd[c];
+		global_packet_pool.pd[c] = packet_pool.pd[c];
+		++global_packet_pool.pdcount[c];
+		packet_pool.pd[c] = 0;
 	    }
-	    packet_pool.pdcount = 0;
+	    packet_pool.pdcount[c] = 0;
 	}
 
 	click_compiler_fence();
-	global_packet_pool_lock = 0;
+	pool_node.lock = 0;
     }
 #  else
-    if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
+    if (packet_pool.pcount >= packet_pool_size) {
 	delete p;
 	p = 0;
+	++packet_pool.stats.overflows;
     }
-    if (data && packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
+    if (data && packet_pool.pdcount[c] >= packet_pool_size) {
 	delete[] data;
 	data = 0;
+	++packet_pool.stats.overflows;
     }
 #  endif
 
@@ -413,9 +637,9 @@ WritablePacket::recycle(WritablePacket *p)
     }
     if (data) {
 	PacketData *pd = reinterpret_cast<PacketData *>(data);
-	pd->next = packet_pool.pd;
-	packet_pool.pd = pd;
-	++packet_pool.pdcount;
+	pd->next = packet_pool.pd[c];
+	packet_pool.pd[c] = pd;
+	++packet_pool.pdcount[c];
     }
 }
 
@@ -434,6 +658,9 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
     if (!d)
 	return false;
     _head = d;
+# if HAVE_CLICK_PACKET_POOL && HAVE_MULTITHREAD
+    _pool_node = -1;
+# endif
     _data = d + headroom;
     _tail = _data + length;
     _end = _head + n;
@@ -535,24 +762,28 @@ Packet::make(uint32_t headroom, const void *data,
  * @param data data used in the new packet
  * @param length length of packet
  * @param destructor destructor function
+ * @param argument argument to destructor function
  * @return new packet, or null if no packet could be created
  *
  * The packet's data pointer becomes the @a data: the data is not copied into
  * the new packet, rather the packet owns the @a data pointer.  When the
  * packet's data is eventually destroyed, either because the packet is deleted
  * or because of something like a push() or full(), the @a destructor will be
- * called with arguments @a destructor(@a data, @a length).  (If @a destructor
- * is null, the packet data will be freed by <tt>delete[] @a data</tt>.)  The
- * packet has zero headroom and tailroom.
+ * called with arguments @a destructor(@a data, @a length, @a argument).  (If
+ * @a destructor is null, the packet data will be freed by <tt>delete[] @a
+ * data</tt>.)  The packet has zero headroom and tailroom.
+ *
+ * This lets a caller hand an existing buffer to Click without copying it;
+ * the ns driver uses it to pass simulator frames into the router.
  *
  * The returned packet's annotations are cleared and its header pointers are
  * null. */
 WritablePacket *
 Packet::make(unsigned char *data, uint32_t length,
-	     void (*destructor)(unsigned char *, size_t))
+	     buffer_destructor_type destructor, void *argument)
 {
 # if HAVE_CLICK_PACKET_POOL
-    WritablePacket *p = WritablePacket::pool_allocate(false);
+    WritablePacket *p = WritablePacket::pool_allocate(-1);
 # else
     WritablePacket *p = new WritablePacket;
 # endif
@@ -561,6 +792,7 @@ Packet::make(unsigned char *data, uint32_t length,
 	p->_head = p->_data = data;
 	p->_tail = p->_end = data + length;
 	p->_destructor = destructor;
+	p->_destructor_argument = argument;
     }
     return p;
 }
@@ -605,7 +837,7 @@ Packet::clone()
 
     // timing: .31-.39 normal, .43-.55 two allocs, .55-.58 two memcpys
 # if HAVE_CLICK_PACKET_POOL
-    Packet *p = WritablePacket::pool_allocate(false);
+    Packet *p = WritablePacket::pool_allocate(-1);
 # else
     Packet *p = new WritablePacket; // no initialization
 # endif
@@ -618,6 +850,13 @@ Packet::clone()
     p->_destructor = 0;
 # else
     p->_m = m;
+# endif
+# if CLICK_NS
+    // the clone's annotations are independent
+    if (_sim_packetinfo) {
+	p->_sim_packetinfo = 0;
+	p->set_sim_packetinfo(_sim_packetinfo);
+    }
 # endif
     // increment our reference count because of _data_packet reference
     _use_count++;
@@ -726,7 +965,7 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
 	_data_packet->kill();
 # if CLICK_USERLEVEL
     else if (_destructor)
-	_destructor(old_head, old_end - old_head);
+	_destructor(old_head, old_end - old_head, _destructor_argument);
     else
 	delete[] old_head;
     _destructor = 0;
@@ -911,10 +1150,161 @@ cleanup_pool(PacketPool *pp)
 	pp->p = static_cast<WritablePacket *>(p->next());
 	::operator delete((void *) p);
     }
-    while (PacketData *pd = pp->pd) {
-	pp->pd = pd->next;
-	delete[] reinterpret_cast<unsigned char *>(pd);
+    pp->pcount = 0;
+    for (int c = 0; c < Packet::pool_max_buffer_sizes; ++c) {
+	while (PacketData *pd = pp->pd[c]) {
+	    pp->pd[c] = pd->next;
+	    delete[] reinterpret_cast<unsigned char *>(pd);
+	}
+	pp->pdcount[c] = 0;
+    }
+}
+
+# if HAVE_MULTITHREAD
+static void
+cleanup_node_pool(PacketPoolNode *pn)
+{
+    PacketPool *gp = &pn->pool;
+    PacketPool batch;
+    memset(&batch, 0, sizeof(PacketPool));
+    while (WritablePacket *p = gp->p) {
+	gp->p = static_cast<WritablePacket *>(p->prev());
+	batch.p = p;
+	cleanup_pool(&batch);
+    }
+    for (int c = 0; c < Packet::pool_max_buffer_sizes; ++c)
+	while (PacketData *pd = gp->pd[c]) {
+	    gp->pd[c] = pd->pool_next;
+	    batch.pd[c] = pd;
+	    cleanup_pool(&batch);
+	}
+    for (int c = 0; c < Packet::pool_max_buffer_sizes; ++c) {
+	batch.pd[c] = pn->remote[c];
+	cleanup_pool(&batch);
+    }
+    memset(pn, 0, sizeof(PacketPoolNode));
+}
+# endif
+
+static void
+flush_packet_pools()
+{
+# if HAVE_MULTITHREAD
+    for (PacketPool *pp = all_thread_packet_pools; pp; pp = pp->chain)
+	cleanup_pool(pp);
+    for (int n = 0; n < CLICK_PACKET_POOL_MAX_NODES; ++n)
+	cleanup_node_pool(&packet_pool_nodes[n]);
+# else
+    cleanup_pool(&packet_pool);
+# endif
+}
+
+/** @brief Change the packet pool's parameters.
+ * @param size number of free packets, and of free buffers of each size,
+ *   that each thread keeps
+ * @param global_count number of batches of @a size free packets, and of
+ *   free buffers of each size, that the shared pool for each NUMA node keeps
+ *   (multithreaded drivers only)
+ * @param buffer_sizes pooled buffer sizes, in increasing order
+ * @param nbuffer_sizes number of pooled buffer sizes
+ * @return 0 on success, -EINVAL if the parameters are bad
+ *
+ * A negative @a size or @a global_count, or a zero @a nbuffer_sizes, leaves
+ * that parameter unchanged.  A new packet's buffer is rounded up to the
+ * smallest pooled buffer size that fits; bigger buffers are allocated
+ * directly.  Each buffer size must be at least @link
+ * Packet::min_buffer_length min_buffer_length @endlink, and at most @link
+ * Packet::pool_max_buffer_sizes pool_max_buffer_sizes @endlink sizes are
+ * allowed.  The defaults are 1000 packets per thread, 16 batches per node,
+ * and a single buffer size of 2048 bytes.
+ *
+ * Frees every pooled packet and buffer.  Call this only while no other
+ * thread is allocating or freeing packets, such as before the driver
+ * starts. */
+int
+Packet::set_pool_parameters(int size, int global_count,
+			    const uint32_t *buffer_sizes, int nbuffer_sizes)
+{
+    if (size == 0 || nbuffer_sizes < 0
+	|| nbuffer_sizes > pool_max_buffer_sizes)
+	return -EINVAL;
+    for (int c = 0; c < nbuffer_sizes; ++c)
+	if (buffer_sizes[c] < (uint32_t) min_buffer_length
+	    || (c > 0 && buffer_sizes[c] <= buffer_sizes[c - 1]))
+	    return -EINVAL;
+    flush_packet_pools();
+    if (size > 0)
+	packet_pool_size = size;
+    if (global_count >= 0)
+	global_packet_pool_count = global_count;
+    if (nbuffer_sizes > 0) {
+	for (int c = 0; c < nbuffer_sizes; ++c)
+	    packet_pool_bufsiz[c] = buffer_sizes[c];
+	packet_pool_nbufsiz = nbuffer_sizes;
+    }
+    return 0;
+}
+
+/** @brief Return a description of the packet pool's parameters.
+ *
+ * The result has lines "size N", "global_count N", and "buffer_sizes N...";
+ * see set_pool_parameters(). */
+String
+Packet::unparse_pool_parameters()
+{
+    StringAccum sa;
+    sa << "size " << packet_pool_size << '\n'
+       << "global_count " << global_packet_pool_count << '\n'
+       << "buffer_sizes";
+    for (int c = 0; c < packet_pool_nbufsiz; ++c)
+	sa << ' ' << packet_pool_bufsiz[c];
+    sa << '\n';
+    return sa.take_string();
+}
+
+static void
+unparse_pool_stats(StringAccum &sa, const PacketPoolStats &stats)
+{
+    sa << " hits " << stats.hits << " misses " << stats.misses
+       << " refills " << stats.refills << " overflows " << stats.overflows
+       << '\n';
+}
+
+/** @brief Return the packet pool's statistics.
+ *
+ * Each allocation of a packet header or data buffer counts as a hit if the
+ * pool supplied it and a miss otherwise.  Refills count batches a thread
+ * took from the shared pool, and overflows count packets and buffers freed
+ * because every pool was full.  Multithreaded drivers report a line for
+ * each thread's pool, "thread T node N: hits H misses M refills R overflows
+ * O", followed by a line of totals starting with "all:". */
+String
+Packet::unparse_pool_statistics()
+{
+    StringAccum sa;
+# if HAVE_MULTITHREAD
+    Vector<PacketPool *> pools;
+    for (PacketPool *pp = all_thread_packet_pools; pp; pp = pp->chain)
+	pools.push_back(pp);
+    PacketPoolStats all;
+    memset(&all, 0, sizeof(all));
+    // Pools are chained newest first.
+    for (int i = pools.size() - 1; i >= 0; --i) {
+	const PacketPoolStats &stats = pools[i]->stats;
+	sa << "thread " << pools[i]->thread_id << " node " << pools[i]->node << ':';
+	unparse_pool_stats(sa, stats);
+	all.hits += stats.hits;
+	all.misses += stats.misses;
+	all.refills += stats.refills;
+	all.overflows += stats.overflows;
     }
+    sa << "all:";
+    unparse_pool_stats(sa, all);
+# else
+    sa << "all:";
+    unparse_pool_stats(sa, packet_pool.stats);
+# endif
+    return sa.take_string();
 }
 #endif
 
@@ -928,19 +1318,19 @@ Packet::static_cleanup()
 	cleanup_pool(pp);
 	delete pp;
     }
-    while (global_packet_pool.p || global_packet_pool.pd) {
-	WritablePacket *next_p = global_packet_pool.p;
-	next_p = (next_p ? static_cast<WritablePacket *>(next_p->prev()) : 0);
-	PacketData *next_pd = global_packet_pool.pd;
-	next_pd = (next_pd ? next_pd->pool_next : 0);
-	cleanup_pool(&global_packet_pool);
-	global_packet_pool.p = next_p;
-	global_packet_pool.pd = next_pd;
-    }
+    for (int n = 0; n < CLICK_PACKET_POOL_MAX_NODES; ++n)
+	cleanup_node_pool(&packet_pool_nodes[n]);
 # else
     cleanup_pool(&packet_pool);
 # endif
 #endif
+#if CLICK_NS
+    while (SimPacketinfoData *pd = sim_packetinfo_pool.pd) {
+	sim_packetinfo_pool.pd = pd->next;
+	delete pd;
+    }
+    sim_packetinfo_pool.pdcount = 0;
+#endif
 }
 
 CLICK_ENDDECLS
@@ -1912,6 +1912,16 @@ ThreadSched::initial_home_thread_id(const Element *)
     return 0;
 }
 
+/** @brief Return true iff @a e's tasks must stay on their home thread.
+ *
+ * Work stealing never moves a pinned element's tasks.  The default
+ * implementation returns false. */
+bool
+ThreadSched::thread_pinned(const Element *)
+{
+    return false;
+}
+
 /** @cond never */
 /** @brief  Create (if necessary) and return the NameInfo object for this router.
  *
@@ -2135,6 +2145,78 @@ Router::element_ports_string(const Element *e) const
 }
 
 
+#if HAVE_ELEMENT_PROFILE
+// PROFILING
+
+/** @brief Start profiling this router's elements.
+ *
+ * Gives every element a set of Element::Profile counters, if it doesn't have
+ * them already, then sets Element::profiling.  Profiling is global: once it
+ * starts, port transfers and tasks in every router update their elements'
+ * counters.  Clear Element::profiling to stop. */
+void
+Router::enable_profile()
+{
+    for (Element **ep = _elements.begin(); ep != _elements.end(); ++ep)
+	if (!(*ep)->_profile) {
+	    int n = (*ep)->ninputs() + (*ep)->noutputs() + 1;
+	    (*ep)->_profile = new Element::Profile[n];
+	    memset((*ep)->_profile, 0, sizeof(Element::Profile) * n);
+	}
+    click_compiler_fence();
+    Element::profiling = true;
+}
+
+/** @brief Zero this router's profile counters. */
+void
+Router::reset_profile()
+{
+    for (Element **ep = _elements.begin(); ep != _elements.end(); ++ep)
+	if ((*ep)->_profile) {
+	    int n = (*ep)->ninputs() + (*ep)->noutputs() + 1;
+	    memset((*ep)->_profile, 0, sizeof(Element::Profile) * n);
+	}
+}
+
+static void
+unparse_profile_line(StringAccum &sa, const Element *e, const char *what,
+		     int port, const Element::Profile &pr)
+{
+    if (!pr.calls)
+	return;
+    sa << e->name() << ' ' << what << ' ';
+    if (port >= 0)
+	sa << port;
+    else
+	sa << '-';
+    sa << ' ' << pr.calls << ' ' << pr.packets << ' ' << pr.self_cycles
+       << ' ' << pr.inclusive_cycles << '\n';
+}
+
+/** @brief Unparse this router's profile counters into @a sa.
+ *
+ * Writes a header line starting with "#", then one line per element port or
+ * task that has been called: the element name; "in", "out", or "task"; the
+ * port number, or "-" for tasks; and the calls, packets, self cycles, and
+ * inclusive cycles counted there. */
+void
+Router::unparse_profile(StringAccum &sa) const
+{
+    sa << "# element kind port calls packets self_cycles inclusive_cycles\n";
+    for (Element * const *ep = _elements.begin(); ep != _elements.end(); ++ep)
+	if (const Element::Profile *pr = (*ep)->profile()) {
+	    const Element *e = *ep;
+	    for (int i = 0; i < e->ninputs(); ++i)
+		unparse_profile_line(sa, e, "in", i, pr[i]);
+	    for (int i = 0; i < e->noutputs(); ++i)
+		unparse_profile_line(sa, e, "out", i, pr[e->ninputs() + i]);
+	    unparse_profile_line(sa, e, "task", -1,
+				 pr[e->ninputs() + e->noutputs()]);
+	}
+}
+#endif
+
+
 // STATIC INITIALIZATION, DEFAULT GLOBAL HANDLERS
 
 /** @brief  Returns the router's initial configuration string.
@@ -2153,7 +2235,13 @@ Router::configuration_string() const
 
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
-       GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE };
+       GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE,
+       GH_WORK_STEALING, GH_THREAD_STEALS, GH_THREAD_IDLE_PASSES,
+       GH_PACKET_POOL, GH_PACKET_POOL_STATS, GH_PROFILE,
+       GH_SIM_BATCHES, GH_SIM_BATCH_PACKETS, GH_SIM_DRIVER_RUNS_SAVED,
+       GH_SIM_UNKNOWN_IFID_DROPS, GH_SIM_WAKEUPS_SCHEDULED,
+       GH_SIM_WAKEUPS_SUPPRESSED, GH_SIM_WAKEUPS_SPURIOUS,
+       GH_SIM_TASKS_PENDING };
 
 String
 Router::router_read_handler(Element *e, void *thunk)
@@ -2247,6 +2335,80 @@ Router::router_read_handler(Element *e, void *thunk)
 	break;
 #endif
 
+    case GH_WORK_STEALING:
+	if (r)
+	    sa << r->master()->work_stealing();
+	break;
+
+    case GH_THREAD_STEALS:
+	if (r)
+	    for (int i = 0; i < r->master()->nthreads(); ++i)
+		sa << r->master()->thread(i)->steals() << '\n';
+	break;
+
+    case GH_THREAD_IDLE_PASSES:
+	if (r)
+	    for (int i = 0; i < r->master()->nthreads(); ++i)
+		sa << r->master()->thread(i)->idle_passes() << '\n';
+	break;
+
+#if HAVE_ELEMENT_PROFILE
+    case GH_PROFILE:
+	if (r)
+	    r->unparse_profile(sa);
+	break;
+#endif
+
+#if HAVE_CLICK_PACKET_POOL
+    case GH_PACKET_POOL:
+	return Packet::unparse_pool_parameters();
+
+    case GH_PACKET_POOL_STATS:
+	return Packet::unparse_pool_statistics();
+#endif
+
+#if CLICK_NS
+    case GH_SIM_BATCHES:
+	if (r)
+	    sa << r->master()->sim_stats().batches;
+	break;
+
+    case GH_SIM_BATCH_PACKETS:
+	if (r)
+	    sa << r->master()->sim_stats().batch_packets;
+	break;
+
+    case GH_SIM_DRIVER_RUNS_SAVED:
+	if (r)
+	    sa << r->master()->sim_stats().driver_runs_saved;
+	break;
+
+    case GH_SIM_UNKNOWN_IFID_DROPS:
+	if (r)
+	    sa << r->master()->sim_stats().unknown_ifid_drops;
+	break;
+
+    case GH_SIM_WAKEUPS_SCHEDULED:
+	if (r)
+	    sa << r->master()->sim_stats().wakeups_scheduled;
+	break;
+
+    case GH_SIM_WAKEUPS_SUPPRESSED:
+	if (r)
+	    sa << r->master()->sim_stats().wakeups_suppressed;
+	break;
+
+    case GH_SIM_WAKEUPS_SPURIOUS:
+	if (r)
+	    sa << r->master()->sim_stats().wakeups_spurious;
+	break;
+
+    case GH_SIM_TASKS_PENDING:
+	if (r)
+	    sa << r->master()->thread(0)->active();
+	break;
+#endif
+
     }
     return sa.take_string();
 }
@@ -2263,6 +2425,37 @@ stop_global_handler(const String &s, Element *e, void *, ErrorHandler *errh)
     return 0;
 }
 
+static int
+work_stealing_global_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+    bool stealing;
+    if (!BoolArg().parse(s, stealing))
+	return errh->error("syntax error");
+    if (!e)
+	return errh->error("no router");
+    e->router()->master()->set_work_stealing(stealing);
+    return 0;
+}
+
+#if HAVE_ELEMENT_PROFILE
+static int
+profile_global_handler(const String &s, Element *e, void *, ErrorHandler *errh)
+{
+    bool profiling;
+    if (!e)
+	return errh->error("no router");
+    else if (s == "reset")
+	e->router()->reset_profile();
+    else if (!BoolArg().parse(s, profiling))
+	return errh->error("syntax error");
+    else if (profiling)
+	e->router()->enable_profile();
+    else
+	Element::profiling = false;
+    return 0;
+}
+#endif
+
 void
 Router::static_initialize()
 {
@@ -2276,6 +2469,18 @@ Router::static_initialize()
 	add_read_handler(0, "handlers", Element::read_handlers_handler, 0);
 	add_read_handler(0, "list", router_read_handler, (void *)GH_LIST);
 	add_write_handler(0, "stop", stop_global_handler, 0);
+	add_read_handler(0, "work_stealing", router_read_handler, (void *) GH_WORK_STEALING);
+	add_write_handler(0, "work_stealing", work_stealing_global_handler, 0);
+	add_read_handler(0, "thread_steals", router_read_handler, (void *) GH_THREAD_STEALS);
+	add_read_handler(0, "thread_idle_passes", router_read_handler, (void *) GH_THREAD_IDLE_PASSES);
+#if HAVE_ELEMENT_PROFILE
+	add_read_handler(0, "profile", router_read_handler, (void *) GH_PROFILE);
+	add_write_handler(0, "profile", profile_global_handler, 0);
+#endif
+#if HAVE_CLICK_PACKET_POOL
+	add_read_handler(0, "packet_pool", router_read_handler, (void *) GH_PACKET_POOL);
+	add_read_handler(0, "packet_pool_stats", router_read_handler, (void *) GH_PACKET_POOL_STATS);
+#endif
 #if CLICK_STATS >= 1
 	add_read_handler(0, "active_ports", router_read_handler, (void *)GH_ACTIVE_PORTS);
 	add_read_handler(0, "active_port_stats", router_read_handler, (void *)GH_ACTIVE_PORT_STATS);
@@ -2288,6 +2493,16 @@ Router::static_initialize()
 #endif
 #if CLICK_DEBUG_MASTER || CLICK_DEBUG_SCHEDULING
 	add_read_handler(0, "scheduling_profile", router_read_handler, (void *) GH_SCHEDULING_PROFILE);
+#endif
+#if CLICK_NS
+	add_read_handler(0, "sim_batches", router_read_handler, (void *) GH_SIM_BATCHES);
+	add_read_handler(0, "sim_batch_packets", router_read_handler, (void *) GH_SIM_BATCH_PACKETS);
+	add_read_handler(0, "sim_driver_runs_saved", router_read_handler, (void *) GH_SIM_DRIVER_RUNS_SAVED);
+	add_read_handler(0, "sim_unknown_ifid_drops", router_read_handler, (void *) GH_SIM_UNKNOWN_IFID_DROPS);
+	add_read_handler(0, "sim_wakeups_scheduled", router_read_handler, (void *) GH_SIM_WAKEUPS_SCHEDULED);
+	add_read_handler(0, "sim_wakeups_suppressed", router_read_handler, (void *) GH_SIM_WAKEUPS_SUPPRESSED);
+	add_read_handler(0, "sim_wakeups_spurious", router_read_handler, (void *) GH_SIM_WAKEUPS_SPURIOUS);
+	add_read_handler(0, "sim_tasks_pending", router_read_handler, (void *) GH_SIM_TASKS_PENDING);
 #endif
     }
 }
@@ -2315,27 +2530,30 @@ Router::sim_get_ifid(const char* ifname) {
     return simclick_sim_command(_master->simnode(), SIMCLICK_IFID_FROM_NAME, ifname);
 }
 
-Vector<int> *
-Router::sim_listenvec(int ifid) {
-  for (int i = 0; i < _listenvecs.size(); i++)
-    if (_listenvecs[i]->at(0) == ifid)
-      return _listenvecs[i];
-  Vector<int> *new_vec = new Vector<int>(1, ifid);
-  if (new_vec)
-    _listenvecs.push_back(new_vec);
-  return new_vec;
+inline const Vector<FromSimDevice *> *
+Router::sim_listeners(int ifid) const {
+  if (unsigned(ifid) < unsigned(_sim_listeners.size())
+      && _sim_listeners.at_u(ifid).size())
+    return &_sim_listeners.at_u(ifid);
+  return 0;
 }
 
 int
 Router::sim_listen(int ifid, int element) {
-  if (Vector<int> *vec = sim_listenvec(ifid)) {
-    for (int i = 1; i < vec->size(); i++)
-      if ((*vec)[i] == element)
-	return 0;
-    vec->push_back(element);
-    return 0;
-  } else
+  if (ifid < 0 || ifid > SIM_MAX_IFID)
     return -1;
+  Element *e = this->element(element);
+  FromSimDevice *fsd = (e ? static_cast<FromSimDevice *>(e->cast("FromSimDevice")) : 0);
+  if (!fsd)
+    return -1;
+  if (ifid >= _sim_listeners.size())
+    _sim_listeners.resize(ifid + 1);
+  Vector<FromSimDevice *> &vec = _sim_listeners[ifid];
+  for (int i = 0; i < vec.size(); i++)
+    if (vec[i] == fsd)
+      return 0;
+  vec.push_back(fsd);
+  return 0;
 }
 
 int
@@ -2344,6 +2562,23 @@ Router::sim_write(int ifid,int ptype,const unsigned char* data,int len,
     return simclick_sim_send(_master->simnode(),ifid,ptype,data,len,pinfo);
 }
 
+static void
+sim_packet_destructor(unsigned char *, size_t, void *arg)
+{
+    static_cast<Packet *>(arg)->kill();
+}
+
+int
+Router::sim_write(int ifid, int ptype, WritablePacket *p) {
+    // Unless the simulator returns a negative value, it now owns p and will
+    // kill it through the destructor.
+    simclick_simpacketinfo pinfo;
+    p->copy_sim_packetinfo(&pinfo);
+    return simclick_sim_command(_master->simnode(), SIMCLICK_SEND_BUFFER,
+				ifid, ptype, p->data(), (int) p->length(),
+				sim_packet_destructor, (void *) p, &pinfo);
+}
+
 int
 Router::sim_if_ready(int ifid) {
     return simclick_sim_command(_master->simnode(), SIMCLICK_IF_READY, ifid);
@@ -2352,10 +2587,85 @@ Router::sim_if_ready(int ifid) {
 int
 Router::sim_incoming_packet(int ifid, int ptype, const unsigned char* data,
 			    int len, simclick_simpacketinfo* pinfo) {
-  if (Vector<int> *vec = sim_listenvec(ifid))
-    for (int i = 1; i < vec->size(); i++)
-      ((FromSimDevice *)element((*vec)[i]))->incoming_packet(ifid, ptype, data,
-							     len, pinfo);
+  if (const Vector<FromSimDevice *> *vec = sim_listeners(ifid))
+    for (int i = 0; i < vec->size(); i++)
+      (*vec)[i]->incoming_packet(ifid, ptype, data, len, pinfo);
+  else
+    _master->sim_stats().unknown_ifid_drops++;
+  return 0;
+}
+
+int
+Router::sim_incoming_packet(int ifid, int ptype, unsigned char *data, int len,
+			    simclick_buffer_destructor destructor, void *arg,
+			    simclick_simpacketinfo *pinfo) {
+  WritablePacket *p = Packet::make(data, len, destructor, arg);
+  if (!p) {
+    destructor(data, len, arg);
+    return -1;
+  }
+  if (const Vector<FromSimDevice *> *vec = sim_listeners(ifid))
+    for (int i = 0; i < vec->size() && p; i++) {
+      // every listener but the last gets a clone sharing the buffer
+      Packet *q = (i < vec->size() - 1 ? p->clone() : p);
+      if (q == p)
+	p = 0;
+      if (q)
+	(*vec)[i]->incoming_packet(ifid, ptype, q, pinfo);
+    }
+  else
+    _master->sim_stats().unknown_ifid_drops++;
+  if (p)
+    p->kill();
+  return 0;
+}
+
+int
+Router::sim_incoming_batch(const simclick_packet_t *packets, int npackets) {
+  // Each run of packets with the same interface and type reaches each
+  // listener as one batch.
+  for (int i = 0, j; i < npackets; i = j) {
+    int ifid = packets[i].ifid, ptype = packets[i].type;
+    for (j = i + 1; j < npackets && packets[j].ifid == ifid
+	   && packets[j].type == ptype; j++)
+      /* nada */;
+
+    const Vector<FromSimDevice *> *vec = sim_listeners(ifid);
+    if (!vec) {
+      _master->sim_stats().unknown_ifid_drops += j - i;
+      for (int k = i; k < j; k++)
+	if (packets[k].destructor)
+	  packets[k].destructor(packets[k].data, packets[k].len, packets[k].arg);
+      continue;
+    }
+
+    PacketBatch batch;
+    for (int k = i; k < j; k++) {
+      const simclick_packet_t &sp = packets[k];
+      WritablePacket *p;
+      if (sp.destructor) {
+	if (!(p = Packet::make(sp.data, sp.len, sp.destructor, sp.arg)))
+	  sp.destructor(sp.data, sp.len, sp.arg);
+      } else
+	p = Packet::make(sp.data, sp.len);
+      if (p) {
+	p->set_sim_packetinfo(sp.pinfo);
+	batch.push_back(p);
+      }
+    }
+
+    for (int l = 0; l < vec->size() && !batch.empty(); l++) {
+      // every listener but the last gets clones sharing the buffers
+      PacketBatch lbatch;
+      if (l < vec->size() - 1) {
+	for (Packet *p = batch.front(); p; p = p->next())
+	  if (Packet *q = p->clone())
+	    lbatch.push_back(q);
+      } else
+	lbatch.append(batch);
+      (*vec)[l]->incoming_batch(ifid, ptype, lbatch);
+    }
+  }
   return 0;
 }
 
@@ -2364,6 +2674,11 @@ Router::sim_trace(const char* event) {
     simclick_sim_command(_master->simnode(), SIMCLICK_TRACE, event);
 }
 
+int
+Router::sim_trace(const simclick_trace_record *rec) {
+    return simclick_sim_command(_master->simnode(), SIMCLICK_TRACE_RECORD, rec);
+}
+
 int
 Router::sim_get_node_id() {
     return simclick_sim_command(_master->simnode(), SIMCLICK_GET_NODE_ID);
@@ -24,6 +24,7 @@
 #include <click/router.hh>
 #include <click/routerthread.hh>
 #include <click/master.hh>
+#include <click/standard/threadsched.hh>
 #if CLICK_LINUXMODULE
 # include <click/cxxprotect.h>
 CLICK_CXX_PROTECT
@@ -80,6 +81,15 @@ RouterThread::RouterThread(Master *m, int id)
 
     _task_blocker = 0;
     _task_blocker_waiting = 0;
+    _steals = _idle_passes = 0;
+#if CLICK_USERLEVEL
+    _current_task = 0;
+#endif
+#if HAVE_MULTITHREAD
+    _idle = false;
+    _steal_from = -1;
+    _epoch = 1;
+#endif
 #if HAVE_ADAPTIVE_SCHEDULER
     _max_click_share = 80 * Task::MAX_UTILIZATION / 100;
     _min_click_share = Task::MAX_UTILIZATION / 200;
@@ -128,6 +138,36 @@ RouterThread::~RouterThread()
     assert(!active());
 }
 
+/** @brief Wait in block_tasks() until the driver lets go of its tasks.
+ *
+ * The wait is a quiescent state for the calling driver thread, if any: the
+ * thread holding the task lock may be in Master::wait_grace_period(),
+ * waiting for the caller.  So callers of lock_tasks() must not hold
+ * pointers to data published for Master::wait_grace_period(). */
+void
+RouterThread::block_tasks_wait()
+{
+    RouterThread *self = _master->begin_quiescent_wait();
+    while (1) {
+	uint32_t blocker = _task_blocker.value();
+	if ((int32_t) blocker >= 0
+	    && _task_blocker.compare_swap(blocker, blocker + 1) == blocker)
+	    break;
+#if CLICK_LINUXMODULE
+	// 3.Nov.2008: Must allow other threads a chance to run.  Otherwise,
+	// soft lock is possible: the thread in block_tasks() waits for
+	// RouterThread::_linux_task to complete a task set, but
+	// RouterThread::_linux_task can't run until the thread in
+	// block_tasks() relinquishes the CPU.
+	//
+	// We might be able to avoid schedule() in some cases, but don't
+	// bother to try.
+	schedule();
+#endif
+    }
+    _master->end_quiescent_wait(self);
+}
+
 inline void
 RouterThread::driver_lock_tasks()
 {
@@ -387,7 +427,13 @@ RouterThread::run_tasks(int ntasks)
 #endif
 
 	t->_status.is_scheduled = false;
+#if CLICK_USERLEVEL
+	_current_task = t;
 	work_done = t->fire();
+	_current_task = 0;
+#else
+	work_done = t->fire();
+#endif
 
 #if HAVE_MULTITHREAD
 	if (runs > PROFILE_ELEMENT) {
@@ -542,6 +588,112 @@ RouterThread::process_pending()
     }
 }
 
+#if HAVE_MULTITHREAD
+/** @brief Return true iff another thread may steal task @a t.
+ *
+ * Tasks already on their way to another thread cannot be stolen, and neither
+ * can tasks whose element is pinned by its router's ThreadSched. */
+inline bool
+RouterThread::task_stealable(Task *t) const
+{
+    if (t->_status.home_thread_id != _id || !t->_status.is_scheduled)
+	return false;
+    ThreadSched *ts = t->router()->thread_sched();
+    return !ts || !ts->thread_pinned(t->element());
+}
+
+/** @brief Return the first task another thread may steal, or null.
+ *
+ * Must be called with the task lock held.  The first task in the list is
+ * never stealable, since it runs next anyway. */
+Task *
+RouterThread::stealable_task() const
+{
+    Task *t = task_begin();
+    if (t == task_end())
+	return 0;
+    for (t = task_next(t); t != task_end(); t = task_next(t))
+	if (task_stealable(t))
+	    return t;
+    return 0;
+}
+
+/** @brief Steal tasks from the thread that most recently asked for help.
+ *
+ * Takes every other stealable task, so the two threads end up sharing the
+ * load.  Must be called without this thread's task lock: two threads
+ * stealing from each other would otherwise deadlock.  Stolen tasks make this
+ * thread their home; they arrive through the victim's pending list. */
+bool
+RouterThread::steal_tasks()
+{
+    int victim_id = _steal_from;
+    if (victim_id < 0)
+	return false;
+    _steal_from = -1;
+    RouterThread *victim = _master->thread(victim_id);
+    uint64_t old_steals = _steals;
+    bool take = true;
+    victim->lock_tasks();
+    // move_thread() leaves the task in the victim's list until the victim
+    // processes its pending list, so the traversal stays valid.
+    if (Task *t = victim->stealable_task())
+	for (; t != victim->task_end(); t = victim->task_next(t))
+	    if (victim->task_stealable(t)) {
+		if (take) {
+		    t->move_thread(_id);
+		    ++_steals;
+		}
+		take = !take;
+	    }
+    victim->unlock_tasks();
+    return _steals != old_steals;
+}
+
+/** @brief Wake an idle thread if this thread has a task to spare.
+ *
+ * Must be called with the task lock held. */
+void
+RouterThread::wake_idle_thread()
+{
+    if (!stealable_task())
+	return;
+    int n = _master->nthreads();
+    for (int i = 1; i < n; ++i) {
+	RouterThread *thief = _master->thread((_id + i) % n);
+	if (thief->_idle) {
+	    thief->_steal_from = _id;
+	    thief->wake();
+	    return;
+	}
+    }
+}
+#endif
+
+#if CLICK_NS
+void
+RouterThread::ns_schedule_wakeup()
+{
+    // If there's another timer, tell the simulator to make us run when it's
+    // due to go off. Only ask when that is earlier than the wakeup we
+    // already have outstanding; a later timer is handled when the earlier
+    // wakeup arrives.
+    Timestamp next_expiry = timer_set().next_timer_expiry();
+    if (!next_expiry)
+	return;
+    if (_ns_wakeup && _ns_wakeup <= Timestamp::now())
+	_ns_wakeup = Timestamp();
+    Master::SimStats &stats = _master->sim_stats();
+    if (!_ns_wakeup || next_expiry < _ns_wakeup) {
+	struct timeval nexttime = next_expiry.timeval();
+	simclick_sim_command(_master->simnode(), SIMCLICK_SCHEDULE, &nexttime);
+	_ns_wakeup = next_expiry;
+	stats.wakeups_scheduled++;
+    } else
+	stats.wakeups_suppressed++;
+}
+#endif
+
 void
 RouterThread::driver()
 {
@@ -560,6 +712,7 @@ RouterThread::driver()
 #endif
 
     driver_lock_tasks();
+    leave_quiescent_state();
 
 #if HAVE_ADAPTIVE_SCHEDULER
     client_set_tickets(C_CLICK, DRIVER_TOTAL_TICKETS / 2);
@@ -573,6 +726,10 @@ RouterThread::driver()
 #if CLICK_DEBUG_SCHEDULING
 	_driver_epoch++;
 #endif
+#if HAVE_MULTITHREAD
+	// No element code is running: a quiescent state.
+	_epoch += 2;
+#endif
 
 #if !BSD_NETISRSCHED
 	// check to see if driver is stopped
@@ -618,12 +775,7 @@ RouterThread::driver()
 #endif
 	    timer_set().run_timers(this, _master);
 #if CLICK_NS
-	    // If there's another timer, tell the simulator to make us
-	    // run when it's due to go off.
-	    if (Timestamp next_expiry = timer_set().next_timer_expiry()) {
-		struct timeval nexttime = next_expiry.timeval();
-		simclick_sim_command(_master->simnode(), SIMCLICK_SCHEDULE, &nexttime);
-	    }
+	    ns_schedule_wakeup();
 #endif
 	} while (0);
 
@@ -637,8 +789,35 @@ RouterThread::driver()
 		break;
 #elif BSD_NETISRSCHED
 	    break;
+#endif
+	    bool idle = !active();
+	    if (idle)
+		++_idle_passes;
+#if HAVE_MULTITHREAD
+	    // With work stealing, a loaded thread wakes an idle one, which
+	    // then takes a task off the loaded thread's list.
+	    if (_master->work_stealing()) {
+		if (!idle)
+		    wake_idle_thread();
+		else if (_steal_from >= 0) {
+		    driver_unlock_tasks();
+		    idle = !steal_tasks();
+		    driver_lock_tasks();
+		}
+	    }
+	    _idle = idle;
+#endif
+#if !CLICK_USERLEVEL
+	    // At user level, SelectSet marks just the time spent blocked.
+	    enter_quiescent_state();
 #endif
 	    run_os();
+#if !CLICK_USERLEVEL
+	    leave_quiescent_state();
+#endif
+#if HAVE_MULTITHREAD
+	    _idle = false;
+#endif
 	} while (0);
 
 #if CLICK_NS || BSD_NETISRSCHED
@@ -648,6 +827,7 @@ RouterThread::driver()
 #endif
     }
 
+    enter_quiescent_state();
     driver_unlock_tasks();
 
 #if HAVE_ADAPTIVE_SCHEDULER
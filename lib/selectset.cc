@@ -400,8 +400,10 @@ SelectSet::run_selects_kqueue(RouterThread *thread)
     thread->set_thread_state_for_blocking(delay_type);
 
     struct kevent kev[256];
+    thread->enter_quiescent_state();
     int n = kevent(_kqueue, 0, 0, &kev[0], 256, wait_ptr);
     int was_errno = errno;
+    thread->leave_quiescent_state();
 
     if (post_select(thread, true))
 	return;
@@ -450,8 +452,10 @@ SelectSet::run_selects_poll(RouterThread *thread)
 	timeout = -1;
     thread->set_thread_state_for_blocking(delay_type);
 
+    thread->enter_quiescent_state();
     int n = poll(my_pollfds.begin(), my_pollfds.size(), timeout);
     int was_errno = errno;
+    thread->leave_quiescent_state();
 
     if (post_select(thread, true))
 	return;
@@ -506,8 +510,10 @@ SelectSet::run_selects_select(RouterThread *thread)
 	wait_ptr = 0;
     thread->set_thread_state_for_blocking(delay_type);
 
+    thread->enter_quiescent_state();
     int n = select(n_select_fd, &read_mask, &write_mask, (fd_set*) 0, wait_ptr);
     int was_errno = errno;
+    thread->leave_quiescent_state();
 
     if (post_select(thread, true))
 	return;
@@ -314,6 +314,28 @@ Task::move_thread(int new_thread_id)
     }
 }
 
+#if HAVE_ELEMENT_PROFILE
+/** @brief Call the task's callback, charging its cycles to the owning
+ * element's profile. */
+bool
+Task::profiled_call()
+{
+    click_cycles_t saved = 0, start = 0;
+    Element::Profile *profile = (_owner ? _owner->_profile : 0);
+    if (profile)
+	Element::profile_begin(saved, start);
+    bool work_done;
+    if (!_hook)
+	work_done = ((Element*)_thunk)->run_task(this);
+    else
+	work_done = _hook(this, _thunk);
+    if (profile)
+	Element::profile_end(profile + _owner->ninputs() + _owner->noutputs(),
+			     0, saved, start);
+    return work_done;
+}
+#endif
+
 void
 Task::process_pending(RouterThread *thread)
 {
@@ -271,18 +271,35 @@ Timer::schedule_at(const Timestamp& when)
     // any reschedule removes a timer from the runchunk (XXX -- even backwards
     // reschedulings)
     int old_schedpos1 = _schedpos1;
-    if (_schedpos1 <= 0) {
-	if (_schedpos1 < 0)
+    if (_schedpos1 == TimerSet::wheel_schedpos1)
+	ts.wheel_unlink(this);
+    if (ts._wheel && TimerSet::wheel_tick(_expiry) >= ts._wheel_now) {
+	// timing wheel: constant time, and never the earliest timer unless
+	// the heap is empty
+	if (_schedpos1 > 0) {
+	    remove_heap<4>(ts._timer_heap.begin(), ts._timer_heap.end(),
+			   ts._timer_heap.begin() + _schedpos1 - 1,
+			   TimerSet::heap_less(), TimerSet::heap_place());
+	    ts._timer_heap.pop_back();
+	} else if (_schedpos1 < 0)
 	    ts._timer_runchunk[-_schedpos1 - 1] = 0;
-	_schedpos1 = ts._timer_heap.size() + 1;
-	ts._timer_heap.push_back(TimerSet::heap_element(this));
-    } else
-	ts._timer_heap.at_u(_schedpos1 - 1).expiry = _expiry;
-    change_heap<4>(ts._timer_heap.begin(), ts._timer_heap.end(),
-		   ts._timer_heap.begin() + _schedpos1 - 1,
-		   TimerSet::heap_less(), TimerSet::heap_place());
-    if (old_schedpos1 == 1 || _schedpos1 == 1)
-	ts.set_timer_expiry();
+	ts.wheel_link(this, TimerSet::wheel_tick(_expiry));
+	if (old_schedpos1 == 1 || ts._timer_heap.empty())
+	    ts.set_timer_expiry();
+    } else {
+	if (_schedpos1 <= 0) {
+	    if (_schedpos1 < 0)
+		ts._timer_runchunk[-_schedpos1 - 1] = 0;
+	    _schedpos1 = ts._timer_heap.size() + 1;
+	    ts._timer_heap.push_back(TimerSet::heap_element(this));
+	} else
+	    ts._timer_heap.at_u(_schedpos1 - 1).expiry = _expiry;
+	change_heap<4>(ts._timer_heap.begin(), ts._timer_heap.end(),
+		       ts._timer_heap.begin() + _schedpos1 - 1,
+		       TimerSet::heap_less(), TimerSet::heap_place());
+	if (old_schedpos1 == 1 || _schedpos1 == 1)
+	    ts.set_timer_expiry();
+    }
 
     // if we changed the timeout, wake up the thread
     if (_schedpos1 == 1)
@@ -306,7 +323,9 @@ Timer::unschedule()
     TimerSet &ts = _thread->timer_set();
     ts.lock_timers();
     int old_schedpos1 = _schedpos1;
-    if (_schedpos1 > 0) {
+    if (_schedpos1 == TimerSet::wheel_schedpos1)
+	ts.wheel_unlink(this);
+    else if (_schedpos1 > 0) {
 	remove_heap<4>(ts._timer_heap.begin(), ts._timer_heap.end(),
 		       ts._timer_heap.begin() + _schedpos1 - 1,
 		       TimerSet::heap_less(), TimerSet::heap_place());
@@ -48,6 +48,14 @@ TimerSet::TimerSet()
 #endif
     _timer_check = Timestamp::now();
     _timer_check_reports = 0;
+    _wheel = 0;
+    _wheel_now = 0;
+    _wheel_count = 0;
+}
+
+TimerSet::~TimerSet()
+{
+    delete[] _wheel;
 }
 
 void
@@ -66,10 +74,123 @@ TimerSet::kill_router(Router *router)
 	    t->_schedpos1 = 0;
 	}
     }
+    if (_wheel)
+	for (Timer **slot = _wheel; slot <= _wheel + wheel_levels * wheel_size; ++slot)
+	    for (Timer *t = *slot, *next; t; t = next) {
+		next = t->_wheel_next;
+		if (t->router() == router) {
+		    wheel_unlink(t);
+		    t->_owner = 0;
+		}
+	    }
+    set_timer_expiry();
+    unlock_timers();
+}
+
+/** @brief Select the timing wheel or the heap for this TimerSet's timers.
+ *
+ * The heap costs O(log n) to schedule or unschedule a timer; the wheel costs
+ * O(1), which pays off when many timers are rescheduled often, as with
+ * per-flow timeouts.  Both run timers in the same order.  Existing timers
+ * move to the new structure. */
+void
+TimerSet::set_timer_wheel(bool wheel)
+{
+    lock_timers();
+    assert(!_timer_runchunk.size());
+    if (wheel && !_wheel) {
+	_wheel = new Timer *[wheel_levels * wheel_size + 1];
+	memset(_wheel, 0, sizeof(Timer *) * (wheel_levels * wheel_size + 1));
+	_wheel_now = wheel_tick(Timestamp::now());
+	Vector<heap_element> heap;
+	heap.swap(_timer_heap);
+	for (heap_element *thp = heap.begin(); thp != heap.end(); ++thp)
+	    wheel_insert(thp->t);
+    } else if (!wheel && _wheel) {
+	for (Timer **slot = _wheel; slot <= _wheel + wheel_levels * wheel_size; ++slot)
+	    while (Timer *t = *slot) {
+		wheel_unlink(t);
+		heap_insert(t);
+	    }
+	delete[] _wheel;
+	_wheel = 0;
+    }
     set_timer_expiry();
     unlock_timers();
 }
 
+void
+TimerSet::wheel_requeue(Timer **slot)
+{
+    Timer *t = *slot;
+    *slot = 0;
+    while (t) {
+	Timer *next = t->_wheel_next;
+	--_wheel_count;
+	wheel_insert(t);
+	t = next;
+    }
+}
+
+void
+TimerSet::wheel_advance(uint64_t now)
+{
+    // Timers before the new _wheel_now move to the heap; timers in a slot
+    // that now matches _wheel_now cascade to lower levels.  Slots before
+    // the old _wheel_now's digit are empty at every level.
+    uint64_t old_now = _wheel_now;
+    _wheel_now = now;
+    for (int level = 0; level < wheel_levels; ++level) {
+	int shift = level * wheel_bits;
+	unsigned first = (old_now >> shift) & wheel_mask, last;
+	if ((old_now >> (shift + wheel_bits)) != (now >> (shift + wheel_bits)))
+	    last = wheel_mask;
+	else
+	    last = (now >> shift) & wheel_mask;
+	Timer **slot = _wheel + level * wheel_size;
+	for (unsigned i = first; i <= last; ++i)
+	    if (slot[i])
+		wheel_requeue(&slot[i]);
+    }
+    if ((old_now >> (wheel_levels * wheel_bits))
+	!= (now >> (wheel_levels * wheel_bits)))
+	wheel_requeue(_wheel + wheel_levels * wheel_size);
+}
+
+bool
+TimerSet::wheel_refill()
+{
+    // Advance the wheel to its earliest nonempty slot until some timers
+    // reach the heap.
+    while (_timer_heap.empty() && _wheel_count) {
+	uint64_t next = 0;
+	bool found = false;
+	for (int level = 0; level < wheel_levels && !found; ++level) {
+	    int shift = level * wheel_bits;
+	    Timer **slot = _wheel + level * wheel_size;
+	    for (unsigned i = (_wheel_now >> shift) & wheel_mask; i < wheel_size; ++i)
+		if (slot[i]) {
+		    next = ((_wheel_now >> (shift + wheel_bits)) << (shift + wheel_bits))
+			| ((uint64_t) i << shift);
+		    // a level-0 slot holds a single tick; move past it
+		    if (level == 0)
+			++next;
+		    found = true;
+		    break;
+		}
+	}
+	if (!found) {
+	    Timer *t = _wheel[wheel_levels * wheel_size];
+	    next = wheel_tick(t->_expiry);
+	    for (t = t->_wheel_next; t; t = t->_wheel_next)
+		if (wheel_tick(t->_expiry) < next)
+		    next = wheel_tick(t->_expiry);
+	}
+	wheel_advance(next);
+    }
+    return !_timer_heap.empty();
+}
+
 void
 TimerSet::set_max_timer_stride(unsigned timer_stride)
 {
@@ -163,7 +284,7 @@ TimerSet::run_timers(RouterThread *thread, Master *master)
 		    t->_schedpos1 = -_timer_runchunk.size() - 1;
 
 		    _timer_runchunk.push_back(t);
-		} while (_timer_heap.size() > 0
+		} while ((_timer_heap.size() > 0 || (_wheel_count && wheel_refill()))
 			 && (th = _timer_heap.begin(), th->expiry <= _timer_check));
 		set_timer_expiry();
 
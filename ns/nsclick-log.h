@@ -0,0 +1,58 @@
+#ifndef NSCLICK_LOG_H
+#define NSCLICK_LOG_H
+/*
+ * nsclick-log.h -- format of simclick event logs
+ *
+ * simclick_click_record() writes one of these logs per node; nsclick-replay
+ * reads it back. A log is an nsclick_log_header followed by events. Each
+ * event is an nsclick_log_event followed by "length" bytes of payload. All
+ * integers are in host byte order, so logs are meant to be replayed on the
+ * machine type that recorded them.
+ *
+ * The first events describe the node (CONFIG, NODE, then one IFACE per
+ * simulated interface the configuration uses); they let nsclick-replay
+ * answer Click's SIMCLICK_*_FROM_NAME commands without the simulator. The
+ * remaining events are the calls the simulator made into Click.
+ */
+#include <stdint.h>
+
+#define NSCLICK_LOG_MAGIC	"SCLOG"
+#define NSCLICK_LOG_VERSION	1
+
+enum {
+    NSCLICK_LOG_CONFIG = 1,	/* configuration text */
+    NSCLICK_LOG_NODE = 2,	/* int32 node id, node name */
+    NSCLICK_LOG_IFACE = 3,	/* int32 ifid, "name\0ipaddr\0macaddr" */
+    NSCLICK_LOG_SEND = 4,	/* nsclick_log_send, packet data */
+    NSCLICK_LOG_RUN = 5,	/* none */
+    NSCLICK_LOG_READ = 6,	/* "element\0handler" */
+    NSCLICK_LOG_WRITE = 7	/* "element\0handler\0value" */
+};
+
+typedef struct {
+    char magic[8];		/* NSCLICK_LOG_MAGIC */
+    int32_t version;		/* NSCLICK_LOG_VERSION */
+    int32_t event_size;		/* sizeof(nsclick_log_event) */
+} nsclick_log_header;
+
+typedef struct {
+    int64_t sim_sec;		/* simulated time of the call */
+    int32_t sim_usec;
+    uint32_t length;		/* payload length */
+    int64_t wall_usec;		/* wall-clock time since recording began */
+    uint32_t type;		/* NSCLICK_LOG_* */
+    uint32_t reserved;
+} nsclick_log_event;
+
+typedef struct {
+    int32_t ifid;
+    int32_t ptype;
+    int32_t id;			/* simclick_simpacketinfo */
+    int32_t fid;
+    int32_t simtype;
+    int32_t run;		/* nonzero if Click ran after this packet;
+				   zero for all but the last packet of a
+				   simclick_click_send_batch */
+} nsclick_log_send;
+
+#endif
@@ -0,0 +1,459 @@
+/*
+ * Replays a simclick event log (see simclick_click_record) into a Click
+ * router without the simulator, as fast as possible, and reports how fast
+ * Click processed it. This gives a repeatable benchmark of the Click side of
+ * a simulation.
+ *
+ * Usage: nsclick-replay [-q] [-p] LOG
+ *
+ * Events are replayed in order with the node's clock set to each event's
+ * recorded simulated time, so timers fire as they did in the recorded run.
+ * Packets are copied into Click. Click's own SIMCLICK_SCHEDULE requests are
+ * ignored: the recorded simclick_click_run calls already reflect them.
+ * Simulator commands are answered from the node description at the start
+ * of the log.
+ *
+ * With -p, the replay is profiled through the global "profile" handler
+ * and per-element call and cycle counts are reported from it; profiling
+ * slows the replay down somewhat. Otherwise, if Click was built with
+ * --enable-stats=2, the counts come from the "cycles" handlers.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <string>
+#include "click/simclick.h"
+#include "nsclick-log.h"
+
+using namespace std;
+
+struct ReplayIface {
+  int ifid;
+  string ipaddr;
+  string macaddr;
+};
+
+struct ReplayEvent {
+  nsclick_log_event ev;
+  const unsigned char* payload;
+};
+
+static map<string,ReplayIface> ifaces;
+static string node_name;
+static int node_id = -1;
+static int next_pkt_id = 0;
+static long long packets_out = 0;
+static long long bytes_out = 0;
+
+static double
+wall_seconds() {
+  struct timeval tv;
+  gettimeofday(&tv,0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int
+read_log(const char* filename,vector<unsigned char>& buf,
+	 vector<ReplayEvent>& events) {
+  FILE* f = fopen(filename,"rb");
+  if (!f) {
+    fprintf(stderr,"nsclick-replay: %s: %s\n",filename,strerror(errno));
+    return -1;
+  }
+  unsigned char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk,1,sizeof(chunk),f)) > 0)
+    buf.insert(buf.end(),chunk,chunk + n);
+  fclose(f);
+
+  nsclick_log_header h;
+  if (buf.size() < sizeof(h)) {
+    fprintf(stderr,"nsclick-replay: %s: not a simclick log\n",filename);
+    return -1;
+  }
+  memcpy(&h,&buf[0],sizeof(h));
+  if (strcmp(h.magic,NSCLICK_LOG_MAGIC) != 0
+      || h.version != NSCLICK_LOG_VERSION
+      || h.event_size != (int32_t) sizeof(nsclick_log_event)) {
+    fprintf(stderr,"nsclick-replay: %s: not a simclick log\n",filename);
+    return -1;
+  }
+
+  size_t pos = sizeof(h);
+  while (pos + sizeof(nsclick_log_event) <= buf.size()) {
+    ReplayEvent e;
+    memcpy(&e.ev,&buf[pos],sizeof(e.ev));
+    pos += sizeof(e.ev);
+    if (pos + e.ev.length > buf.size())
+      break;			// truncated log: drop the partial event
+    e.payload = &buf[pos];
+    pos += e.ev.length;
+    events.push_back(e);
+  }
+  return 0;
+}
+
+// Splits a payload of NUL-separated strings.
+static vector<string>
+payload_strings(const unsigned char* data,uint32_t len) {
+  vector<string> v;
+  const char* s = (const char*) data;
+  const char* end = s + len;
+  while (s <= end) {
+    const char* nul = (const char*) memchr(s,0,end - s);
+    if (!nul)
+      nul = end;
+    v.push_back(string(s,nul));
+    s = nul + 1;
+  }
+  return v;
+}
+
+static void
+print_cycles(vector< pair<unsigned long long,string> >& rows) {
+  sort(rows.rbegin(),rows.rend());
+  printf("%-30s %12s %16s %10s\n","element","calls","self cycles","per call");
+  for (size_t i = 0; i < rows.size(); i++)
+    printf("%s\n",rows[i].second.c_str());
+}
+
+static void
+cycles_row(vector< pair<unsigned long long,string> >& rows,const string& name,
+	   unsigned long long calls,unsigned long long self) {
+  char line[256];
+  snprintf(line,sizeof(line),"%-30s %12llu %16llu %10.1f",
+	   name.c_str(),calls,self,calls ? (double) self / calls : 0.);
+  rows.push_back(make_pair(self,string(line)));
+}
+
+// Sum the profile handler's per-port and per-task lines by element.
+static void
+report_profile(simclick_node_t* node) {
+  char* prof = simclick_click_read_handler(node,"","profile",0,0);
+  if (!prof)
+    return;
+  map<string,pair<unsigned long long,unsigned long long> > totals;
+  char* save;
+  for (char* s = strtok_r(prof,"\n",&save); s; s = strtok_r(0,"\n",&save)) {
+    char name[256];
+    unsigned long long calls,packets,self,inclusive;
+    if (s[0] != '#'
+	&& sscanf(s,"%255s %*s %*s %llu %llu %llu %llu",
+		  name,&calls,&packets,&self,&inclusive) == 5) {
+      pair<unsigned long long,unsigned long long>& t = totals[name];
+      t.first += calls;
+      t.second += self;
+    }
+  }
+  free(prof);
+
+  vector< pair<unsigned long long,string> > rows;
+  for (map<string,pair<unsigned long long,unsigned long long> >::iterator it = totals.begin();
+       it != totals.end(); ++it)
+    cycles_row(rows,it->first,it->second.first,it->second.second);
+  print_cycles(rows);
+}
+
+static void
+report_cycles(simclick_node_t* node) {
+  char* list = simclick_click_read_handler(node,"","list",0,0);
+  if (!list)
+    return;
+  vector<string> names;
+  char* save;
+  // the first line is the number of elements
+  for (char* s = strtok_r(list,"\n",&save); s; s = strtok_r(0,"\n",&save))
+    names.push_back(s);
+  free(list);
+  if (names.size() <= 1)
+    return;
+  names.erase(names.begin());
+
+  char* h = simclick_click_read_handler(node,names[0].c_str(),"handlers",0,0);
+  bool have_cycles = h && strstr(h,"cycles\t") != 0;
+  free(h);
+  if (!have_cycles) {
+    printf("(per-element cycle counts need -p, or Click built with --enable-stats=2)\n");
+    return;
+  }
+
+  vector< pair<unsigned long long,string> > rows;
+  for (size_t i = 0; i < names.size(); i++) {
+    char* c = simclick_click_read_handler(node,names[i].c_str(),"cycles",0,0);
+    unsigned long long calls = 0,self = 0,child = 0;
+    if (c && sscanf(c,"%llu %llu %llu",&calls,&self,&child) == 3)
+      cycles_row(rows,names[i],calls,self);
+    free(c);
+  }
+  print_cycles(rows);
+}
+
+int
+main(int argc,char** argv) {
+  bool quiet = false,profile = false;
+  int argi = 1;
+  for (; argi < argc - 1 && argv[argi][0] == '-'; argi++)
+    if (strcmp(argv[argi],"-q") == 0)
+      quiet = true;
+    else if (strcmp(argv[argi],"-p") == 0)
+      profile = true;
+    else
+      break;
+  if (argi != argc - 1) {
+    fprintf(stderr,"Usage: nsclick-replay [-q] [-p] LOG\n");
+    return 1;
+  }
+
+  vector<unsigned char> buf;
+  vector<ReplayEvent> events;
+  if (read_log(argv[argi],buf,events) < 0)
+    return 1;
+
+  // Node description
+  string config;
+  size_t first = 0;
+  for (; first < events.size(); first++) {
+    const ReplayEvent& e = events[first];
+    if (e.ev.type == NSCLICK_LOG_CONFIG)
+      config.assign((const char*) e.payload,e.ev.length);
+    else if (e.ev.type == NSCLICK_LOG_NODE && e.ev.length >= 4) {
+      memcpy(&node_id,e.payload,4);
+      node_name.assign((const char*) e.payload + 4,e.ev.length - 4);
+    } else if (e.ev.type == NSCLICK_LOG_IFACE && e.ev.length >= 4) {
+      ReplayIface iface;
+      memcpy(&iface.ifid,e.payload,4);
+      vector<string> v = payload_strings(e.payload + 4,e.ev.length - 4);
+      v.resize(3);
+      iface.ipaddr = v[1];
+      iface.macaddr = v[2];
+      ifaces[v[0]] = iface;
+    } else
+      break;
+  }
+  if (config.empty()) {
+    fprintf(stderr,"nsclick-replay: %s: log has no configuration\n",argv[argi]);
+    return 1;
+  }
+
+  char tmpname[] = "/tmp/nsclick-replay.XXXXXX";
+  int fd = mkstemp(tmpname);
+  if (fd < 0 || write(fd,config.data(),config.length()) != (ssize_t) config.length()) {
+    fprintf(stderr,"nsclick-replay: %s\n",strerror(errno));
+    return 1;
+  }
+  close(fd);
+
+  simclick_node_t node;
+  memset(&node,0,sizeof(node));
+  if (first < events.size()) {
+    node.curtime.tv_sec = events[first].ev.sim_sec;
+    node.curtime.tv_usec = events[first].ev.sim_usec;
+  }
+  int r = simclick_click_create(&node,tmpname);
+  unlink(tmpname);
+  if (r < 0)
+    return 1;
+  if (profile && simclick_click_write_handler(&node,"","profile","true") < 0) {
+    fprintf(stderr,"nsclick-replay: this Click cannot profile elements\n");
+    profile = false;
+  }
+
+  // Replay
+  long long packets_in = 0,bytes_in = 0,runs = 0,handlers = 0;
+  vector<simclick_packet_t> batch;
+  vector<simclick_simpacketinfo> pinfos;
+  double start = wall_seconds();
+  for (size_t i = first; i < events.size(); i++) {
+    const ReplayEvent& e = events[i];
+    node.curtime.tv_sec = e.ev.sim_sec;
+    node.curtime.tv_usec = e.ev.sim_usec;
+    switch (e.ev.type) {
+    case NSCLICK_LOG_SEND: {
+      if (e.ev.length < sizeof(nsclick_log_send))
+	break;
+      nsclick_log_send s;
+      memcpy(&s,e.payload,sizeof(s));
+      simclick_simpacketinfo pinfo;
+      pinfo.id = s.id;
+      pinfo.fid = s.fid;
+      pinfo.simtype = s.simtype;
+      simclick_packet_t p;
+      p.ifid = s.ifid;
+      p.type = s.ptype;
+      p.data = const_cast<unsigned char*>(e.payload) + sizeof(s);
+      p.len = e.ev.length - sizeof(s);
+      p.destructor = 0;
+      p.arg = 0;
+      p.pinfo = 0;
+      batch.push_back(p);
+      pinfos.push_back(pinfo);
+      packets_in++;
+      bytes_in += p.len;
+      if (s.run) {
+	for (size_t j = 0; j < batch.size(); j++)
+	  batch[j].pinfo = &pinfos[j];
+	if (batch.size() == 1)
+	  simclick_click_send(&node,p.ifid,p.type,p.data,p.len,&pinfos[0]);
+	else
+	  simclick_click_send_batch(&node,&batch[0],batch.size());
+	batch.clear();
+	pinfos.clear();
+      }
+      break;
+    }
+    case NSCLICK_LOG_RUN:
+      simclick_click_run(&node);
+      runs++;
+      break;
+    case NSCLICK_LOG_READ: {
+      vector<string> v = payload_strings(e.payload,e.ev.length);
+      v.resize(2);
+      free(simclick_click_read_handler(&node,v[0].c_str(),v[1].c_str(),0,0));
+      handlers++;
+      break;
+    }
+    case NSCLICK_LOG_WRITE: {
+      vector<string> v = payload_strings(e.payload,e.ev.length);
+      v.resize(3);
+      simclick_click_write_handler(&node,v[0].c_str(),v[1].c_str(),v[2].c_str());
+      handlers++;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  double elapsed = wall_seconds() - start;
+
+  double recorded = 0;
+  if (first < events.size())
+    recorded = (events.back().ev.wall_usec - events[first].ev.wall_usec) / 1e6;
+  printf("node %d %s: %lu events, %lld packets in (%lld bytes), %lld out (%lld bytes), %lld runs, %lld handler calls\n",
+	 node_id,node_name.c_str(),(unsigned long) (events.size() - first),
+	 packets_in,bytes_in,packets_out,bytes_out,runs,handlers);
+  printf("replay %.6f s, recorded run %.6f s\n",elapsed,recorded);
+  if (elapsed > 0)
+    printf("%.0f packets/s in, %.0f packets/s out\n",
+	   packets_in / elapsed,packets_out / elapsed);
+  if (!quiet && profile)
+    report_profile(&node);
+  else if (!quiet)
+    report_cycles(&node);
+
+  simclick_click_kill(&node);
+  return 0;
+}
+
+extern "C" {
+
+int
+simclick_sim_send(simclick_node_t*,int,int,const unsigned char*,int len,
+		  simclick_simpacketinfo*) {
+  packets_out++;
+  bytes_out += len;
+  return 0;
+}
+
+static int
+copy_string(const string& s,char* buf,int len) {
+  if (s.empty() || len <= 0)
+    return -1;
+  strncpy(buf,s.c_str(),len);
+  buf[len - 1] = 0;
+  return 0;
+}
+
+int
+simclick_sim_command(simclick_node_t*,int cmd,...) {
+  va_list val;
+  va_start(val,cmd);
+  int r = -1;
+
+  switch (cmd) {
+  case SIMCLICK_VERSION:
+    r = 0;
+    break;
+  case SIMCLICK_SUPPORTS: {
+    int othercmd = va_arg(val,int);
+    r = (othercmd == SIMCLICK_VERSION || othercmd == SIMCLICK_SUPPORTS
+	 || othercmd == SIMCLICK_IFID_FROM_NAME
+	 || othercmd == SIMCLICK_IPADDR_FROM_NAME
+	 || othercmd == SIMCLICK_MACADDR_FROM_NAME
+	 || othercmd == SIMCLICK_SCHEDULE
+	 || othercmd == SIMCLICK_GET_NODE_NAME
+	 || othercmd == SIMCLICK_IF_READY
+	 || othercmd == SIMCLICK_TRACE
+	 || othercmd == SIMCLICK_GET_NODE_ID
+	 || othercmd == SIMCLICK_GET_NEXT_PKT_ID
+	 || othercmd == SIMCLICK_SEND_BUFFER
+	 || othercmd == SIMCLICK_TRACE_RECORD);
+    break;
+  }
+  case SIMCLICK_IFID_FROM_NAME: {
+    const char* ifname = va_arg(val,const char*);
+    map<string,ReplayIface>::iterator it = ifaces.find(ifname);
+    r = (it == ifaces.end() ? -1 : it->second.ifid);
+    break;
+  }
+  case SIMCLICK_IPADDR_FROM_NAME:
+  case SIMCLICK_MACADDR_FROM_NAME: {
+    const char* ifname = va_arg(val,const char*);
+    char* buf = va_arg(val,char*);
+    int len = va_arg(val,int);
+    map<string,ReplayIface>::iterator it = ifaces.find(ifname);
+    if (it != ifaces.end())
+      r = copy_string(cmd == SIMCLICK_IPADDR_FROM_NAME ? it->second.ipaddr
+		      : it->second.macaddr,buf,len);
+    break;
+  }
+  case SIMCLICK_GET_NODE_NAME: {
+    char* buf = va_arg(val,char*);
+    int len = va_arg(val,int);
+    r = copy_string(node_name,buf,len);
+    break;
+  }
+  case SIMCLICK_GET_NODE_ID:
+    r = node_id;
+    break;
+  case SIMCLICK_GET_NEXT_PKT_ID:
+    r = next_pkt_id++;
+    break;
+  case SIMCLICK_SCHEDULE:
+  case SIMCLICK_TRACE:
+  case SIMCLICK_TRACE_RECORD:
+    r = 0;
+    break;
+  case SIMCLICK_IF_READY:
+    r = 1;
+    break;
+  case SIMCLICK_SEND_BUFFER: {
+    (void) va_arg(val,int);
+    (void) va_arg(val,int);
+    unsigned char* data = va_arg(val,unsigned char*);
+    int len = va_arg(val,int);
+    simclick_buffer_destructor destructor =
+      va_arg(val,simclick_buffer_destructor);
+    void* arg = va_arg(val,void*);
+    packets_out++;
+    bytes_out += len;
+    destructor(data,len,arg);
+    r = 0;
+    break;
+  }
+  default:
+    break;
+  }
+
+  va_end(val);
+  return r;
+}
+
+}
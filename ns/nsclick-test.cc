@@ -4,6 +4,16 @@
  * decided I wanted to use an existing template heap class, and
  * it seemed like as good a time as any to exercise my rusty
  * STL skills.
+ *
+ * Run as "nsclick-test -t N" to run N independent copies of the test
+ * network on N threads at once. Each copy's packet trace is checked
+ * against a single-threaded reference run.
+ *
+ * Run as "nsclick-test -w" to check that the nodes send the same packets
+ * when they keep their timers in a timing wheel (SIMCLICK_TIMER_WHEEL).
+ *
+ * Run as "nsclick-test -r PREFIX" to also log each node's simclick calls
+ * to PREFIX.0, PREFIX.1, ...; nsclick-replay replays these logs.
  */
 
 #include <stdlib.h>
@@ -14,7 +24,9 @@
 #include <ctype.h>
 #include <map>
 #include <vector>
+#include <string>
 #include <stdarg.h>
+#include <pthread.h>
 #include "CUT_BinHeap.h"
 #include "click/simclick.h"
 
@@ -94,12 +106,24 @@ Simulator::SimEvent::~SimEvent() {}
 
 class TestClickSimulator : public Simulator {
 public:
-  TestClickSimulator();
+  TestClickSimulator(bool verbose = true);
   virtual ~TestClickSimulator();
 
-  int add_node(char* clickfile);
+  int add_node(const char* clickfile);
+  void record(const char* prefix);
+  void use_timer_wheel();
+  void setup(const char* const* scripts,int nscripts);
+  void run(int endtime);
+  void kill_nodes();
+  bool verbose() const { return verbose_; }
+  const vector<string>& trace() const { return trace_; }
+
   void handle_packet_from_click(simclick_node_t *node,int ifid,int ptype,
 				const unsigned char* data,int len);
+  void handle_buffer_from_click(simclick_node_t *node,int ifid,int ptype,
+				unsigned char* data,int len,
+				simclick_buffer_destructor destructor,
+				void* arg);
   void handle_schedule_from_click(simclick_node_t *node,const struct timeval* when);
   void add_lan_entry(simclick_node_t *node,int ifid,int lanid);
   void add_lan_entry(int nodenum,int ifid,int lanid);
@@ -116,6 +140,8 @@ public:
     unsigned char* data_;
     int len_;
     int ptype_;
+    simclick_buffer_destructor destructor_;
+    void* arg_;
   };
 
   class ScheduledEvent : public Simulator::SimEvent {
@@ -126,6 +152,10 @@ public:
 
     simclick_node_t *simnode_;
   };
+    struct clicknode : public simclick_node_t {
+	TestClickSimulator *sim;
+	int index;
+    };
 protected:
   struct netif {
     netif(simclick_node_t *n,int i) { node=n,ifid=i; }
@@ -139,25 +169,30 @@ protected:
       }
   };
 
-    struct clicknode : public simclick_node_t {
-	TestClickSimulator *sim;
-    };
     vector<clicknode *> clickrouters_;
     map<netif,int> netiftolanid_;
     map< int,vector<netif> > lanidtonetif_;
+    bool verbose_;
+    vector<string> trace_;
+
+    void trace_packet(simclick_node_t *node,int ifid,
+		      const unsigned char* data,int len);
 };
 
-TestClickSimulator::TestClickSimulator() {
+TestClickSimulator::TestClickSimulator(bool verbose)
+  : verbose_(verbose) {
 }
 
 TestClickSimulator::~TestClickSimulator() {
 }
 
 int
-TestClickSimulator::add_node(char* clickfile) {
+TestClickSimulator::add_node(const char* clickfile) {
   int result = -1;
   clicknode *c = new clicknode;
   c->sim = this;
+  c->index = clickrouters_.size();
+  c->clickinfo = 0;
   timerclear(&c->curtime);
   if (simclick_click_create(c, clickfile) >= 0) {
       clickrouters_.push_back(c);
@@ -167,11 +202,38 @@ TestClickSimulator::add_node(char* clickfile) {
   return result;
 }
 
+void
+TestClickSimulator::record(const char* prefix) {
+  for (size_t i = 0; i < clickrouters_.size(); i++) {
+    char buf[1024];
+    snprintf(buf,sizeof(buf),"%s.%d",prefix,(int)i);
+    if (simclick_click_record(clickrouters_[i],buf) < 0)
+      fprintf(stderr,"%s: cannot record\n",buf);
+  }
+}
+
+void
+TestClickSimulator::trace_packet(simclick_node_t *node,int ifid,
+				 const unsigned char* data,int len)
+{
+  // Record enough to compare runs: when, where, and a hash of the contents.
+  unsigned hash = 5381;
+  for (int i = 0; i < len; i++)
+    hash = hash * 33 + data[i];
+  char buf[128];
+  snprintf(buf,sizeof(buf),"%ld.%06ld node %d ifid %d len %d hash %08x",
+	   (long)cursimtime_.tv_sec,(long)cursimtime_.tv_usec,
+	   static_cast<clicknode *>(node)->index,ifid,len,hash);
+  trace_.push_back(buf);
+}
+
 void
 TestClickSimulator::handle_packet_from_click(simclick_node_t *node,int ifid,
 					     int ptype,
 					     const unsigned char* data,int len)
 {
+  trace_packet(node,ifid,data,len);
+
   // Use the node-ifid combo to find the lanid, and then use the lanid
   // to get the list of node-ifid combos attached to it.
   netif fromif(node,ifid);
@@ -193,10 +255,53 @@ TestClickSimulator::handle_packet_from_click(simclick_node_t *node,int ifid,
     pkt->ptype_ = ptype;
     memcpy(pkt->data_,data,len);
     eventheap_.insert(newtime,pkt);
-    fprintf(stderr,"Added send packet event: clickinst: %d ifid: %d time: %d %d\n",(int)(pkt->simnode_),pkt->ifid_,(int)newtime.tv_sec,(int)newtime.tv_usec);
+    if (verbose_)
+      fprintf(stderr,"Added send packet event: clickinst: %p ifid: %d time: %d %d\n",(void*)(pkt->simnode_),pkt->ifid_,(int)newtime.tv_sec,(int)newtime.tv_usec);
   }
 }
 
+static void
+delete_buffer(unsigned char* data,size_t,void*) {
+  delete[] data;
+}
+
+void
+TestClickSimulator::handle_buffer_from_click(simclick_node_t *node,int ifid,
+					     int ptype,
+					     unsigned char* data,int len,
+					     simclick_buffer_destructor destructor,
+					     void* arg)
+{
+  // Same as handle_packet_from_click, but the last receiver on the lan
+  // takes over Click's buffer rather than a copy.
+  trace_packet(node,ifid,data,len);
+  netif fromif(node,ifid);
+
+  int onlan = netiftolanid_[fromif];
+  int n = lanidtonetif_[onlan].size();
+
+  for (int i=0;i<n;i++) {
+    SimTime newtime = cursimtime_;
+    newtime.tv_usec += 100;
+    PacketEvent* pkt = new PacketEvent();
+    pkt->simnode_ = lanidtonetif_[onlan][i].node;
+    pkt->ifid_ = lanidtonetif_[onlan][i].ifid;
+    pkt->len_ = len;
+    pkt->ptype_ = ptype;
+    if (i == n - 1) {
+      pkt->data_ = data;
+      pkt->destructor_ = destructor;
+      pkt->arg_ = arg;
+    } else {
+      pkt->data_ = new unsigned char[len];
+      memcpy(pkt->data_,data,len);
+    }
+    eventheap_.insert(newtime,pkt);
+  }
+  if (n == 0)
+    destructor(data,len,arg);
+}
+
 void
 TestClickSimulator::handle_schedule_from_click(simclick_node_t *node,
 					       const struct timeval* when) {
@@ -232,8 +337,12 @@ TestClickSimulator::PacketEvent::go(SimTime* when) {
   simnode_->curtime = *when;
   pinfo.id = 2;
   pinfo.fid =2;
-  fprintf(stderr,"Dispatching send packet event: clickinst: %d ifid: %d time: %d %d pid %d fid %d\n",(int)simnode_,ifid_,(int)when->tv_sec,(int)when->tv_usec,pinfo.id,pinfo.fid);
-  simclick_click_send(simnode_,ifid_,ptype_,data_,len_,&pinfo);
+  if (static_cast<clicknode *>(simnode_)->sim->verbose())
+    fprintf(stderr,"Dispatching send packet event: clickinst: %p ifid: %d time: %d %d pid %d fid %d\n",(void*)simnode_,ifid_,(int)when->tv_sec,(int)when->tv_usec,pinfo.id,pinfo.fid);
+  // Ownership of the buffer passes to Click.
+  simclick_click_send_buffer(simnode_,ifid_,ptype_,data_,len_,
+			     destructor_,arg_,&pinfo);
+  data_ = 0;
 
   return result;
 }
@@ -244,11 +353,13 @@ TestClickSimulator::PacketEvent::PacketEvent() {
   ptype_ = -1;
   data_ = 0;
   len_  = 0;
+  destructor_ = delete_buffer;
+  arg_ = 0;
 }
 
 TestClickSimulator::PacketEvent::~PacketEvent() {
   if (data_) {
-    delete[] data_;
+    destructor_(data_,len_,arg_);
   }
 }
 
@@ -265,64 +376,160 @@ TestClickSimulator::ScheduledEvent::go(SimTime* when) {
   return 0;
 }
 
-static TestClickSimulator thesim;
-
-int main(int,char**) {
-  int result = 0;
-  int i = 0;
-  const int numclicks = 3;
-
-  printf("Testing the simclick interface...\n");
-
-  char* scripts[numclicks] = {"../conf/test-simclick-udpgen.click", \
-				"../conf/test-simclick-device.click", \
-				"../conf/test-simclick-device.click"};
+void
+TestClickSimulator::use_timer_wheel() {
+  for (size_t i = 0; i < clickrouters_.size(); i++)
+    if (simclick_click_command(clickrouters_[i],SIMCLICK_SUPPORTS,
+			       SIMCLICK_TIMER_WHEEL))
+      simclick_click_command(clickrouters_[i],SIMCLICK_TIMER_WHEEL,1);
+}
 
-  for (i=0;i<numclicks;i++) {
-    printf("Creating a SimClick click instance with %s\n",scripts[i]);
-    thesim.add_node(scripts[i]);
+void
+TestClickSimulator::setup(const char* const* scripts,int nscripts) {
+  for (int i=0;i<nscripts;i++) {
+    if (verbose_)
+      printf("Creating a SimClick click instance with %s\n",scripts[i]);
+    add_node(scripts[i]);
   }
 
   // eth0 of the traffic source (node 0) goes on the same
   // lan as eth0 of node 1
-  thesim.add_lan_entry(0,1,1);
-  thesim.add_lan_entry(1,1,1);
+  add_lan_entry(0,1,1);
+  add_lan_entry(1,1,1);
 
   // Put eth1 of node 0 and eth0 of node 1 on the same lan
-  thesim.add_lan_entry(1,2,2);
-  thesim.add_lan_entry(2,1,2);
+  add_lan_entry(1,2,2);
+  add_lan_entry(2,1,2);
 
   // Put eth1 of node1 and eth0 of node 1 on the same lan
-  //thesim.add_lan_entry(1,1,3);
-  //thesim.add_lan_entry(2,2,3);
+  //add_lan_entry(1,1,3);
+  //add_lan_entry(2,2,3);
+}
+
+void
+TestClickSimulator::run(int endtime) {
+  // Prime the simulator pump
+  SimTime now;
+  SimTime tick(0,10000);
+
+  while (gettime().tv_sec < endtime) {
+    // Insert a clock tick, then run the simulator for a step.
+    handle_schedule_from_click(get_node(0),&now);
+    nextevent();
+    now = now + tick;
+  }
+}
+
+void
+TestClickSimulator::kill_nodes() {
+  for (size_t i = 0; i < clickrouters_.size(); i++) {
+    simclick_click_kill(clickrouters_[i]);
+    delete clickrouters_[i];
+  }
+  clickrouters_.clear();
+}
+
+static const int numclicks = 3;
+static const char* scripts[numclicks] = {
+  "../conf/test-simclick-udpgen.click",
+  "../conf/test-simclick-device.click",
+  "../conf/test-simclick-device.click"
+};
+static const int endtime = 60;
+
+static void*
+run_test_thread(void* arg) {
+  TestClickSimulator* sim = (TestClickSimulator*) arg;
+  sim->setup(scripts,numclicks);
+  sim->run(endtime);
+  sim->kill_nodes();
+  return 0;
+}
+
+static int
+run_threaded(int nthreads) {
+  printf("Running the reference simulation...\n");
+  TestClickSimulator reference(false);
+  run_test_thread(&reference);
+  printf("Reference run sent %d packets.\n",(int)reference.trace().size());
+
+  printf("Running %d simulations on %d threads...\n",nthreads,nthreads);
+  vector<TestClickSimulator*> sims;
+  vector<pthread_t> threads(nthreads);
+  for (int i = 0; i < nthreads; i++)
+    sims.push_back(new TestClickSimulator(false));
+  for (int i = 0; i < nthreads; i++)
+    pthread_create(&threads[i],0,run_test_thread,sims[i]);
+  for (int i = 0; i < nthreads; i++)
+    pthread_join(threads[i],0);
+
+  int result = 0;
+  for (int i = 0; i < nthreads; i++) {
+    if (sims[i]->trace() != reference.trace()) {
+      printf("Thread %d: trace differs from the reference run!\n",i);
+      result = 1;
+    }
+    delete sims[i];
+  }
+  printf(result ? "FAILED.\n" : "OK.\n");
+  return result;
+}
+
+static int
+run_timer_wheel() {
+  printf("Running the reference simulation...\n");
+  TestClickSimulator reference(false);
+  run_test_thread(&reference);
+  printf("Reference run sent %d packets.\n",(int)reference.trace().size());
+
+  printf("Running the simulation with timing wheels...\n");
+  TestClickSimulator wheel(false);
+  wheel.setup(scripts,numclicks);
+  wheel.use_timer_wheel();
+  wheel.run(endtime);
+  wheel.kill_nodes();
+
+  int result = (wheel.trace() != reference.trace());
+  if (result)
+    printf("Trace differs from the reference run!\n");
+  printf(result ? "FAILED.\n" : "OK.\n");
+  return result;
+}
+
+static TestClickSimulator thesim;
+
+int main(int argc,char** argv) {
+  if (argc == 3 && strcmp(argv[1],"-t") == 0)
+    return run_threaded(atoi(argv[2]));
+  if (argc == 2 && strcmp(argv[1],"-w") == 0)
+    return run_timer_wheel();
+
+  printf("Testing the simclick interface...\n");
+
+  thesim.setup(scripts,numclicks);
+  if (argc == 3 && strcmp(argv[1],"-r") == 0)
+    thesim.record(argv[2]);
 
   // Send a packet out to eth0 of node 0.
   //printf("About to send out test packet on node 0, eth0...\n");
   //simclick_click_send(thesim.get_node(0),TESTSIM_IFID_FIRSTIF,
   //		      SIMCLICK_PTYPE_ETHER,mypacket,sizeof(mypacket));
 
-  // Prime the simulator pump
-  Simulator::SimTime now;
-  int endtime = 60;
-  Simulator::SimTime tick(0,10000);
-
   printf("About to start pumping the simulator...\n");
-  while (thesim.gettime().tv_sec < endtime) {
-    // Insert a clock tick, then run the simulator for a step.
-    thesim.handle_schedule_from_click(thesim.get_node(0),&now);
-    thesim.nextevent();
-    now = now + tick;
-  }
+  thesim.run(endtime);
 
+  thesim.kill_nodes();
   printf("Done.\n");
 
-  return result;
+  return 0;
 }
 
 extern "C" {
 
 int
 simclick_sim_command(simclick_node_t *simnode, int cmd, ...) {
+    TestClickSimulator *sim =
+	static_cast<TestClickSimulator::clicknode *>(simnode)->sim;
     va_list val;
     va_start(val, cmd);
     int r;
@@ -337,7 +544,8 @@ simclick_sim_command(simclick_node_t *simnode, int cmd, ...) {
 	  int othercmd = va_arg(val, int);
 	  r = (othercmd == SIMCLICK_VERSION || othercmd == SIMCLICK_SUPPORTS
 	       || othercmd == SIMCLICK_IFID_FROM_NAME
-	       || othercmd == SIMCLICK_SCHEDULE);
+	       || othercmd == SIMCLICK_SCHEDULE
+	       || othercmd == SIMCLICK_SEND_BUFFER);
 	  break;
       }
 
@@ -345,7 +553,8 @@ simclick_sim_command(simclick_node_t *simnode, int cmd, ...) {
 	  const char *ifname = va_arg(val, const char *);
 	  r = -1;
 
-	  fprintf(stderr,"Woo! Got a request for %s\n",ifname);
+	  if (sim->verbose())
+	      fprintf(stderr,"Woo! Got a request for %s\n",ifname);
 	  /*
 	   * Provide a mapping between a textual interface name
 	   * and the id numbers used. This is so that click scripts
@@ -368,13 +577,29 @@ simclick_sim_command(simclick_node_t *simnode, int cmd, ...) {
 	      if (*devname)
 		  r = atoi(devname) + TESTSIM_IFID_FIRSTIF;
 	  }
-	  fprintf(stderr,"Corresponds to simdev number %d\n", r);
+	  if (sim->verbose())
+	      fprintf(stderr,"Corresponds to simdev number %d\n", r);
 	  break;
       }
 
       case SIMCLICK_SCHEDULE: {
 	  const struct timeval *when = va_arg(val, const struct timeval *);
-	  thesim.handle_schedule_from_click(simnode, when);
+	  sim->handle_schedule_from_click(simnode, when);
+	  r = 0;
+	  break;
+      }
+
+      case SIMCLICK_SEND_BUFFER: {
+	  int ifid = va_arg(val, int);
+	  int type = va_arg(val, int);
+	  unsigned char *data = va_arg(val, unsigned char *);
+	  int len = va_arg(val, int);
+	  simclick_buffer_destructor destructor =
+	      va_arg(val, simclick_buffer_destructor);
+	  void *arg = va_arg(val, void *);
+	  (void) va_arg(val, simclick_simpacketinfo *);
+	  sim->handle_buffer_from_click(simnode, ifid, type, data, len,
+					destructor, arg);
 	  r = 0;
 	  break;
       }
@@ -395,10 +620,14 @@ simclick_sim_send(simclick_node_t *simnode,
 		  int ifid,int type,const unsigned char* data,int len,
 		  simclick_simpacketinfo*) {
   int result = 0;
+  TestClickSimulator *sim =
+      static_cast<TestClickSimulator::clicknode *>(simnode)->sim;
   // XXX print pinfo data
-  fprintf(stderr,"Packet incoming on clickinst %d ifid %d\n",(int)simnode,ifid);
-  thesim.handle_packet_from_click(simnode,ifid,type,data,len);
-  fprintf(stderr,"Exiting simclick_send_to_if...\n");
+  if (sim->verbose())
+    fprintf(stderr,"Packet incoming on clickinst %p ifid %d\n",(void*)simnode,ifid);
+  sim->handle_packet_from_click(simnode,ifid,type,data,len);
+  if (sim->verbose())
+    fprintf(stderr,"Exiting simclick_send_to_if...\n");
   return result;
 }
 
@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/resource.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <click/lexer.hh>
 #include <click/routerthread.hh>
@@ -46,8 +47,12 @@
 #include <click/master.hh>
 #include <click/simclick.h>
 #include <click/handlercall.hh>
+#include <click/hashtable.hh>
 #include "elements/standard/quitwatcher.hh"
 #include "elements/userlevel/controlsocket.hh"
+#include "elements/ns/fromsimdevice.hh"
+#include "elements/ns/tosimdevice.hh"
+#include "nsclick-log.h"
 
 CLICK_USING_DECLS
 
@@ -67,30 +72,171 @@ CLICK_USING_DECLS
 #define EXPRESSION_OPT		313
 
 
+// The node currently running Click. Simulators may run different nodes on
+// different threads (for example, one logical process per thread), so this
+// is per-thread state where the compiler supports it. Each node has its own
+// Router, Master and RouterThreads, so nodes share no run-time state.
+#if HAVE___THREAD_STORAGE_CLASS
+static __thread simclick_node_t *cursimnode = NULL;
+#else
 static simclick_node_t *cursimnode = NULL;
+#endif
+
+// Serializes router creation and destruction. These touch process-wide
+// state: the shared Lexer, global handlers, element class registrations
+// and the default ErrorHandler.
+static pthread_mutex_t simclick_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Thread safety: simclick_click_create, simclick_click_kill and
+// simclick_click_flush_configs may be called from any thread. Every other
+// simclick_click_* call takes its node's lock, so different nodes can run
+// concurrently and calls on one node are serialized. The lock is recursive
+// because the simulator may call back into the node from inside
+// simclick_sim_send or simclick_sim_command. Nodes share no Strings -- each
+// Router gets private copies from its RouterImage -- so String reference
+// counts need not be atomic. simclick_click_kill must not overlap other
+// calls on the same node.
+struct SimClick {
+    Router *router;
+    pthread_mutex_t lock;
+};
+
+class SimNodeLock { public:
+    SimNodeLock(simclick_node_t *simnode)
+	: _sc((SimClick *) simnode->clickinfo) {
+	if (_sc)
+	    pthread_mutex_lock(&_sc->lock);
+    }
+    ~SimNodeLock() {
+	if (_sc)
+	    pthread_mutex_unlock(&_sc->lock);
+    }
+    Router *router() const {
+	return _sc ? _sc->router : 0;
+    }
+  private:
+    SimClick *_sc;
+    SimNodeLock(const SimNodeLock &);
+    SimNodeLock &operator=(const SimNodeLock &);
+};
 
-//
-// XXX
-// OK, this bit of code here should work fine as long as your simulator
-// isn't multithreaded. If it is, there could be multiple threads stomping
-// on each other and potentially causing subtle or unsubtle problems.
-//
 static void setsimstate(simclick_node_t *newstate) {
     cursimnode = newstate;
 }
 
+// Event logs (simclick_click_record). A recording node's Router has a
+// SimRecorder attachment; see nsclick-log.h for the format.
+struct SimRecorder {
+    FILE *f;
+    Timestamp wall0;
+};
+
+static String recorder_attachment;
+
+static inline SimRecorder *
+recorder(Router *r)
+{
+    return (SimRecorder *) r->attachment(recorder_attachment);
+}
+
+static void
+record(SimRecorder *rec, simclick_node_t *simnode, uint32_t type,
+       const void *data1 = 0, uint32_t len1 = 0,
+       const void *data2 = 0, uint32_t len2 = 0)
+{
+    nsclick_log_event ev;
+    ev.sim_sec = simnode->curtime.tv_sec;
+    ev.sim_usec = simnode->curtime.tv_usec;
+    ev.length = len1 + len2;
+    // Timestamp::now() is simulated time in this driver
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    ev.wall_usec = (Timestamp(tv) - rec->wall0).usecval();
+    ev.type = type;
+    ev.reserved = 0;
+    fwrite(&ev, sizeof(ev), 1, rec->f);
+    if (len1)
+	fwrite(data1, 1, len1, rec->f);
+    if (len2)
+	fwrite(data2, 1, len2, rec->f);
+}
+
+static void
+record_send(SimRecorder *rec, simclick_node_t *simnode, int ifid, int type,
+	    const unsigned char *data, int len, simclick_simpacketinfo *pinfo,
+	    bool run)
+{
+    nsclick_log_send s;
+    s.ifid = ifid;
+    s.ptype = type;
+    if (pinfo) {
+	s.id = pinfo->id;
+	s.fid = pinfo->fid;
+	s.simtype = pinfo->simtype;
+    } else
+	s.id = s.fid = s.simtype = -1;
+    s.run = run;
+    record(rec, simnode, NSCLICK_LOG_SEND, &s, sizeof(s), data, len);
+}
+
+static void
+record_strings(SimRecorder *rec, simclick_node_t *simnode, uint32_t type,
+	       const char *s1, const char *s2, const char *s3 = 0)
+{
+    StringAccum sa;
+    sa << s1 << '\0' << s2;
+    if (s3)
+	sa << '\0' << s3;
+    record(rec, simnode, type, sa.data(), sa.length());
+}
+
+static void
+stop_recording(Router *r)
+{
+    if (SimRecorder *rec = recorder(r)) {
+	fclose(rec->f);
+	delete rec;
+	r->set_attachment(recorder_attachment, 0);
+    }
+}
+
 // functions for packages
 
 
 extern "C" {
 
-int simclick_click_create(simclick_node_t *simnode, const char* router_file) {
-    static bool didinit = false;
+// Parsed configurations, keyed by router file name. Simulations commonly
+// load the same configuration on many nodes; each file is lexed, expanded
+// and resolved to element classes once, and every node's Router is built
+// from the cached RouterImage. Element configuration strings are still
+// parsed per node, so per-node values (e.g. "eth0:ip") are resolved through
+// the simulator's SIMCLICK_*_FROM_NAME commands as usual. Protected by
+// simclick_config_lock.
+static HashTable<String, RouterImage *> *router_images;
 
-    setsimstate(simnode);
+static RouterImage *
+router_image_locked(const String &router_file, ErrorHandler *errh)
+{
+    if (!router_images)
+	router_images = new HashTable<String, RouterImage *>;
+    HashTable<String, RouterImage *>::iterator it = router_images->find(router_file);
+    if (it != router_images->end())
+	return it.value();
+
+    RouterImage *image = click_read_router_image(router_file, false, errh);
+    if (image)
+	router_images->set(router_file, image);
+    return image;
+}
+
+static int
+click_create_locked(simclick_node_t *simnode, const char *router_file)
+{
+    static bool didinit = false;
 
     if (!didinit) {
 	click_static_initialize();
+	recorder_attachment = String::make_stable("simclick_recorder");
 	didinit = true;
     }
 
@@ -100,10 +246,25 @@ int simclick_click_create(simclick_node_t *simnode, const char* router_file) {
     ErrorHandler *errh = ErrorHandler::default_handler();
     int before = errh->nerrors();
 
-    Router *r = click_read_router(router_file, false, errh, false);
-    simnode->clickinfo = r;
-    if (!r)
+    RouterImage *image = router_image_locked(router_file, errh);
+    Router *r = 0;
+    if (image) {
+	Master *master = new Master(1);
+	if (!(r = image->create_router(master, errh)))
+	    delete master;
+    }
+    if (!r) {
+	simnode->clickinfo = 0;
 	return errh->fatal("%s: not a valid router", router_file);
+    }
+    SimClick *sc = new SimClick;
+    sc->router = r;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sc->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    simnode->clickinfo = sc;
     r->master()->initialize_ns(simnode);
     if (r->nelements() == 0 && warnings)
 	errh->warning("%s: configuration has no elements", router_file);
@@ -114,6 +275,26 @@ int simclick_click_create(simclick_node_t *simnode, const char* router_file) {
     return 0;
 }
 
+int simclick_click_create(simclick_node_t *simnode, const char* router_file) {
+    setsimstate(simnode);
+    pthread_mutex_lock(&simclick_config_lock);
+    int r = click_create_locked(simnode, router_file);
+    pthread_mutex_unlock(&simclick_config_lock);
+    return r;
+}
+
+void simclick_click_flush_configs(void) {
+    pthread_mutex_lock(&simclick_config_lock);
+    if (router_images) {
+	for (HashTable<String, RouterImage *>::iterator it = router_images->begin();
+	     it != router_images->end(); ++it)
+	    delete it.value();
+	delete router_images;
+	router_images = 0;
+    }
+    pthread_mutex_unlock(&simclick_config_lock);
+}
+
 /*
  * XXX Need to actually implement this a little more intelligenetly...
  */
@@ -121,9 +302,17 @@ void simclick_click_run(simclick_node_t *simnode) {
   setsimstate(simnode);
   //fprintf(stderr,"Hey! Need to implement simclick_click_run!\n");
   // not right - mostly smoke testing for now...
-  Router* r = (Router *) simnode->clickinfo;
+  SimNodeLock lock(simnode);
+  Router* r = lock.router();
   if (r) {
-    r->master()->thread(0)->driver();
+    if (SimRecorder *rec = recorder(r))
+      record(rec, simnode, NSCLICK_LOG_RUN);
+    RouterThread *thread = r->master()->thread(0);
+    Timestamp next_expiry = thread->timer_set().next_timer_expiry();
+    if (!thread->active()
+	&& (!next_expiry || next_expiry > Timestamp::now()))
+      r->master()->sim_stats().wakeups_spurious++;
+    thread->driver();
   } else {
     click_chatter("simclick_click_run: call with null router");
   }
@@ -132,9 +321,14 @@ void simclick_click_run(simclick_node_t *simnode) {
 void simclick_click_kill(simclick_node_t *simnode) {
   //fprintf(stderr,"Hey! Need to implement simclick_click_kill!\n");
   setsimstate(simnode);
-  Router *r = (Router *) simnode->clickinfo;
-  if (r) {
-    delete r;
+  SimClick *sc = (SimClick *) simnode->clickinfo;
+  if (sc) {
+    pthread_mutex_lock(&simclick_config_lock);
+    stop_recording(sc->router);
+    delete sc->router;
+    pthread_mutex_unlock(&simclick_config_lock);
+    pthread_mutex_destroy(&sc->lock);
+    delete sc;
     simnode->clickinfo = 0;
   } else {
     click_chatter("simclick_click_kill: call with null router");
@@ -158,8 +352,11 @@ int simclick_click_send(simclick_node_t *simnode,
 			simclick_simpacketinfo* pinfo) {
   setsimstate(simnode);
   int result = 0;
-  Router* r = (Router *) simnode->clickinfo;
+  SimNodeLock lock(simnode);
+  Router* r = lock.router();
   if (r) {
+    if (SimRecorder *rec = recorder(r))
+      record_send(rec, simnode, ifid, type, data, len, pinfo, true);
     r->sim_incoming_packet(ifid,type,data,len,pinfo);
     r->master()->thread(0)->driver();
   }
@@ -170,22 +367,76 @@ int simclick_click_send(simclick_node_t *simnode,
   return result;
 }
 
+int simclick_click_send_buffer(simclick_node_t *simnode,
+			       int ifid, int type, unsigned char *data, int len,
+			       simclick_buffer_destructor destructor, void *arg,
+			       simclick_simpacketinfo *pinfo) {
+  setsimstate(simnode);
+  int result = 0;
+  SimNodeLock lock(simnode);
+  Router* r = lock.router();
+  if (r) {
+    if (SimRecorder *rec = recorder(r))
+      record_send(rec, simnode, ifid, type, data, len, pinfo, true);
+    r->sim_incoming_packet(ifid,type,data,len,destructor,arg,pinfo);
+    r->master()->thread(0)->driver();
+  }
+  else {
+    click_chatter("simclick_click_send_buffer: called with null router");
+    destructor(data, len, arg);
+    result = -1;
+  }
+  return result;
+}
+
+int simclick_click_send_batch(simclick_node_t *simnode,
+			      const simclick_packet_t *packets, int npackets) {
+  setsimstate(simnode);
+  SimNodeLock lock(simnode);
+  Router* r = lock.router();
+  if (!r) {
+    click_chatter("simclick_click_send_batch: called with null router");
+    for (int i = 0; i < npackets; i++)
+      if (packets[i].destructor)
+	packets[i].destructor(packets[i].data, packets[i].len, packets[i].arg);
+    return -1;
+  }
+  if (SimRecorder *rec = recorder(r))
+    for (int i = 0; i < npackets; i++) {
+      const simclick_packet_t &sp = packets[i];
+      record_send(rec, simnode, sp.ifid, sp.type, sp.data, sp.len, sp.pinfo,
+		  i == npackets - 1);
+    }
+  r->sim_incoming_batch(packets, npackets);
+  r->master()->thread(0)->driver();
+
+  Master::SimStats &stats = r->master()->sim_stats();
+  stats.batches++;
+  stats.batch_packets += npackets;
+  if (npackets > 1)
+    stats.driver_runs_saved += npackets - 1;
+  return 0;
+}
+
 char* simclick_click_read_handler(simclick_node_t *simnode,
 				  const char* elementname,
 				  const char* handlername,
 				  SIMCLICK_MEM_ALLOC memalloc,
 				  void* memparam) {
-    Router *r = (Router *) simnode->clickinfo;
+    SimNodeLock lock(simnode);
+    Router *r = lock.router();
     if (!r) {
       click_chatter("simclick_click_read_handler: call with null router");
       return 0;
     }
     setsimstate(simnode);
+    if (SimRecorder *rec = recorder(r))
+	record_strings(rec, simnode, NSCLICK_LOG_READ, elementname, handlername);
     String hdesc = String(elementname) + "." + String(handlername);
-    ErrorHandler *errh = ErrorHandler::default_handler();
-    int before = errh->nerrors();
-    String result = HandlerCall::call_read(hdesc, r->root_element(), errh);
-    if (!result && errh->nerrors() != before)
+    // count this call's errors, not other nodes'
+    ErrorVeneer errh(ErrorHandler::default_handler());
+    String result = HandlerCall::call_read(hdesc, r->root_element(), &errh);
+    if (!result && errh.nerrors())
 	return 0;
     char *rstr;
     if (memalloc)
@@ -203,17 +454,92 @@ int simclick_click_write_handler(simclick_node_t *simnode,
 				 const char* elementname,
 				 const char* handlername,
 				 const char* writestring) {
-    Router *r = (Router *) simnode->clickinfo;
+    SimNodeLock lock(simnode);
+    Router *r = lock.router();
     if (!r) {
       click_chatter("simclick_click_write_handler: call with null router");
       return -3;
     }
     setsimstate(simnode);
+    if (SimRecorder *rec = recorder(r))
+	record_strings(rec, simnode, NSCLICK_LOG_WRITE, elementname, handlername, writestring);
     String hdesc = String(elementname) + "." + String(handlername);
-    return HandlerCall::call_write(hdesc, String(writestring), r->root_element(), ErrorHandler::default_handler());
+    // keep this call's error count apart from other nodes'
+    ErrorVeneer errh(ErrorHandler::default_handler());
+    return HandlerCall::call_write(hdesc, String(writestring), r->root_element(), &errh);
+}
+
+static void
+record_iface(SimRecorder *rec, simclick_node_t *simnode, const String &ifname)
+{
+    int32_t ifid = simclick_sim_command(simnode, SIMCLICK_IFID_FROM_NAME, ifname.c_str());
+    char ip[256], mac[256];
+    if (simclick_sim_command(simnode, SIMCLICK_IPADDR_FROM_NAME, ifname.c_str(), ip, 255) < 0)
+	ip[0] = 0;
+    if (simclick_sim_command(simnode, SIMCLICK_MACADDR_FROM_NAME, ifname.c_str(), mac, 255) < 0)
+	mac[0] = 0;
+    ip[255] = mac[255] = 0;
+    StringAccum sa;
+    sa << ifname << '\0' << ip << '\0' << mac;
+    record(rec, simnode, NSCLICK_LOG_IFACE, &ifid, sizeof(ifid), sa.data(), sa.length());
+}
+
+int simclick_click_record(simclick_node_t *simnode, const char *filename)
+{
+    SimNodeLock lock(simnode);
+    Router *r = lock.router();
+    if (!r) {
+	click_chatter("simclick_click_record: call with null router");
+	return -1;
+    }
+    setsimstate(simnode);
+    stop_recording(r);
+    if (!filename)
+	return 0;
+
+    SimRecorder *rec = new SimRecorder;
+    if (!(rec->f = fopen(filename, "wb"))) {
+	click_chatter("%s: %s", filename, strerror(errno));
+	delete rec;
+	return -1;
+    }
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    rec->wall0 = Timestamp(tv);
+
+    nsclick_log_header h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, NSCLICK_LOG_MAGIC);
+    h.version = NSCLICK_LOG_VERSION;
+    h.event_size = sizeof(nsclick_log_event);
+    fwrite(&h, sizeof(h), 1, rec->f);
+
+    // describe the node, so the log can be replayed without the simulator
+    const String &config = r->configuration_string();
+    record(rec, simnode, NSCLICK_LOG_CONFIG, config.data(), config.length());
+    char name[256];
+    if (simclick_sim_command(simnode, SIMCLICK_GET_NODE_NAME, name, 255) < 0)
+	name[0] = 0;
+    name[255] = 0;
+    int32_t node_id = simclick_sim_command(simnode, SIMCLICK_GET_NODE_ID);
+    record(rec, simnode, NSCLICK_LOG_NODE, &node_id, sizeof(node_id), name, strlen(name));
+    HashTable<String, int> ifnames;
+    for (int i = 0; i < r->nelements(); i++) {
+	Element *e = r->element(i);
+	String ifname;
+	if (e->cast("FromSimDevice"))
+	    ifname = static_cast<FromSimDevice *>(e)->ifname();
+	else if (e->cast("ToSimDevice"))
+	    ifname = static_cast<ToSimDevice *>(e)->ifname();
+	if (ifname && ifnames.set(ifname, 1))
+	    record_iface(rec, simnode, ifname);
+    }
+
+    r->set_attachment(recorder_attachment, rec);
+    return 0;
 }
 
-int simclick_click_command(simclick_node_t *, int cmd, ...)
+int simclick_click_command(simclick_node_t *simnode, int cmd, ...)
 {
     va_list val;
     va_start(val, cmd);
@@ -223,7 +549,21 @@ int simclick_click_command(simclick_node_t *, int cmd, ...)
 	r = 0;
     else if (cmd == SIMCLICK_SUPPORTS) {
 	int othercmd = va_arg(val, int);
-	r = othercmd >= SIMCLICK_VERSION && othercmd <= SIMCLICK_SUPPORTS;
+	r = (othercmd >= SIMCLICK_VERSION && othercmd <= SIMCLICK_SUPPORTS)
+	    || othercmd == SIMCLICK_TASKS_PENDING
+	    || othercmd == SIMCLICK_TIMER_WHEEL;
+    } else if (cmd == SIMCLICK_TASKS_PENDING) {
+	SimNodeLock lock(simnode);
+	Router *router = lock.router();
+	r = router && router->master()->thread(0)->active();
+    } else if (cmd == SIMCLICK_TIMER_WHEEL) {
+	SimNodeLock lock(simnode);
+	Router *router = lock.router();
+	if (router) {
+	    router->master()->set_timer_wheel(va_arg(val, int) != 0);
+	    r = 0;
+	} else
+	    r = -1;
     } else
 	r = 1;
 
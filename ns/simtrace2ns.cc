@@ -0,0 +1,95 @@
+/*
+ * simtrace2ns.cc -- convert binary ToSimTrace records to ns-2 trace text
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+/*
+ * Usage: simtrace2ns FILE...
+ *
+ * Reads the files written by ToSimTrace(..., FILE f), merges their records
+ * by time, and prints them in the format ToSimTrace uses for SIMCLICK_TRACE
+ * text. Records with equal times keep the order they had in the input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <vector>
+#include <click/simclick.h>
+
+static bool
+record_time_less(const simclick_trace_record &a, const simclick_trace_record &b)
+{
+    return a.sec < b.sec || (a.sec == b.sec && a.usec < b.usec);
+}
+
+static int
+read_trace(const char *filename, std::vector<simclick_trace_record> &records)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+	fprintf(stderr, "simtrace2ns: %s: %s\n", filename, strerror(errno));
+	return -1;
+    }
+
+    simclick_trace_header h;
+    if (fread(&h, sizeof(h), 1, f) != 1
+	|| memcmp(h.magic, SIMCLICK_TRACE_MAGIC, sizeof(SIMCLICK_TRACE_MAGIC)) != 0) {
+	fprintf(stderr, "simtrace2ns: %s: not a simclick trace file\n", filename);
+	fclose(f);
+	return -1;
+    }
+    if (h.version != SIMCLICK_TRACE_VERSION
+	|| h.record_size != (int) sizeof(simclick_trace_record)) {
+	fprintf(stderr, "simtrace2ns: %s: unsupported trace version %d\n", filename, h.version);
+	fclose(f);
+	return -1;
+    }
+
+    simclick_trace_record rec;
+    while (fread(&rec, sizeof(rec), 1, f) == 1)
+	records.push_back(rec);
+    if (ferror(f)) {
+	fprintf(stderr, "simtrace2ns: %s: %s\n", filename, strerror(errno));
+	fclose(f);
+	return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2) {
+	fprintf(stderr, "Usage: simtrace2ns FILE...\n");
+	return 1;
+    }
+
+    std::vector<simclick_trace_record> records;
+    for (int i = 1; i < argc; i++)
+	if (read_trace(argv[i], records) < 0)
+	    return 1;
+    std::stable_sort(records.begin(), records.end(), record_time_less);
+
+    // Record strings need not be NUL-terminated, hence the %.*s.
+    for (size_t i = 0; i < records.size(); i++) {
+	const simclick_trace_record &r = records[i];
+	printf("%.*s %lld.%06d _%i_ RTR --- %i raw %i [%.*s %.*s]\n",
+	       (int) sizeof(r.event), r.event, r.sec, r.usec, r.node_id,
+	       r.packet_id, r.length, (int) sizeof(r.info), r.info,
+	       (int) sizeof(r.analysis), r.analysis);
+    }
+    return 0;
+}
@@ -32,10 +32,20 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #if HAVE_EXECINFO_H
 # include <execinfo.h>
 #endif
+#if HAVE_EXECINFO_H && HAVE_SIGACTION && defined(ITIMER_PROF)
+# define HAVE_SAMPLE_PROFILE 1
+# if HAVE_DYNAMIC_LINKING && defined(HAVE_DLFCN_H)
+#  include <dlfcn.h>
+# endif
+# ifdef __GNUC__
+#  include <cxxabi.h>
+# endif
+#endif
 
 #include <click/lexer.hh>
 #include <click/routerthread.hh>
@@ -51,6 +61,7 @@
 #include <click/userutils.hh>
 #include <click/args.hh>
 #include <click/handlercall.hh>
+#include <click/hashtable.hh>
 #include "elements/standard/quitwatcher.hh"
 #include "elements/userlevel/controlsocket.hh"
 CLICK_USING_DECLS
@@ -73,6 +84,12 @@ CLICK_USING_DECLS
 #define THREADS_OPT		316
 #define SIMTIME_OPT		317
 #define SOCKET_OPT		318
+#define TIMER_WHEEL_OPT		319
+#define WORK_STEALING_OPT	320
+#define PACKET_POOL_SIZE_OPT	321
+#define PACKET_POOL_GLOBAL_OPT	322
+#define PACKET_BUFFER_SIZES_OPT	323
+#define PROFILE_OPT		324
 
 static const Clp_Option options[] = {
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
@@ -82,16 +99,22 @@ static const Clp_Option options[] = {
     { "handler", 'h', HANDLER_OPT, Clp_ValString, 0 },
     { "help", 0, HELP_OPT, 0, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
+    { "packet-buffer-sizes", 0, PACKET_BUFFER_SIZES_OPT, Clp_ValString, 0 },
+    { "packet-pool-global", 0, PACKET_POOL_GLOBAL_OPT, Clp_ValInt, 0 },
+    { "packet-pool-size", 0, PACKET_POOL_SIZE_OPT, Clp_ValInt, 0 },
     { "socket", 0, SOCKET_OPT, Clp_ValInt, 0 },
     { "port", 'p', PORT_OPT, Clp_ValString, 0 },
+    { "profile", 0, PROFILE_OPT, 0, Clp_Negate },
     { "quit", 'q', QUIT_OPT, 0, 0 },
     { "simtime", 0, SIMTIME_OPT, Clp_ValDouble, Clp_Optional },
     { "simulation-time", 0, SIMTIME_OPT, Clp_ValDouble, Clp_Optional },
     { "threads", 'j', THREADS_OPT, Clp_ValInt, 0 },
     { "time", 't', TIME_OPT, 0, 0 },
+    { "timer-wheel", 0, TIMER_WHEEL_OPT, 0, Clp_Negate },
     { "unix-socket", 'u', UNIX_SOCKET_OPT, Clp_ValString, 0 },
     { "version", 'v', VERSION_OPT, 0, 0 },
     { "warnings", 0, WARNINGS_OPT, 0, Clp_Negate },
+    { "work-stealing", 0, WORK_STEALING_OPT, 0, Clp_Negate },
     { "exit-handler", 'x', EXIT_HANDLER_OPT, Clp_ValString, 0 },
     { 0, 'w', NO_WARNINGS_OPT, 0, Clp_Negate },
 };
@@ -132,6 +155,16 @@ Options:\n\
   -t, --time                    Print information on how long driver took.\n\
   -w, --no-warnings             Do not print warnings.\n\
       --simtime                 Run in simulation time.\n\
+      --timer-wheel             Keep timers in a timing wheel, not a heap.\n\
+      --work-stealing           Let idle threads steal tasks from busy ones.\n\
+      --packet-pool-size N      Keep up to N free packets per thread.\n\
+      --packet-pool-global N    Keep up to N batches of free packets per NUMA\n\
+                                node for threads to share.\n\
+      --packet-buffer-sizes SIZES\n\
+                                Pool packet buffers of these sizes\n\
+                                (comma-separated, increasing).\n\
+      --profile                 Count cycles and packets per element; see the\n\
+                                'profile' handler.\n\
   -C, --clickpath PATH          Use PATH for CLICKPATH.\n\
       --help                    Print this message and exit.\n\
   -v, --version                 Print version number and exit.\n\
@@ -275,16 +308,28 @@ static Router *hotswap_router;
 static Router *hotswap_thunk_router;
 static bool hotswap_hook(Task *, void *);
 static Task hotswap_task(hotswap_hook, 0);
+#if HAVE_SAMPLE_PROFILE
+static void suspend_profile_sampling(struct itimerval *saved);
+static void resume_profile_sampling(const struct itimerval *saved);
+static void shutdown_profile_sampling();
+#endif
 
 static bool
 hotswap_hook(Task *, void *)
 {
+#if HAVE_SAMPLE_PROFILE
+    struct itimerval sampling;
+    suspend_profile_sampling(&sampling);
+#endif
     hotswap_thunk_router->set_foreground(false);
     hotswap_router->activate(ErrorHandler::default_handler());
     router->unuse();
     router = hotswap_router;
     router->use();
     hotswap_router = 0;
+#if HAVE_SAMPLE_PROFILE
+    resume_profile_sampling(&sampling);
+#endif
     return true;
 }
 
@@ -295,6 +340,12 @@ static Vector<String> cs_ports;
 static Vector<String> cs_sockets;
 static bool warnings = true;
 static int nthreads = 1;
+static bool timer_wheel = false;
+static bool work_stealing = false;
+static int packet_pool_size = -1;
+static int packet_pool_global = -1;
+static Vector<uint32_t> packet_buffer_sizes;
+static bool profile = false;
 
 static String
 click_driver_control_socket_name(int number)
@@ -314,6 +365,10 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
 	master = router->master();
     else
 	master = new_master = new Master(nthreads);
+    if (new_master && timer_wheel)
+	new_master->set_timer_wheel(true);
+    if (new_master && work_stealing)
+	new_master->set_work_stealing(true);
 
     Router *r = click_read_router(text, text_is_expr, errh, false, master);
     if (!r) {
@@ -361,8 +416,12 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
     delete r;
     delete new_master;
     return 0;
-  } else
-    return r;
+  }
+#if HAVE_ELEMENT_PROFILE
+  if (profile)
+    r->enable_profile();
+#endif
+  return r;
 }
 
 static int
@@ -411,6 +470,248 @@ timewarp_write_handler(const String &text, Element *, void *, ErrorHandler *errh
 }
 
 
+// sampling profiler
+
+#if HAVE_SAMPLE_PROFILE
+// Each sample records the interrupted thread's stack and the element whose
+// task it was running.  Samples are written by the SIGPROF handler into a
+// buffer allocated once, and symbolized only when read.  The handler never
+// touches the global router, which hotswapping replaces and exit deletes;
+// it finds threads through a table taken when sampling starts, and the
+// timer is disarmed before the router goes away.
+# define SAMPLE_PROFILE_DEPTH	32
+# define SAMPLE_PROFILE_MAX	32768
+
+namespace {
+struct ProfileSample {
+    volatile int depth;		// 0 until the sample is complete
+    int thread_id;
+    Element *element;
+    void *pc[SAMPLE_PROFILE_DEPTH];
+};
+}
+
+static ProfileSample *profile_samples;
+static atomic_uint32_t profile_nsamples;
+static volatile bool profile_sampling;
+static Timestamp profile_sample_end;
+static RouterThread **profile_threads;
+static volatile sig_atomic_t profile_nthreads;
+
+static void
+stop_profile_sampling()
+{
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, 0);
+    profile_sampling = false;
+}
+
+static void
+profile_sample_signal(int)
+{
+    if (!profile_sampling)
+	return;
+    unsigned i = profile_nsamples.fetch_and_add(1);
+    if (i >= SAMPLE_PROFILE_MAX
+	|| Timestamp::now_real_time() >= profile_sample_end) {
+	stop_profile_sampling();
+	return;
+    }
+
+    ProfileSample &s = profile_samples[i];
+# if HAVE_MULTITHREAD && HAVE___THREAD_STORAGE_CLASS
+    s.thread_id = click_current_thread_id;
+# else
+    s.thread_id = 0;
+# endif
+    Task *t = 0;
+    if (s.thread_id >= 0 && s.thread_id < profile_nthreads)
+	t = profile_threads[s.thread_id]->current_task();
+    s.element = (t ? t->element() : 0);
+    int depth = backtrace(s.pc, SAMPLE_PROFILE_DEPTH);
+    click_compiler_fence();
+    s.depth = depth;
+}
+
+static void
+suspend_profile_sampling(struct itimerval *saved)
+{
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, saved);
+}
+
+static void
+resume_profile_sampling(const struct itimerval *saved)
+{
+    if (profile_sampling && timerisset(&saved->it_value))
+	setitimer(ITIMER_PROF, saved, 0);
+}
+
+/** @brief Stop sampling for good, before the router is deleted.
+ *
+ * SIGPROF is then ignored rather than reset to its default action, so a
+ * signal already in flight cannot kill the process. */
+static void
+shutdown_profile_sampling()
+{
+    if (!profile_samples)
+	return;
+    stop_profile_sampling();
+    profile_nthreads = 0;
+    click_fence();
+    struct sigaction sa;
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGPROF, &sa, 0);
+}
+
+/** @brief Return a flame-graph frame name for the code address @a pc. */
+static String
+profile_frame_name(void *pc)
+{
+    String name;
+# if HAVE_DYNAMIC_LINKING && defined(HAVE_DLFCN_H)
+    Dl_info info;
+    if (!dladdr(pc, &info))
+	info.dli_fname = info.dli_sname = 0;
+    if (info.dli_sname) {
+#  ifdef __GNUC__
+	int status;
+	char *demangled = abi::__cxa_demangle(info.dli_sname, 0, 0, &status);
+	name = String(demangled && status == 0 ? demangled : info.dli_sname);
+	free(demangled);
+#  else
+	name = String(info.dli_sname);
+#  endif
+	// drop the argument list: "Counter::push(int, Packet*)" -> "Counter::push"
+	int paren = name.find_left('(');
+	if (paren > 0 && !name.starts_with("operator"))
+	    name = name.substring(0, paren);
+    } else if (info.dli_fname && info.dli_fname[0]) {
+	// unexported code: name it by its object file
+	const char *slash = strrchr(info.dli_fname, '/');
+	name = "[" + String(slash ? slash + 1 : info.dli_fname) + "]";
+    }
+# endif
+    if (!name)
+	name = "0x" + String::make_numeric(reinterpret_cast<uintptr_t>(pc), 16, false);
+    // ';' separates frames in the folded format
+    if (name.find_left(';') >= 0) {
+	StringAccum sa;
+	for (const char *x = name.begin(); x != name.end(); ++x)
+	    sa << (*x == ';' ? ':' : *x);
+	name = sa.take_string();
+    }
+    return name;
+}
+
+static String
+sample_profile_read_handler(Element *, void *)
+{
+    if (profile_sampling && Timestamp::now_real_time() >= profile_sample_end)
+	stop_profile_sampling();
+    if (!profile_samples)
+	return String();
+
+    // Frames 0 and 1 are the signal handler and the signal trampoline.
+    enum { skip_frames = 2 };
+    HashTable<uintptr_t, String> frame_names;
+    HashTable<String, unsigned> stacks;
+    Vector<String> keys;
+    HashTable<Element *, int> live_elements;
+    for (int i = 0; i < router->nelements(); ++i)
+	live_elements[router->element(i)] = i;
+
+    unsigned n = profile_nsamples.value();
+    if (n > SAMPLE_PROFILE_MAX)
+	n = SAMPLE_PROFILE_MAX;
+    for (unsigned i = 0; i < n; ++i) {
+	const ProfileSample &s = profile_samples[i];
+	if (s.depth <= skip_frames)
+	    continue;
+	StringAccum sa;
+	sa << "thread " << s.thread_id;
+	// Elements of a router that was hotswapped out may no longer exist.
+	if (s.element && live_elements.get_pointer(s.element))
+	    sa << ';' << s.element->name();
+	for (int d = s.depth - 1; d >= skip_frames; --d) {
+	    uintptr_t pc = reinterpret_cast<uintptr_t>(s.pc[d]);
+	    HashTable<uintptr_t, String>::iterator it = frame_names.find(pc);
+	    if (!it.live())
+		it = frame_names.find_insert(pc, profile_frame_name(s.pc[d]));
+	    sa << ';' << it.value();
+	}
+	String stack = sa.take_string();
+	HashTable<String, unsigned>::iterator it = stacks.find(stack);
+	if (!it.live()) {
+	    keys.push_back(stack);
+	    it = stacks.find_insert(stack, 0);
+	}
+	++it.value();
+    }
+
+    click_qsort(keys.begin(), keys.size());
+    StringAccum sa;
+    for (String *k = keys.begin(); k != keys.end(); ++k)
+	sa << *k << ' ' << stacks[*k] << '\n';
+    return sa.take_string();
+}
+
+static int
+sample_profile_write_handler(const String &text, Element *, void *, ErrorHandler *errh)
+{
+    if (text == "stop") {
+	stop_profile_sampling();
+	return 0;
+    }
+    Timestamp duration, interval = Timestamp::make_msec(1);
+    if (Args(errh).push_back_words(text)
+	.read_mp("DURATION", duration)
+	.read_p("INTERVAL", interval)
+	.complete() < 0)
+	return -1;
+    if (!duration || !interval)
+	return errh->error("DURATION and INTERVAL must be positive");
+    if (profile_sampling)
+	return errh->error("already sampling");
+
+    if (!profile_samples) {
+	// warm up backtrace(), which may allocate memory on its first call
+	void *pc[SAMPLE_PROFILE_DEPTH];
+	(void) backtrace(pc, SAMPLE_PROFILE_DEPTH);
+	// Hotswapped routers share the master, so its threads outlive them.
+	Master *master = router->master();
+	if (!(profile_threads = new RouterThread *[master->nthreads()])
+	    || !(profile_samples = new ProfileSample[SAMPLE_PROFILE_MAX]))
+	    return errh->error("out of memory");
+	for (int i = 0; i < master->nthreads(); ++i)
+	    profile_threads[i] = master->thread(i);
+	click_fence();
+	profile_nthreads = master->nthreads();
+	struct sigaction sa;
+	sa.sa_handler = profile_sample_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &sa, 0);
+    }
+    unsigned n = profile_nsamples.value();
+    for (unsigned i = 0; i < n && i < SAMPLE_PROFILE_MAX; ++i)
+	profile_samples[i].depth = 0;
+    profile_nsamples = 0;
+    profile_sample_end = Timestamp::now_real_time() + duration;
+    profile_sampling = true;
+
+    struct itimerval it;
+    it.it_interval = it.it_value = interval.timeval();
+    setitimer(ITIMER_PROF, &it, 0);
+    return 0;
+}
+#endif
+
+
 // main
 
 static void
@@ -564,6 +865,57 @@ main(int argc, char **argv)
 #endif
       break;
 
+    case TIMER_WHEEL_OPT:
+	timer_wheel = !clp->negated;
+	break;
+
+    case WORK_STEALING_OPT:
+	work_stealing = !clp->negated;
+	break;
+
+    case PROFILE_OPT:
+	profile = !clp->negated;
+#if !HAVE_ELEMENT_PROFILE
+	if (profile)
+	    errh->warning("Click was built without element profiling, ignoring %<--profile%>");
+#endif
+	break;
+
+    case PACKET_POOL_SIZE_OPT:
+	if (clp->val.i <= 0) {
+	    Clp_OptionError(clp, "%<%O%> expects a positive integer");
+	    goto bad_option;
+	}
+	packet_pool_size = clp->val.i;
+	break;
+
+    case PACKET_POOL_GLOBAL_OPT:
+	if (clp->val.i < 0) {
+	    Clp_OptionError(clp, "%<%O%> expects a nonnegative integer");
+	    goto bad_option;
+	}
+	packet_pool_global = clp->val.i;
+	break;
+
+    case PACKET_BUFFER_SIZES_OPT: {
+	packet_buffer_sizes.clear();
+	const char *x = clp->vstr;
+	while (1) {
+	    const char *comma = strchr(x, ',');
+	    String word = (comma ? String(x, comma - x) : String(x));
+	    uint32_t size;
+	    if (!IntArg().parse(word, size)) {
+		Clp_OptionError(clp, "%<%O%> expects a list of buffer sizes, not %<%s%>", clp->vstr);
+		goto bad_option;
+	    }
+	    packet_buffer_sizes.push_back(size);
+	    if (!comma)
+		break;
+	    x = comma + 1;
+	}
+	break;
+    }
+
     case SIMTIME_OPT: {
 	Timestamp::warp_set_class(Timestamp::warp_simulation);
 	Timestamp simbegin(clp->have_val ? clp->val.d : 1000000000);
@@ -603,10 +955,28 @@ particular purpose.\n");
   }
 
  done:
+  if (packet_pool_size >= 0 || packet_pool_global >= 0
+      || packet_buffer_sizes.size()) {
+#if HAVE_CLICK_PACKET_POOL
+      if (Packet::set_pool_parameters(packet_pool_size, packet_pool_global,
+				      packet_buffer_sizes.begin(),
+				      packet_buffer_sizes.size()) < 0) {
+	  errh->error("packet buffer sizes must increase, be at least %d, and number at most %d", (int) Packet::min_buffer_length, (int) Packet::pool_max_buffer_sizes);
+	  return cleanup(clp, 1);
+      }
+#else
+      errh->warning("Click was built without a packet pool, ignoring packet pool options");
+#endif
+  }
+
   // provide hotconfig handler if asked
   if (allow_reconfigure)
       Router::add_write_handler(0, "hotconfig", hotconfig_handler, 0, Handler::RAW | Handler::NONEXCLUSIVE);
   Router::add_read_handler(0, "timewarp", timewarp_read_handler, 0);
+#if HAVE_SAMPLE_PROFILE
+  Router::add_read_handler(0, "sample_profile", sample_profile_read_handler, 0);
+  Router::add_write_handler(0, "sample_profile", sample_profile_write_handler, 0);
+#endif
   if (Timestamp::warp_class() != Timestamp::warp_simulation)
       Router::add_write_handler(0, "timewarp", timewarp_write_handler, 0);
 
@@ -705,6 +1075,9 @@ particular purpose.\n");
     }
   }
 
+#if HAVE_SAMPLE_PROFILE
+  shutdown_profile_sampling();
+#endif
   Master *master = router->master();
   router->unuse();
 #if HAVE_MULTITHREAD